@@ -0,0 +1,199 @@
+/*
+* Device memory allocation tracking by category
+*
+* Records the allocations made through vks::VulkanDevice, vks::Texture and vkglTF with their size, memory heap and category
+* Only works on the handles and sizes it is given, so it can be used and checked without a device (see selfTest)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <ostream>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "SelfTest.hpp"
+
+namespace vks
+{
+	enum MemoryCategory
+	{
+		MEMORY_CATEGORY_BUFFER = 0,
+		MEMORY_CATEGORY_TEXTURE,
+		MEMORY_CATEGORY_MODEL,
+		MEMORY_CATEGORY_ATTACHMENT,
+		MEMORY_CATEGORY_STAGING,
+		MEMORY_CATEGORY_UI,
+		MEMORY_CATEGORY_COUNT
+	};
+
+	inline const char* memoryCategoryName(MemoryCategory category)
+	{
+		switch (category)
+		{
+		case MEMORY_CATEGORY_BUFFER: return "buffer";
+		case MEMORY_CATEGORY_TEXTURE: return "texture";
+		case MEMORY_CATEGORY_MODEL: return "model";
+		case MEMORY_CATEGORY_ATTACHMENT: return "attachment";
+		case MEMORY_CATEGORY_STAGING: return "staging";
+		case MEMORY_CATEGORY_UI: return "ui";
+		default: return "unknown";
+		}
+	}
+
+	class AllocationTracker
+	{
+	public:
+		struct Usage
+		{
+			VkDeviceSize currentBytes = 0;
+			VkDeviceSize peakBytes = 0;
+			uint32_t liveAllocations = 0;
+			uint32_t totalAllocations = 0;
+
+			void add(VkDeviceSize size)
+			{
+				currentBytes += size;
+				peakBytes = std::max(peakBytes, currentBytes);
+				liveAllocations++;
+				totalAllocations++;
+			}
+			void remove(VkDeviceSize size)
+			{
+				currentBytes -= size;
+				liveAllocations--;
+			}
+		};
+
+	private:
+		struct Allocation
+		{
+			VkDeviceSize size;
+			uint32_t heapIndex;
+			MemoryCategory category;
+		};
+
+		mutable std::mutex mutex;
+		std::map<VkDeviceMemory, Allocation> allocations;
+		Usage categories[MEMORY_CATEGORY_COUNT];
+		std::vector<Usage> heaps;
+		Usage total;
+
+	public:
+		void recordAllocation(VkDeviceMemory memory, VkDeviceSize size, uint32_t heapIndex, MemoryCategory category)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			// A handle can only be reused after it has been freed, a missed free is replaced
+			auto existing = allocations.find(memory);
+			if (existing != allocations.end())
+			{
+				removeLocked(existing);
+			}
+			allocations[memory] = { size, heapIndex, category };
+			if (heaps.size() <= heapIndex)
+			{
+				heaps.resize(heapIndex + 1);
+			}
+			categories[category].add(size);
+			heaps[heapIndex].add(size);
+			total.add(size);
+		}
+
+		// Frees of memory that wasn't recorded (e.g. allocated by an example itself) are ignored
+		void recordFree(VkDeviceMemory memory)
+		{
+			if (memory == VK_NULL_HANDLE)
+			{
+				return;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			auto allocation = allocations.find(memory);
+			if (allocation != allocations.end())
+			{
+				removeLocked(allocation);
+			}
+		}
+
+		Usage getCategoryUsage(MemoryCategory category) const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return categories[category];
+		}
+
+		// Usage of a memory heap, empty for heaps without recorded allocations
+		Usage getHeapUsage(uint32_t heapIndex) const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return (heapIndex < heaps.size()) ? heaps[heapIndex] : Usage();
+		}
+
+		Usage getTotalUsage() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return total;
+		}
+
+		// Checks the category, heap (reported next to the heap budgets) and total accounting of allocations and frees with fake handles, returns the number of failed checks
+		static uint32_t selfTest(std::ostream& out)
+		{
+			vks::SelfTest test(out);
+			AllocationTracker tracker;
+			auto memory = [](uintptr_t handle) { return (VkDeviceMemory)handle; };
+
+			tracker.recordAllocation(memory(1), 1024, 0, MEMORY_CATEGORY_BUFFER);
+			tracker.recordAllocation(memory(2), 4096, 0, MEMORY_CATEGORY_TEXTURE);
+			tracker.recordAllocation(memory(3), 256, 1, MEMORY_CATEGORY_STAGING);
+			test.check(tracker.getCategoryUsage(MEMORY_CATEGORY_BUFFER).currentBytes == 1024, "allocation is accounted to its category");
+			test.check(tracker.getCategoryUsage(MEMORY_CATEGORY_TEXTURE).liveAllocations == 1, "live allocations are counted per category");
+			test.check(tracker.getCategoryUsage(MEMORY_CATEGORY_UI).currentBytes == 0, "categories without allocations are empty");
+			test.check(tracker.getHeapUsage(0).currentBytes == 5120, "allocations are accounted to their heap");
+			test.check(tracker.getHeapUsage(1).currentBytes == 256, "allocations of other heaps are kept apart");
+			test.check(tracker.getHeapUsage(7).currentBytes == 0, "heaps without allocations are empty");
+			test.check(tracker.getTotalUsage().currentBytes == 5376, "total covers all heaps");
+
+			tracker.recordFree(memory(2));
+			test.check(tracker.getCategoryUsage(MEMORY_CATEGORY_TEXTURE).currentBytes == 0, "free removes the bytes from the category");
+			test.check(tracker.getCategoryUsage(MEMORY_CATEGORY_TEXTURE).peakBytes == 4096, "free keeps the category peak");
+			test.check(tracker.getCategoryUsage(MEMORY_CATEGORY_TEXTURE).totalAllocations == 1, "free keeps the allocation count");
+			test.check(tracker.getHeapUsage(0).currentBytes == 1024, "free removes the bytes from the heap");
+			test.check(tracker.getHeapUsage(0).peakBytes == 5120, "free keeps the heap peak");
+
+			tracker.recordFree(memory(2));
+			tracker.recordFree(memory(42));
+			tracker.recordFree(VK_NULL_HANDLE);
+			test.check(tracker.getTotalUsage().currentBytes == 1280, "repeated and unknown frees are ignored");
+
+			// The driver may hand out the handle of a missed free again
+			tracker.recordAllocation(memory(1), 512, 1, MEMORY_CATEGORY_ATTACHMENT);
+			test.check(tracker.getCategoryUsage(MEMORY_CATEGORY_BUFFER).currentBytes == 0, "reused handle removes the missed free");
+			test.check(tracker.getCategoryUsage(MEMORY_CATEGORY_ATTACHMENT).currentBytes == 512, "reused handle is accounted to its new category");
+			test.check((tracker.getHeapUsage(0).currentBytes == 0) && (tracker.getHeapUsage(1).currentBytes == 768), "reused handle moves to its new heap");
+			test.check(tracker.getTotalUsage().liveAllocations == 2, "reused handle is counted once");
+
+			tracker.recordFree(memory(1));
+			tracker.recordFree(memory(3));
+			const Usage total = tracker.getTotalUsage();
+			test.check((total.currentBytes == 0) && (total.liveAllocations == 0), "all frees leave nothing behind");
+			test.check((total.peakBytes == 5376) && (total.totalAllocations == 4), "total peak and allocation count");
+
+			return test.failed();
+		}
+
+	private:
+		void removeLocked(std::map<VkDeviceMemory, Allocation>::iterator allocation)
+		{
+			const Allocation& info = allocation->second;
+			categories[info.category].remove(info.size);
+			heaps[info.heapIndex].remove(info.size);
+			total.remove(info.size);
+			allocations.erase(allocation);
+		}
+	};//class AllocationTracker
+
+}//vks
@@ -0,0 +1,635 @@
+/*
+* Asynchronous compute scheduling with timeline semaphores
+*
+* Runs the simulation step of a frame on a dedicated compute queue while the graphics queue renders the result of the previous step
+* The rendered simulation state is double buffered: step N reads state N % 2 and writes state (N + 1) % 2, while frame N renders state N % 2
+* Two timeline semaphores hand the states over between the queues:
+* - the compute timeline reaches N + 1 when step N is done, frame N waits for value N (its state was written by step N - 1)
+* - the graphics timeline reaches N + 1 when frame N is done, step N waits for value N (frame N - 1 rendered the state step N overwrites)
+* Without a separate compute queue family (or without timeline semaphores) steps and frames are submitted to the graphics queue in turn
+* and ordered by pipeline barriers
+* Timestamps around both submissions measure how much of a step runs at the same time as the frame (overlap)
+* Timestamps are only comparable if they were written on the same queue, so on a dedicated compute queue both queues are calibrated
+* against a host-synchronised reference: each of them waits for the same event set by the host and writes a timestamp right after,
+* the overlap is measured relative to these two timestamps (see calibrate)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+
+#include <vulkan/vulkan.h>
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "SelfTest.hpp"
+
+// Number of simulation states the steps alternate between
+#define ASYNC_COMPUTE_STATE_COUNT 2
+// Timestamps per state slot: start and end of the step and of the frame
+#define ASYNC_COMPUTE_QUERIES_PER_SLOT 4
+// Timestamps of the calibration, one per queue, behind the slots
+#define ASYNC_COMPUTE_CALIBRATION_QUERY (ASYNC_COMPUTE_STATE_COUNT * ASYNC_COMPUTE_QUERIES_PER_SLOT)
+// The queue clocks may drift apart and timestamps wrap around, so the calibration is repeated after this many ms
+#define ASYNC_COMPUTE_CALIBRATION_INTERVAL 1000
+
+namespace vks
+{
+	class AsyncCompute
+	{
+	public:
+		struct Statistics
+		{
+			// Averages over recent frames (exponential) in ms
+			float computeTime = 0.0f;
+			float graphicsTime = 0.0f;
+			// Time the step ran at the same time as the frame, i.e. the time gained over submitting them one after another
+			float overlap = 0.0f;
+			// Sums for the benchmark report
+			double computeTimeTotal = 0.0;
+			double graphicsTimeTotal = 0.0;
+			double overlapTotal = 0.0;
+			uint32_t samples = 0;
+		};
+
+		// Durations of one step and frame in ms, measured from their timestamps
+		struct Sample
+		{
+			double computeTime;
+			double graphicsTime;
+			double overlap;
+		};
+
+		// Timestamps the compute and the graphics queue wrote at the same (host-synchronised) time
+		struct Calibration
+		{
+			uint64_t computeReference = 0;
+			uint64_t graphicsReference = 0;
+		};
+
+		// Set by examples that schedule their simulation steps with this class (before the device is created)
+		bool requested = false;
+		// Keeps the steps on the graphics queue (--noasynccompute)
+		bool singleQueue = false;
+		// Timeline semaphores are enabled on the device (VK_KHR_timeline_semaphore), required for the dedicated compute queue
+		bool timelineSemaphores = false;
+		// Chained into the device creation by the base if supported
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR };
+
+	private:
+		vks::VulkanDevice* device = nullptr;
+		VkQueue graphicsQueue = VK_NULL_HANDLE;
+		VkQueue computeQueue = VK_NULL_HANDLE;
+		uint32_t graphicsQueueFamilyIndex = 0;
+		uint32_t computeQueueFamilyIndex = 0;
+		bool async = false;
+
+		VkSemaphore computeTimeline = VK_NULL_HANDLE;
+		VkSemaphore graphicsTimeline = VK_NULL_HANDLE;
+		PFN_vkWaitSemaphoresKHR fpWaitSemaphoresKHR = nullptr;
+
+		// Index of the current step and frame
+		uint64_t step = 0;
+		bool stepSubmitted = false;
+		bool frameSubmitted = false;
+
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		double timestampPeriod = 1.0; // ns per tick
+		uint64_t timestampMask = ~0ull;
+		// Step and frame of the slot wrote their timestamps, which haven't been read back yet
+		std::array<bool, ASYNC_COMPUTE_STATE_COUNT> pending = {};
+		Statistics statistics;
+
+		// Command buffers that wait for the calibration event and write a timestamp, graphics queue first
+		std::array<VkCommandPool, 2> calibrationCommandPools = {};
+		std::array<VkCommandBuffer, 2> calibrationCommandBuffers = {};
+		VkEvent calibrationEvent = VK_NULL_HANDLE;
+		bool calibrated = false;
+		Calibration calibration;
+		std::chrono::steady_clock::time_point calibrationTime;
+		// Calibration that was current when the step and frame of the slot were submitted
+		std::array<Calibration, ASYNC_COMPUTE_STATE_COUNT> slotCalibrations = {};
+
+		static float average(float current, double sample, bool first)
+		{
+			return first ? static_cast<float>(sample) : current + (static_cast<float>(sample) - current) * 0.1f;
+		}
+
+		void writeTimestamp(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t slot, uint32_t query)
+		{
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkCmdWriteTimestamp(commandBuffer, stage, queryPool, slot * ASYNC_COMPUTE_QUERIES_PER_SLOT + query);
+			}
+		}
+
+		// Reads back the timestamps of the slot's last step and frame, both are done when the slot is reused
+		void collect(uint32_t slot)
+		{
+			if (!pending[slot])
+			{
+				return;
+			}
+			pending[slot] = false;
+
+			std::array<uint64_t, ASYNC_COMPUTE_QUERIES_PER_SLOT> timestamps;
+			VkResult result = vkGetQueryPoolResults(device->logicalDevice, queryPool, slot * ASYNC_COMPUTE_QUERIES_PER_SLOT, ASYNC_COMPUTE_QUERIES_PER_SLOT,
+				sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			if (result == VK_NOT_READY)
+			{
+				return;
+			}
+			VK_CHECK_RESULT(result);
+
+			// On the graphics queue both submissions share one clock and the step's start serves as reference
+			const Calibration reference = async ? slotCalibrations[slot] : Calibration{ timestamps[0], timestamps[0] };
+			const Sample sample = measure(timestamps, reference, timestampMask, timestampPeriod);
+			const bool first = (statistics.samples == 0);
+			statistics.computeTime = average(statistics.computeTime, sample.computeTime, first);
+			statistics.graphicsTime = average(statistics.graphicsTime, sample.graphicsTime, first);
+			statistics.overlap = average(statistics.overlap, sample.overlap, first);
+			statistics.computeTimeTotal += sample.computeTime;
+			statistics.graphicsTimeTotal += sample.graphicsTime;
+			statistics.overlapTotal += sample.overlap;
+			statistics.samples++;
+		}
+
+		void prepareCalibration()
+		{
+			VkEventCreateInfo eventCreateInfo = vks::initializers::GenEventCreateInfo();
+			VK_CHECK_RESULT(vkCreateEvent(device->logicalDevice, &eventCreateInfo, nullptr, &calibrationEvent));
+			const std::array<uint32_t, 2> queueFamilyIndices = { graphicsQueueFamilyIndex, computeQueueFamilyIndex };
+			for (uint32_t i = 0; i < 2; i++)
+			{
+				calibrationCommandPools[i] = device->CreateCommandPool(queueFamilyIndices[i], 0);
+				VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, calibrationCommandPools[i], true);
+				vkCmdResetQueryPool(commandBuffer, queryPool, ASYNC_COMPUTE_CALIBRATION_QUERY + i, 1);
+				vkCmdWaitEvents(commandBuffer, 1, &calibrationEvent, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, nullptr, 0, nullptr, 0, nullptr);
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, ASYNC_COMPUTE_CALIBRATION_QUERY + i);
+				VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+				calibrationCommandBuffers[i] = commandBuffer;
+			}
+			calibrated = false;
+		}
+
+		// Synchronises the timestamps of both queues through the host: with both queues idle, each of them waits for the same event and
+		// writes a timestamp once the host sets it, the timestamps mark the same point in time up to the difference in how fast the
+		// queues resume (usually a few microseconds)
+		// Stalls both queues, which is why it is only repeated every ASYNC_COMPUTE_CALIBRATION_INTERVAL ms
+		void calibrate()
+		{
+			VK_CHECK_RESULT(vkQueueWaitIdle(graphicsQueue));
+			VK_CHECK_RESULT(vkQueueWaitIdle(computeQueue));
+			VK_CHECK_RESULT(vkResetEvent(device->logicalDevice, calibrationEvent));
+			const std::array<VkQueue, 2> queues = { graphicsQueue, computeQueue };
+			for (uint32_t i = 0; i < 2; i++)
+			{
+				VkSubmitInfo submitInfo = vks::initializers::GenSubmitInfo();
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &calibrationCommandBuffers[i];
+				VK_CHECK_RESULT(vkQueueSubmit(queues[i], 1, &submitInfo, VK_NULL_HANDLE));
+			}
+			VK_CHECK_RESULT(vkSetEvent(device->logicalDevice, calibrationEvent));
+			VK_CHECK_RESULT(vkQueueWaitIdle(graphicsQueue));
+			VK_CHECK_RESULT(vkQueueWaitIdle(computeQueue));
+
+			std::array<uint64_t, 2> timestamps;
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device->logicalDevice, queryPool, ASYNC_COMPUTE_CALIBRATION_QUERY, 2,
+				sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			calibration.graphicsReference = timestamps[0];
+			calibration.computeReference = timestamps[1];
+			calibrationTime = std::chrono::steady_clock::now();
+			calibrated = true;
+		}
+
+	public:
+		// Timeline values of the hand over, see the header comment
+		static uint64_t stateReadyValue(uint64_t step) { return step; }
+		static uint64_t stepDoneValue(uint64_t step) { return step + 1; }
+		static uint64_t stateFreeValue(uint64_t step) { return step; }
+		static uint64_t frameDoneValue(uint64_t step) { return step + 1; }
+
+		// Time from one timestamp to another in ms, timestamps that are more than half of the valid range apart count as earlier
+		static double elapsed(uint64_t from, uint64_t to, uint64_t mask, double period)
+		{
+			const uint64_t ticks = (to - from) & mask;
+			const double signedTicks = (ticks > (mask >> 1)) ? -static_cast<double>((from - to) & mask) : static_cast<double>(ticks);
+			return signedTicks * period / 1000000.0;
+		}
+
+		// Durations and overlap of a step and a frame from their start and end timestamps
+		// The durations only compare timestamps of the same queue, the overlap compares the times since each queue's calibration reference
+		static Sample measure(const std::array<uint64_t, ASYNC_COMPUTE_QUERIES_PER_SLOT>& timestamps, const Calibration& calibration, uint64_t mask, double period)
+		{
+			const double computeStart = elapsed(calibration.computeReference, timestamps[0], mask, period);
+			const double computeEnd = elapsed(calibration.computeReference, timestamps[1], mask, period);
+			const double graphicsStart = elapsed(calibration.graphicsReference, timestamps[2], mask, period);
+			const double graphicsEnd = elapsed(calibration.graphicsReference, timestamps[3], mask, period);
+			Sample sample;
+			sample.computeTime = elapsed(timestamps[0], timestamps[1], mask, period);
+			sample.graphicsTime = elapsed(timestamps[2], timestamps[3], mask, period);
+			sample.overlap = std::max(std::min(computeEnd, graphicsEnd) - std::max(computeStart, graphicsStart), 0.0);
+			return sample;
+		}
+
+		// Selects the queue the steps are submitted to and creates the timeline semaphores and the timestamp queries
+		void prepare(vks::VulkanDevice* device, VkQueue graphicsQueue)
+		{
+			this->device = device;
+			this->graphicsQueue = graphicsQueue;
+			graphicsQueueFamilyIndex = device->queueFamilyIndices.graphicIndex;
+			computeQueueFamilyIndex = graphicsQueueFamilyIndex;
+			computeQueue = graphicsQueue;
+			async = false;
+
+			if ((device->queueFamilyIndices.computeIndex != graphicsQueueFamilyIndex) && !singleQueue)
+			{
+				if (timelineSemaphores)
+				{
+					async = true;
+					computeQueueFamilyIndex = device->queueFamilyIndices.computeIndex;
+					vkGetDeviceQueue(device->logicalDevice, computeQueueFamilyIndex, 0, &computeQueue);
+				}
+				else
+				{
+					std::cerr << "Timeline semaphores are not supported, simulation steps run on the graphics queue\n";
+				}
+			}
+
+			if (async)
+			{
+				fpWaitSemaphoresKHR = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkWaitSemaphoresKHR"));
+				VkSemaphoreTypeCreateInfoKHR semaphoreTypeCreateInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR };
+				semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+				semaphoreTypeCreateInfo.initialValue = 0;
+				VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::GenSemaphoreCreateInfo();
+				semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+				VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCreateInfo, nullptr, &computeTimeline));
+				VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCreateInfo, nullptr, &graphicsTimeline));
+			}
+
+			// Both queues write timestamps, so both families need to support them
+			const uint32_t validBits = std::min(device->queueFamilyProperties[graphicsQueueFamilyIndex].timestampValidBits, device->queueFamilyProperties[computeQueueFamilyIndex].timestampValidBits);
+			if (validBits > 0)
+			{
+				timestampPeriod = device->properties.limits.timestampPeriod;
+				timestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+				VkQueryPoolCreateInfo queryPoolInfo = {};
+				queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+				queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+				queryPoolInfo.queryCount = ASYNC_COMPUTE_CALIBRATION_QUERY + 2;
+				VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+				if (async)
+				{
+					prepareCalibration();
+				}
+			}
+			else
+			{
+				std::cerr << "Queue families don't support timestamps, the async compute overlap is not measured\n";
+			}
+
+			step = 0;
+			stepSubmitted = false;
+			frameSubmitted = false;
+			pending = {};
+			statistics = Statistics();
+		}
+
+		bool isPrepared() const
+		{
+			return device != nullptr;
+		}
+
+		// Steps run on a dedicated compute queue
+		bool isAsync() const
+		{
+			return async;
+		}
+
+		uint32_t getQueueFamilyIndex() const
+		{
+			return computeQueueFamilyIndex;
+		}
+
+		VkQueue getQueue() const
+		{
+			return computeQueue;
+		}
+
+		// Queue families that access the simulation states, create them with vks::VulkanDevice::CreateBuffer(..., queueFamilyIndices) to share them without ownership transfers
+		std::vector<uint32_t> getSharedQueueFamilyIndices() const
+		{
+			return async ? std::vector<uint32_t>{ graphicsQueueFamilyIndex, computeQueueFamilyIndex } : std::vector<uint32_t>();
+		}
+
+		uint64_t getStep() const
+		{
+			return step;
+		}
+
+		// State the current frame renders and the current step reads
+		uint32_t getReadState() const
+		{
+			return static_cast<uint32_t>(step % ASYNC_COMPUTE_STATE_COUNT);
+		}
+
+		// State the current step writes
+		uint32_t getWriteState() const
+		{
+			return static_cast<uint32_t>((step + 1) % ASYNC_COMPUTE_STATE_COUNT);
+		}
+
+		// Waits until the previous step is done, so that the inputs of the step (e.g. its uniform buffer) can be updated
+		// The frame of the previous step has already been waited for by the base (submitFrame)
+		void beginStep()
+		{
+			if (async && (step > 0))
+			{
+				const uint64_t value = stepDoneValue(step - 1);
+				VkSemaphoreWaitInfoKHR waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR };
+				waitInfo.semaphoreCount = 1;
+				waitInfo.pSemaphores = &computeTimeline;
+				waitInfo.pValues = &value;
+				VK_CHECK_RESULT(fpWaitSemaphoresKHR(device->logicalDevice, &waitInfo, UINT64_MAX));
+			}
+			collect(getReadState());
+			if (async && (queryPool != VK_NULL_HANDLE))
+			{
+				const double sinceCalibration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - calibrationTime).count();
+				if (!calibrated || (sinceCalibration > ASYNC_COMPUTE_CALIBRATION_INTERVAL))
+				{
+					calibrate();
+				}
+			}
+		}
+
+		// Records the start of a step into a command buffer of the given read state, outside of any other compute work
+		// Makes the results of the previous step visible and, on the graphics queue, waits for the previous frame to stop reading the write state
+		void cmdBeginStep(VkCommandBuffer commandBuffer, uint32_t readState)
+		{
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkCmdResetQueryPool(commandBuffer, queryPool, readState * ASYNC_COMPUTE_QUERIES_PER_SLOT, 2);
+			}
+			writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, readState, 0);
+
+			VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+			// On a dedicated queue the graphics timeline orders the step after the previous frame
+			const VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | (async ? 0 : VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+			vkCmdPipelineBarrier(commandBuffer, srcStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE,
+				1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		void cmdEndStep(VkCommandBuffer commandBuffer, uint32_t readState)
+		{
+			writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, readState, 1);
+		}
+
+		// Records the start of a frame that renders the given state, outside of a render pass
+		// On the graphics queue the state written by the previous step is made visible to the vertex input
+		void cmdBeginFrame(VkCommandBuffer commandBuffer, uint32_t readState)
+		{
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkCmdResetQueryPool(commandBuffer, queryPool, readState * ASYNC_COMPUTE_QUERIES_PER_SLOT + 2, 2);
+			}
+			writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, readState, 2);
+
+			if (!async)
+			{
+				VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_FLAGS_NONE,
+					1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
+		}
+
+		void cmdEndFrame(VkCommandBuffer commandBuffer, uint32_t readState)
+		{
+			writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, readState, 3);
+		}
+
+		// Submits the command buffer of the current step, recorded for getReadState()
+		void submitStep(VkCommandBuffer commandBuffer)
+		{
+			VkSubmitInfo submitInfo = vks::initializers::GenSubmitInfo();
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &commandBuffer;
+
+			const uint64_t waitValue = stateFreeValue(step);
+			const uint64_t signalValue = stepDoneValue(step);
+			const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR };
+			if (async)
+			{
+				timelineSubmitInfo.waitSemaphoreValueCount = 1;
+				timelineSubmitInfo.pWaitSemaphoreValues = &waitValue;
+				timelineSubmitInfo.signalSemaphoreValueCount = 1;
+				timelineSubmitInfo.pSignalSemaphoreValues = &signalValue;
+				submitInfo.pNext = &timelineSubmitInfo;
+				submitInfo.waitSemaphoreCount = 1;
+				submitInfo.pWaitSemaphores = &graphicsTimeline;
+				submitInfo.pWaitDstStageMask = &waitStageMask;
+				submitInfo.signalSemaphoreCount = 1;
+				submitInfo.pSignalSemaphores = &computeTimeline;
+			}
+			VK_CHECK_RESULT(vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+			stepSubmitted = true;
+		}
+
+		// Submits the graphics work of the current frame with the hand over of the states added to its (binary) semaphores
+		void submitFrame(const VkSubmitInfo& submitInfo, VkPipelineStageFlags stateWaitStageMask = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT)
+		{
+			if (!async)
+			{
+				VK_CHECK_RESULT(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+				frameSubmitted = true;
+				return;
+			}
+
+			// Values of binary semaphores are ignored
+			std::vector<VkSemaphore> waitSemaphores(submitInfo.pWaitSemaphores, submitInfo.pWaitSemaphores + submitInfo.waitSemaphoreCount);
+			std::vector<VkPipelineStageFlags> waitStageMasks(submitInfo.pWaitDstStageMask, submitInfo.pWaitDstStageMask + submitInfo.waitSemaphoreCount);
+			std::vector<uint64_t> waitValues(submitInfo.waitSemaphoreCount, 0);
+			std::vector<VkSemaphore> signalSemaphores(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+			std::vector<uint64_t> signalValues(submitInfo.signalSemaphoreCount, 0);
+			waitSemaphores.push_back(computeTimeline);
+			waitStageMasks.push_back(stateWaitStageMask);
+			waitValues.push_back(stateReadyValue(step));
+			signalSemaphores.push_back(graphicsTimeline);
+			signalValues.push_back(frameDoneValue(step));
+
+			VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR };
+			timelineSubmitInfo.pNext = submitInfo.pNext;
+			timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+			timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+			timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+			timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+			VkSubmitInfo frameSubmitInfo = submitInfo;
+			frameSubmitInfo.pNext = &timelineSubmitInfo;
+			frameSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+			frameSubmitInfo.pWaitSemaphores = waitSemaphores.data();
+			frameSubmitInfo.pWaitDstStageMask = waitStageMasks.data();
+			frameSubmitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+			frameSubmitInfo.pSignalSemaphores = signalSemaphores.data();
+			VK_CHECK_RESULT(vkQueueSubmit(graphicsQueue, 1, &frameSubmitInfo, VK_NULL_HANDLE));
+			frameSubmitted = true;
+		}
+
+		// Moves on to the next step, call after the step and the frame have been submitted
+		void endFrame()
+		{
+			pending[getReadState()] = (queryPool != VK_NULL_HANDLE) && stepSubmitted && frameSubmitted;
+			slotCalibrations[getReadState()] = calibration;
+			stepSubmitted = false;
+			frameSubmitted = false;
+			step++;
+		}
+
+		const Statistics& getStatistics() const
+		{
+			return statistics;
+		}
+
+		void destroy()
+		{
+			if (device == nullptr)
+			{
+				return;
+			}
+			vkDestroySemaphore(device->logicalDevice, computeTimeline, nullptr);
+			vkDestroySemaphore(device->logicalDevice, graphicsTimeline, nullptr);
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+			}
+			if (calibrationEvent != VK_NULL_HANDLE)
+			{
+				for (uint32_t i = 0; i < 2; i++)
+				{
+					vkFreeCommandBuffers(device->logicalDevice, calibrationCommandPools[i], 1, &calibrationCommandBuffers[i]);
+					vkDestroyCommandPool(device->logicalDevice, calibrationCommandPools[i], nullptr);
+				}
+				vkDestroyEvent(device->logicalDevice, calibrationEvent, nullptr);
+			}
+			computeTimeline = VK_NULL_HANDLE;
+			graphicsTimeline = VK_NULL_HANDLE;
+			queryPool = VK_NULL_HANDLE;
+			calibrationCommandPools = {};
+			calibrationCommandBuffers = {};
+			calibrationEvent = VK_NULL_HANDLE;
+			calibrated = false;
+			device = nullptr;
+		}
+
+		// Checks the overlap measurement and replays the hand over on two simulated queues, returns the number of failed checks
+		static uint32_t selfTest(std::ostream& out)
+		{
+			vks::SelfTest test(out);
+			auto near = [](double a, double b)
+			{
+				return std::abs(a - b) < 1e-6;
+			};
+
+			// One tick per ms, both queues calibrated at tick 0 of a shared clock
+			const double period = 1000000.0;
+			const Calibration shared{};
+			Sample sample = measure({ 100, 110, 104, 120 }, shared, ~0ull, period);
+			test.check(near(sample.computeTime, 10.0) && near(sample.graphicsTime, 16.0) && near(sample.overlap, 6.0), "partial overlap");
+			sample = measure({ 100, 110, 110, 120 }, shared, ~0ull, period);
+			test.check(near(sample.overlap, 0.0), "no overlap for back to back submissions");
+			sample = measure({ 100, 110, 95, 105 }, shared, ~0ull, period);
+			test.check(near(sample.graphicsTime, 10.0) && near(sample.overlap, 5.0), "frame started before the step");
+			const uint64_t mask = (1ull << 32) - 1;
+			sample = measure({ mask - 5, 4, mask - 3, 14 }, Calibration{ mask - 105, mask - 105 }, mask, period);
+			test.check(near(sample.computeTime, 10.0) && near(sample.graphicsTime, 18.0) && near(sample.overlap, 8.0), "timestamps wrapping around the valid bits");
+
+			// Queue clocks with unrelated origins: the compute clock is 5000 ticks ahead of the graphics clock
+			// Compared directly the step would appear to end long after the frame, through the calibration the partial overlap is found again
+			const Calibration offset{ 5000, 0 };
+			sample = measure({ 5100, 5110, 104, 120 }, offset, ~0ull, period);
+			test.check(near(sample.computeTime, 10.0) && near(sample.graphicsTime, 16.0) && near(sample.overlap, 6.0), "overlap of queues with different clocks");
+			sample = measure({ 5100, 5110, 110, 120 }, offset, ~0ull, period);
+			test.check(near(sample.overlap, 0.0), "no overlap of queues with different clocks for back to back submissions");
+			sample = measure({ 95, 105, mask - 3, 14 }, Calibration{ 0, mask - 100 }, mask, period);
+			test.check(near(sample.graphicsTime, 18.0) && near(sample.overlap, 8.0), "calibration reference before a wrap of the graphics clock");
+
+			// Replays steps and frames like the examples submit them: the host waits for the previous step (beginStep), submits the step and
+			// the frame and waits for the graphics queue to become idle (submitFrame of the base)
+			const double computeTime = 6.0;
+			const double graphicsTime = 10.0;
+			const uint32_t frameCount = 32;
+			struct Result
+			{
+				bool stateReady = true;
+				bool stateFree = true;
+				double frameTime = 0.0;
+				double overlap = 0.0;
+			};
+			auto simulate = [&](bool dedicatedQueue)
+			{
+				Result result;
+				std::vector<double> stepStart(frameCount), stepEnd(frameCount), frameStart(frameCount), frameEnd(frameCount);
+				// Time at which a timeline value is reached
+				auto computeValueTime = [&](uint64_t value) { return (value == 0) ? 0.0 : stepEnd[value - 1]; };
+				auto graphicsValueTime = [&](uint64_t value) { return (value == 0) ? 0.0 : frameEnd[value - 1]; };
+				double host = 0.0;
+				double computeQueueFree = 0.0;
+				for (uint64_t i = 0; i < frameCount; i++)
+				{
+					if (i > 0)
+					{
+						host = std::max(host, computeValueTime(stepDoneValue(i - 1)));
+					}
+					if (dedicatedQueue)
+					{
+						stepStart[i] = std::max({ host, computeQueueFree, graphicsValueTime(stateFreeValue(i)) });
+						stepEnd[i] = stepStart[i] + computeTime;
+						computeQueueFree = stepEnd[i];
+						frameStart[i] = std::max(host, computeValueTime(stateReadyValue(i)));
+					}
+					else
+					{
+						stepStart[i] = host;
+						stepEnd[i] = stepStart[i] + computeTime;
+						frameStart[i] = stepEnd[i];
+					}
+					frameEnd[i] = frameStart[i] + graphicsTime;
+					host = frameEnd[i];
+
+					// The frame renders the state the previous step wrote, the step overwrites the state the previous frame rendered
+					result.stateReady &= (i == 0) || (frameStart[i] >= stepEnd[i - 1]);
+					result.stateFree &= (i == 0) || (stepStart[i] >= frameEnd[i - 1]);
+					result.overlap += std::max(std::min(stepEnd[i], frameEnd[i]) - std::max(stepStart[i], frameStart[i]), 0.0);
+				}//for_i
+				result.frameTime = (frameEnd[frameCount - 1] - frameEnd[0]) / (frameCount - 1);
+				result.overlap /= frameCount;
+				return result;
+			};
+
+			const Result dedicated = simulate(true);
+			const Result serial = simulate(false);
+			test.check(dedicated.stateReady && serial.stateReady, "frames only render states of finished steps");
+			test.check(dedicated.stateFree && serial.stateFree, "steps only overwrite states of finished frames");
+			test.check(near(dedicated.frameTime, std::max(computeTime, graphicsTime)) && near(serial.frameTime, computeTime + graphicsTime), "a dedicated queue hides the step behind the frame");
+			test.check(near(dedicated.overlap, std::min(computeTime, graphicsTime)) && near(serial.overlap, 0.0), "overlap gained per frame");
+			test.check((stateReadyValue(1) == stepDoneValue(0)) && (stateFreeValue(1) == frameDoneValue(0)), "each step and frame waits for its predecessor");
+			out << "frame time on a dedicated compute queue " << dedicated.frameTime << " ms, on the graphics queue " << serial.frameTime << " ms\n";
+
+			return test.failed();
+		}
+	};//class AsyncCompute
+
+}//vks
@@ -0,0 +1,657 @@
+/*
+* Descriptor set allocator
+*
+* Persistent descriptor sets are allocated from pools that are created on demand: when a pool runs out of sets or descriptors
+* the next pool is created with twice the sets (up to DESCRIPTOR_POOL_MAX_SETS), so examples don't have to size pools up front
+* Transient sets are allocated from per-frame pools that are reset as a whole when their frame index comes around again
+* Set layouts are cached by their bindings, descriptor writes are queued and submitted with a single vkUpdateDescriptorSets
+* Pool creation, allocation and updates are std::function members, selfTest swaps them for counters to check when pools grow and get reset
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+#include <ostream>
+#include <cassert>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+#include "VulkanTools.h"
+#include "SelfTest.hpp"
+
+// Sets of the first pool, each further pool gets twice the sets of the previous one
+#define DESCRIPTOR_POOL_INITIAL_SETS 32
+#define DESCRIPTOR_POOL_MAX_SETS 4096
+
+namespace vks
+{
+	class DescriptorAllocator
+	{
+	public:
+		// Pool, set and layout entry points, prepare fills them with the vkCreateDescriptorPool etc. calls of the device
+		struct Functions
+		{
+			std::function<VkResult(const VkDescriptorPoolCreateInfo&, VkDescriptorPool&)> createPool;
+			std::function<void(VkDescriptorPool)> destroyPool;
+			std::function<void(VkDescriptorPool)> resetPool;
+			std::function<VkResult(VkDescriptorPool, VkDescriptorSetLayout, VkDescriptorSet&)> allocateSet;
+			std::function<void(uint32_t, const VkWriteDescriptorSet*)> updateSets;
+			std::function<VkResult(const VkDescriptorSetLayoutCreateInfo&, VkDescriptorSetLayout&)> createLayout;
+			std::function<void(VkDescriptorSetLayout)> destroyLayout;
+		};
+
+		struct FrameStatistics
+		{
+			uint32_t allocations = 0;
+			uint32_t writes = 0;
+			uint32_t updateCalls = 0;
+			uint32_t poolResets = 0;
+		};
+
+		struct Statistics
+		{
+			uint32_t layouts = 0;
+			// getLayout calls that returned a cached layout
+			uint32_t layoutHits = 0;
+			uint32_t pools = 0;
+			uint32_t transientPools = 0;
+			uint64_t allocations = 0;
+			uint64_t transientAllocations = 0;
+			uint64_t writes = 0;
+			uint64_t updateCalls = 0;
+			// Sums over the completed frames (allocations and updates made between two beginFrame calls)
+			uint32_t frames = 0;
+			FrameStatistics frameTotals;
+		};
+
+	private:
+		struct Layout
+		{
+			VkDescriptorSetLayoutCreateFlags flags;
+			std::vector<VkDescriptorSetLayoutBinding> bindings;
+			std::vector<VkSampler> immutableSamplers;
+			VkDescriptorSetLayout layout;
+		};
+
+		// Pools of one kind (persistent or one frame), pools before current are full
+		struct PoolList
+		{
+			std::vector<VkDescriptorPool> pools;
+			uint32_t current = 0;
+			uint32_t setsPerPool = DESCRIPTOR_POOL_INITIAL_SETS;
+		};
+
+		Functions functions;
+		std::mutex mutex;
+
+		std::vector<Layout> layouts;
+		std::unordered_multimap<uint64_t, size_t> layoutLookup;
+		// Descriptors per set of the layouts created by getLayout, so new pools can hold at least a pool's worth of them
+		std::unordered_map<uint64_t, std::vector<VkDescriptorPoolSize>> layoutSizes;
+
+		PoolList persistent;
+		std::vector<PoolList> frames;
+		uint32_t frameIndex = 0;
+
+		struct PendingWrite
+		{
+			VkWriteDescriptorSet write;
+			size_t info;
+		};
+		std::vector<PendingWrite> pendingWrites;
+		std::vector<VkDescriptorBufferInfo> bufferInfos;
+		std::vector<VkDescriptorImageInfo> imageInfos;
+
+		Statistics statistics;
+		FrameStatistics frame;
+		FrameStatistics lastFrame;
+
+		static uint64_t handleKey(VkDescriptorSetLayout layout)
+		{
+			return (uint64_t)(uintptr_t)layout;
+		}
+
+		// Descriptors per set for pools that aren't sized for a specific layout
+		static std::vector<VkDescriptorPoolSize> defaultRatios()
+		{
+			return {
+				{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+				{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+				{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+				{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+				{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1 },
+				{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+				{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1 },
+			};
+		}
+
+		// Expects the lock to be held
+		VkDescriptorPool createPool(PoolList& list, VkDescriptorSetLayout layout, bool transient)
+		{
+			const uint32_t sets = list.setsPerPool;
+			std::vector<VkDescriptorPoolSize> poolSizes = defaultRatios();
+			auto known = layoutSizes.find(handleKey(layout));
+			if (known != layoutSizes.end())
+			{
+				for (const VkDescriptorPoolSize& size : known->second)
+				{
+					auto existing = std::find_if(poolSizes.begin(), poolSizes.end(), [&](const VkDescriptorPoolSize& poolSize) { return poolSize.type == size.type; });
+					if (existing == poolSizes.end())
+					{
+						poolSizes.push_back(size);
+					}
+					else
+					{
+						existing->descriptorCount = std::max(existing->descriptorCount, size.descriptorCount);
+					}
+				}
+			}
+			for (VkDescriptorPoolSize& poolSize : poolSizes)
+			{
+				poolSize.descriptorCount *= sets;
+			}
+
+			VkDescriptorPoolCreateInfo poolCI{};
+			poolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			poolCI.maxSets = sets;
+			poolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+			poolCI.pPoolSizes = poolSizes.data();
+			VkDescriptorPool pool;
+			VK_CHECK_RESULT(functions.createPool(poolCI, pool));
+			list.pools.push_back(pool);
+			list.setsPerPool = std::min(sets * 2, (uint32_t)DESCRIPTOR_POOL_MAX_SETS);
+			if (transient)
+			{
+				statistics.transientPools++;
+			}
+			else
+			{
+				statistics.pools++;
+			}
+			return pool;
+		}
+
+		// Expects the lock to be held
+		VkDescriptorSet allocateFrom(PoolList& list, VkDescriptorSetLayout layout, bool transient)
+		{
+			VkDescriptorSet set = VK_NULL_HANDLE;
+			while (list.current < list.pools.size())
+			{
+				const VkResult result = functions.allocateSet(list.pools[list.current], layout, set);
+				if (result == VK_SUCCESS)
+				{
+					return set;
+				}
+				if ((result != VK_ERROR_OUT_OF_POOL_MEMORY) && (result != VK_ERROR_FRAGMENTED_POOL))
+				{
+					VK_CHECK_RESULT(result);
+				}
+				// Pool is full, continue with the next (reset transient pools are reused before new ones are created)
+				list.current++;
+			}
+			const VkDescriptorPool pool = createPool(list, layout, transient);
+			VK_CHECK_RESULT(functions.allocateSet(pool, layout, set));
+			return set;
+		}
+
+		// Expects the lock to be held
+		void queueWrite(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, uint32_t arrayElement, size_t info)
+		{
+			PendingWrite pending{};
+			pending.write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			pending.write.dstSet = set;
+			pending.write.dstBinding = binding;
+			pending.write.dstArrayElement = arrayElement;
+			pending.write.descriptorType = type;
+			pending.write.descriptorCount = 1;
+			pending.info = info;
+			pendingWrites.push_back(pending);
+		}
+
+		static bool isImageType(VkDescriptorType type)
+		{
+			return (type == VK_DESCRIPTOR_TYPE_SAMPLER) || (type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) || (type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE)
+				|| (type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE) || (type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
+		}
+
+	public:
+		~DescriptorAllocator()
+		{
+			destroy();
+		}
+
+		// frameCount transient pool lists are kept, one per frame index passed to beginFrame
+		void prepare(VkDevice device, uint32_t frameCount)
+		{
+			Functions deviceFunctions;
+			deviceFunctions.createPool = [device](const VkDescriptorPoolCreateInfo& createInfo, VkDescriptorPool& pool) { return vkCreateDescriptorPool(device, &createInfo, nullptr, &pool); };
+			deviceFunctions.destroyPool = [device](VkDescriptorPool pool) { vkDestroyDescriptorPool(device, pool, nullptr); };
+			deviceFunctions.resetPool = [device](VkDescriptorPool pool) { VK_CHECK_RESULT(vkResetDescriptorPool(device, pool, 0)); };
+			deviceFunctions.allocateSet = [device](VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet& set)
+			{
+				VkDescriptorSetAllocateInfo allocInfo{};
+				allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+				allocInfo.descriptorPool = pool;
+				allocInfo.descriptorSetCount = 1;
+				allocInfo.pSetLayouts = &layout;
+				return vkAllocateDescriptorSets(device, &allocInfo, &set);
+			};
+			deviceFunctions.updateSets = [device](uint32_t count, const VkWriteDescriptorSet* writes) { vkUpdateDescriptorSets(device, count, writes, 0, nullptr); };
+			deviceFunctions.createLayout = [device](const VkDescriptorSetLayoutCreateInfo& createInfo, VkDescriptorSetLayout& layout) { return vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &layout); };
+			deviceFunctions.destroyLayout = [device](VkDescriptorSetLayout layout) { vkDestroyDescriptorSetLayout(device, layout, nullptr); };
+			setFunctions(deviceFunctions, frameCount);
+		}
+
+		void setFunctions(const Functions& functions, uint32_t frameCount)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			this->functions = functions;
+			frames.resize(frameCount);
+		}
+
+		// Returns a layout with the given bindings (in any order), created on first use and owned by the allocator
+		VkDescriptorSetLayout getLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorSetLayoutCreateFlags flags = 0)
+		{
+			Layout key;
+			key.flags = flags;
+			key.bindings = bindings;
+			std::sort(key.bindings.begin(), key.bindings.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+			// 64 bit FNV-1a over the flags, the bindings and their immutable samplers
+			uint64_t hash = vks::tools::hashSeed;
+			auto add = [&hash](const void* data, size_t size)
+			{
+				hash = vks::tools::hashBytes(data, size, hash);
+			};
+			add(&flags, sizeof(flags));
+			for (VkDescriptorSetLayoutBinding& binding : key.bindings)
+			{
+				add(&binding.binding, sizeof(binding.binding));
+				add(&binding.descriptorType, sizeof(binding.descriptorType));
+				add(&binding.descriptorCount, sizeof(binding.descriptorCount));
+				add(&binding.stageFlags, sizeof(binding.stageFlags));
+				if (binding.pImmutableSamplers != nullptr)
+				{
+					key.immutableSamplers.insert(key.immutableSamplers.end(), binding.pImmutableSamplers, binding.pImmutableSamplers + binding.descriptorCount);
+					add(binding.pImmutableSamplers, binding.descriptorCount * sizeof(VkSampler));
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			auto range = layoutLookup.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				const Layout& cached = layouts[it->second];
+				bool equal = (cached.flags == key.flags) && (cached.bindings.size() == key.bindings.size()) && (cached.immutableSamplers == key.immutableSamplers);
+				for (size_t i = 0; equal && (i < key.bindings.size()); i++)
+				{
+					const VkDescriptorSetLayoutBinding& a = cached.bindings[i];
+					const VkDescriptorSetLayoutBinding& b = key.bindings[i];
+					equal = (a.binding == b.binding) && (a.descriptorType == b.descriptorType) && (a.descriptorCount == b.descriptorCount) && (a.stageFlags == b.stageFlags);
+				}
+				if (equal)
+				{
+					statistics.layoutHits++;
+					return cached.layout;
+				}
+			}
+
+			VkDescriptorSetLayoutCreateInfo layoutCI{};
+			layoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layoutCI.flags = flags;
+			layoutCI.bindingCount = static_cast<uint32_t>(key.bindings.size());
+			layoutCI.pBindings = key.bindings.data();
+			VK_CHECK_RESULT(functions.createLayout(layoutCI, key.layout));
+
+			std::vector<VkDescriptorPoolSize> sizes;
+			for (const VkDescriptorSetLayoutBinding& binding : key.bindings)
+			{
+				auto existing = std::find_if(sizes.begin(), sizes.end(), [&](const VkDescriptorPoolSize& size) { return size.type == binding.descriptorType; });
+				if (existing == sizes.end())
+				{
+					sizes.push_back({ binding.descriptorType, binding.descriptorCount });
+				}
+				else
+				{
+					existing->descriptorCount += binding.descriptorCount;
+				}
+			}
+			layoutSizes[handleKey(key.layout)] = sizes;
+			layoutLookup.insert(std::make_pair(hash, layouts.size()));
+			layouts.push_back(key);
+			statistics.layouts++;
+			return key.layout;
+		}
+
+		// Allocates a set that lives until the allocator is destroyed (the layout can come from anywhere)
+		VkDescriptorSet allocate(VkDescriptorSetLayout layout)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			const VkDescriptorSet set = allocateFrom(persistent, layout, false);
+			statistics.allocations++;
+			frame.allocations++;
+			return set;
+		}
+
+		// Allocates a set that is only valid until beginFrame is called with the current frame index again
+		VkDescriptorSet allocateTransient(VkDescriptorSetLayout layout)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			assert(!frames.empty());
+			const VkDescriptorSet set = allocateFrom(frames[frameIndex], layout, true);
+			statistics.transientAllocations++;
+			frame.allocations++;
+			return set;
+		}
+
+		// Starts a frame: resets the transient pools of the frame index (whose previous frame must have completed on the GPU)
+		// and closes the counters of the previous frame
+		void beginFrame(uint32_t index)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			// The swap chain may come back with more images after a resize
+			if (index >= frames.size())
+			{
+				frames.resize(index + 1);
+			}
+			PoolList& list = frames[index];
+			const uint32_t usedPools = std::min(list.current + 1, static_cast<uint32_t>(list.pools.size()));
+			for (uint32_t i = 0; i < usedPools; i++)
+			{
+				functions.resetPool(list.pools[i]);
+			}//for_i
+			list.current = 0;
+
+			lastFrame = frame;
+			statistics.frames++;
+			statistics.frameTotals.allocations += frame.allocations;
+			statistics.frameTotals.writes += frame.writes;
+			statistics.frameTotals.updateCalls += frame.updateCalls;
+			statistics.frameTotals.poolResets += frame.poolResets;
+			frame = FrameStatistics();
+			frame.poolResets = usedPools;
+			frameIndex = index;
+		}
+
+		// Queue a descriptor write, the info is copied so it doesn't have to outlive the call
+		void write(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo& bufferInfo, uint32_t arrayElement = 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			assert(!isImageType(type));
+			queueWrite(set, binding, type, arrayElement, bufferInfos.size());
+			bufferInfos.push_back(bufferInfo);
+		}
+
+		void write(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo& imageInfo, uint32_t arrayElement = 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			assert(isImageType(type));
+			queueWrite(set, binding, type, arrayElement, imageInfos.size());
+			imageInfos.push_back(imageInfo);
+		}
+
+		// Submits all queued writes with one vkUpdateDescriptorSets call, returns the number of writes
+		uint32_t flush()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (pendingWrites.empty())
+			{
+				return 0;
+			}
+			// The info arrays are complete now, so the pointers into them stay valid for the update
+			std::vector<VkWriteDescriptorSet> writes(pendingWrites.size());
+			for (size_t i = 0; i < pendingWrites.size(); i++)
+			{
+				writes[i] = pendingWrites[i].write;
+				if (isImageType(writes[i].descriptorType))
+				{
+					writes[i].pImageInfo = &imageInfos[pendingWrites[i].info];
+				}
+				else
+				{
+					writes[i].pBufferInfo = &bufferInfos[pendingWrites[i].info];
+				}
+			}//for_i
+			functions.updateSets(static_cast<uint32_t>(writes.size()), writes.data());
+
+			const uint32_t count = static_cast<uint32_t>(writes.size());
+			statistics.writes += count;
+			statistics.updateCalls++;
+			frame.writes += count;
+			frame.updateCalls++;
+			pendingWrites.clear();
+			bufferInfos.clear();
+			imageInfos.clear();
+			return count;
+		}
+
+		Statistics getStatistics()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return statistics;
+		}
+
+		// Counters of the last completed frame
+		FrameStatistics getFrameStatistics()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return lastFrame;
+		}
+
+		// Destroys all pools (and with them all sets) and the cached layouts
+		void destroy()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!functions.destroyPool)
+			{
+				return;
+			}
+			for (VkDescriptorPool pool : persistent.pools)
+			{
+				functions.destroyPool(pool);
+			}
+			persistent = PoolList();
+			for (PoolList& list : frames)
+			{
+				for (VkDescriptorPool pool : list.pools)
+				{
+					functions.destroyPool(pool);
+				}
+				list = PoolList();
+			}
+			for (Layout& layout : layouts)
+			{
+				functions.destroyLayout(layout.layout);
+			}
+			layouts.clear();
+			layoutLookup.clear();
+			layoutSizes.clear();
+			pendingWrites.clear();
+			bufferInfos.clear();
+			imageInfos.clear();
+		}
+
+		// Checks the pool growth, frame recycling, layout cache and write batching with fake pools, returns the number of failed checks
+		static uint32_t selfTest(std::ostream& out)
+		{
+			vks::SelfTest test(out);
+
+			// Fake pools track their remaining sets and descriptors like a driver would
+			struct FakePool
+			{
+				uint32_t sets;
+				std::vector<VkDescriptorPoolSize> sizes;
+				VkDescriptorPoolCreateInfo createInfo;
+				std::vector<VkDescriptorPoolSize> createSizes;
+				bool destroyed = false;
+			};
+			std::vector<FakePool> pools;
+			std::vector<std::vector<VkDescriptorSetLayoutBinding>> fakeLayouts;
+			uint32_t destroyedLayouts = 0;
+			std::vector<std::vector<VkWriteDescriptorSet>> updates;
+			std::vector<VkDescriptorBufferInfo> updatedBufferInfos;
+			uint64_t nextSet = 1;
+
+			Functions fake;
+			fake.createPool = [&](const VkDescriptorPoolCreateInfo& createInfo, VkDescriptorPool& pool)
+			{
+				FakePool fakePool;
+				fakePool.sets = createInfo.maxSets;
+				fakePool.sizes.assign(createInfo.pPoolSizes, createInfo.pPoolSizes + createInfo.poolSizeCount);
+				fakePool.createInfo = createInfo;
+				fakePool.createSizes = fakePool.sizes;
+				pools.push_back(fakePool);
+				pool = (VkDescriptorPool)(uintptr_t)pools.size();
+				return VK_SUCCESS;
+			};
+			fake.destroyPool = [&](VkDescriptorPool pool) { pools[(uintptr_t)pool - 1].destroyed = true; };
+			// Resetting restores the capacity the pool was created with
+			fake.resetPool = [&](VkDescriptorPool pool)
+			{
+				FakePool& fakePool = pools[(uintptr_t)pool - 1];
+				fakePool.sets = fakePool.createInfo.maxSets;
+				fakePool.sizes = fakePool.createSizes;
+			};
+			fake.allocateSet = [&](VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet& set)
+			{
+				FakePool& fakePool = pools[(uintptr_t)pool - 1];
+				if (fakePool.sets == 0)
+				{
+					return VK_ERROR_OUT_OF_POOL_MEMORY;
+				}
+				const std::vector<VkDescriptorSetLayoutBinding>& bindings = fakeLayouts[(uintptr_t)layout - 1];
+				std::vector<VkDescriptorPoolSize> remaining = fakePool.sizes;
+				for (const VkDescriptorSetLayoutBinding& binding : bindings)
+				{
+					auto size = std::find_if(remaining.begin(), remaining.end(), [&](const VkDescriptorPoolSize& poolSize) { return poolSize.type == binding.descriptorType; });
+					if ((size == remaining.end()) || (size->descriptorCount < binding.descriptorCount))
+					{
+						return VK_ERROR_OUT_OF_POOL_MEMORY;
+					}
+					size->descriptorCount -= binding.descriptorCount;
+				}
+				fakePool.sizes = remaining;
+				fakePool.sets--;
+				set = (VkDescriptorSet)(uintptr_t)(nextSet++);
+				return VK_SUCCESS;
+			};
+			fake.updateSets = [&](uint32_t count, const VkWriteDescriptorSet* writes)
+			{
+				updates.push_back(std::vector<VkWriteDescriptorSet>(writes, writes + count));
+				for (uint32_t i = 0; i < count; i++)
+				{
+					if (writes[i].pBufferInfo != nullptr)
+					{
+						updatedBufferInfos.push_back(*writes[i].pBufferInfo);
+					}
+				}
+			};
+			fake.createLayout = [&](const VkDescriptorSetLayoutCreateInfo& createInfo, VkDescriptorSetLayout& layout)
+			{
+				fakeLayouts.push_back(std::vector<VkDescriptorSetLayoutBinding>(createInfo.pBindings, createInfo.pBindings + createInfo.bindingCount));
+				layout = (VkDescriptorSetLayout)(uintptr_t)fakeLayouts.size();
+				return VK_SUCCESS;
+			};
+			fake.destroyLayout = [&](VkDescriptorSetLayout) { destroyedLayouts++; };
+
+			{
+				DescriptorAllocator allocator;
+				allocator.setFunctions(fake, 2);
+
+				const VkDescriptorSetLayoutBinding ubo = { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
+				const VkDescriptorSetLayoutBinding image = { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+				const VkDescriptorSetLayout layout = allocator.getLayout({ ubo, image });
+				const VkDescriptorSetLayout reordered = allocator.getLayout({ image, ubo });
+				VkDescriptorSetLayoutBinding otherStage = image;
+				otherStage.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+				const VkDescriptorSetLayout other = allocator.getLayout({ ubo, otherStage });
+				test.check((layout == reordered) && (layout != other) && (fakeLayouts.size() == 2) && (allocator.getStatistics().layoutHits == 1), "layouts are cached by their bindings");
+
+				// Persistent sets: more than the first pool holds
+				const uint32_t setCount = DESCRIPTOR_POOL_INITIAL_SETS * 3 + 1;
+				std::vector<VkDescriptorSet> sets;
+				for (uint32_t i = 0; i < setCount; i++)
+				{
+					sets.push_back(allocator.allocate(layout));
+				}//for_i
+				std::sort(sets.begin(), sets.end());
+				const bool unique = (std::unique(sets.begin(), sets.end()) == sets.end()) && (std::find(sets.begin(), sets.end(), (VkDescriptorSet)VK_NULL_HANDLE) == sets.end());
+				// 32 + 64 sets in the first two pools, the third one (128 sets) takes the rest
+				test.check(unique && (allocator.getStatistics().pools == 3) && (pools.size() == 3) && (pools[1].sets + pools[0].sets == 0), "pools grow on demand");
+
+				// A layout with more descriptors per set than the default ratios gets a pool sized for it
+				const VkDescriptorSetLayoutBinding textures = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+				const VkDescriptorSetLayout textureLayout = allocator.getLayout({ textures });
+				const size_t poolsBefore = pools.size();
+				for (uint32_t i = 0; i < 40; i++)
+				{
+					allocator.allocate(textureLayout);
+				}//for_i
+				bool sizedForLayout = (pools.size() == poolsBefore + 1);
+				for (const VkDescriptorPoolSize& size : pools.back().createSizes)
+				{
+					sizedForLayout = sizedForLayout && ((size.type != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) || (size.descriptorCount == 16 * pools.back().createInfo.maxSets));
+				}
+				test.check(sizedForLayout, "pools run out of descriptors and are sized for the layout");
+
+				// Transient sets of a frame are recycled when the frame index comes around again
+				allocator.beginFrame(0);
+				for (uint32_t i = 0; i < DESCRIPTOR_POOL_INITIAL_SETS + 4; i++)
+				{
+					allocator.allocateTransient(layout);
+				}//for_i
+				allocator.beginFrame(1);
+				allocator.allocateTransient(layout);
+				const size_t transientPools = allocator.getStatistics().transientPools;
+				allocator.beginFrame(0);
+				for (uint32_t i = 0; i < DESCRIPTOR_POOL_INITIAL_SETS + 4; i++)
+				{
+					allocator.allocateTransient(layout);
+				}//for_i
+				const FrameStatistics lastFrame = allocator.getFrameStatistics();
+				test.check((transientPools == 3) && (allocator.getStatistics().transientPools == 3), "transient pools are reset and reused instead of growing");
+				test.check(lastFrame.allocations == 1, "frame counters cover the allocations between two frames");
+
+				// Writes are batched into one update, the infos are copies
+				allocator.beginFrame(1);
+				const size_t updatesBefore = updates.size();
+				for (uint32_t i = 0; i < 5; i++)
+				{
+					VkDescriptorBufferInfo bufferInfo = { (VkBuffer)(uintptr_t)(i + 1), 0, 64 };
+					allocator.write(sets[i], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfo);
+				}//for_i
+				VkDescriptorImageInfo imageInfo = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+				allocator.write(sets[0], 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfo);
+				const uint32_t flushed = allocator.flush();
+				bool infosKept = (updatedBufferInfos.size() == 5);
+				for (uint32_t i = 0; infosKept && (i < 5); i++)
+				{
+					infosKept = (updatedBufferInfos[i].buffer == (VkBuffer)(uintptr_t)(i + 1));
+				}//for_i
+				test.check((flushed == 6) && (updates.size() == updatesBefore + 1) && (updates.back().size() == 6) && infosKept, "writes are submitted with one update");
+				test.check((allocator.flush() == 0) && (updates.size() == updatesBefore + 1), "empty flush doesn't update");
+
+				allocator.beginFrame(0);
+				const FrameStatistics updateFrame = allocator.getFrameStatistics();
+				const Statistics statistics = allocator.getStatistics();
+				test.check((updateFrame.writes == 6) && (updateFrame.updateCalls == 1) && (updateFrame.poolResets == 1) && (statistics.allocations == setCount + 40) && (statistics.frames == 5), "statistics count allocations and updates");
+			}
+
+			bool allDestroyed = true;
+			for (const FakePool& pool : pools)
+			{
+				allDestroyed = allDestroyed && pool.destroyed;
+			}
+			test.check(allDestroyed && (destroyedLayouts == fakeLayouts.size()), "destroy releases all pools and layouts");
+
+			return test.failed();
+		}
+	};//class DescriptorAllocator
+
+}//vks
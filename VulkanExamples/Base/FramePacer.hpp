@@ -0,0 +1,300 @@
+/*
+* Frame pacing for low latency presentation
+*
+* Decides how long the render loop waits before a frame samples its input and measures the input-to-present latency
+* Present wait mode waits until no more than framesAhead frames are queued for presentation (VK_KHR_present_wait),
+* just-in-time mode additionally delays the frame start so that the frame is done shortly before the next present,
+* using the measured present interval and frame work time
+* The base waits for the GPU work of every frame (submitFrame), so framesAhead only lets finished frames queue up for presentation,
+* it never lets the GPU work of several frames queue up; without present wait there is nothing to wait for and it has no effect
+* The clock is replaceable, so the controller can be checked against a simulated display (see selfTest)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <ostream>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+
+#include "SelfTest.hpp"
+
+// Frames whose input time is kept until their present is reported
+#define FRAME_PACER_HISTORY 16
+
+namespace vks
+{
+	class FramePacer
+	{
+	public:
+		enum Mode
+		{
+			// No waiting, the latency is measured to the end of the frame's GPU work
+			MODE_OFF = 0,
+			// Wait for the presents of earlier frames before starting a frame
+			MODE_PRESENT_WAIT,
+			// Present wait and a delayed frame start, so the input is sampled as late as possible
+			MODE_JUST_IN_TIME,
+		};
+
+		// Times in milliseconds
+		struct Clock
+		{
+			std::function<double()> now;
+			std::function<void(double)> sleep;
+		};
+
+		struct Statistics
+		{
+			// Averages over recent frames (exponential)
+			float latency = 0.0f;
+			float presentInterval = 0.0f;
+			float workTime = 0.0f;
+			float sleepTime = 0.0f;
+			float latencyMax = 0.0f;
+			// Sums for the benchmark report
+			double latencyTotal = 0.0;
+			uint32_t latencySamples = 0;
+		};
+
+		Mode mode = MODE_OFF;
+		// Frames that may still be queued for presentation when a frame starts (0 = wait until the previous frame is shown)
+		uint32_t framesAhead = 0;
+		// Time the just-in-time start leaves between the predicted end of the frame and the present
+		double margin = 1.0;
+
+	private:
+		Clock clock;
+		std::vector<double> inputTimes = std::vector<double>(FRAME_PACER_HISTORY, 0.0);
+		uint64_t lastFrameId = 0;
+		uint64_t lastPresentedId = 0;
+		double lastPresentTime = 0.0;
+		double frameStart = 0.0;
+		bool haveInterval = false;
+		bool haveWorkTime = false;
+		Statistics statistics;
+
+		static float average(float current, double sample, bool first)
+		{
+			return first ? static_cast<float>(sample) : current + (static_cast<float>(sample) - current) * 0.1f;
+		}
+
+	public:
+		FramePacer()
+		{
+			clock.now = []()
+			{
+				return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			};
+			clock.sleep = [](double milliseconds)
+			{
+				std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(milliseconds));
+			};
+		}
+
+		void setClock(const Clock& clock)
+		{
+			this->clock = clock;
+		}
+
+		// Forgets the present timing, e.g. after the swap chain has been recreated
+		void reset()
+		{
+			lastPresentedId = lastFrameId;
+			haveInterval = false;
+		}
+
+		// Present id the loop has to wait for before the next frame starts, 0 if none
+		uint64_t waitTarget() const
+		{
+			if ((mode == MODE_OFF) || (lastFrameId <= framesAhead))
+			{
+				return 0;
+			}
+			const uint64_t target = lastFrameId - framesAhead;
+			return (target > lastPresentedId) ? target : 0;
+		}
+
+		// Time the next frame start should be delayed by in just-in-time mode
+		double startDelay() const
+		{
+			if ((mode != MODE_JUST_IN_TIME) || !haveInterval || !haveWorkTime)
+			{
+				return 0.0;
+			}
+			// The frame should be done margin before the present that follows the last one
+			const double interval = statistics.presentInterval;
+			const double start = lastPresentTime + interval * (framesAhead + 1) - statistics.workTime - margin;
+			return std::min(std::max(start - clock.now(), 0.0), interval);
+		}
+
+		// Sleeps for the just-in-time delay
+		void sleepBeforeFrame()
+		{
+			const double delay = startDelay();
+			if (delay > 0.0)
+			{
+				clock.sleep(delay);
+			}
+			statistics.sleepTime = average(statistics.sleepTime, delay, statistics.latencySamples == 0);
+		}
+
+		// Starts a frame, the input is sampled now, returns the present id of the frame
+		uint64_t beginFrame()
+		{
+			frameStart = clock.now();
+			lastFrameId++;
+			inputTimes[lastFrameId % FRAME_PACER_HISTORY] = frameStart;
+			return lastFrameId;
+		}
+
+		// The frame's work is done (the base waits for the queue after presenting)
+		void endFrame()
+		{
+			statistics.workTime = average(statistics.workTime, clock.now() - frameStart, !haveWorkTime);
+			haveWorkTime = true;
+		}
+
+		// The frame with the given id has been presented at time (or its work has completed if presents can't be waited for)
+		void presentCompleted(uint64_t presentId, double time)
+		{
+			if ((presentId <= lastPresentedId) || (lastFrameId - presentId >= FRAME_PACER_HISTORY))
+			{
+				return;
+			}
+			if ((lastPresentedId > 0) && (lastPresentTime > 0.0))
+			{
+				const double interval = (time - lastPresentTime) / static_cast<double>(presentId - lastPresentedId);
+				statistics.presentInterval = average(statistics.presentInterval, interval, !haveInterval);
+				haveInterval = true;
+			}
+			const double latency = time - inputTimes[presentId % FRAME_PACER_HISTORY];
+			statistics.latency = average(statistics.latency, latency, statistics.latencySamples == 0);
+			statistics.latencyMax = std::max(statistics.latencyMax, static_cast<float>(latency));
+			statistics.latencyTotal += latency;
+			statistics.latencySamples++;
+			lastPresentedId = presentId;
+			lastPresentTime = time;
+		}
+
+		double now() const
+		{
+			return clock.now();
+		}
+
+		const Statistics& getStatistics() const
+		{
+			return statistics;
+		}
+
+		// Checks the wait targets, the interval estimate and the latencies of all modes on a simulated FIFO display, returns the number of failed checks
+		static uint32_t selfTest(std::ostream& out)
+		{
+			vks::SelfTest test(out);
+
+			const double interval = 1000.0 / 60.0;
+			const double work = 5.0;
+			const uint32_t frameCount = 240;
+			// Swap chain images minus the one being rendered to
+			const uint32_t queueDepth = 2;
+
+			struct Result
+			{
+				double latency = 0.0;
+				double sleep = 0.0;
+				float intervalEstimate = 0.0f;
+				uint32_t missedVblanks = 0;
+			};
+			auto simulate = [&](Mode mode, uint32_t framesAhead)
+			{
+				double time = 0.0;
+				FramePacer pacer;
+				pacer.mode = mode;
+				pacer.framesAhead = framesAhead;
+				pacer.setClock({ [&]() { return time; }, [&](double milliseconds) { time += milliseconds; } });
+
+				std::vector<double> presentTimes(frameCount + 1, 0.0);
+				Result result;
+				for (uint64_t frame = 1; frame <= frameCount; frame++)
+				{
+					// Wait for an earlier present like vkWaitForPresentKHR would
+					const uint64_t target = pacer.waitTarget();
+					if (target > 0)
+					{
+						time = std::max(time, presentTimes[target]);
+						pacer.presentCompleted(target, presentTimes[target]);
+					}
+					const double beforeSleep = time;
+					pacer.sleepBeforeFrame();
+					result.sleep += time - beforeSleep;
+
+					// Acquire blocks while all images are queued
+					if (frame > queueDepth)
+					{
+						time = std::max(time, presentTimes[frame - queueDepth]);
+						if (mode == MODE_OFF)
+						{
+							pacer.presentCompleted(frame - queueDepth, presentTimes[frame - queueDepth]);
+						}
+					}
+					const uint64_t id = pacer.beginFrame();
+					time += work;
+					pacer.endFrame();
+
+					// FIFO: shown at the first vblank after the work is done and after the previous frame
+					double present = std::ceil(time / interval) * interval;
+					if (frame > 1)
+					{
+						present = std::max(present, presentTimes[frame - 1] + interval);
+						// Skipped vblanks after the first frames, while the display is busy
+						if ((frame > 8) && (present - presentTimes[frame - 1] > interval * 1.5))
+						{
+							result.missedVblanks++;
+						}
+					}
+					presentTimes[id] = present;
+				}//for_frame
+				const Statistics& statistics = pacer.getStatistics();
+				result.latency = statistics.latencyTotal / std::max(statistics.latencySamples, 1u);
+				result.sleep /= frameCount;
+				result.intervalEstimate = statistics.presentInterval;
+				return result;
+			};
+
+			{
+				FramePacer pacer;
+				double time = 0.0;
+				pacer.setClock({ [&]() { return time; }, [&](double milliseconds) { time += milliseconds; } });
+				test.check(pacer.waitTarget() == 0, "nothing to wait for while pacing is off");
+				pacer.mode = MODE_PRESENT_WAIT;
+				pacer.framesAhead = 1;
+				pacer.beginFrame();
+				test.check(pacer.waitTarget() == 0, "frames up to framesAhead don't wait");
+				pacer.beginFrame();
+				pacer.beginFrame();
+				test.check(pacer.waitTarget() == 2, "wait targets leave framesAhead frames queued");
+				pacer.presentCompleted(2, 10.0);
+				test.check((pacer.waitTarget() == 0) && (pacer.startDelay() == 0.0), "presented frames aren't waited for, no delay without estimates");
+			}
+
+			const Result off = simulate(MODE_OFF, 0);
+			const Result presentWait = simulate(MODE_PRESENT_WAIT, 0);
+			const Result justInTime = simulate(MODE_JUST_IN_TIME, 0);
+			test.check(std::abs(presentWait.intervalEstimate - interval) < 0.1, "the present interval is measured");
+			test.check(presentWait.latency < off.latency - interval * 0.5, "present wait removes the queued frames from the latency");
+			test.check((justInTime.latency < work + 1.0 + 1.0) && (justInTime.latency < presentWait.latency), "just-in-time starts leave about the work time and margin as latency");
+			test.check((off.missedVblanks == 0) && (presentWait.missedVblanks == 0) && (justInTime.missedVblanks == 0), "no mode misses a vblank");
+			test.check((justInTime.sleep > 0.0) && (presentWait.sleep == 0.0), "only just-in-time mode sleeps");
+			out << "latency off " << off.latency << " ms, present wait " << presentWait.latency << " ms, just in time " << justInTime.latency << " ms\n";
+
+			return test.failed();
+		}
+	};//class FramePacer
+
+}//vks
@@ -0,0 +1,326 @@
+/*
+* Pipeline statistics and device memory instrumentation
+*
+* Pipeline statistics are collected per pass with a query pool that is split into slots like the GPU regions of vks::Profiler
+* (one slot per command buffer that is recorded or submitted in turn), results are read back when a slot is reused
+* Device memory is reported from the allocation tracker of vks::VulkanDevice and, if VK_EXT_memory_budget is enabled, from the driver's heap budgets
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <iostream>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanUIOverlay.h"
+#include "AllocationTracker.hpp"
+#include "benchmark.hpp"
+
+// Maximum number of passes per slot
+#define INSTRUMENTATION_MAX_PASSES 16
+// Number of values written by a pipeline statistics query, in the order of the flag bits below
+#define INSTRUMENTATION_STATISTICS_COUNT 7
+
+namespace vks
+{
+	class Instrumentation
+	{
+	public:
+		struct PassStatistics
+		{
+			uint64_t last[INSTRUMENTATION_STATISTICS_COUNT] = {};
+			uint64_t sum[INSTRUMENTATION_STATISTICS_COUNT] = {};
+			uint64_t samples = 0;
+
+			double average(uint32_t statistic) const
+			{
+				return (samples > 0) ? (double)sum[statistic] / (double)samples : 0.0;
+			}
+		};
+
+		bool enabled = false;
+
+		static const char* statisticName(uint32_t statistic)
+		{
+			static const char* names[INSTRUMENTATION_STATISTICS_COUNT] = {
+				"vertices", "primitives", "vs invocations", "clip invocations", "clip primitives", "fs invocations", "cs invocations"
+			};
+			return names[statistic];
+		}
+
+	private:
+		struct Pass
+		{
+			std::string name;
+			bool closed;
+		};
+
+		struct Slot
+		{
+			std::vector<Pass> passes;
+			bool open = false; // Pipeline statistics queries can't be nested
+			bool pending = false; // Recorded and submitted, results not read back yet
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		// One per command buffer in flight, sized by prepareStatistics
+		std::vector<Slot> slots;
+		std::map<std::string, PassStatistics> passStatistics;
+		PFN_vkGetPhysicalDeviceMemoryProperties2KHR fpGetPhysicalDeviceMemoryProperties2 = nullptr;
+
+	public:
+		~Instrumentation()
+		{
+			destroy();
+		}
+
+		// getMemoryProperties2 is only passed if VK_EXT_memory_budget has been enabled on the device
+		void prepare(vks::VulkanDevice* device, PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2)
+		{
+			this->device = device;
+			fpGetPhysicalDeviceMemoryProperties2 = getMemoryProperties2;
+		}
+
+		// Creates the pipeline statistics query pool with the given number of slots (e.g. the swapchain image count) if the
+		// pipelineStatisticsQuery feature has been enabled, replacing the slots of an earlier call
+		void prepareStatistics(uint32_t slotCount)
+		{
+			destroy();
+			if (!device->m_enabledDeviceFeatures.pipelineStatisticsQuery)
+			{
+				std::cerr << "pipelineStatisticsQuery is not supported, pipeline statistics are disabled\n";
+				return;
+			}
+
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			queryPoolInfo.pipelineStatistics =
+				VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+			queryPoolInfo.queryCount = slotCount * INSTRUMENTATION_MAX_PASSES;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+			slots.assign(slotCount, Slot());
+		}
+
+		void destroy()
+		{
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+				queryPool = VK_NULL_HANDLE;
+			}
+			slots.clear();
+		}
+
+		bool statisticsEnabled() const
+		{
+			return enabled && (queryPool != VK_NULL_HANDLE);
+		}
+
+		// Slots beyond the count passed to prepareStatistics are not queried
+		bool slotEnabled(uint32_t slot) const
+		{
+			return statisticsEnabled() && (slot < slots.size());
+		}
+
+		// Starts recording the passes of a slot into a command buffer, outside of a render pass
+		// Results of the slot's previous submission are read back first
+		void beginSlot(VkCommandBuffer commandBuffer, uint32_t slot)
+		{
+			if (!slotEnabled(slot))
+			{
+				return;
+			}
+			collectSlot(slot);
+			slots[slot].passes.clear();
+			slots[slot].open = false;
+			vkCmdResetQueryPool(commandBuffer, queryPool, slot * INSTRUMENTATION_MAX_PASSES, INSTRUMENTATION_MAX_PASSES);
+		}
+
+		// Returns the index of the pass for endPass, passes beyond INSTRUMENTATION_MAX_PASSES are dropped
+		// A pass that is begun inside a render pass has to end in the same subpass
+		uint32_t beginPass(VkCommandBuffer commandBuffer, uint32_t slot, const char* name)
+		{
+			if (!slotEnabled(slot) || (slots[slot].passes.size() >= INSTRUMENTATION_MAX_PASSES))
+			{
+				return UINT32_MAX;
+			}
+			Slot& querySlot = slots[slot];
+			assert(!querySlot.open);
+			const uint32_t pass = (uint32_t)querySlot.passes.size();
+			querySlot.passes.push_back({ name, false });
+			querySlot.open = true;
+			vkCmdBeginQuery(commandBuffer, queryPool, slot * INSTRUMENTATION_MAX_PASSES + pass, 0);
+			return pass;
+		}
+
+		void endPass(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t pass)
+		{
+			if (!slotEnabled(slot) || (pass == UINT32_MAX))
+			{
+				return;
+			}
+			slots[slot].passes[pass].closed = true;
+			slots[slot].open = false;
+			vkCmdEndQuery(commandBuffer, queryPool, slot * INSTRUMENTATION_MAX_PASSES + pass);
+		}
+
+		// Call once the command buffer of the slot has been submitted
+		void submitSlot(uint32_t slot)
+		{
+			if (!slotEnabled(slot) || slots[slot].passes.empty())
+			{
+				return;
+			}
+			slots[slot].pending = true;
+		}
+
+		// Reads back the statistics of the slot's last submission without waiting, call before submitting the slot again
+		void collectSlot(uint32_t slot)
+		{
+			if (!slotEnabled(slot) || !slots[slot].pending)
+			{
+				return;
+			}
+			Slot& querySlot = slots[slot];
+			querySlot.pending = false;
+
+			const uint32_t queryCount = (uint32_t)querySlot.passes.size();
+			std::vector<uint64_t> values(queryCount * INSTRUMENTATION_STATISTICS_COUNT);
+			VkResult result = vkGetQueryPoolResults(device->logicalDevice, queryPool, slot * INSTRUMENTATION_MAX_PASSES, queryCount,
+				values.size() * sizeof(uint64_t), values.data(), INSTRUMENTATION_STATISTICS_COUNT * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			if (result == VK_NOT_READY)
+			{
+				// The slot was reused before the GPU finished it, drop its results
+				return;
+			}
+			VK_CHECK_RESULT(result);
+
+			for (uint32_t i = 0; i < queryCount; i++)
+			{
+				if (!querySlot.passes[i].closed)
+				{
+					continue;
+				}
+				PassStatistics& statistics = passStatistics[querySlot.passes[i].name];
+				for (uint32_t j = 0; j < INSTRUMENTATION_STATISTICS_COUNT; j++)
+				{
+					statistics.last[j] = values[i * INSTRUMENTATION_STATISTICS_COUNT + j];
+					statistics.sum[j] += statistics.last[j];
+				}//for_j
+				statistics.samples++;
+			}//for_i
+		}
+
+		const std::map<std::string, PassStatistics>& getPassStatistics() const { return passStatistics; }
+
+		// Budget and usage of this process per memory heap as reported by VK_EXT_memory_budget
+		bool getMemoryBudget(std::vector<VkDeviceSize>& heapBudgets, std::vector<VkDeviceSize>& heapUsages) const
+		{
+			if (fpGetPhysicalDeviceMemoryProperties2 == nullptr)
+			{
+				return false;
+			}
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+			budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+			VkPhysicalDeviceMemoryProperties2KHR memoryProperties2 = {};
+			memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+			memoryProperties2.pNext = &budgetProperties;
+			fpGetPhysicalDeviceMemoryProperties2(device->physicalDevice, &memoryProperties2);
+
+			const uint32_t heapCount = memoryProperties2.memoryProperties.memoryHeapCount;
+			heapBudgets.assign(budgetProperties.heapBudget, budgetProperties.heapBudget + heapCount);
+			heapUsages.assign(budgetProperties.heapUsage, budgetProperties.heapUsage + heapCount);
+			return true;
+		}
+
+		void drawUI(vks::UIOverlay* overlay)
+		{
+			if (!enabled || (device == nullptr))
+			{
+				return;
+			}
+			if (overlay->header("Memory"))
+			{
+				for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+				{
+					const AllocationTracker::Usage usage = device->allocationTracker.getCategoryUsage((MemoryCategory)i);
+					overlay->text("%s: %.2f MB in %u (peak %.2f MB)", memoryCategoryName((MemoryCategory)i), toMegabytes(usage.currentBytes), usage.liveAllocations, toMegabytes(usage.peakBytes));
+				}
+				std::vector<VkDeviceSize> heapBudgets, heapUsages;
+				const bool budget = getMemoryBudget(heapBudgets, heapUsages);
+				for (uint32_t i = 0; i < device->memoryProperties.memoryHeapCount; i++)
+				{
+					const AllocationTracker::Usage usage = device->allocationTracker.getHeapUsage(i);
+					if (budget)
+					{
+						overlay->text("heap %u: %.2f MB tracked, %.2f / %.2f MB budget", i, toMegabytes(usage.currentBytes), toMegabytes(heapUsages[i]), toMegabytes(heapBudgets[i]));
+					}
+					else
+					{
+						overlay->text("heap %u: %.2f MB tracked of %.2f MB", i, toMegabytes(usage.currentBytes), toMegabytes(device->memoryProperties.memoryHeaps[i].size));
+					}
+				}//for_i
+			}
+			if (statisticsEnabled() && overlay->header("Pipeline statistics"))
+			{
+				for (auto& statistics : passStatistics)
+				{
+					const uint64_t* last = statistics.second.last;
+					overlay->text("%s: vs %llu, prims %llu, fs %llu, cs %llu", statistics.first.c_str(), (unsigned long long)last[2], (unsigned long long)last[4],
+						(unsigned long long)last[5], (unsigned long long)last[6]);
+				}
+			}
+		}
+
+		// Adds the peak memory usage per category and the average pipeline statistics per pass to the benchmark report
+		void addCounters(vks::Benchmark& benchmark) const
+		{
+			if (!enabled || (device == nullptr))
+			{
+				return;
+			}
+			for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+			{
+				const AllocationTracker::Usage usage = device->allocationTracker.getCategoryUsage((MemoryCategory)i);
+				benchmark.setCounter(std::string("memory.") + memoryCategoryName((MemoryCategory)i) + ".peakMB", toMegabytes(usage.peakBytes));
+			}
+			std::vector<VkDeviceSize> heapBudgets, heapUsages;
+			if (getMemoryBudget(heapBudgets, heapUsages))
+			{
+				for (size_t i = 0; i < heapBudgets.size(); i++)
+				{
+					benchmark.setCounter("memory.heap" + std::to_string(i) + ".usageMB", toMegabytes(heapUsages[i]));
+					benchmark.setCounter("memory.heap" + std::to_string(i) + ".budgetMB", toMegabytes(heapBudgets[i]));
+				}
+			}
+			for (auto& statistics : passStatistics)
+			{
+				for (uint32_t j = 0; j < INSTRUMENTATION_STATISTICS_COUNT; j++)
+				{
+					benchmark.setCounter("pipeline." + statistics.first + "." + statisticName(j), statistics.second.average(j));
+				}
+			}
+		}
+
+		static double toMegabytes(VkDeviceSize bytes)
+		{
+			return (double)bytes / (1024.0 * 1024.0);
+		}
+	};//class Instrumentation
+
+}//vks
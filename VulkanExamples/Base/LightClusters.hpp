@@ -0,0 +1,476 @@
+/*
+* Clustered light culling
+*
+* Splits the view frustum into a grid of froxels (screen tiles x exponential depth slices) and assigns lights to every
+* froxel whose view space bounding box they touch. The result is a per cluster (offset, count) pair and a light index
+* list that can be uploaded to storage buffers, so a deferred composition pass only shades the lights of its cluster
+* Assignment only tests the clusters in the depth, column and row range of a light, four clusters at a time with SSE2
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <ostream>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "SelfTest.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define LIGHT_CLUSTERS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Default grid size, tiles are a fraction of the screen so the cluster count doesn't depend on the resolution
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+// Lights stored per cluster, further lights of a cluster are dropped (in light order)
+#define LIGHT_CLUSTER_MAX_LIGHTS 256
+
+namespace vks
+{
+	class LightClusterGrid
+	{
+	private:
+		// View space bounding boxes of the clusters (structure of arrays, padded by three floats for the SIMD tests)
+		std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+		// Bounds of all clusters in a column (x) or row (y) of a slice, used to find the clusters a light can touch
+		std::vector<float> columnMinX, columnMaxX, rowMinY, rowMaxY;
+		// Distance of the slice boundaries from the camera
+		std::vector<float> sliceDepth;
+
+		// Cluster and light of every hit of the last assignment, in light order
+		std::vector<uint32_t> hitClusters;
+		std::vector<uint32_t> hitLights;
+		std::vector<uint32_t> counts;
+
+	public:
+		uint32_t tilesX = 0;
+		uint32_t tilesY = 0;
+		uint32_t slices = 0;
+		float zNear = 0.0f;
+		float zFar = 0.0f;
+		// slice = log(depth) * sliceScale + sliceBias
+		float sliceScale = 0.0f;
+		float sliceBias = 0.0f;
+		uint32_t maxLightsPerCluster = LIGHT_CLUSTER_MAX_LIGHTS;
+		bool useSimd = true;
+
+		// Results of the last assignment: offset and count into lightIndices for every cluster
+		std::vector<uint32_t> clusters;
+		std::vector<uint32_t> lightIndices;
+		// Clusters that had more than maxLightsPerCluster lights
+		uint32_t overflowClusters = 0;
+
+		uint32_t getClusterCount() const
+		{
+			return tilesX * tilesY * slices;
+		}
+
+		uint32_t getClusterIndex(uint32_t x, uint32_t y, uint32_t slice) const
+		{
+			return (slice * tilesY + y) * tilesX + x;
+		}
+
+		// Slice of a view space depth (distance along the view direction), same as in the composition shader
+		uint32_t getSlice(float depth) const
+		{
+			const float slice = std::log(std::max(depth, 1e-6f)) * sliceScale + sliceBias;
+			return static_cast<uint32_t>(std::min(std::max(slice, 0.0f), static_cast<float>(slices - 1)));
+		}
+
+		// Sets up the grid for a perspective projection with the given depth range (right handed view space, looking down -z)
+		void build(const glm::mat4& projection, float zNear, float zFar, uint32_t tilesX = LIGHT_CLUSTERS_X, uint32_t tilesY = LIGHT_CLUSTERS_Y, uint32_t slices = LIGHT_CLUSTERS_Z)
+		{
+			this->tilesX = tilesX;
+			this->tilesY = tilesY;
+			this->slices = slices;
+			this->zNear = zNear;
+			this->zFar = zFar;
+			sliceScale = static_cast<float>(slices) / std::log(zFar / zNear);
+			sliceBias = -std::log(zNear) * sliceScale;
+
+			sliceDepth.resize(slices + 1);
+			for (uint32_t s = 0; s <= slices; s++)
+			{
+				sliceDepth[s] = zNear * std::pow(zFar / zNear, static_cast<float>(s) / static_cast<float>(slices));
+			}
+			sliceDepth[slices] = zFar;
+
+			// View space direction through a point on the screen, scaled to a depth of one
+			const glm::mat4 inverseProjection = glm::inverse(projection);
+			auto getRay = [&](uint32_t x, uint32_t y)
+			{
+				const glm::vec4 ndc(-1.0f + 2.0f * static_cast<float>(x) / static_cast<float>(tilesX), -1.0f + 2.0f * static_cast<float>(y) / static_cast<float>(tilesY), 1.0f, 1.0f);
+				glm::vec4 point = inverseProjection * ndc;
+				glm::vec3 ray = glm::vec3(point) / point.w;
+				return ray / -ray.z;
+			};
+
+			const uint32_t count = getClusterCount();
+			// A group of four read by testRowSimd may start at the last cluster, so three floats past the end have to be readable
+			const uint32_t padded = count + 3;
+			for (std::vector<float>* bounds : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ })
+			{
+				bounds->assign(padded, 0.0f);
+			}
+			columnMinX.assign(slices * tilesX, FLT_MAX);
+			columnMaxX.assign(slices * tilesX, -FLT_MAX);
+			rowMinY.assign(slices * tilesY, FLT_MAX);
+			rowMaxY.assign(slices * tilesY, -FLT_MAX);
+
+			for (uint32_t y = 0; y < tilesY; y++)
+			{
+				for (uint32_t x = 0; x < tilesX; x++)
+				{
+					const glm::vec3 rays[4] = { getRay(x, y), getRay(x + 1, y), getRay(x, y + 1), getRay(x + 1, y + 1) };
+					for (uint32_t s = 0; s < slices; s++)
+					{
+						glm::vec3 boxMin(FLT_MAX);
+						glm::vec3 boxMax(-FLT_MAX);
+						for (const glm::vec3& ray : rays)
+						{
+							for (float depth : { sliceDepth[s], sliceDepth[s + 1] })
+							{
+								boxMin = glm::min(boxMin, ray * depth);
+								boxMax = glm::max(boxMax, ray * depth);
+							}
+						}
+						const uint32_t index = getClusterIndex(x, y, s);
+						minX[index] = boxMin.x;
+						minY[index] = boxMin.y;
+						minZ[index] = -sliceDepth[s + 1];
+						maxX[index] = boxMax.x;
+						maxY[index] = boxMax.y;
+						maxZ[index] = -sliceDepth[s];
+						columnMinX[s * tilesX + x] = std::min(columnMinX[s * tilesX + x], boxMin.x);
+						columnMaxX[s * tilesX + x] = std::max(columnMaxX[s * tilesX + x], boxMax.x);
+						rowMinY[s * tilesY + y] = std::min(rowMinY[s * tilesY + y], boxMin.y);
+						rowMaxY[s * tilesY + y] = std::max(rowMaxY[s * tilesY + y], boxMax.y);
+					}//for_s
+				}//for_x
+			}//for_y
+		}
+
+		// Sphere against the bounding box of a cluster, this is the test the assignment has to match exactly
+		bool intersects(uint32_t index, const glm::vec4& light) const
+		{
+			const float dx = std::max(minX[index] - light.x, 0.0f) + std::max(light.x - maxX[index], 0.0f);
+			const float dy = std::max(minY[index] - light.y, 0.0f) + std::max(light.y - maxY[index], 0.0f);
+			const float dz = std::max(minZ[index] - light.z, 0.0f) + std::max(light.z - maxZ[index], 0.0f);
+			return dx * dx + dy * dy + dz * dz <= light.w * light.w;
+		}
+
+		// Assigns lights (view space center in xyz, range in w) to the clusters
+		void assign(const std::vector<glm::vec4>& lights)
+		{
+			hitClusters.clear();
+			hitLights.clear();
+
+			for (uint32_t lightIndex = 0; lightIndex < lights.size(); lightIndex++)
+			{
+				const glm::vec4& light = lights[lightIndex];
+				// The range checks use a slightly larger radius, so rounding can't skip a cluster that the box test accepts
+				const float radius = light.w * 1.001f;
+				const float depthMin = -light.z - radius;
+				const float depthMax = -light.z + radius;
+				if ((depthMax < zNear) || (depthMin > zFar))
+				{
+					continue;
+				}
+				// One slice of margin on both ends, the box test below decides
+				const uint32_t firstSlice = (depthMin <= zNear) ? 0 : std::max(getSlice(depthMin), 1u) - 1;
+				const uint32_t lastSlice = std::min(getSlice(depthMax) + 1, slices - 1);
+
+				for (uint32_t s = firstSlice; s <= lastSlice; s++)
+				{
+					if ((-sliceDepth[s + 1] > light.z + radius) || (-sliceDepth[s] < light.z - radius))
+					{
+						continue;
+					}
+					uint32_t firstX = tilesX;
+					uint32_t lastX = 0;
+					for (uint32_t x = 0; x < tilesX; x++)
+					{
+						if ((columnMaxX[s * tilesX + x] >= light.x - radius) && (columnMinX[s * tilesX + x] <= light.x + radius))
+						{
+							firstX = std::min(firstX, x);
+							lastX = x;
+						}
+					}
+					uint32_t firstY = tilesY;
+					uint32_t lastY = 0;
+					for (uint32_t y = 0; y < tilesY; y++)
+					{
+						if ((rowMaxY[s * tilesY + y] >= light.y - radius) && (rowMinY[s * tilesY + y] <= light.y + radius))
+						{
+							firstY = std::min(firstY, y);
+							lastY = y;
+						}
+					}
+					if ((firstX > lastX) || (firstY > lastY))
+					{
+						continue;
+					}
+
+					for (uint32_t y = firstY; y <= lastY; y++)
+					{
+						const uint32_t rowStart = getClusterIndex(firstX, y, s);
+						const uint32_t rowCount = lastX - firstX + 1;
+#if defined(LIGHT_CLUSTERS_SSE2)
+						if (useSimd)
+						{
+							testRowSimd(rowStart, rowCount, light, lightIndex);
+							continue;
+						}
+#endif
+						for (uint32_t i = 0; i < rowCount; i++)
+						{
+							if (intersects(rowStart + i, light))
+							{
+								hitClusters.push_back(rowStart + i);
+								hitLights.push_back(lightIndex);
+							}
+						}//for_i
+					}//for_y
+				}//for_s
+			}//for_lightIndex
+
+			compact();
+		}
+
+		// Brute force assignment that tests every light against every cluster, for validation
+		void assignReference(const std::vector<glm::vec4>& lights)
+		{
+			hitClusters.clear();
+			hitLights.clear();
+			for (uint32_t lightIndex = 0; lightIndex < lights.size(); lightIndex++)
+			{
+				for (uint32_t index = 0; index < getClusterCount(); index++)
+				{
+					if (intersects(index, lights[lightIndex]))
+					{
+						hitClusters.push_back(index);
+						hitLights.push_back(lightIndex);
+					}
+				}
+			}
+			compact();
+		}
+
+	private:
+#if defined(LIGHT_CLUSTERS_SSE2)
+		// Same arithmetic as intersects() for four neighbouring clusters, the bounds arrays are padded by three floats for the last group
+		void testRowSimd(uint32_t rowStart, uint32_t rowCount, const glm::vec4& light, uint32_t lightIndex)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 x = _mm_set1_ps(light.x);
+			const __m128 y = _mm_set1_ps(light.y);
+			const __m128 z = _mm_set1_ps(light.z);
+			const __m128 radiusSquared = _mm_set1_ps(light.w * light.w);
+			for (uint32_t i = 0; i < rowCount; i += 4)
+			{
+				const uint32_t index = rowStart + i;
+				const __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[index]), x), zero), _mm_max_ps(_mm_sub_ps(x, _mm_loadu_ps(&maxX[index])), zero));
+				const __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[index]), y), zero), _mm_max_ps(_mm_sub_ps(y, _mm_loadu_ps(&maxY[index])), zero));
+				const __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[index]), z), zero), _mm_max_ps(_mm_sub_ps(z, _mm_loadu_ps(&maxZ[index])), zero));
+				const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(distanceSquared, radiusSquared)));
+				if (rowCount - i < 4)
+				{
+					mask &= (1u << (rowCount - i)) - 1;
+				}
+				for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+				{
+					if (mask & 1)
+					{
+						hitClusters.push_back(index + lane);
+						hitLights.push_back(lightIndex);
+					}
+				}
+			}//for_i
+		}
+#endif
+
+		// Counting sort of the hits by cluster, stable so every cluster list stays in light order
+		void compact()
+		{
+			const uint32_t count = getClusterCount();
+			counts.assign(count, 0);
+			for (uint32_t cluster : hitClusters)
+			{
+				counts[cluster]++;
+			}
+			clusters.resize(count * 2);
+			overflowClusters = 0;
+			uint32_t offset = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (counts[i] > maxLightsPerCluster)
+				{
+					overflowClusters++;
+				}
+				clusters[i * 2] = offset;
+				clusters[i * 2 + 1] = std::min(counts[i], maxLightsPerCluster);
+				offset += clusters[i * 2 + 1];
+				counts[i] = 0;
+			}
+			lightIndices.resize(offset);
+			for (size_t i = 0; i < hitClusters.size(); i++)
+			{
+				const uint32_t cluster = hitClusters[i];
+				if (counts[cluster] < clusters[cluster * 2 + 1])
+				{
+					lightIndices[clusters[cluster * 2] + counts[cluster]++] = hitLights[i];
+				}
+			}
+		}
+
+		// Random lights in and around the view frustum of the test grid
+		static std::vector<glm::vec4> getRandomLights(uint32_t count, float maxRange, uint32_t seed)
+		{
+			std::default_random_engine rndGen(seed);
+			std::uniform_real_distribution<float> rndDist(-1.0f, 1.0f);
+			std::vector<glm::vec4> lights(count);
+			for (auto& light : lights)
+			{
+				const float depth = 1.0f + (rndDist(rndGen) * 0.5f + 0.5f) * 60.0f;
+				light = glm::vec4(rndDist(rndGen) * depth, rndDist(rndGen) * depth * 0.6f, -depth, (0.25f + std::abs(rndDist(rndGen))) * maxRange);
+			}
+			return lights;
+		}
+
+	public:
+		// Checks the assignment against the brute force reference and against the cluster lookup of the shader
+		// Returns the number of failed checks
+		static uint32_t selfTest(std::ostream& out)
+		{
+			vks::SelfTest test(out);
+
+			const float zNear = 0.1f;
+			const float zFar = 256.0f;
+			LightClusterGrid grid;
+			grid.build(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, zNear, zFar), zNear, zFar);
+			test.check(grid.getClusterCount() == LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z, "cluster count");
+			test.check((grid.getSlice(zNear) == 0) && (grid.getSlice(zFar * 2.0f) == LIGHT_CLUSTERS_Z - 1), "depth range maps to the first and last slice");
+
+			grid.assign({});
+			test.check(grid.lightIndices.empty() && (grid.clusters.size() == grid.getClusterCount() * 2), "no lights");
+
+			grid.assign({ glm::vec4(0.0f, 0.0f, 5.0f, 1.0f), glm::vec4(0.0f, 0.0f, -300.0f, 1.0f) });
+			test.check(grid.lightIndices.empty(), "lights behind the camera and beyond the far plane are not assigned");
+
+			// Lights crossing the near plane and lights covering many clusters are part of the set
+			std::vector<glm::vec4> lights = getRandomLights(2000, 2.0f, 1);
+			lights.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+			lights.push_back(glm::vec4(1.0f, -2.0f, -20.0f, 15.0f));
+
+			auto matchesReference = [&](bool useSimd)
+			{
+				LightClusterGrid reference = grid;
+				reference.assignReference(lights);
+				grid.useSimd = useSimd;
+				grid.assign(lights);
+				grid.useSimd = true;
+				return (grid.clusters == reference.clusters) && (grid.lightIndices == reference.lightIndices) && (grid.overflowClusters == reference.overflowClusters);
+			};
+			test.check(matchesReference(true), "SIMD assignment equals brute force reference");
+			test.check(matchesReference(false), "scalar assignment equals brute force reference");
+
+			grid.maxLightsPerCluster = 8;
+			test.check(matchesReference(true) && (grid.overflowClusters > 0), "capped cluster lists equal brute force reference");
+			bool capped = true;
+			for (uint32_t i = 0; i < grid.getClusterCount(); i++)
+			{
+				capped = capped && (grid.clusters[i * 2 + 1] <= 8);
+			}
+			test.check(capped, "cluster lists are capped");
+			grid.maxLightsPerCluster = LIGHT_CLUSTER_MAX_LIGHTS;
+
+			// Every point lit by a light must find that light in the cluster the shader computes for it
+			grid.assign(lights);
+			const glm::mat4 inverseProjection = glm::inverse(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, zNear, zFar));
+			std::default_random_engine rndGen(2);
+			std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+			bool conservative = true;
+			uint32_t litPoints = 0;
+			for (uint32_t i = 0; (i < 20000) && conservative; i++)
+			{
+				const float u = rndDist(rndGen);
+				const float v = rndDist(rndGen);
+				const float depth = zNear + std::pow(rndDist(rndGen), 2.0f) * 70.0f;
+				glm::vec4 point = inverseProjection * glm::vec4(u * 2.0f - 1.0f, v * 2.0f - 1.0f, 1.0f, 1.0f);
+				glm::vec3 ray = glm::vec3(point) / point.w;
+				const glm::vec3 position = ray / -ray.z * depth;
+
+				const uint32_t x = std::min(static_cast<uint32_t>(u * grid.tilesX), grid.tilesX - 1);
+				const uint32_t y = std::min(static_cast<uint32_t>(v * grid.tilesY), grid.tilesY - 1);
+				const uint32_t cluster = grid.getClusterIndex(x, y, grid.getSlice(depth));
+				const uint32_t* first = grid.lightIndices.data() + grid.clusters[cluster * 2];
+				const uint32_t* last = first + grid.clusters[cluster * 2 + 1];
+				for (uint32_t lightIndex = 0; lightIndex < lights.size(); lightIndex++)
+				{
+					// Points on the border of a light don't receive any light, so they are skipped
+					if (glm::length(position - glm::vec3(lights[lightIndex])) < lights[lightIndex].w * 0.999f)
+					{
+						litPoints++;
+						conservative = conservative && (std::find(first, last, lightIndex) != last);
+					}
+				}
+			}//for_i
+			test.check(conservative && (litPoints > 0), "lit points find their lights in the shader cluster");
+
+			return test.failed();
+		}
+
+		// Measures the assignment throughput for growing light counts
+		static void benchmark(std::ostream& out)
+		{
+			const float zNear = 0.1f;
+			const float zFar = 256.0f;
+			LightClusterGrid grid;
+			grid.build(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, zNear, zFar), zNear, zFar);
+			out << "Cluster grid " << grid.tilesX << "x" << grid.tilesY << "x" << grid.slices << "\n";
+			for (uint32_t lightCount : { 256u, 1024u, 4096u, 16384u })
+			{
+				const std::vector<glm::vec4> lights = getRandomLights(lightCount, 1.0f, lightCount);
+				for (int32_t mode = 0; mode < 3; mode++)
+				{
+					grid.useSimd = (mode == 0);
+					// Repeat until at least 100 ms were measured
+					uint32_t iterations = 0;
+					double time = 0.0;
+					while (time < 100.0)
+					{
+						auto tStart = std::chrono::high_resolution_clock::now();
+						if (mode == 2)
+						{
+							grid.assignReference(lights);
+						}
+						else
+						{
+							grid.assign(lights);
+						}
+						time += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+						iterations++;
+					}
+					const double timePerAssignment = time / iterations;
+					const char* modeName[3] = { "simd", "scalar", "brute force" };
+					out << lightCount << " lights, " << modeName[mode] << ": " << timePerAssignment << " ms, " << lightCount / timePerAssignment << " lights/ms, " << grid.lightIndices.size() << " indices" << "\n";
+				}//for_mode
+			}
+			grid.useSimd = true;
+		}
+	};//class LightClusterGrid
+
+}//vks
@@ -0,0 +1,445 @@
+/*
+* Quadric error metric mesh simplifier for generating level of detail chains
+*
+* Vertices are only ever collapsed onto one of their neighbours (half edge collapse), so all levels index the vertex buffer of the source mesh
+* and can be stored as additional index ranges next to it
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <functional>
+#include <initializer_list>
+#include <cmath>
+#include <cstdint>
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class MeshSimplifier
+	{
+	public:
+		struct Settings
+		{
+			// Largest error allowed for a collapse, relative to the extent of the mesh
+			float maxError = FLT_MAX;
+			// Weight of each vertex attribute (e.g. normal and uv components) relative to the squared position error
+			std::vector<float> attributeWeights;
+			// Vertices on open borders can't move, otherwise they may slide along their border
+			// Vertices on attribute seams (split vertices with the same position) are always locked
+			bool lockBorders = true;
+		};
+
+		struct Level
+		{
+			std::vector<uint32_t> indices;
+			float error; // In the units of the source positions
+		};
+
+		// attributes holds attributeCount floats per vertex and may be null if attributeCount is 0
+		MeshSimplifier(const glm::vec3* positions, const float* attributes, uint32_t attributeCount, size_t vertexCount, const uint32_t* indices, size_t indexCount, const Settings& settings)
+			: settings(settings), attributeCount(attributeCount), vertexCount(vertexCount), indices(indices, indices + indexCount)
+		{
+			this->settings.attributeWeights.resize(attributeCount, 0.0f);
+
+			// Positions are scaled to the unit cube, so the error limit and attribute weights don't depend on the size of the model
+			glm::vec3 min(FLT_MAX);
+			glm::vec3 max(-FLT_MAX);
+			for (uint32_t index : this->indices)
+			{
+				min = glm::min(min, positions[index]);
+				max = glm::max(max, positions[index]);
+			}
+			const glm::vec3 size = max - min;
+			extent = std::max(std::max(size.x, size.y), std::max(size.z, FLT_MIN));
+			this->positions.resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				this->positions[i] = (positions[i] - min) / extent;
+			}
+			if (attributeCount > 0)
+			{
+				this->attributes.assign(attributes, attributes + vertexCount * attributeCount);
+			}
+
+			classifyVertices();
+			computeQuadrics();
+		}
+
+		// Collapses edges until at most targetIndexCount indices are left or no collapse below the error limit remains
+		// Can be called repeatedly with decreasing targets, the error is always measured against the source mesh
+		void simplify(size_t targetIndexCount)
+		{
+			const size_t targetTriangleCount = targetIndexCount / 3;
+			while (indices.size() / 3 > targetTriangleCount)
+			{
+				buildAdjacency();
+				const std::vector<Collapse> collapses = collectCollapses();
+
+				// Collapses within one pass must not share vertices, each removes about two triangles
+				const size_t maxCollapses = (indices.size() / 3 - targetTriangleCount + 1) / 2 + 1;
+				std::vector<uint32_t> remap(vertexCount);
+				for (size_t i = 0; i < vertexCount; i++)
+				{
+					remap[i] = static_cast<uint32_t>(i);
+				}
+				std::vector<bool> touched(vertexCount, false);
+				const float maxCost = (settings.maxError < FLT_MAX) ? settings.maxError * settings.maxError : FLT_MAX;
+				size_t collapseCount = 0;
+				for (const Collapse& collapse : collapses)
+				{
+					if (collapse.distance > maxCost)
+					{
+						continue;
+					}
+					if (touched[collapse.from] || touched[collapse.to] || flipsTriangles(collapse.from, collapse.to))
+					{
+						continue;
+					}
+					remap[collapse.from] = collapse.to;
+					quadrics[collapse.to].add(quadrics[collapse.from]);
+					for (uint32_t j = 0; j < vertexTriangleCounts[collapse.from]; j++)
+					{
+						const uint32_t triangle = vertexTriangles[vertexTriangleOffsets[collapse.from] + j];
+						touched[indices[triangle * 3 + 0]] = true;
+						touched[indices[triangle * 3 + 1]] = true;
+						touched[indices[triangle * 3 + 2]] = true;
+					}
+					error = std::max(error, std::sqrt(collapse.distance));
+					if (++collapseCount >= maxCollapses)
+					{
+						break;
+					}
+				}//for collapse
+				if (collapseCount == 0)
+				{
+					break;
+				}
+
+				// Remove the triangles that became degenerate
+				size_t writeIndex = 0;
+				for (size_t i = 0; i < indices.size(); i += 3)
+				{
+					const uint32_t a = remap[indices[i + 0]];
+					const uint32_t b = remap[indices[i + 1]];
+					const uint32_t c = remap[indices[i + 2]];
+					if ((a != b) && (b != c) && (a != c))
+					{
+						indices[writeIndex++] = a;
+						indices[writeIndex++] = b;
+						indices[writeIndex++] = c;
+					}
+				}//for_i
+				indices.resize(writeIndex);
+			}//while
+		}
+
+		const std::vector<uint32_t>& getIndices() const
+		{
+			return indices;
+		}
+
+		// Largest geometric error of all collapses so far (without the attribute error), in the units of the source positions
+		float getError() const
+		{
+			return error * extent;
+		}
+
+		// Generates up to levelCount levels after the source mesh, each with about reduction times the indices of the previous one
+		// Stops early once the error limit prevents further reduction
+		static std::vector<Level> buildLodChain(const glm::vec3* positions, const float* attributes, uint32_t attributeCount, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+			uint32_t levelCount, float reduction, const Settings& settings)
+		{
+			std::vector<Level> levels;
+			MeshSimplifier simplifier(positions, attributes, attributeCount, vertexCount, indices, indexCount, settings);
+			size_t targetIndexCount = indexCount;
+			for (uint32_t i = 0; i < levelCount; i++)
+			{
+				const size_t previousIndexCount = simplifier.getIndices().size();
+				targetIndexCount = static_cast<size_t>(static_cast<float>(targetIndexCount) * reduction) / 3 * 3;
+				simplifier.simplify(targetIndexCount);
+				// No progress, further levels would be identical
+				if ((simplifier.getIndices().size() == previousIndexCount) || simplifier.getIndices().empty())
+				{
+					break;
+				}
+				levels.push_back({ simplifier.getIndices(), simplifier.getError() });
+			}
+			return levels;
+		}
+
+	private:
+		// Symmetric 4x4 matrix of the summed squared distances to the planes of the adjacent triangles, weighted by their area
+		struct Quadric
+		{
+			double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+			double b0 = 0.0, b1 = 0.0, b2 = 0.0, c = 0.0;
+			double area = 0.0;
+
+			void addPlane(const glm::dvec3& normal, double distance, double weight)
+			{
+				a00 += weight * normal.x * normal.x;
+				a01 += weight * normal.x * normal.y;
+				a02 += weight * normal.x * normal.z;
+				a11 += weight * normal.y * normal.y;
+				a12 += weight * normal.y * normal.z;
+				a22 += weight * normal.z * normal.z;
+				b0 += weight * normal.x * distance;
+				b1 += weight * normal.y * distance;
+				b2 += weight * normal.z * distance;
+				c += weight * distance * distance;
+				area += weight;
+			}
+
+			void add(const Quadric& other)
+			{
+				a00 += other.a00; a01 += other.a01; a02 += other.a02;
+				a11 += other.a11; a12 += other.a12; a22 += other.a22;
+				b0 += other.b0; b1 += other.b1; b2 += other.b2;
+				c += other.c;
+				area += other.area;
+			}
+
+			// Summed squared distance of p to all planes
+			double evaluate(const glm::dvec3& p) const
+			{
+				const double result = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+					+ 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+					+ 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+				return std::max(result, 0.0);
+			}
+		};
+
+		struct Collapse
+		{
+			uint32_t from;
+			uint32_t to;
+			float cost; // Squared error per area, orders the collapses
+			float distance; // Squared geometric error per area
+
+			bool operator<(const Collapse& other) const
+			{
+				return cost < other.cost;
+			}
+		};
+
+		enum VertexKind : uint8_t
+		{
+			VERTEX_MANIFOLD,
+			VERTEX_BORDER, // On an open border, may only move along it
+			VERTEX_LOCKED
+		};
+
+		Settings settings;
+		uint32_t attributeCount;
+		size_t vertexCount;
+		float extent = 1.0f;
+		float error = 0.0f;
+
+		std::vector<glm::vec3> positions;
+		std::vector<float> attributes;
+		std::vector<uint32_t> indices;
+		std::vector<Quadric> quadrics;
+		std::vector<VertexKind> vertexKinds;
+
+		// Triangles around each vertex, rebuilt before each pass
+		std::vector<uint32_t> vertexTriangleOffsets;
+		std::vector<uint32_t> vertexTriangleCounts;
+		std::vector<uint32_t> vertexTriangles;
+
+		static uint64_t edgeKey(uint32_t a, uint32_t b)
+		{
+			return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+		}
+
+		// Edges with a single triangle are either open borders or attribute seams, they are told apart by welding the vertices by position
+		void classifyVertices()
+		{
+			std::unordered_map<uint64_t, uint32_t> edgeTriangles;
+			std::unordered_map<uint64_t, uint32_t> weldedEdgeTriangles;
+			std::vector<uint32_t> welded(vertexCount);
+			{
+				struct PositionHash
+				{
+					size_t operator()(const glm::vec3& p) const
+					{
+						const std::hash<float> hash;
+						return hash(p.x) ^ (hash(p.y) * 31) ^ (hash(p.z) * 131);
+					}
+				};
+				std::unordered_map<glm::vec3, uint32_t, PositionHash> firstVertex;
+				for (size_t i = 0; i < vertexCount; i++)
+				{
+					welded[i] = firstVertex.emplace(positions[i], static_cast<uint32_t>(i)).first->second;
+				}
+			}
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				for (uint32_t e = 0; e < 3; e++)
+				{
+					const uint32_t a = indices[i + e];
+					const uint32_t b = indices[i + (e + 1) % 3];
+					edgeTriangles[edgeKey(a, b)]++;
+					weldedEdgeTriangles[edgeKey(welded[a], welded[b])]++;
+				}
+			}
+
+			vertexKinds.assign(vertexCount, VERTEX_MANIFOLD);
+			for (const auto& edge : edgeTriangles)
+			{
+				if (edge.second == 2)
+				{
+					continue;
+				}
+				const uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+				const uint32_t b = static_cast<uint32_t>(edge.first & 0xffffffff);
+				// Single triangle edges that are shared once welded are seams, non manifold edges are locked as well
+				const bool border = (edge.second == 1) && (weldedEdgeTriangles[edgeKey(welded[a], welded[b])] == 1) && !settings.lockBorders;
+				for (uint32_t v : { a, b })
+				{
+					vertexKinds[v] = (border && (vertexKinds[v] != VERTEX_LOCKED)) ? VERTEX_BORDER : VERTEX_LOCKED;
+				}
+			}
+		}
+
+		void computeQuadrics()
+		{
+			quadrics.assign(vertexCount, Quadric());
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				const glm::dvec3 p0 = positions[indices[i + 0]];
+				const glm::dvec3 p1 = positions[indices[i + 1]];
+				const glm::dvec3 p2 = positions[indices[i + 2]];
+				const glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+				const double length = glm::length(normal);
+				if (length <= 0.0)
+				{
+					continue;
+				}
+				const glm::dvec3 n = normal / length;
+				const double area = length * 0.5;
+				for (uint32_t j = 0; j < 3; j++)
+				{
+					quadrics[indices[i + j]].addPlane(n, -glm::dot(n, p0), area);
+				}
+			}
+		}
+
+		void buildAdjacency()
+		{
+			vertexTriangleCounts.assign(vertexCount, 0);
+			for (uint32_t index : indices)
+			{
+				vertexTriangleCounts[index]++;
+			}
+			vertexTriangleOffsets.resize(vertexCount);
+			uint32_t offset = 0;
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				vertexTriangleOffsets[i] = offset;
+				offset += vertexTriangleCounts[i];
+			}
+			vertexTriangles.resize(indices.size());
+			std::vector<uint32_t> fill(vertexCount, 0);
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				const uint32_t index = indices[i];
+				vertexTriangles[vertexTriangleOffsets[index] + fill[index]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		bool isBorderEdge(uint32_t a, uint32_t b) const
+		{
+			uint32_t count = 0;
+			for (uint32_t j = 0; j < vertexTriangleCounts[a]; j++)
+			{
+				const uint32_t triangle = vertexTriangles[vertexTriangleOffsets[a] + j];
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					count += (indices[triangle * 3 + k] == b) ? 1 : 0;
+				}
+			}
+			return count == 1;
+		}
+
+		// Error of moving from onto to: position quadric plus the weighted attribute change, both per area
+		Collapse evaluateCollapse(uint32_t from, uint32_t to) const
+		{
+			const Quadric& quadric = quadrics[from];
+			const double area = std::max(quadric.area, 1e-12);
+			const double distance = quadric.evaluate(glm::dvec3(positions[to])) / area;
+			double attributeError = 0.0;
+			for (uint32_t k = 0; k < attributeCount; k++)
+			{
+				const double difference = attributes[to * attributeCount + k] - attributes[from * attributeCount + k];
+				attributeError += settings.attributeWeights[k] * difference * difference;
+			}
+			return { from, to, static_cast<float>(distance + attributeError), static_cast<float>(distance) };
+		}
+
+		std::vector<Collapse> collectCollapses() const
+		{
+			std::vector<Collapse> collapses;
+			collapses.reserve(indices.size() * 2);
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				for (uint32_t e = 0; e < 3; e++)
+				{
+					const uint32_t a = indices[i + e];
+					const uint32_t b = indices[i + (e + 1) % 3];
+					for (uint32_t direction = 0; direction < 2; direction++)
+					{
+						const uint32_t from = direction ? b : a;
+						const uint32_t to = direction ? a : b;
+						if (vertexKinds[from] == VERTEX_LOCKED)
+						{
+							continue;
+						}
+						// Border vertices only move along their border, which keeps its shape
+						if ((vertexKinds[from] == VERTEX_BORDER) && ((vertexKinds[to] == VERTEX_MANIFOLD) || !isBorderEdge(from, to)))
+						{
+							continue;
+						}
+						collapses.push_back(evaluateCollapse(from, to));
+					}
+				}
+			}
+			std::sort(collapses.begin(), collapses.end());
+			return collapses;
+		}
+
+		// Rejects collapses that would turn any of the remaining triangles around from upside down
+		bool flipsTriangles(uint32_t from, uint32_t to) const
+		{
+			for (uint32_t j = 0; j < vertexTriangleCounts[from]; j++)
+			{
+				const uint32_t triangle = vertexTriangles[vertexTriangleOffsets[from] + j];
+				const uint32_t* corners = &indices[triangle * 3];
+				if ((corners[0] == to) || (corners[1] == to) || (corners[2] == to))
+				{
+					continue;
+				}
+				glm::vec3 p[3];
+				glm::vec3 q[3];
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					p[k] = positions[corners[k]];
+					q[k] = (corners[k] == from) ? positions[to] : p[k];
+				}
+				const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				const glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				if (glm::dot(before, after) <= 0.0f)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+}
@@ -0,0 +1,335 @@
+/*
+* Splits triangle lists into small clusters (meshlets) with bounds for cluster culling
+*
+* The triangles are reordered so that each meshlet is a contiguous range of the index buffer and can be drawn with a regular indexed draw
+* Each meshlet has a bounding sphere for frustum (and occlusion) culling and a normal cone for rejecting clusters that face away from the camera
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	struct Meshlet
+	{
+		uint32_t firstIndex; // Into the index buffer passed to buildMeshlets
+		uint32_t triangleCount;
+		uint32_t vertexCount; // Unique vertices
+		glm::vec3 center; // Bounding sphere
+		float radius;
+		glm::vec3 coneApex; // Normal cone, all triangles face away from cameras inside of it
+		glm::vec3 coneAxis;
+		float coneCutoff; // Sine of the cone angle, 1 if the triangles face too many directions for the cone to be useful
+	};
+
+	enum MeshletVisibility
+	{
+		MESHLET_VISIBLE,
+		MESHLET_OUTSIDE_FRUSTUM,
+		MESHLET_BACKFACING
+	};
+
+	namespace meshlets
+	{
+		// Geometric triangle normal (not normalized), if vertex normals are given it is flipped to their side, so the winding order of the source doesn't matter
+		inline glm::vec3 triangleNormal(const glm::vec3* positions, const glm::vec3* normals, const uint32_t* triangle)
+		{
+			const glm::vec3& p0 = positions[triangle[0]];
+			glm::vec3 normal = glm::cross(positions[triangle[1]] - p0, positions[triangle[2]] - p0);
+			if ((normals != nullptr) && (glm::dot(normal, normals[triangle[0]] + normals[triangle[1]] + normals[triangle[2]]) < 0.0f))
+			{
+				normal = -normal;
+			}
+			return normal;
+		}
+
+		// Spreads the bits of a 10 bit value to every third bit
+		inline uint32_t expandBits(uint32_t value)
+		{
+			value = (value | (value << 16)) & 0x030000ff;
+			value = (value | (value << 8)) & 0x0300f00f;
+			value = (value | (value << 4)) & 0x030c30c3;
+			value = (value | (value << 2)) & 0x09249249;
+			return value;
+		}
+
+		// Bounding sphere and normal cone of the triangles of a meshlet
+		inline void computeBounds(Meshlet& meshlet, const glm::vec3* positions, const glm::vec3* normals, const uint32_t* indices)
+		{
+			const uint32_t* triangles = indices + meshlet.firstIndex;
+			const uint32_t indexCount = meshlet.triangleCount * 3;
+
+			glm::vec3 min(FLT_MAX);
+			glm::vec3 max(-FLT_MAX);
+			for (uint32_t i = 0; i < indexCount; i++)
+			{
+				min = glm::min(min, positions[triangles[i]]);
+				max = glm::max(max, positions[triangles[i]]);
+			}
+			meshlet.center = (min + max) * 0.5f;
+			meshlet.radius = 0.0f;
+			for (uint32_t i = 0; i < indexCount; i++)
+			{
+				meshlet.radius = std::max(meshlet.radius, glm::length(positions[triangles[i]] - meshlet.center));
+			}
+
+			// The axis is the average normal, the cutoff follows from the normal that deviates most from it
+			std::vector<glm::vec3> triangleNormals(meshlet.triangleCount, glm::vec3(0.0f));
+			glm::vec3 axis(0.0f);
+			for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+			{
+				const glm::vec3 normal = triangleNormal(positions, normals, triangles + i * 3);
+				const float length = glm::length(normal);
+				if (length > 0.0f)
+				{
+					triangleNormals[i] = normal / length;
+					axis += triangleNormals[i];
+				}
+			}
+			meshlet.coneApex = meshlet.center;
+			meshlet.coneAxis = glm::vec3(0.0f);
+			meshlet.coneCutoff = 1.0f;
+			const float axisLength = glm::length(axis);
+			if (axisLength <= 0.0f)
+			{
+				return;
+			}
+			axis /= axisLength;
+			float minDot = 1.0f;
+			for (const glm::vec3& normal : triangleNormals)
+			{
+				if (normal != glm::vec3(0.0f))
+				{
+					minDot = std::min(minDot, glm::dot(normal, axis));
+				}
+			}
+			// Cones wider than about 85 degrees hardly ever reject anything
+			if (minDot <= 0.1f)
+			{
+				return;
+			}
+
+			// Move the apex back along the axis until all triangle planes are in front of it, so the test is exact for perspective projections
+			float maxT = 0.0f;
+			for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+			{
+				const glm::vec3& normal = triangleNormals[i];
+				if (normal != glm::vec3(0.0f))
+				{
+					maxT = std::max(maxT, glm::dot(meshlet.center - positions[triangles[i * 3]], normal) / glm::dot(normal, axis));
+				}
+			}
+			meshlet.coneApex = meshlet.center - axis * maxT;
+			meshlet.coneAxis = axis;
+			meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+		}
+	}
+
+	/*
+		Greedily grows meshlets over shared vertices, preferring triangles that add the fewest new vertices and stay close to the meshlet center
+		Seeds are taken in Morton order of the triangle centers, so meshlets of disconnected parts are still spatially coherent
+		The triangles of indices are reordered in place, the returned meshlets index into it
+	*/
+	inline std::vector<Meshlet> buildMeshlets(const glm::vec3* positions, const glm::vec3* normals, size_t vertexCount, std::vector<uint32_t>& indices,
+		uint32_t maxVertices = 64, uint32_t maxTriangles = 124)
+	{
+		const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+		std::vector<Meshlet> result;
+		if (triangleCount == 0)
+		{
+			return result;
+		}
+
+		// Triangles around each vertex
+		std::vector<uint32_t> vertexTriangleOffsets(vertexCount + 1, 0);
+		for (uint32_t i = 0; i < triangleCount * 3; i++)
+		{
+			vertexTriangleOffsets[indices[i] + 1]++;
+		}
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			vertexTriangleOffsets[i + 1] += vertexTriangleOffsets[i];
+		}
+		std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+		{
+			std::vector<uint32_t> fill(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end() - 1);
+			for (uint32_t i = 0; i < triangleCount * 3; i++)
+			{
+				vertexTriangles[fill[indices[i]]++] = i / 3;
+			}
+		}
+
+		std::vector<glm::vec3> centers(triangleCount);
+		glm::vec3 min(FLT_MAX);
+		glm::vec3 max(-FLT_MAX);
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			centers[i] = (positions[indices[i * 3 + 0]] + positions[indices[i * 3 + 1]] + positions[indices[i * 3 + 2]]) / 3.0f;
+			min = glm::min(min, centers[i]);
+			max = glm::max(max, centers[i]);
+		}
+		const glm::vec3 scale = 1023.0f / glm::max(max - min, glm::vec3(FLT_MIN));
+		std::vector<uint32_t> mortonCodes(triangleCount);
+		std::vector<uint32_t> seedOrder(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			const glm::uvec3 cell = glm::uvec3((centers[i] - min) * scale);
+			mortonCodes[i] = (meshlets::expandBits(cell.x) << 2) | (meshlets::expandBits(cell.y) << 1) | meshlets::expandBits(cell.z);
+			seedOrder[i] = i;
+		}
+		std::sort(seedOrder.begin(), seedOrder.end(), [&](uint32_t a, uint32_t b) { return mortonCodes[a] < mortonCodes[b]; });
+
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> vertexMeshlet(vertexCount, UINT32_MAX); // Last meshlet that used a vertex
+		std::vector<uint32_t> orderedIndices;
+		orderedIndices.reserve(indices.size());
+		std::vector<uint32_t> meshletVertices;
+		size_t seedPosition = 0;
+
+		while (orderedIndices.size() < triangleCount * 3)
+		{
+			const uint32_t meshletIndex = static_cast<uint32_t>(result.size());
+			Meshlet meshlet = {};
+			meshlet.firstIndex = static_cast<uint32_t>(orderedIndices.size());
+			meshletVertices.clear();
+			glm::vec3 centerSum(0.0f);
+
+			auto newVertexCount = [&](uint32_t triangle)
+			{
+				uint32_t count = 0;
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					count += (vertexMeshlet[indices[triangle * 3 + k]] != meshletIndex) ? 1 : 0;
+				}
+				return count;
+			};
+			auto addTriangle = [&](uint32_t triangle)
+			{
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					const uint32_t vertex = indices[triangle * 3 + k];
+					if (vertexMeshlet[vertex] != meshletIndex)
+					{
+						vertexMeshlet[vertex] = meshletIndex;
+						meshletVertices.push_back(vertex);
+					}
+					orderedIndices.push_back(vertex);
+				}
+				emitted[triangle] = true;
+				centerSum += centers[triangle];
+				meshlet.triangleCount++;
+			};
+
+			while (emitted[seedOrder[seedPosition]])
+			{
+				seedPosition++;
+			}
+			addTriangle(seedOrder[seedPosition]);
+
+			while (meshlet.triangleCount < maxTriangles)
+			{
+				const glm::vec3 center = centerSum / static_cast<float>(meshlet.triangleCount);
+				uint32_t best = UINT32_MAX;
+				uint32_t bestNewVertices = 4;
+				float bestDistance = FLT_MAX;
+				for (uint32_t vertex : meshletVertices)
+				{
+					for (uint32_t j = vertexTriangleOffsets[vertex]; j < vertexTriangleOffsets[vertex + 1]; j++)
+					{
+						const uint32_t triangle = vertexTriangles[j];
+						if (emitted[triangle])
+						{
+							continue;
+						}
+						const uint32_t newVertices = newVertexCount(triangle);
+						if (meshletVertices.size() + newVertices > maxVertices)
+						{
+							continue;
+						}
+						const float distance = glm::length(centers[triangle] - center);
+						if ((newVertices < bestNewVertices) || ((newVertices == bestNewVertices) && (distance < bestDistance)))
+						{
+							best = triangle;
+							bestNewVertices = newVertices;
+							bestDistance = distance;
+						}
+					}
+				}//for vertex
+
+				// Disconnected parts continue with the next seed if it is close enough to keep the bounds tight
+				if (best == UINT32_MAX)
+				{
+					while ((seedPosition < seedOrder.size()) && emitted[seedOrder[seedPosition]])
+					{
+						seedPosition++;
+					}
+					if (seedPosition == seedOrder.size())
+					{
+						break;
+					}
+					const uint32_t seed = seedOrder[seedPosition];
+					float spread = 0.0f;
+					for (uint32_t vertex : meshletVertices)
+					{
+						spread = std::max(spread, glm::length(positions[vertex] - center));
+					}
+					if ((meshletVertices.size() + newVertexCount(seed) > maxVertices) || (glm::length(centers[seed] - center) > 2.0f * spread))
+					{
+						break;
+					}
+					best = seed;
+				}
+				addTriangle(best);
+			}//while
+
+			meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+			result.push_back(meshlet);
+		}//while
+
+		indices.swap(orderedIndices);
+		for (Meshlet& meshlet : result)
+		{
+			meshlets::computeBounds(meshlet, positions, normals, indices.data());
+		}
+		return result;
+	}
+
+	// Frustum test of the bounding sphere (planes as in vks::Frustum) and normal cone test against the camera position
+	inline MeshletVisibility cullMeshlet(const Meshlet& meshlet, const glm::vec4* frustumPlanes, const glm::vec3& cameraPos)
+	{
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			if (glm::dot(glm::vec4(meshlet.center, 1.0f), frustumPlanes[i]) <= -meshlet.radius)
+			{
+				return MESHLET_OUTSIDE_FRUSTUM;
+			}
+		}
+		if (glm::dot(glm::normalize(meshlet.coneApex - cameraPos), meshlet.coneAxis) >= meshlet.coneCutoff)
+		{
+			return MESHLET_BACKFACING;
+		}
+		return MESHLET_VISIBLE;
+	}
+
+	// Number of triangles of the meshlet that face the camera, cone culling is conservative if this is 0 for every rejected meshlet
+	inline uint32_t countFrontFacingTriangles(const Meshlet& meshlet, const glm::vec3* positions, const glm::vec3* normals, const uint32_t* indices, const glm::vec3& cameraPos)
+	{
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+		{
+			const uint32_t* triangle = indices + meshlet.firstIndex + i * 3;
+			const glm::vec3 normal = meshlets::triangleNormal(positions, normals, triangle);
+			count += (glm::dot(normal, cameraPos - positions[triangle[0]]) > 0.0f) ? 1 : 0;
+		}
+		return count;
+	}
+}
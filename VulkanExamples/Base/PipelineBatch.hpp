@@ -0,0 +1,249 @@
+/*
+* Batched pipeline creation on several threads
+*
+* add() copies a pipeline create info with all state it points to, so the caller can keep changing its state structures
+* between pipelines like with direct vkCreate*Pipelines calls. create() then builds all pipelines of the batch in parallel,
+* the pipeline cache is shared (pipeline caches are internally synchronized)
+* pNext chains of the create info and its states are not copied
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+
+#include <vulkan/vulkan.h>
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class PipelineBatch
+	{
+	private:
+		struct ShaderStage
+		{
+			VkPipelineShaderStageCreateInfo stage;
+			std::string entryPoint;
+			VkSpecializationInfo specializationInfo;
+			std::vector<VkSpecializationMapEntry> mapEntries;
+			std::vector<uint8_t> data;
+
+			void copy(const VkPipelineShaderStageCreateInfo& source)
+			{
+				assert(source.pNext == nullptr);
+				stage = source;
+				entryPoint = source.pName;
+				stage.pName = entryPoint.c_str();
+				if (source.pSpecializationInfo)
+				{
+					specializationInfo = *source.pSpecializationInfo;
+					mapEntries.assign(specializationInfo.pMapEntries, specializationInfo.pMapEntries + specializationInfo.mapEntryCount);
+					const uint8_t* sourceData = static_cast<const uint8_t*>(specializationInfo.pData);
+					data.assign(sourceData, sourceData + specializationInfo.dataSize);
+					specializationInfo.pMapEntries = mapEntries.data();
+					specializationInfo.pData = data.data();
+					stage.pSpecializationInfo = &specializationInfo;
+				}
+			}
+		};
+
+		// Copies a state structure and returns the copy, or nullptr if the state isn't set
+		template <typename T>
+		static T* copyState(const T* source, T& target)
+		{
+			if (source == nullptr)
+			{
+				return nullptr;
+			}
+			assert(source->pNext == nullptr);
+			target = *source;
+			return &target;
+		}
+
+		template <typename T>
+		static const T* copyArray(const T* source, uint32_t count, std::vector<T>& target)
+		{
+			if (source == nullptr)
+			{
+				return nullptr;
+			}
+			target.assign(source, source + count);
+			return target.data();
+		}
+
+		struct GraphicsPipeline
+		{
+			VkGraphicsPipelineCreateInfo info;
+			std::vector<ShaderStage> shaderStages;
+			std::vector<VkPipelineShaderStageCreateInfo> stages;
+			VkPipelineVertexInputStateCreateInfo vertexInputState;
+			std::vector<VkVertexInputBindingDescription> vertexBindings;
+			std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+			VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
+			VkPipelineTessellationStateCreateInfo tessellationState;
+			VkPipelineViewportStateCreateInfo viewportState;
+			std::vector<VkViewport> viewports;
+			std::vector<VkRect2D> scissors;
+			VkPipelineRasterizationStateCreateInfo rasterizationState;
+			VkPipelineMultisampleStateCreateInfo multisampleState;
+			std::vector<VkSampleMask> sampleMask;
+			VkPipelineDepthStencilStateCreateInfo depthStencilState;
+			VkPipelineColorBlendStateCreateInfo colorBlendState;
+			std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+			VkPipelineDynamicStateCreateInfo dynamicState;
+			std::vector<VkDynamicState> dynamicStates;
+			VkPipeline* pipeline;
+		};
+
+		struct ComputePipeline
+		{
+			VkComputePipelineCreateInfo info;
+			ShaderStage shaderStage;
+			VkPipeline* pipeline;
+		};
+
+		// Entries are heap allocated so the pointers between the copies stay valid
+		std::vector<std::unique_ptr<GraphicsPipeline>> graphicsPipelines;
+		std::vector<std::unique_ptr<ComputePipeline>> computePipelines;
+
+	public:
+		// Time the last create() took in ms and the number of threads it used
+		double createTime = 0.0;
+		uint32_t threadCount = 0;
+
+		// Queues a graphics pipeline, the handle is written to pipeline by create()
+		void add(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* pipeline)
+		{
+			assert(createInfo.pNext == nullptr);
+			std::unique_ptr<GraphicsPipeline> entry(new GraphicsPipeline());
+			GraphicsPipeline& copy = *entry;
+			copy.info = createInfo;
+			copy.pipeline = pipeline;
+
+			copy.shaderStages.resize(createInfo.stageCount);
+			copy.stages.resize(createInfo.stageCount);
+			for (uint32_t i = 0; i < createInfo.stageCount; i++)
+			{
+				copy.shaderStages[i].copy(createInfo.pStages[i]);
+				copy.stages[i] = copy.shaderStages[i].stage;
+			}//for_i
+			copy.info.pStages = copy.stages.data();
+
+			if (copyState(createInfo.pVertexInputState, copy.vertexInputState))
+			{
+				copy.vertexInputState.pVertexBindingDescriptions = copyArray(createInfo.pVertexInputState->pVertexBindingDescriptions, createInfo.pVertexInputState->vertexBindingDescriptionCount, copy.vertexBindings);
+				copy.vertexInputState.pVertexAttributeDescriptions = copyArray(createInfo.pVertexInputState->pVertexAttributeDescriptions, createInfo.pVertexInputState->vertexAttributeDescriptionCount, copy.vertexAttributes);
+				copy.info.pVertexInputState = &copy.vertexInputState;
+			}
+			copy.info.pInputAssemblyState = copyState(createInfo.pInputAssemblyState, copy.inputAssemblyState);
+			copy.info.pTessellationState = copyState(createInfo.pTessellationState, copy.tessellationState);
+			if (copyState(createInfo.pViewportState, copy.viewportState))
+			{
+				copy.viewportState.pViewports = copyArray(createInfo.pViewportState->pViewports, createInfo.pViewportState->viewportCount, copy.viewports);
+				copy.viewportState.pScissors = copyArray(createInfo.pViewportState->pScissors, createInfo.pViewportState->scissorCount, copy.scissors);
+				copy.info.pViewportState = &copy.viewportState;
+			}
+			copy.info.pRasterizationState = copyState(createInfo.pRasterizationState, copy.rasterizationState);
+			if (copyState(createInfo.pMultisampleState, copy.multisampleState))
+			{
+				const uint32_t sampleMaskWords = (static_cast<uint32_t>(createInfo.pMultisampleState->rasterizationSamples) + 31) / 32;
+				copy.multisampleState.pSampleMask = copyArray(createInfo.pMultisampleState->pSampleMask, sampleMaskWords, copy.sampleMask);
+				copy.info.pMultisampleState = &copy.multisampleState;
+			}
+			copy.info.pDepthStencilState = copyState(createInfo.pDepthStencilState, copy.depthStencilState);
+			if (copyState(createInfo.pColorBlendState, copy.colorBlendState))
+			{
+				copy.colorBlendState.pAttachments = copyArray(createInfo.pColorBlendState->pAttachments, createInfo.pColorBlendState->attachmentCount, copy.blendAttachments);
+				copy.info.pColorBlendState = &copy.colorBlendState;
+			}
+			if (copyState(createInfo.pDynamicState, copy.dynamicState))
+			{
+				copy.dynamicState.pDynamicStates = copyArray(createInfo.pDynamicState->pDynamicStates, createInfo.pDynamicState->dynamicStateCount, copy.dynamicStates);
+				copy.info.pDynamicState = &copy.dynamicState;
+			}
+
+			graphicsPipelines.push_back(std::move(entry));
+		}
+
+		// Queues a compute pipeline, the handle is written to pipeline by create()
+		void add(const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline)
+		{
+			assert(createInfo.pNext == nullptr);
+			std::unique_ptr<ComputePipeline> entry(new ComputePipeline());
+			entry->info = createInfo;
+			entry->shaderStage.copy(createInfo.stage);
+			entry->info.stage = entry->shaderStage.stage;
+			entry->pipeline = pipeline;
+			computePipelines.push_back(std::move(entry));
+		}
+
+		size_t size() const
+		{
+			return graphicsPipelines.size() + computePipelines.size();
+		}
+
+		// Creates all queued pipelines with up to maxThreads threads (0 = one per hardware thread) and clears the batch
+		void create(VkDevice device, VkPipelineCache pipelineCache, uint32_t maxThreads = 0)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			const uint32_t count = static_cast<uint32_t>(size());
+			if (maxThreads == 0)
+			{
+				maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+			}
+			threadCount = std::max(std::min(maxThreads, count), 1u);
+
+			// Pipelines are assigned round robin, the calling thread takes the first share
+			std::vector<VkResult> results(threadCount, VK_SUCCESS);
+			auto createShare = [&](uint32_t thread)
+			{
+				for (uint32_t i = thread; i < count; i += threadCount)
+				{
+					VkResult result;
+					if (i < graphicsPipelines.size())
+					{
+						GraphicsPipeline& entry = *graphicsPipelines[i];
+						result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &entry.info, nullptr, entry.pipeline);
+					}
+					else
+					{
+						ComputePipeline& entry = *computePipelines[i - graphicsPipelines.size()];
+						result = vkCreateComputePipelines(device, pipelineCache, 1, &entry.info, nullptr, entry.pipeline);
+					}
+					if (result != VK_SUCCESS)
+					{
+						results[thread] = result;
+					}
+				}//for_i
+			};
+
+			std::vector<std::thread> threads;
+			for (uint32_t thread = 1; thread < threadCount; thread++)
+			{
+				threads.push_back(std::thread(createShare, thread));
+			}
+			createShare(0);
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+			for (VkResult result : results)
+			{
+				VK_CHECK_RESULT(result);
+			}
+
+			graphicsPipelines.clear();
+			computePipelines.clear();
+			createTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		}
+	};//class PipelineBatch
+
+}//vks
@@ -0,0 +1,404 @@
+/*
+* Graphics pipeline libraries (VK_EXT_graphics_pipeline_library)
+*
+* A pipeline description is split into the four library parts of the extension: vertex input interface, pre-rasterization
+* shaders, fragment shader and fragment output interface. Each part only depends on the members of the description that
+* belong to it, so the parts are cached by these members and shared between variants: a variant that only changes the
+* fragment shader (e.g. its specialization constants) only compiles a new fragment shader library
+* link() either fast links the four parts, which is much cheaper than compiling a full pipeline, or links them with link
+* time optimization. The pipeline registry fast links variants at request time and relinks them optimized in the background
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <ostream>
+#include <iomanip>
+#include <limits>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+#include "VulkanTools.h"
+#include "ShaderModuleCache.hpp"
+#include "PipelineRegistry.hpp"
+
+namespace vks
+{
+	class GraphicsPipelineLibrary
+	{
+	public:
+		// Parts in the order they are passed to the link, the fragment shader part is the one that changes between variants
+		static const uint32_t PART_COUNT = 4;
+		static const uint32_t FRAGMENT_SHADER_PART = 2;
+
+		static VkGraphicsPipelineLibraryFlagBitsEXT getPartType(uint32_t index)
+		{
+			return static_cast<VkGraphicsPipelineLibraryFlagBitsEXT>(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT << index);
+		}
+
+		struct Statistics
+		{
+			uint32_t parts = 0;
+			// Parts reused for another variant
+			uint32_t partHits = 0;
+			uint32_t fastLinks = 0;
+			uint32_t optimizedLinks = 0;
+			// Times summed over all threads in ms
+			double partTime = 0.0;
+			double fastLinkTime = 0.0;
+			double optimizedLinkTime = 0.0;
+		};
+
+	private:
+		struct Part
+		{
+			VkGraphicsPipelineLibraryFlagBitsEXT type;
+			PipelineStateDesc desc;
+			VkPipeline library;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+		ShaderModuleCache* shaderModules = nullptr;
+
+		mutable std::mutex mutex;
+		std::vector<std::unique_ptr<Part>> cache;
+		std::unordered_multimap<uint64_t, size_t> lookup;
+		Statistics statistics;
+
+	public:
+		// Set by examples that want their pipeline variants linked from libraries (before the device is created)
+		bool requested = false;
+		// Extension and feature are available and enabled on the device
+		bool enabled = false;
+		// Linking is guaranteed to be fast (VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT)
+		bool fastLinking = false;
+		// Chained into the device creation by the base when the feature is supported
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+
+		~GraphicsPipelineLibrary()
+		{
+			destroy();
+		}
+
+		void prepare(VkDevice device, VkPipelineCache pipelineCache, ShaderModuleCache* shaderModules)
+		{
+			this->device = device;
+			this->pipelineCache = pipelineCache;
+			this->shaderModules = shaderModules;
+		}
+
+		// Members of a description that belong to a part, all others are left at their defaults
+		// The dynamic states are kept for all parts, states that don't belong to a part are ignored by its library
+		static PipelineStateDesc partDesc(const PipelineStateDesc& desc, VkGraphicsPipelineLibraryFlagBitsEXT type)
+		{
+			PipelineStateDesc part;
+			part.dynamicStates = desc.dynamicStates;
+			switch (type)
+			{
+			case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+				part.vertexBindings = desc.vertexBindings;
+				part.vertexAttributes = desc.vertexAttributes;
+				part.topology = desc.topology;
+				break;
+			case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+				part.layout = desc.layout;
+				part.renderPass = desc.renderPass;
+				part.subpass = desc.subpass;
+				part.vertexShader = desc.vertexShader;
+				part.specializationStages = desc.specializationStages & VK_SHADER_STAGE_VERTEX_BIT;
+				if (part.specializationStages != 0)
+				{
+					part.specializationConstants = desc.specializationConstants;
+				}
+				part.polygonMode = desc.polygonMode;
+				part.cullMode = desc.cullMode;
+				part.frontFace = desc.frontFace;
+				break;
+			case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+				part.layout = desc.layout;
+				part.renderPass = desc.renderPass;
+				part.subpass = desc.subpass;
+				part.fragmentShader = desc.fragmentShader;
+				part.specializationStages = desc.specializationStages & VK_SHADER_STAGE_FRAGMENT_BIT;
+				if (part.specializationStages != 0)
+				{
+					part.specializationConstants = desc.specializationConstants;
+				}
+				part.depthTest = desc.depthTest;
+				part.depthWrite = desc.depthWrite;
+				part.depthCompareOp = desc.depthCompareOp;
+				part.samples = desc.samples;
+				break;
+			default:
+				part.renderPass = desc.renderPass;
+				part.subpass = desc.subpass;
+				part.blendEnable = desc.blendEnable;
+				part.samples = desc.samples;
+				break;
+			}
+			return part;
+		}
+
+		// Returns the library of a part of the description, created on first use (thread safe)
+		VkPipeline getPart(const PipelineStateDesc& desc, VkGraphicsPipelineLibraryFlagBitsEXT type)
+		{
+			std::unique_ptr<Part> part(new Part());
+			part->type = type;
+			part->desc = partDesc(desc, type);
+			const uint64_t hash = part->desc.hash() ^ static_cast<uint64_t>(type);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				VkPipeline cached = find(*part, hash);
+				if (cached != VK_NULL_HANDLE)
+				{
+					statistics.partHits++;
+					return cached;
+				}
+			}
+
+			// Libraries are created outside of the lock, so the render thread isn't blocked by a worker creating a part
+			auto tStart = std::chrono::high_resolution_clock::now();
+			part->library = createPart(part->desc, type, pipelineCache);
+			auto tEnd = std::chrono::high_resolution_clock::now();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			VkPipeline existing = find(*part, hash);
+			if (existing != VK_NULL_HANDLE)
+			{
+				// Another thread created the same part in the meantime
+				vkDestroyPipeline(device, part->library, nullptr);
+				statistics.partHits++;
+				return existing;
+			}
+			statistics.parts++;
+			statistics.partTime += std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+			lookup.insert(std::make_pair(hash, cache.size()));
+			cache.push_back(std::move(part));
+			return cache.back()->library;
+		}
+
+		// Links the four parts of the description into a pipeline owned by the caller
+		// Without optimize the link is fast, with optimize it takes about as long as a full compile but the pipeline is as fast as a full one
+		VkPipeline link(const PipelineStateDesc& desc, bool optimize)
+		{
+			VkPipeline libraries[PART_COUNT];
+			for (uint32_t i = 0; i < PART_COUNT; i++)
+			{
+				libraries[i] = getPart(desc, getPartType(i));
+			}//for_i
+
+			auto tStart = std::chrono::high_resolution_clock::now();
+			const VkPipeline pipeline = linkParts(libraries, desc.layout, optimize, pipelineCache);
+			auto tEnd = std::chrono::high_resolution_clock::now();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			const double linkTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+			if (optimize)
+			{
+				statistics.optimizedLinks++;
+				statistics.optimizedLinkTime += linkTime;
+			}
+			else
+			{
+				statistics.fastLinks++;
+				statistics.fastLinkTime += linkTime;
+			}
+			return pipeline;
+		}
+
+		Statistics getStatistics() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return statistics;
+		}
+
+		// Pipelines linked from the libraries don't reference them, so the libraries can be destroyed before them
+		void destroy()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& part : cache)
+			{
+				vkDestroyPipeline(device, part->library, nullptr);
+			}
+			cache.clear();
+			lookup.clear();
+		}
+
+		// Compares compiling full pipelines with linking them from libraries for variants of constantID = 0..variants-1
+		// Nothing is cached (no pipeline cache, new libraries for each round), driver side shader caches can still hide compile
+		// times (e.g. the Mesa disk cache, disabled with MESA_SHADER_CACHE_DISABLE=true)
+		void benchmark(std::ostream& out, const PipelineStateDesc& desc, uint32_t constantID, uint32_t variants, uint32_t rounds = 5)
+		{
+			typedef std::chrono::high_resolution_clock Clock;
+			auto elapsed = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+
+			// Average and minimum per variant of full compile, fragment shader library, fast link, optimized link
+			const uint32_t measureCount = 4;
+			const char* measureNames[measureCount] = { "full compile", "fragment shader library", "fast link", "optimized link" };
+			double total[measureCount] = {};
+			double minimum[measureCount];
+			std::fill(minimum, minimum + measureCount, std::numeric_limits<double>::max());
+			double sharedTime = 0.0;
+
+			for (uint32_t round = 0; round < rounds; round++)
+			{
+				// Vertex input, pre-rasterization and fragment output libraries are shared by all variants
+				VkPipeline libraries[PART_COUNT];
+				auto tShared = Clock::now();
+				for (uint32_t i = 0; i < PART_COUNT; i++)
+				{
+					libraries[i] = (i == FRAGMENT_SHADER_PART) ? VK_NULL_HANDLE : createPart(partDesc(desc, getPartType(i)), getPartType(i), VK_NULL_HANDLE);
+				}//for_i
+				sharedTime += elapsed(tShared);
+
+				for (uint32_t variant = 0; variant < variants; variant++)
+				{
+					PipelineStateDesc variantDesc = desc;
+					variantDesc.setSpecializationConstant(constantID, variant);
+					double times[measureCount];
+
+					auto tStart = Clock::now();
+					VkPipeline full;
+					{
+						PipelineCreateState state(variantDesc, shaderModules);
+						VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &state.pipelineCI, nullptr, &full));
+					}
+					times[0] = elapsed(tStart);
+
+					tStart = Clock::now();
+					libraries[FRAGMENT_SHADER_PART] = createPart(partDesc(variantDesc, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT), VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, VK_NULL_HANDLE);
+					times[1] = elapsed(tStart);
+
+					tStart = Clock::now();
+					const VkPipeline fast = linkParts(libraries, desc.layout, false, VK_NULL_HANDLE);
+					times[2] = elapsed(tStart);
+
+					tStart = Clock::now();
+					const VkPipeline optimized = linkParts(libraries, desc.layout, true, VK_NULL_HANDLE);
+					times[3] = elapsed(tStart);
+
+					for (uint32_t i = 0; i < measureCount; i++)
+					{
+						total[i] += times[i];
+						minimum[i] = std::min(minimum[i], times[i]);
+					}//for_i
+					vkDestroyPipeline(device, full, nullptr);
+					vkDestroyPipeline(device, fast, nullptr);
+					vkDestroyPipeline(device, optimized, nullptr);
+					vkDestroyPipeline(device, libraries[FRAGMENT_SHADER_PART], nullptr);
+				}//for_variant
+
+				for (uint32_t i = 0; i < PART_COUNT; i++)
+				{
+					if (i != FRAGMENT_SHADER_PART)
+					{
+						vkDestroyPipeline(device, libraries[i], nullptr);
+					}
+				}//for_i
+			}//for_round
+
+			const double count = static_cast<double>(std::max(rounds * variants, 1u));
+			out << std::fixed << std::setprecision(3);
+			out << "Graphics pipeline library benchmark (" << variants << " variants, " << rounds << " rounds"
+				<< (fastLinking ? ", fast linking" : ", fast linking not guaranteed by the implementation") << "):\n";
+			out << "  shared libraries: " << sharedTime / std::max(rounds, 1u) << " ms per round\n";
+			for (uint32_t i = 0; i < measureCount; i++)
+			{
+				out << "  " << measureNames[i] << ": " << total[i] / count << " ms per variant (min " << minimum[i] << " ms)\n";
+			}//for_i
+			if ((total[2] > 0.0) && (total[1] + total[2] > 0.0))
+			{
+				out << std::setprecision(1) << "  fast link is " << total[0] / total[2] << "x faster than a full compile, "
+					<< total[0] / (total[1] + total[2]) << "x with the fragment shader library\n";
+			}
+		}
+
+	private:
+		// Expects the lock to be held
+		VkPipeline find(const Part& part, uint64_t hash) const
+		{
+			auto range = lookup.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				const Part& cached = *cache[it->second];
+				if ((cached.type == part.type) && (cached.desc == part.desc))
+				{
+					return cached.library;
+				}
+			}
+			return VK_NULL_HANDLE;
+		}
+
+		VkPipeline createPart(const PipelineStateDesc& desc, VkGraphicsPipelineLibraryFlagBitsEXT type, VkPipelineCache cache) const
+		{
+			PipelineCreateState state(desc, shaderModules);
+			VkGraphicsPipelineCreateInfo& pipelineCI = state.pipelineCI;
+
+			// Only the state of the part is passed (partDesc already cleared the layout and render pass where they don't apply)
+			// The libraries keep the information needed for optimized links
+			VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+			libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+			libraryInfo.flags = type;
+			pipelineCI.pNext = &libraryInfo;
+			pipelineCI.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+
+			const bool vertexInput = (type == VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+			const bool preRasterization = (type == VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+			const bool fragmentShader = (type == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+			const bool fragmentOutput = (type == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+			if (!vertexInput)
+			{
+				pipelineCI.pVertexInputState = nullptr;
+				pipelineCI.pInputAssemblyState = nullptr;
+			}
+			if (!preRasterization)
+			{
+				pipelineCI.pViewportState = nullptr;
+				pipelineCI.pRasterizationState = nullptr;
+			}
+			if (!fragmentShader)
+			{
+				pipelineCI.pDepthStencilState = nullptr;
+			}
+			if (!fragmentShader && !fragmentOutput)
+			{
+				pipelineCI.pMultisampleState = nullptr;
+			}
+			if (!fragmentOutput)
+			{
+				pipelineCI.pColorBlendState = nullptr;
+			}
+
+			VkPipeline library;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, cache, 1, &pipelineCI, nullptr, &library));
+			return library;
+		}
+
+		VkPipeline linkParts(const VkPipeline* libraries, VkPipelineLayout layout, bool optimize, VkPipelineCache cache) const
+		{
+			VkPipelineLibraryCreateInfoKHR linkInfo{};
+			linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+			linkInfo.libraryCount = PART_COUNT;
+			linkInfo.pLibraries = libraries;
+
+			VkGraphicsPipelineCreateInfo pipelineCI{};
+			pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			pipelineCI.pNext = &linkInfo;
+			pipelineCI.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+			pipelineCI.layout = layout;
+
+			VkPipeline pipeline;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, cache, 1, &pipelineCI, nullptr, &pipeline));
+			return pipeline;
+		}
+	};//class GraphicsPipelineLibrary
+
+}//vks
@@ -0,0 +1,615 @@
+/*
+* Pipeline variant registry
+*
+* A PipelineStateDesc holds everything that varies between the graphics pipelines of the examples (shaders, specialization
+* constants, vertex input and the fixed function state) by value, so it can be hashed and compared. The registry keeps one
+* pipeline per distinct description: requesting a description a second time returns the key of the first request
+* Variants are compiled on worker threads into the shared pipeline cache, until a variant is ready get() returns the
+* pipeline of its fallback, so an example can start rendering before all of its variants have been compiled
+* With link functions set (see GraphicsPipelineLibrary) a variant is fast linked from pipeline libraries when it is requested
+* and used until the optimized pipeline has been linked in the background
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <ostream>
+#include <cstring>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+#include "ShaderModuleCache.hpp"
+#include "ThreadPool.hpp"
+#include "SelfTest.hpp"
+
+namespace vks
+{
+	struct PipelineStateDesc
+	{
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		uint32_t subpass = 0;
+		// SPIR-V files, loaded through the shader module cache
+		std::string vertexShader;
+		std::string fragmentShader;
+		// Specialization constants (constant id and 32 bit value) of both stages, kept sorted by id
+		std::vector<std::pair<uint32_t, uint32_t>> specializationConstants;
+		// Stages the specialization constants are passed to, pipeline libraries share the stages without constants between variants
+		VkShaderStageFlags specializationStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		std::vector<VkVertexInputBindingDescription> vertexBindings;
+		std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+		VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		VkBool32 depthTest = VK_TRUE;
+		VkBool32 depthWrite = VK_TRUE;
+		VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		VkBool32 blendEnable = VK_FALSE;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+		std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		void setSpecializationConstant(uint32_t constantID, uint32_t value)
+		{
+			auto constant = std::lower_bound(specializationConstants.begin(), specializationConstants.end(), std::make_pair(constantID, 0u),
+				[](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) { return a.first < b.first; });
+			if ((constant != specializationConstants.end()) && (constant->first == constantID))
+			{
+				constant->second = value;
+			}
+			else
+			{
+				specializationConstants.insert(constant, std::make_pair(constantID, value));
+			}
+		}
+
+		void setSpecializationConstant(uint32_t constantID, float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			setSpecializationConstant(constantID, bits);
+		}
+
+		// Copies the bindings and attributes of a vertex input state (e.g. from vkglTF::Vertex::getPipelineVertexInputState)
+		void setVertexInput(const VkPipelineVertexInputStateCreateInfo* vertexInputState)
+		{
+			vertexBindings.assign(vertexInputState->pVertexBindingDescriptions, vertexInputState->pVertexBindingDescriptions + vertexInputState->vertexBindingDescriptionCount);
+			vertexAttributes.assign(vertexInputState->pVertexAttributeDescriptions, vertexInputState->pVertexAttributeDescriptions + vertexInputState->vertexAttributeDescriptionCount);
+		}
+
+		// 64 bit FNV-1a over all members, arrays are prefixed with their size
+		uint64_t hash() const
+		{
+			uint64_t value = vks::tools::hashSeed;
+			auto add = [&value](const void* data, size_t size)
+			{
+				value = vks::tools::hashBytes(data, size, value);
+			};
+			auto addArray = [&add](const void* data, size_t count, size_t elementSize)
+			{
+				const uint64_t size = count;
+				add(&size, sizeof(size));
+				add(data, count * elementSize);
+			};
+			add(&layout, sizeof(layout));
+			add(&renderPass, sizeof(renderPass));
+			add(&subpass, sizeof(subpass));
+			addArray(vertexShader.data(), vertexShader.size(), 1);
+			addArray(fragmentShader.data(), fragmentShader.size(), 1);
+			for (const auto& constant : specializationConstants)
+			{
+				add(&constant.first, sizeof(constant.first));
+				add(&constant.second, sizeof(constant.second));
+			}
+			add(&specializationStages, sizeof(specializationStages));
+			addArray(vertexBindings.data(), vertexBindings.size(), sizeof(VkVertexInputBindingDescription));
+			addArray(vertexAttributes.data(), vertexAttributes.size(), sizeof(VkVertexInputAttributeDescription));
+			add(&topology, sizeof(topology));
+			add(&polygonMode, sizeof(polygonMode));
+			add(&cullMode, sizeof(cullMode));
+			add(&frontFace, sizeof(frontFace));
+			add(&depthTest, sizeof(depthTest));
+			add(&depthWrite, sizeof(depthWrite));
+			add(&depthCompareOp, sizeof(depthCompareOp));
+			add(&blendEnable, sizeof(blendEnable));
+			add(&samples, sizeof(samples));
+			addArray(dynamicStates.data(), dynamicStates.size(), sizeof(VkDynamicState));
+			return value;
+		}
+
+		bool operator==(const PipelineStateDesc& other) const
+		{
+			// The vertex input descriptions only consist of 32 bit members, so they can be compared bytewise
+			auto equalArrays = [](const void* a, size_t countA, const void* b, size_t countB, size_t elementSize)
+			{
+				return (countA == countB) && ((countA == 0) || (memcmp(a, b, countA * elementSize) == 0));
+			};
+			return (layout == other.layout) && (renderPass == other.renderPass) && (subpass == other.subpass)
+				&& (vertexShader == other.vertexShader) && (fragmentShader == other.fragmentShader)
+				&& (specializationConstants == other.specializationConstants) && (specializationStages == other.specializationStages)
+				&& equalArrays(vertexBindings.data(), vertexBindings.size(), other.vertexBindings.data(), other.vertexBindings.size(), sizeof(VkVertexInputBindingDescription))
+				&& equalArrays(vertexAttributes.data(), vertexAttributes.size(), other.vertexAttributes.data(), other.vertexAttributes.size(), sizeof(VkVertexInputAttributeDescription))
+				&& (topology == other.topology) && (polygonMode == other.polygonMode) && (cullMode == other.cullMode) && (frontFace == other.frontFace)
+				&& (depthTest == other.depthTest) && (depthWrite == other.depthWrite) && (depthCompareOp == other.depthCompareOp)
+				&& (blendEnable == other.blendEnable) && (samples == other.samples) && (dynamicStates == other.dynamicStates);
+		}
+
+		bool operator!=(const PipelineStateDesc& other) const
+		{
+			return !(*this == other);
+		}
+	};//struct PipelineStateDesc
+
+	// Vulkan create info of a description, pipelineCI points into the members so the state can't be copied
+	// The vertex input and dynamic state arrays of the description are referenced, so it has to outlive the state
+	struct PipelineCreateState
+	{
+		std::vector<VkSpecializationMapEntry> mapEntries;
+		std::vector<uint32_t> specializationData;
+		VkSpecializationInfo specializationInfo{};
+		std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+		VkPipelineVertexInputStateCreateInfo vertexInputState{};
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
+		VkPipelineRasterizationStateCreateInfo rasterizationState;
+		VkPipelineColorBlendAttachmentState blendAttachmentState;
+		VkPipelineColorBlendStateCreateInfo colorBlendState;
+		VkPipelineDepthStencilStateCreateInfo depthStencilState;
+		VkPipelineViewportStateCreateInfo viewportState;
+		VkPipelineMultisampleStateCreateInfo multisampleState;
+		VkPipelineDynamicStateCreateInfo dynamicState;
+		VkGraphicsPipelineCreateInfo pipelineCI;
+
+		// Shader modules are loaded through the cache, stages without a shader file are left out
+		PipelineCreateState(const PipelineStateDesc& desc, ShaderModuleCache* shaderModules)
+		{
+			mapEntries.resize(desc.specializationConstants.size());
+			specializationData.resize(desc.specializationConstants.size());
+			for (size_t i = 0; i < desc.specializationConstants.size(); i++)
+			{
+				mapEntries[i].constantID = desc.specializationConstants[i].first;
+				mapEntries[i].offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+				mapEntries[i].size = sizeof(uint32_t);
+				specializationData[i] = desc.specializationConstants[i].second;
+			}
+			specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+			specializationInfo.pMapEntries = mapEntries.data();
+			specializationInfo.dataSize = specializationData.size() * sizeof(uint32_t);
+			specializationInfo.pData = specializationData.data();
+
+			// Map entries for constants a stage doesn't declare are ignored, so all specialized stages get all constants
+			for (const auto& shader : { std::make_pair(VK_SHADER_STAGE_VERTEX_BIT, &desc.vertexShader), std::make_pair(VK_SHADER_STAGE_FRAGMENT_BIT, &desc.fragmentShader) })
+			{
+				if (shader.second->empty())
+				{
+					continue;
+				}
+				VkPipelineShaderStageCreateInfo shaderStage{};
+				shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+				shaderStage.stage = shader.first;
+				shaderStage.module = shaderModules->load(*shader.second);
+				shaderStage.pName = "main";
+				shaderStage.pSpecializationInfo = (mapEntries.empty() || ((desc.specializationStages & shader.first) == 0)) ? nullptr : &specializationInfo;
+				assert(shaderStage.module != VK_NULL_HANDLE);
+				shaderStages.push_back(shaderStage);
+			}
+
+			vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+			vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+			vertexInputState.pVertexBindingDescriptions = desc.vertexBindings.data();
+			vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+			vertexInputState.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+			inputAssemblyState = vks::initializers::GenPipelineInputAssemblyStateCreateInfo(desc.topology, 0, VK_FALSE);
+			rasterizationState = vks::initializers::GenPipelineRasterizationStateCreateInfo(desc.polygonMode, desc.cullMode, desc.frontFace, 0);
+			blendAttachmentState = vks::initializers::GenPipelineColorBlendAttachmentState(0xf, desc.blendEnable);
+			if (desc.blendEnable)
+			{
+				blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+				blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+				blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+				blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+				blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+				blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+			}
+			colorBlendState = vks::initializers::GenPipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+			depthStencilState = vks::initializers::GenPipelineDepthStencilStateCreateInfo(desc.depthTest, desc.depthWrite, desc.depthCompareOp);
+			viewportState = vks::initializers::GenPipelineViewportStateCreateInfo(1, 1, 0);
+			multisampleState = vks::initializers::GenPipelineMultisampleStateCreateInfo(desc.samples, 0);
+			dynamicState = vks::initializers::GenPipelineDynamicStateCreateInfo(desc.dynamicStates);
+
+			pipelineCI = vks::initializers::GenPipelineCreateInfo(desc.layout, desc.renderPass, 0);
+			pipelineCI.subpass = desc.subpass;
+			pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
+			pipelineCI.pStages = shaderStages.data();
+			pipelineCI.pVertexInputState = &vertexInputState;
+			pipelineCI.pInputAssemblyState = &inputAssemblyState;
+			pipelineCI.pRasterizationState = &rasterizationState;
+			pipelineCI.pColorBlendState = &colorBlendState;
+			pipelineCI.pDepthStencilState = &depthStencilState;
+			pipelineCI.pViewportState = &viewportState;
+			pipelineCI.pMultisampleState = &multisampleState;
+			pipelineCI.pDynamicState = &dynamicState;
+		}
+
+		PipelineCreateState(const PipelineCreateState&) = delete;
+		PipelineCreateState& operator=(const PipelineCreateState&) = delete;
+	};//struct PipelineCreateState
+
+	class PipelineRegistry
+	{
+	public:
+		typedef uint32_t Key;
+		static const Key INVALID_KEY = ~0u;
+		// Creates the pipeline of a description, replaceable so the registry can be checked without a device
+		typedef std::function<VkPipeline(const PipelineStateDesc&)> CompileFunction;
+
+		struct Statistics
+		{
+			uint32_t requests = 0;
+			// Requests that returned the key of an earlier identical description
+			uint32_t dedupHits = 0;
+			uint32_t compiled = 0;
+			uint32_t pending = 0;
+			// Variants fast linked at request time
+			uint32_t fastLinked = 0;
+			double fastLinkTime = 0.0;
+			// Compile time summed over all pipelines (and threads) in ms
+			double compileTime = 0.0;
+			// Time from the first request until the last pipeline was ready in ms
+			double readyTime = 0.0;
+		};
+
+	private:
+		struct Entry
+		{
+			PipelineStateDesc desc;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			bool ready = false;
+			// Fast linked pipeline used until the compiled one is ready
+			VkPipeline linked = VK_NULL_HANDLE;
+			Key fallback = INVALID_KEY;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+		ShaderModuleCache* shaderModules = nullptr;
+		CompileFunction compileFunction;
+		CompileFunction linkFunction;
+
+		mutable std::mutex mutex;
+		// Entries are heap allocated so workers can keep a pointer while new variants are requested
+		std::vector<std::unique_ptr<Entry>> entries;
+		std::unordered_multimap<uint64_t, Key> lookup;
+		Statistics statistics;
+		std::chrono::high_resolution_clock::time_point firstRequest;
+		uint32_t readyGeneration = 0;
+		uint32_t seenGeneration = 0;
+
+		ThreadPool threadPool;
+		uint32_t threadCount = 0;
+		uint32_t nextThread = 0;
+
+	public:
+		// Compile requested variants on the calling thread (to compare startup times with the background compilation)
+		bool synchronous = false;
+
+		~PipelineRegistry()
+		{
+			destroy();
+		}
+
+		// threadCount = 0 uses one worker per hardware thread (minus the render thread)
+		void prepare(VkDevice device, VkPipelineCache pipelineCache, ShaderModuleCache* shaderModules, uint32_t threadCount = 0)
+		{
+			this->device = device;
+			this->pipelineCache = pipelineCache;
+			this->shaderModules = shaderModules;
+			this->threadCount = (threadCount > 0) ? threadCount : std::max(std::thread::hardware_concurrency(), 2u) - 1;
+			compileFunction = [this](const PipelineStateDesc& desc) { return createPipeline(desc); };
+		}
+
+		void setCompileFunction(CompileFunction function, uint32_t threadCount)
+		{
+			compileFunction = function;
+			this->threadCount = std::max(threadCount, 1u);
+		}
+
+		// Background requests are fast linked with fastLink right away, optimizedLink then replaces the compile function
+		void setLinkFunctions(CompileFunction fastLink, CompileFunction optimizedLink)
+		{
+			linkFunction = fastLink;
+			compileFunction = optimizedLink;
+		}
+
+		// Returns the key of the variant, compiled in the background unless background is false or the registry is synchronous
+		// Can be called from any thread, wait and destroy must not run at the same time
+		// Until it is ready, get() returns the pipeline of fallback (which should be a variant that is already compiled)
+		Key request(const PipelineStateDesc& desc, Key fallback = INVALID_KEY, bool background = true)
+		{
+			const uint64_t hash = desc.hash();
+			Entry* entry;
+			Key key;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (statistics.requests == 0)
+				{
+					firstRequest = std::chrono::high_resolution_clock::now();
+				}
+				statistics.requests++;
+				auto range = lookup.equal_range(hash);
+				for (auto it = range.first; it != range.second; ++it)
+				{
+					if (entries[it->second]->desc == desc)
+					{
+						statistics.dedupHits++;
+						return it->second;
+					}
+				}
+				key = static_cast<Key>(entries.size());
+				entries.push_back(std::unique_ptr<Entry>(new Entry()));
+				entry = entries.back().get();
+				entry->desc = desc;
+				entry->fallback = fallback;
+				lookup.insert(std::make_pair(hash, key));
+				statistics.pending++;
+			}
+
+			if (background && !synchronous)
+			{
+				if (linkFunction)
+				{
+					auto tStart = std::chrono::high_resolution_clock::now();
+					const VkPipeline linked = linkFunction(entry->desc);
+					auto tEnd = std::chrono::high_resolution_clock::now();
+					std::lock_guard<std::mutex> lock(mutex);
+					entry->linked = linked;
+					statistics.fastLinked++;
+					statistics.fastLinkTime += std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+				}
+				// The workers are created by the first background request, requests may come from several threads
+				std::lock_guard<std::mutex> lock(mutex);
+				if (threadPool.threads.empty())
+				{
+					threadPool.setThreadCount(threadCount);
+				}
+				threadPool.threads[nextThread]->addJob([this, entry] { compile(entry); });
+				nextThread = (nextThread + 1) % threadCount;
+			}
+			else
+			{
+				compile(entry);
+			}
+			return key;
+		}
+
+		// Pipeline of the variant, or its fast linked pipeline or that of its fallback while it's compiled, VK_NULL_HANDLE if none is ready
+		VkPipeline get(Key key) const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while (key != INVALID_KEY)
+			{
+				const Entry& entry = *entries[key];
+				if (entry.ready)
+				{
+					return entry.pipeline;
+				}
+				if (entry.linked != VK_NULL_HANDLE)
+				{
+					return entry.linked;
+				}
+				key = entry.fallback;
+			}
+			return VK_NULL_HANDLE;
+		}
+
+		bool isReady(Key key) const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return entries[key]->ready;
+		}
+
+		// Returns true once after variants got ready, command buffers binding get() results need to be rebuilt then
+		bool update()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			const bool changed = (seenGeneration != readyGeneration);
+			seenGeneration = readyGeneration;
+			return changed;
+		}
+
+		// Waits until all requested variants have been compiled
+		void wait()
+		{
+			threadPool.wait();
+		}
+
+		Statistics getStatistics() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return statistics;
+		}
+
+		void destroy()
+		{
+			threadPool.wait();
+			threadPool.threads.clear();
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& entry : entries)
+			{
+				if ((device != VK_NULL_HANDLE) && (entry->pipeline != VK_NULL_HANDLE))
+				{
+					vkDestroyPipeline(device, entry->pipeline, nullptr);
+				}
+				if ((device != VK_NULL_HANDLE) && (entry->linked != VK_NULL_HANDLE))
+				{
+					vkDestroyPipeline(device, entry->linked, nullptr);
+				}
+			}
+			entries.clear();
+			lookup.clear();
+		}
+
+		// Creates the pipeline of a description with the device, pipeline cache and shader modules given to prepare()
+		VkPipeline createPipeline(const PipelineStateDesc& desc) const
+		{
+			PipelineCreateState state(desc, shaderModules);
+			VkPipeline pipeline;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &state.pipelineCI, nullptr, &pipeline));
+			return pipeline;
+		}
+
+	private:
+		void compile(Entry* entry)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			const VkPipeline pipeline = compileFunction(entry->desc);
+			auto tEnd = std::chrono::high_resolution_clock::now();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			entry->pipeline = pipeline;
+			entry->ready = true;
+			readyGeneration++;
+			statistics.compiled++;
+			statistics.pending--;
+			statistics.compileTime += std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+			statistics.readyTime = std::chrono::duration<double, std::milli>(tEnd - firstRequest).count();
+		}
+
+	public:
+		// Checks hashing, deduplication and the fallback with a fake compile function, returns the number of failed checks
+		static uint32_t selfTest(std::ostream& out)
+		{
+			vks::SelfTest test(out);
+
+			PipelineStateDesc base;
+			base.vertexShader = "pipelines/phong.vert.spv";
+			base.fragmentShader = "pipelines/phong.frag.spv";
+			base.vertexBindings = { { 0, 48, VK_VERTEX_INPUT_RATE_VERTEX } };
+			base.vertexAttributes = { { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 }, { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, 12 } };
+
+			PipelineStateDesc copy = base;
+			test.check((copy == base) && (copy.hash() == base.hash()), "copies are equal and hash equal");
+
+			// Every kind of member has to change the description
+			std::vector<std::pair<const char*, std::function<void(PipelineStateDesc&)>>> changes =
+			{
+				{ "shader", [](PipelineStateDesc& desc) { desc.fragmentShader = "pipelines/toon.frag.spv"; } },
+				{ "shader moved between stages", [](PipelineStateDesc& desc) { desc.fragmentShader = desc.vertexShader + desc.fragmentShader; desc.vertexShader.clear(); } },
+				{ "specialization constant", [](PipelineStateDesc& desc) { desc.setSpecializationConstant(0, 1u); } },
+				{ "specialized stages", [](PipelineStateDesc& desc) { desc.specializationStages = VK_SHADER_STAGE_FRAGMENT_BIT; } },
+				{ "vertex attribute", [](PipelineStateDesc& desc) { desc.vertexAttributes[1].offset = 16; } },
+				{ "vertex attribute count", [](PipelineStateDesc& desc) { desc.vertexAttributes.pop_back(); } },
+				{ "polygon mode", [](PipelineStateDesc& desc) { desc.polygonMode = VK_POLYGON_MODE_LINE; } },
+				{ "cull mode", [](PipelineStateDesc& desc) { desc.cullMode = VK_CULL_MODE_NONE; } },
+				{ "blending", [](PipelineStateDesc& desc) { desc.blendEnable = VK_TRUE; } },
+				{ "depth write", [](PipelineStateDesc& desc) { desc.depthWrite = VK_FALSE; } },
+				{ "subpass", [](PipelineStateDesc& desc) { desc.subpass = 1; } },
+				{ "dynamic state", [](PipelineStateDesc& desc) { desc.dynamicStates.push_back(VK_DYNAMIC_STATE_LINE_WIDTH); } },
+			};
+			bool allDiffer = true;
+			for (auto& change : changes)
+			{
+				PipelineStateDesc changed = base;
+				change.second(changed);
+				if ((changed == base) || (changed.hash() == base.hash()))
+				{
+					out << "  unchanged by " << change.first << "\n";
+					allDiffer = false;
+				}
+			}
+			test.check(allDiffer, "every member changes equality and hash");
+
+			PipelineStateDesc a = base;
+			a.setSpecializationConstant(1, 0.5f);
+			a.setSpecializationConstant(0, 2u);
+			PipelineStateDesc b = base;
+			b.setSpecializationConstant(0, 1u);
+			b.setSpecializationConstant(1, 0.5f);
+			b.setSpecializationConstant(0, 2u);
+			test.check((a == b) && (a.hash() == b.hash()), "specialization constants don't depend on the order they were set in");
+
+			// Registry with a fake compile function, one variant is held back to check the fallback
+			std::atomic<uint32_t> compileCalls(0);
+			std::atomic<bool> release(false);
+			{
+				PipelineRegistry registry;
+				registry.setCompileFunction([&](const PipelineStateDesc& desc)
+				{
+					compileCalls++;
+					while ((desc.polygonMode == VK_POLYGON_MODE_LINE) && !release)
+					{
+						std::this_thread::yield();
+					}
+					return (VkPipeline)(uintptr_t)(desc.hash() | 1);
+				}, 2);
+
+				const Key phong = registry.request(base, INVALID_KEY, false);
+				PipelineStateDesc toonDesc = base;
+				toonDesc.fragmentShader = "pipelines/toon.frag.spv";
+				PipelineStateDesc wireframeDesc = base;
+				wireframeDesc.polygonMode = VK_POLYGON_MODE_LINE;
+				const Key toon = registry.request(toonDesc, phong);
+				const Key wireframe = registry.request(wireframeDesc, phong);
+				const Key toonAgain = registry.request(toonDesc, phong);
+				const Key phongAgain = registry.request(copy);
+				test.check((toonAgain == toon) && (phongAgain == phong) && (toon != phong) && (wireframe != toon), "identical descriptions share a key");
+
+				test.check(registry.isReady(phong) && (registry.get(phong) == (VkPipeline)(uintptr_t)(base.hash() | 1)), "synchronous request is ready");
+				test.check(!registry.isReady(wireframe) && (registry.get(wireframe) == registry.get(phong)), "fallback is used while a variant compiles");
+
+				release = true;
+				registry.wait();
+				test.check(registry.isReady(wireframe) && (registry.get(wireframe) == (VkPipeline)(uintptr_t)(wireframeDesc.hash() | 1)), "variant replaces the fallback once compiled");
+				test.check(registry.update() && !registry.update(), "update reports ready variants once");
+
+				const Statistics statistics = registry.getStatistics();
+				test.check((statistics.requests == 5) && (statistics.dedupHits == 2) && (statistics.compiled == 3) && (statistics.pending == 0) && (compileCalls == 3), "each distinct description is compiled once");
+			}
+
+			// Fast linked variants replace the fallback right away and are replaced by the optimized link
+			{
+				PipelineRegistry registry;
+				// One worker, the compile function is replaced by the optimized link
+				registry.setCompileFunction(nullptr, 1);
+				registry.setLinkFunctions([](const PipelineStateDesc& desc)
+				{
+					return (VkPipeline)(uintptr_t)((desc.hash() & ~3ull) | 2);
+				}, [&](const PipelineStateDesc& desc)
+				{
+					while (!release)
+					{
+						std::this_thread::yield();
+					}
+					return (VkPipeline)(uintptr_t)((desc.hash() & ~3ull) | 1);
+				});
+
+				release = true;
+				const Key phong = registry.request(base, INVALID_KEY, false);
+				release = false;
+				PipelineStateDesc toonDesc = base;
+				toonDesc.fragmentShader = "pipelines/toon.frag.spv";
+				const Key toon = registry.request(toonDesc, phong);
+				test.check(!registry.isReady(toon) && (registry.get(toon) == (VkPipeline)(uintptr_t)((toonDesc.hash() & ~3ull) | 2)), "fast linked variant is used while the optimized link runs");
+				release = true;
+				registry.wait();
+				const Statistics statistics = registry.getStatistics();
+				test.check((registry.get(toon) == (VkPipeline)(uintptr_t)((toonDesc.hash() & ~3ull) | 1)) && (statistics.fastLinked == 1) && (statistics.compiled == 2), "optimized link replaces the fast linked variant");
+			}
+
+			return test.failed();
+		}
+	};//class PipelineRegistry
+
+}//vks
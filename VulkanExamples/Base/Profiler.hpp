@@ -0,0 +1,509 @@
+/*
+* Scoped CPU and GPU region profiler
+*
+* CPU regions are timed with a high resolution clock on the thread they are recorded on
+* GPU regions write timestamps into a query pool that is split into slots, one per command buffer that is recorded or submitted in turn
+* (e.g. one per swapchain image or per frame in flight). The results of a slot are read back when it is reused, so they arrive a few frames late
+*
+* Aggregation and the Chrome trace writer only work on recorded events and don't need a device (see selfTest)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanUIOverlay.h"
+#include "SelfTest.hpp"
+
+// Maximum number of GPU regions per slot
+#define PROFILER_MAX_GPU_REGIONS 32
+// Number of samples the statistics of a region are computed over
+#define PROFILER_HISTORY_LENGTH 64
+
+namespace vks
+{
+	class Profiler
+	{
+	public:
+		// A finished region, times are in ms since the creation of the profiler
+		struct Event
+		{
+			std::string name;
+			double start;
+			double duration;
+			uint32_t thread; // Index of the recording thread, unused for GPU events
+			uint32_t depth; // Nesting depth of the region on its thread or in its command buffer
+			uint64_t frame; // Frame in which the region was recorded (CPU) or submitted (GPU)
+			bool gpu;
+		};
+
+		// Durations of the last PROFILER_HISTORY_LENGTH occurrences of a region
+		struct RegionStats
+		{
+			double history[PROFILER_HISTORY_LENGTH] = {};
+			uint32_t next = 0;
+			uint32_t count = 0;
+			double last = 0.0;
+
+			void add(double duration)
+			{
+				history[next] = duration;
+				next = (next + 1) % PROFILER_HISTORY_LENGTH;
+				count = std::min(count + 1, (uint32_t)PROFILER_HISTORY_LENGTH);
+				last = duration;
+			}
+			double average() const
+			{
+				double sum = 0.0;
+				for (uint32_t i = 0; i < count; i++)
+				{
+					sum += history[i];
+				}
+				return (count > 0) ? sum / count : 0.0;
+			}
+			double maximum() const
+			{
+				double result = 0.0;
+				for (uint32_t i = 0; i < count; i++)
+				{
+					result = std::max(result, history[i]);
+				}
+				return result;
+			}
+		};
+
+		// Times the lifetime of the scope on the calling thread
+		class CpuScope
+		{
+		private:
+			Profiler* profiler;
+			const char* name;
+			double start = 0.0;
+			uint32_t depth = 0;
+
+			static uint32_t& threadDepth()
+			{
+				static thread_local uint32_t depth = 0;
+				return depth;
+			}
+
+		public:
+			CpuScope(Profiler& profiler, const char* name) : profiler(profiler.enabled ? &profiler : nullptr), name(name)
+			{
+				if (this->profiler)
+				{
+					depth = threadDepth()++;
+					start = this->profiler->now();
+				}
+			}
+			~CpuScope()
+			{
+				if (profiler)
+				{
+					const double end = profiler->now();
+					threadDepth()--;
+					profiler->addCpuEvent(name, start, end - start, depth);
+				}
+			}
+		};
+
+		bool enabled = false;
+
+		// Chrome trace capture (chrome://tracing or https://ui.perfetto.dev), events of the first traceFrames frames are written to traceFilename
+		std::string traceFilename;
+		uint32_t traceFrames = 120;
+
+	private:
+		struct GpuRegion
+		{
+			std::string name;
+			uint32_t depth;
+			bool closed;
+		};
+
+		struct GpuSlot
+		{
+			std::vector<GpuRegion> regions;
+			uint32_t openRegions = 0;
+			bool pending = false; // Recorded and submitted, results not read back yet
+			uint64_t frame = 0;
+			double submitTime = 0.0;
+		};
+
+		std::chrono::high_resolution_clock::time_point epoch = std::chrono::high_resolution_clock::now();
+		std::mutex mutex;
+		std::map<std::thread::id, uint32_t> threadIndices;
+		std::vector<Event> frameEvents;
+		std::vector<Event> traceEvents;
+		std::map<std::string, RegionStats> cpuStats;
+		std::map<std::string, RegionStats> gpuStats;
+		uint64_t frameIndex = 0;
+		bool traceWritten = false;
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		double timestampPeriod = 1.0; // ns per tick
+		uint64_t timestampMask = ~0ull;
+		// One per command buffer in flight, sized by prepareGpu
+		std::vector<GpuSlot> slots;
+
+		void addCpuEvent(const char* name, double start, double duration, uint32_t depth)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto thread = threadIndices.find(std::this_thread::get_id());
+			if (thread == threadIndices.end())
+			{
+				thread = threadIndices.insert(std::make_pair(std::this_thread::get_id(), (uint32_t)threadIndices.size())).first;
+			}
+			frameEvents.push_back({ name, start, duration, thread->second, depth, frameIndex, false });
+		}
+
+		static std::string jsonString(const std::string& value)
+		{
+			std::string escaped = "\"";
+			for (char c : value)
+			{
+				if ((c == '"') || (c == '\\'))
+				{
+					escaped += '\\';
+				}
+				escaped += c;
+			}
+			return escaped + "\"";
+		}
+
+	public:
+		~Profiler()
+		{
+			destroyGpu();
+		}
+
+		double now() const
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - epoch).count();
+		}
+
+		uint64_t currentFrame() const { return frameIndex; }
+		const std::map<std::string, RegionStats>& getCpuStats() const { return cpuStats; }
+		const std::map<std::string, RegionStats>& getGpuStats() const { return gpuStats; }
+
+		// Adds a finished region, also used to feed events recorded elsewhere (e.g. replayed from a capture)
+		void addEvent(const Event& event)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (event.gpu)
+			{
+				gpuStats[event.name].add(event.duration);
+				if (event.frame < traceFrames)
+				{
+					traceEvents.push_back(event);
+				}
+			}
+			else
+			{
+				frameEvents.push_back(event);
+			}
+		}
+
+		// Aggregates the CPU events of the frame and writes the trace once all frames of the capture have been read back
+		void endFrame()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (const Event& event : frameEvents)
+			{
+				cpuStats[event.name].add(event.duration);
+			}
+			if (frameIndex < traceFrames)
+			{
+				traceEvents.insert(traceEvents.end(), frameEvents.begin(), frameEvents.end());
+			}
+			frameEvents.clear();
+			frameIndex++;
+			// GPU results of the last captured frames arrive up to one slot cycle later
+			if (!traceFilename.empty() && !traceWritten && (frameIndex == traceFrames + slots.size()))
+			{
+				writeChromeTrace(traceFilename);
+				traceWritten = true;
+			}
+		}
+
+		bool writeChromeTrace(const std::string& filename) const
+		{
+			std::ofstream trace(filename, std::ios::out);
+			if (!trace.is_open())
+			{
+				std::cerr << "Could not write profiler trace to " << filename << "\n";
+				return false;
+			}
+			writeChromeTrace(trace);
+			std::cout << "Saved profiler trace with " << traceEvents.size() << " events to " << filename << "\n";
+			return true;
+		}
+
+		// Writes the captured events in the Chrome trace event format, CPU threads and the GPU are shown as separate tracks
+		void writeChromeTrace(std::ostream& trace) const
+		{
+			trace << std::fixed << std::setprecision(3);
+			trace << "{\"traceEvents\":[\n";
+			trace << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+			trace << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}";
+			for (const Event& event : traceEvents)
+			{
+				// Trace timestamps and durations are in microseconds
+				trace << ",\n{\"name\":" << jsonString(event.name) << ",\"cat\":\"" << (event.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"ts\":" << event.start * 1000.0
+					<< ",\"dur\":" << event.duration * 1000.0 << ",\"pid\":" << (event.gpu ? 1 : 0) << ",\"tid\":" << event.thread << ",\"args\":{\"frame\":" << event.frame << "}}";
+			}
+			trace << "\n]}\n";
+		}
+
+		// Time between two timestamps in ms, the difference is taken modulo the valid bits so a counter wrap between them is handled
+		static double timestampDelta(uint64_t from, uint64_t to, uint64_t mask, double period)
+		{
+			return (double)((to - from) & mask) * period / 1000000.0;
+		}
+
+		// Creates the timestamp query pool with the given number of slots (e.g. the swapchain image count), replacing the slots of an earlier call
+		// GPU regions are ignored if the queue family doesn't support timestamps
+		void prepareGpu(vks::VulkanDevice* device, uint32_t queueFamilyIndex, uint32_t slotCount)
+		{
+			destroyGpu();
+			const uint32_t validBits = device->queueFamilyProperties[queueFamilyIndex].timestampValidBits;
+			if (validBits == 0)
+			{
+				std::cerr << "Queue family " << queueFamilyIndex << " doesn't support timestamps, GPU profiling is disabled\n";
+				return;
+			}
+			this->device = device;
+			timestampPeriod = device->properties.limits.timestampPeriod;
+			timestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = slotCount * PROFILER_MAX_GPU_REGIONS * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+			slots.assign(slotCount, GpuSlot());
+		}
+
+		void destroyGpu()
+		{
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+				queryPool = VK_NULL_HANDLE;
+			}
+			slots.clear();
+		}
+
+		bool gpuEnabled() const
+		{
+			return enabled && (queryPool != VK_NULL_HANDLE);
+		}
+
+		// Slots beyond the count passed to prepareGpu are not timed
+		bool gpuSlotEnabled(uint32_t slot) const
+		{
+			return gpuEnabled() && (slot < slots.size());
+		}
+
+		// Starts recording the regions of a slot into a command buffer, outside of a render pass
+		// Results of the slot's previous submission are read back first, all regions of a slot have to be closed before it is submitted
+		void beginGpuSlot(VkCommandBuffer commandBuffer, uint32_t slot)
+		{
+			if (!gpuSlotEnabled(slot))
+			{
+				return;
+			}
+			collectGpuSlot(slot);
+			slots[slot].regions.clear();
+			slots[slot].openRegions = 0;
+			vkCmdResetQueryPool(commandBuffer, queryPool, slot * PROFILER_MAX_GPU_REGIONS * 2, PROFILER_MAX_GPU_REGIONS * 2);
+		}
+
+		// Returns the index of the region for endGpuRegion, regions beyond PROFILER_MAX_GPU_REGIONS are dropped
+		uint32_t beginGpuRegion(VkCommandBuffer commandBuffer, uint32_t slot, const char* name)
+		{
+			if (!gpuSlotEnabled(slot) || (slots[slot].regions.size() >= PROFILER_MAX_GPU_REGIONS))
+			{
+				return UINT32_MAX;
+			}
+			GpuSlot& gpuSlot = slots[slot];
+			const uint32_t region = (uint32_t)gpuSlot.regions.size();
+			gpuSlot.regions.push_back({ name, gpuSlot.openRegions++, false });
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, (slot * PROFILER_MAX_GPU_REGIONS + region) * 2);
+			return region;
+		}
+
+		void endGpuRegion(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t region)
+		{
+			if (!gpuSlotEnabled(slot) || (region == UINT32_MAX))
+			{
+				return;
+			}
+			slots[slot].regions[region].closed = true;
+			slots[slot].openRegions--;
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, (slot * PROFILER_MAX_GPU_REGIONS + region) * 2 + 1);
+		}
+
+		// Call once the command buffer of the slot has been submitted
+		void submitGpuSlot(uint32_t slot)
+		{
+			if (!gpuSlotEnabled(slot) || slots[slot].regions.empty())
+			{
+				return;
+			}
+			slots[slot].pending = true;
+			slots[slot].frame = frameIndex;
+			slots[slot].submitTime = now();
+		}
+
+		// Reads back the timestamps of the slot's last submission without waiting, call before submitting the slot again
+		void collectGpuSlot(uint32_t slot)
+		{
+			if (!gpuSlotEnabled(slot) || !slots[slot].pending)
+			{
+				return;
+			}
+			GpuSlot& gpuSlot = slots[slot];
+			gpuSlot.pending = false;
+
+			const uint32_t queryCount = (uint32_t)gpuSlot.regions.size() * 2;
+			std::vector<uint64_t> timestamps(queryCount);
+			VkResult result = vkGetQueryPoolResults(device->logicalDevice, queryPool, slot * PROFILER_MAX_GPU_REGIONS * 2, queryCount,
+				timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			if (result == VK_NOT_READY)
+			{
+				// The slot was reused before the GPU finished it, drop its results
+				return;
+			}
+			VK_CHECK_RESULT(result);
+
+			// GPU timestamps have their own time base, the first region is aligned to the submission on the CPU timeline
+			const uint64_t base = timestamps[0] & timestampMask;
+			for (size_t i = 0; i < gpuSlot.regions.size(); i++)
+			{
+				if (!gpuSlot.regions[i].closed)
+				{
+					continue;
+				}
+				const uint64_t start = timestamps[i * 2] & timestampMask;
+				const uint64_t end = timestamps[i * 2 + 1] & timestampMask;
+				Event event;
+				event.name = gpuSlot.regions[i].name;
+				event.start = gpuSlot.submitTime + timestampDelta(base, start, timestampMask, timestampPeriod);
+				event.duration = timestampDelta(start, end, timestampMask, timestampPeriod);
+				event.thread = 0;
+				event.depth = gpuSlot.regions[i].depth;
+				event.frame = gpuSlot.frame;
+				event.gpu = true;
+				addEvent(event);
+			}//for_i
+		}
+
+		// Average and maximum time of all regions over the last PROFILER_HISTORY_LENGTH samples
+		void drawUI(vks::UIOverlay* overlay)
+		{
+			if (!enabled)
+			{
+				return;
+			}
+			if (overlay->header("Profiler"))
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (auto& stats : cpuStats)
+				{
+					overlay->text("CPU %s: %.3f ms (max %.3f)", stats.first.c_str(), stats.second.average(), stats.second.maximum());
+				}
+				for (auto& stats : gpuStats)
+				{
+					overlay->text("GPU %s: %.3f ms (max %.3f)", stats.first.c_str(), stats.second.average(), stats.second.maximum());
+				}
+			}
+		}
+
+		// Feeds synthetic CPU and GPU samples and checks the region statistics, the timestamp conversion and the Chrome trace output, returns the number of failed checks
+		static uint32_t selfTest(std::ostream& out)
+		{
+			vks::SelfTest test(out);
+
+			Profiler profiler;
+			profiler.enabled = true;
+			profiler.traceFrames = 2;
+			// The CPU region takes 1, 2, 3 and 4 ms in frames 0 to 3, the GPU region 2 and 6 ms in frames 0 and 1
+			for (uint32_t frame = 0; frame < 4; frame++)
+			{
+				profiler.addEvent({ "update", frame * 10.0, 1.0 + frame, 0, 0, frame, false });
+				if (frame < 2)
+				{
+					profiler.addEvent({ "scene \"main\"", frame * 10.0 + 2.0, 2.0 + frame * 4.0, 0, 0, frame, true });
+				}
+				profiler.endFrame();
+			}
+			const RegionStats& update = profiler.getCpuStats().at("update");
+			test.check((update.count == 4) && (update.average() == 2.5), "CPU region average");
+			test.check((update.maximum() == 4.0) && (update.last == 4.0), "CPU region maximum and last sample");
+			const RegionStats& scene = profiler.getGpuStats().at("scene \"main\"");
+			test.check((scene.count == 2) && (scene.average() == 4.0) && (scene.maximum() == 6.0), "GPU region average and maximum");
+			test.check(profiler.currentFrame() == 4, "endFrame advances the frame");
+
+			RegionStats history;
+			for (uint32_t i = 0; i < PROFILER_HISTORY_LENGTH + 8; i++)
+			{
+				history.add((i < 8) ? 100.0 : 1.0);
+			}
+			test.check((history.count == PROFILER_HISTORY_LENGTH) && (history.average() == 1.0) && (history.maximum() == 1.0), "statistics only cover the last samples");
+
+			{
+				CpuScope outer(profiler, "outer");
+				CpuScope inner(profiler, "inner");
+			}
+			profiler.endFrame();
+			test.check((profiler.getCpuStats().count("outer") == 1) && (profiler.getCpuStats().count("inner") == 1), "scopes are recorded");
+			test.check(profiler.getCpuStats().at("outer").last >= profiler.getCpuStats().at("inner").last, "outer scope contains the inner scope");
+			profiler.enabled = false;
+			{
+				CpuScope disabled(profiler, "disabled");
+			}
+			profiler.endFrame();
+			test.check(profiler.getCpuStats().count("disabled") == 0, "disabled profiler records nothing");
+
+			// 32 ticks of 1 ns across a wrap of a 32 bit counter
+			test.check(timestampDelta(0xFFFFFFF0ull, 0x10ull, 0xFFFFFFFFull, 1.0) == 0.000032, "timestamp difference across a counter wrap");
+			test.check(timestampDelta(1000ull, 3000ull, ~0ull, 0.5) == 0.001, "timestamp period");
+
+			std::stringstream trace;
+			profiler.writeChromeTrace(trace);
+			const std::string json = trace.str();
+			size_t regions = 0;
+			for (size_t pos = json.find("\"ph\":\"X\""); pos != std::string::npos; pos = json.find("\"ph\":\"X\"", pos + 1))
+			{
+				regions++;
+			}
+			test.check((json.find("{\"traceEvents\":[") == 0) && (json.rfind("]}\n") == json.size() - 3), "trace is a traceEvents object");
+			test.check(regions == 4, "trace only contains the captured frames");
+			test.check(json.find("{\"name\":\"update\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":10000.000,\"dur\":2000.000,\"pid\":0,\"tid\":0,\"args\":{\"frame\":1}}") != std::string::npos,
+				"CPU event in microseconds on the CPU track");
+			test.check(json.find("{\"name\":\"scene \\\"main\\\"\",\"cat\":\"gpu\",\"ph\":\"X\",\"ts\":12000.000,\"dur\":6000.000,\"pid\":1,") != std::string::npos,
+				"GPU event with escaped name on the GPU track");
+
+			return test.failed();
+		}
+	};//class Profiler
+
+}//vks
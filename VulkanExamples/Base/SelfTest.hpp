@@ -0,0 +1,39 @@
+/*
+* Check reporting for the selfTest functions of the helper classes
+*
+* Every check prints one line, the number of failed checks is returned by the selfTest functions and used as exit code
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <ostream>
+#include <cstdint>
+
+namespace vks
+{
+	class SelfTest
+	{
+	private:
+		std::ostream& out;
+		uint32_t failedChecks = 0;
+
+	public:
+		explicit SelfTest(std::ostream& out) : out(out)
+		{
+		}
+
+		void check(bool condition, const char* name)
+		{
+			out << (condition ? "passed: " : "FAILED: ") << name << "\n";
+			failedChecks += condition ? 0 : 1;
+		}
+
+		uint32_t failed() const
+		{
+			return failedChecks;
+		}
+	};//class SelfTest
+
+}//vks
@@ -0,0 +1,178 @@
+/*
+* Shader module cache
+*
+* Shader modules are cached by file name and by a hash of their SPIR-V, so a shader that is loaded several times
+* (or copied under a different name) only creates one module. The SPIR-V is read from a memory mapping of the file
+* and compared byte by byte on a hash match, so a hash collision can't return the module of a different shader
+* Loading is thread safe, pipelines can be prepared on several threads
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class ShaderModuleCache
+	{
+	public:
+		struct Statistics
+		{
+			uint32_t modules = 0; // Modules created
+			uint32_t fileHits = 0; // Loads of a file name that was loaded before
+			uint32_t contentHits = 0; // Loads of a new file name with the SPIR-V of a loaded module
+			size_t bytes = 0; // SPIR-V read for created modules
+			double loadTime = 0.0; // Time spent in loading in ms, summed over all threads
+		};
+
+	private:
+		VkDevice device = VK_NULL_HANDLE;
+		std::mutex mutex;
+		struct ContentModule
+		{
+			std::vector<char> code;
+			VkShaderModule module;
+		};
+		std::unordered_map<std::string, VkShaderModule> fileModules;
+		// Modules with the same hash are kept side by side
+		std::unordered_map<uint64_t, std::vector<ContentModule>> contentModules;
+		Statistics statistics;
+
+	public:
+#if defined(__ANDROID__)
+		AAssetManager* assetManager = nullptr;
+#endif
+
+		~ShaderModuleCache()
+		{
+			destroy();
+		}
+
+		// 64 bit FNV-1a hash of the SPIR-V, the size is mixed in to separate modules with a common prefix
+		static uint64_t hash(const char* data, size_t size)
+		{
+			return vks::tools::hashBytes(data, size) ^ static_cast<uint64_t>(size);
+		}
+
+		// Returns the module created from the same SPIR-V, VK_NULL_HANDLE if there is none, the mutex has to be locked
+		VkShaderModule findContent(uint64_t contentHash, const char* data, size_t size)
+		{
+			auto cached = contentModules.find(contentHash);
+			if (cached == contentModules.end())
+			{
+				return VK_NULL_HANDLE;
+			}
+			for (const ContentModule& contentModule : cached->second)
+			{
+				if ((contentModule.code.size() == size) && (memcmp(contentModule.code.data(), data, size) == 0))
+				{
+					return contentModule.module;
+				}
+			}
+			return VK_NULL_HANDLE;
+		}
+
+		void setDevice(VkDevice device)
+		{
+			this->device = device;
+		}
+
+		// Returns the module of a SPIR-V file, VK_NULL_HANDLE if the file can't be read
+		// Modules are owned by the cache and must not be destroyed by the caller
+		VkShaderModule load(const std::string& fileName)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				auto cached = fileModules.find(fileName);
+				if (cached != fileModules.end())
+				{
+					statistics.fileHits++;
+					return cached->second;
+				}
+			}
+
+			vks::tools::MappedFile file;
+#if defined(__ANDROID__)
+			const bool opened = file.open(assetManager, fileName.c_str());
+#else
+			const bool opened = file.open(fileName.c_str());
+#endif
+			if (!opened)
+			{
+				std::cerr << "Error: Could not open shader file \"" << fileName << "\"" << "\n";
+				return VK_NULL_HANDLE;
+			}
+			const uint64_t contentHash = hash(file.data, file.size);
+
+			VkShaderModule shaderModule = VK_NULL_HANDLE;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				VkShaderModule cached = findContent(contentHash, file.data, file.size);
+				if (cached != VK_NULL_HANDLE)
+				{
+					statistics.contentHits++;
+					fileModules[fileName] = cached;
+					return cached;
+				}
+			}
+
+			// Modules are created outside of the lock so several threads can create them at the same time
+			VkShaderModuleCreateInfo moduleCreateInfo{};
+			moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+			moduleCreateInfo.codeSize = file.size;
+			moduleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(file.data);
+			VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, nullptr, &shaderModule));
+
+			std::lock_guard<std::mutex> lock(mutex);
+			VkShaderModule existing = findContent(contentHash, file.data, file.size);
+			if (existing != VK_NULL_HANDLE)
+			{
+				// Another thread created the same module in the meantime
+				vkDestroyShaderModule(device, shaderModule, nullptr);
+				statistics.contentHits++;
+				fileModules[fileName] = existing;
+				return existing;
+			}
+			contentModules[contentHash].push_back({ std::vector<char>(file.data, file.data + file.size), shaderModule });
+			fileModules[fileName] = shaderModule;
+			statistics.modules++;
+			statistics.bytes += file.size;
+			statistics.loadTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+			return shaderModule;
+		}
+
+		Statistics getStatistics()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return statistics;
+		}
+
+		void destroy()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& modules : contentModules)
+			{
+				for (ContentModule& contentModule : modules.second)
+				{
+					vkDestroyShaderModule(device, contentModule.module, nullptr);
+				}
+			}
+			contentModules.clear();
+			fileModules.clear();
+		}
+	};//class ShaderModuleCache
+
+}//vks
@@ -0,0 +1,388 @@
+/*
+* Per-frame upload arena
+*
+* Bump allocator over one persistently mapped, host coherent ring buffer for data that is written once per frame
+* (uniform blocks bound with dynamic offsets, per-draw data). Allocations are aligned to minUniformBufferOffsetAlignment
+* and return the buffer, the dynamic offset and the mapped pointer, so examples don't compute alignments themselves
+* The space of a frame is reclaimed when its frame index is passed to beginFrame again, i.e. after the fence of that frame
+* has been waited on. Submissions to one queue complete in order, so everything allocated up to that frame can be reused
+* If the ring is full an allocation fails (and is counted) instead of overwriting data the GPU may still read
+* Buffer creation and destruction are std::function members, selfTest backs the ring with host memory to check offsets and wrapping
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+#include <ostream>
+#include <cstring>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+#include "VulkanDevice.h"
+#include "SelfTest.hpp"
+
+// Size of the ring if the example doesn't pass one, a few frames of per-object uniform blocks
+#define UPLOAD_ARENA_DEFAULT_SIZE (4 * 1024 * 1024)
+
+namespace vks
+{
+	class UploadArena
+	{
+	public:
+		// Ring buffer creation, prepare uses a host coherent vks::Buffer of the device
+		struct Functions
+		{
+			// Creates the ring buffer and returns it mapped
+			std::function<VkResult(VkDeviceSize, VkBuffer&, void*&)> createBuffer;
+			std::function<void(VkBuffer)> destroyBuffer;
+		};
+
+		struct Allocation
+		{
+			VkBuffer buffer = VK_NULL_HANDLE;
+			// Offset into the ring, passed as the dynamic offset of the binding
+			uint32_t offset = 0;
+			VkDeviceSize size = 0;
+			void* data = nullptr;
+
+			// False if the ring was full
+			explicit operator bool() const
+			{
+				return data != nullptr;
+			}
+		};
+
+		struct FrameStatistics
+		{
+			uint32_t allocations = 0;
+			// Including the alignment padding and the space skipped when the ring wraps
+			VkDeviceSize bytes = 0;
+			uint32_t overflows = 0;
+		};
+
+		struct Statistics
+		{
+			VkDeviceSize capacity = 0;
+			VkDeviceSize alignment = 0;
+			uint64_t allocations = 0;
+			uint64_t bytes = 0;
+			uint64_t overflows = 0;
+			uint64_t overflowBytes = 0;
+			uint32_t wraps = 0;
+			// Largest amount of the ring in use at once (the frames in flight)
+			VkDeviceSize peakUsage = 0;
+			// Sums over the completed frames
+			uint32_t frames = 0;
+			FrameStatistics frameTotals;
+		};
+
+	private:
+		Functions functions;
+		std::mutex mutex;
+		// Created by prepare, unused with fake functions
+		vks::Buffer ringBuffer;
+
+		VkBuffer buffer = VK_NULL_HANDLE;
+		uint8_t* mappedData = nullptr;
+		VkDeviceSize capacity = 0;
+		VkDeviceSize alignment = 1;
+
+		// Running byte counts, the ring position is head % capacity
+		uint64_t head = 0;
+		uint64_t tail = 0;
+
+		// Head at the end of the last frame submitted with each frame index
+		struct Frame
+		{
+			uint64_t end = 0;
+			bool pending = false;
+		};
+		std::vector<Frame> frames;
+		uint32_t frameIndex = 0;
+		bool frameStarted = false;
+
+		Statistics statistics;
+		FrameStatistics frame;
+		FrameStatistics lastFrame;
+
+		static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+	public:
+		~UploadArena()
+		{
+			destroy();
+		}
+
+		// Creates the ring with the uniform buffer offset alignment of the device
+		void prepare(vks::VulkanDevice* device, VkDeviceSize size = UPLOAD_ARENA_DEFAULT_SIZE)
+		{
+			Functions deviceFunctions;
+			deviceFunctions.createBuffer = [this, device](VkDeviceSize bufferSize, VkBuffer& createdBuffer, void*& data)
+			{
+				VkResult result = device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ringBuffer, bufferSize);
+				if (result == VK_SUCCESS)
+				{
+					result = ringBuffer.map();
+				}
+				createdBuffer = ringBuffer.buffer;
+				data = ringBuffer.mappedData;
+				return result;
+			};
+			deviceFunctions.destroyBuffer = [this](VkBuffer)
+			{
+				ringBuffer.destroy();
+				ringBuffer = vks::Buffer();
+			};
+			const VkPhysicalDeviceLimits& limits = device->properties.limits;
+			setFunctions(deviceFunctions, size, std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment));
+		}
+
+		// Creates the ring through the given functions, alignment is the minimum offset alignment of every allocation
+		void setFunctions(const Functions& functions, VkDeviceSize size, VkDeviceSize alignment)
+		{
+			destroy();
+			std::lock_guard<std::mutex> lock(mutex);
+			this->functions = functions;
+			this->alignment = std::max<VkDeviceSize>(alignment, 1);
+			void* data = nullptr;
+			VK_CHECK_RESULT(this->functions.createBuffer(size, buffer, data));
+			mappedData = static_cast<uint8_t*>(data);
+			capacity = size;
+			head = 0;
+			tail = 0;
+			for (Frame& frame : frames)
+			{
+				frame = Frame();
+			}
+			statistics.capacity = capacity;
+			statistics.alignment = this->alignment;
+		}
+
+		bool isPrepared() const
+		{
+			return mappedData != nullptr;
+		}
+
+		// Starts a frame: releases the space of the last frame submitted with this index (which must have completed on the GPU)
+		// and closes the counters of the previous frame
+		void beginFrame(uint32_t index)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			// The swap chain may come back with more images after a resize
+			if (index >= frames.size())
+			{
+				frames.resize(index + 1);
+			}
+			if (frameStarted)
+			{
+				frames[frameIndex].end = head;
+				frames[frameIndex].pending = true;
+
+				lastFrame = frame;
+				statistics.frames++;
+				statistics.frameTotals.allocations += frame.allocations;
+				statistics.frameTotals.bytes += frame.bytes;
+				statistics.frameTotals.overflows += frame.overflows;
+				frame = FrameStatistics();
+			}
+			if (frames[index].pending)
+			{
+				tail = std::max(tail, frames[index].end);
+				frames[index].pending = false;
+			}
+			frameIndex = index;
+			frameStarted = true;
+		}
+
+		// Returns size bytes aligned to at least the device alignment, valid until the frame index comes around again
+		Allocation allocate(VkDeviceSize size, VkDeviceSize minAlignment = 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Allocation allocation;
+			if (mappedData == nullptr)
+			{
+				return allocation;
+			}
+			const VkDeviceSize position = head % capacity;
+			const VkDeviceSize offset = alignUp(position, std::max(alignment, minAlignment));
+			uint64_t start = head - position + offset;
+			// Allocations don't wrap around the end of the ring, the rest of the ring is skipped (offset 0 fits every alignment)
+			const bool wrapped = (offset + size > capacity);
+			if (wrapped)
+			{
+				start = head - position + capacity;
+			}
+			const uint64_t end = start + size;
+			if ((size > capacity) || (end - tail > capacity))
+			{
+				frame.overflows++;
+				statistics.overflows++;
+				statistics.overflowBytes += size;
+				return allocation;
+			}
+
+			allocation.buffer = buffer;
+			allocation.offset = static_cast<uint32_t>(start % capacity);
+			allocation.size = size;
+			allocation.data = mappedData + allocation.offset;
+
+			frame.allocations++;
+			frame.bytes += end - head;
+			statistics.allocations++;
+			statistics.bytes += end - head;
+			statistics.wraps += wrapped ? 1 : 0;
+			head = end;
+			statistics.peakUsage = std::max<VkDeviceSize>(statistics.peakUsage, head - tail);
+			return allocation;
+		}
+
+		// Allocates and copies the data
+		Allocation upload(const void* data, VkDeviceSize size, VkDeviceSize minAlignment = 0)
+		{
+			Allocation allocation = allocate(size, minAlignment);
+			if (allocation)
+			{
+				memcpy(allocation.data, data, static_cast<size_t>(size));
+			}
+			return allocation;
+		}
+
+		template<typename T>
+		Allocation upload(const T& value)
+		{
+			return upload(&value, sizeof(T));
+		}
+
+		// Buffer info for a dynamic uniform or storage buffer binding of range bytes, the offset is passed when binding
+		VkDescriptorBufferInfo descriptor(VkDeviceSize range) const
+		{
+			VkDescriptorBufferInfo bufferInfo;
+			bufferInfo.buffer = buffer;
+			bufferInfo.offset = 0;
+			bufferInfo.range = range;
+			return bufferInfo;
+		}
+
+		VkBuffer getBuffer() const
+		{
+			return buffer;
+		}
+
+		// Counters of the last completed frame
+		FrameStatistics getFrameStatistics()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return lastFrame;
+		}
+
+		Statistics getStatistics()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return statistics;
+		}
+
+		// Destroys the ring, the GPU must not use it anymore
+		void destroy()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (functions.destroyBuffer && (mappedData != nullptr))
+			{
+				functions.destroyBuffer(buffer);
+			}
+			buffer = VK_NULL_HANDLE;
+			mappedData = nullptr;
+			capacity = 0;
+		}
+
+		// Checks alignment, frame reclamation, wrapping and overflow on a fake ring with fake limits, returns the number of failed checks
+		static uint32_t selfTest(std::ostream& out)
+		{
+			vks::SelfTest test(out);
+
+			std::vector<uint8_t> memory;
+			uint32_t destroyedBuffers = 0;
+			Functions fake;
+			fake.createBuffer = [&](VkDeviceSize size, VkBuffer& buffer, void*& data)
+			{
+				memory.assign(static_cast<size_t>(size), 0);
+				buffer = (VkBuffer)(uintptr_t)0x1000;
+				data = memory.data();
+				return VK_SUCCESS;
+			};
+			fake.destroyBuffer = [&](VkBuffer) { destroyedBuffers++; };
+
+			{
+				// Four frames of 256 bytes with a 64 byte alignment limit
+				UploadArena arena;
+				arena.setFunctions(fake, 1024, 64);
+				arena.beginFrame(0);
+				const Allocation first = arena.allocate(16);
+				const Allocation second = arena.allocate(100);
+				const Allocation third = arena.allocate(4);
+				test.check((first.offset == 0) && (second.offset == 64) && (third.offset == 192), "allocations are aligned to the device limit");
+				const Allocation wide = arena.allocate(8, 256);
+				test.check(wide.offset == 256, "larger alignments are respected");
+				test.check((second.data == memory.data() + 64) && (second.buffer == (VkBuffer)(uintptr_t)0x1000) && (second.size == 100), "allocations return the buffer, offset and mapped pointer");
+				const uint32_t value = 0xC0FFEE;
+				const Allocation uploaded = arena.upload(value);
+				test.check(uploaded && (memcmp(memory.data() + uploaded.offset, &value, sizeof(value)) == 0), "upload copies the data");
+
+				// Frame 1 fills the ring up to the end, frame 0 is still in flight
+				arena.beginFrame(1);
+				const Allocation rest = arena.allocate(1024 - 384);
+				test.check(rest && (rest.offset == 384), "frame data is appended behind the frames in flight");
+				const Allocation full = arena.allocate(1);
+				test.check(!full && (arena.getStatistics().overflows == 1), "allocations fail instead of overwriting frames in flight");
+
+				// Frame index 0 comes around again, its space (but not the one of frame 1) is reclaimed
+				arena.beginFrame(0);
+				const Allocation reused = arena.allocate(320);
+				test.check(reused && (reused.offset == 0), "the space of a completed frame is reused");
+				test.check(!arena.allocate(64), "the space of frames in flight is kept");
+				const FrameStatistics frame1 = arena.getFrameStatistics();
+				test.check((frame1.allocations == 1) && (frame1.bytes == 700) && (frame1.overflows == 1), "frame counters cover the allocations between two frames");
+
+				// An allocation that doesn't fit in front of the end of the ring starts at the beginning
+				arena.beginFrame(1);
+				arena.beginFrame(0);
+				arena.allocate(200);
+				const Allocation blocked = arena.allocate(900);
+				arena.beginFrame(1);
+				arena.beginFrame(0);
+				const Allocation wrapped = arena.allocate(500);
+				test.check(!blocked && wrapped && (wrapped.offset == 0) && (arena.getStatistics().wraps == 1), "allocations don't straddle the end of the ring");
+
+				test.check(!arena.allocate(2048) && (arena.getStatistics().overflowBytes == 1 + 64 + 900 + 2048), "oversized allocations fail and are counted");
+				const Statistics statistics = arena.getStatistics();
+				test.check((statistics.peakUsage <= 1024) && (statistics.frames == 6) && (statistics.capacity == 1024) && (statistics.alignment == 64), "statistics track frames and peak usage");
+
+				// Alignments that don't divide the ring size still give aligned offsets
+				arena.setFunctions(fake, 1000, 256);
+				arena.beginFrame(0);
+				bool aligned = true;
+				for (uint32_t i = 0; i < 3; i++)
+				{
+					const Allocation allocation = arena.allocate(200);
+					aligned = aligned && allocation && (allocation.offset % 256 == 0);
+				}//for_i
+				arena.beginFrame(1);
+				arena.beginFrame(0);
+				const Allocation next = arena.allocate(300);
+				test.check(aligned && next && (next.offset == 0), "offsets stay aligned when the ring size isn't a multiple of the alignment");
+			}
+			test.check(destroyedBuffers == 2, "destroy releases the ring");
+
+			return test.failed();
+		}
+	};//class UploadArena
+
+}//vks
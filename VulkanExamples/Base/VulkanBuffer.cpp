@@ -73,6 +73,10 @@ namespace vks
 
 		if (deviceMemory)
 		{
+			if (allocationTracker)
+			{
+				allocationTracker->recordFree(deviceMemory);
+			}
 			vkFreeMemory(device, deviceMemory, nullptr);
 		}
 	}
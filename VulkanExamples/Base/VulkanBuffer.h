@@ -4,6 +4,7 @@
 #include <vector>
 #include "vulkan/vulkan.h"
 #include "VulkanTools.h"
+#include "AllocationTracker.hpp"
 
 namespace vks
 {
@@ -18,6 +19,8 @@ namespace vks
 		void* mappedData = nullptr;
 		VkBufferUsageFlags bufferUsageFlags;
 		VkMemoryPropertyFlags memoryPropertyFlags;
+		// Set when the memory was allocated through vks::VulkanDevice, destroy() reports the free
+		AllocationTracker* allocationTracker = nullptr;
 
 		VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 
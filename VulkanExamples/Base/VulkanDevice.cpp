@@ -298,6 +298,35 @@ namespace vks
 		return result;
 	}
 
+	/**
+	* Allocate device memory and record it with the allocation tracker
+	*
+	* @param allocateInfo Allocation info passed to vkAllocateMemory
+	* @param memory Pointer to the memory handle acquired by the function
+	* @param category Category the allocation is accounted under
+	*
+	* @return Result of vkAllocateMemory
+	*/
+	VkResult VulkanDevice::AllocateMemory(const VkMemoryAllocateInfo* allocateInfo, VkDeviceMemory* memory, MemoryCategory category)
+	{
+		VkResult result = vkAllocateMemory(logicalDevice, allocateInfo, nullptr, memory);
+		if (result == VK_SUCCESS)
+		{
+			uint32_t heapIndex = memoryProperties.memoryTypes[allocateInfo->memoryTypeIndex].heapIndex;
+			allocationTracker.recordAllocation(*memory, allocateInfo->allocationSize, heapIndex, category);
+		}
+		return result;
+	}
+
+	void VulkanDevice::FreeMemory(VkDeviceMemory memory)
+	{
+		if (memory != VK_NULL_HANDLE)
+		{
+			allocationTracker.recordFree(memory);
+			vkFreeMemory(logicalDevice, memory, nullptr);
+		}
+	}
+
 	/**
 	* Create a buffer on the device
 	*
@@ -307,10 +336,11 @@ namespace vks
 	* @param buffer Pointer to the buffer handle acquired by the function
 	* @param memory Pointer to the memory handle acquired by the function
 	* @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
+	* @param category Category the memory is accounted under by the allocation tracker (optional, defaults to buffer)
 	*
 	* @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
 	*/
-	VkResult VulkanDevice::CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer * buffer, VkDeviceMemory * memory, void * data)
+	VkResult VulkanDevice::CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer * buffer, VkDeviceMemory * memory, void * data, MemoryCategory category)
 	{
 		VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo(usageFlags, size);
 		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;//ҷʵ
@@ -331,7 +361,7 @@ namespace vks
 			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
 			memAllocInfo.pNext = &allocFlagsInfo;
 		}
-		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAllocInfo, nullptr, memory));
+		VK_CHECK_RESULT(AllocateMemory(&memAllocInfo, memory, category));
 
         // If a pointer to the buffer data has been passed, map the buffer and copy over the data
 		if (data != nullptr)
@@ -358,12 +388,31 @@ namespace vks
 		return VK_SUCCESS;
 	}
 
-	VkResult VulkanDevice::CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer * buffer, VkDeviceSize size, void * data)
+	VkResult VulkanDevice::CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer * buffer, VkDeviceSize size, void * data, MemoryCategory category)
+	{
+		return CreateBuffer(usageFlags, memoryPropertyFlags, buffer, size, std::vector<uint32_t>(), data, category);
+	}
+
+	/**
+	* Create a buffer that is accessed from several queue families without ownership transfers
+	*
+	* @param queueFamilyIndices Queue families the buffer is shared between (concurrent sharing mode), exclusive if less than two distinct families are passed
+	*/
+	VkResult VulkanDevice::CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer * buffer, VkDeviceSize size, const std::vector<uint32_t>& queueFamilyIndices, void * data, MemoryCategory category)
 	{
 		buffer->device = logicalDevice;
 
 		//Create the buffer handle
 		VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo(usageFlags, size);
+		std::vector<uint32_t> sharedFamilies = queueFamilyIndices;
+		std::sort(sharedFamilies.begin(), sharedFamilies.end());
+		sharedFamilies.erase(std::unique(sharedFamilies.begin(), sharedFamilies.end()), sharedFamilies.end());
+		if (sharedFamilies.size() > 1)
+		{
+			bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			bufferCreateInfo.queueFamilyIndexCount = static_cast<uint32_t>(sharedFamilies.size());
+			bufferCreateInfo.pQueueFamilyIndices = sharedFamilies.data();
+		}
 		VK_CHECK_RESULT(vkCreateBuffer(logicalDevice,&bufferCreateInfo,nullptr,&buffer->buffer));
 
 		//Create the memory backing up the buffer handle
@@ -382,7 +431,8 @@ namespace vks
 			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
 			memAlloc.pNext = &allocFlagsInfo;
 		}
-		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->deviceMemory));
+		VK_CHECK_RESULT(AllocateMemory(&memAlloc, &buffer->deviceMemory, category));
+		buffer->allocationTracker = &allocationTracker;
 
 		buffer->alignment = memReqs.alignment;
 		buffer->size = size;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "VulkanBuffer.h"
+#include "AllocationTracker.hpp"
 #include "VulkanTools.h"
 #include "vulkan/vulkan.h"
 #include <algorithm>
@@ -21,6 +22,8 @@ namespace vks
 		std::vector<std::string> supportedExtensions;
 		VkCommandPool commandPool = VK_NULL_HANDLE;
 		bool enableDebugMarkers = false;
+		// Device memory allocated through this device, by category
+		vks::AllocationTracker allocationTracker;
 
 		struct
 		{
@@ -45,9 +48,15 @@ namespace vks
 		VkResult CreateLogicalDevice(VkPhysicalDeviceFeatures enabledDeviceFeatures, std::vector<const char*>enabledExtensions,
 			void *pNextChain, bool useSwapChain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
 
-		VkResult CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, void * data = nullptr);
+		VkResult AllocateMemory(const VkMemoryAllocateInfo* allocateInfo, VkDeviceMemory* memory, MemoryCategory category);
 
-		VkResult CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer* buffer, VkDeviceSize size, void* data = nullptr);
+		void FreeMemory(VkDeviceMemory memory);
+
+		VkResult CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, void * data = nullptr, MemoryCategory category = MEMORY_CATEGORY_BUFFER);
+
+		VkResult CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer* buffer, VkDeviceSize size, void* data = nullptr, MemoryCategory category = MEMORY_CATEGORY_BUFFER);
+
+		VkResult CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer* buffer, VkDeviceSize size, const std::vector<uint32_t>& queueFamilyIndices, void* data = nullptr, MemoryCategory category = MEMORY_CATEGORY_BUFFER);
 
 		void CopyBuffer(vks::Buffer * src, vks::Buffer * dst, VkQueue queue, VkBufferCopy * copyRegion = nullptr);
 
@@ -7,6 +7,7 @@
 */
 
 #include "VulkanExampleBase.h"
+#include "LightClusters.hpp"
 
 #if (defined(VK_USE_PLATFORM_MACOS_MVK) && defined(VK_EXAMPLE_XCODE_GENERATED))
 #include <Cocoa/Cocoa.h>
@@ -51,7 +52,7 @@ void VulkanExampleBase::resizeWindow()
 	// Recreate the frame buffers
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
-	vkFreeMemory(device, depthStencil.mem, nullptr);
+	vulkanDevice->FreeMemory(depthStencil.mem);
 	
 	setupDepthStencil();
 	
@@ -66,6 +67,7 @@ void VulkanExampleBase::resizeWindow()
 		if (settings.overlay)
 		{
 			uiOverlay.resize(width, height);
+			uiOverlay.frameCount = swapChain.imageCount;
 		}
 	}
 
@@ -130,13 +132,17 @@ void VulkanExampleBase::handleMouseMove(int32_t x, int32_t y)
 void VulkanExampleBase::nextFrame()
 {
 	auto tStart = std::chrono::high_resolution_clock::now();
+	beginPacedFrame();
 	if (viewUpdated)
 	{
 		viewUpdated = false;
 		viewChanged();
 	}
 
-	render();
+	{
+		vks::Profiler::CpuScope scope(profiler, "render");
+		render();
+	}
 	frameCounter++;
 	auto tEnd = std::chrono::high_resolution_clock::now();
 	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
@@ -169,7 +175,11 @@ void VulkanExampleBase::nextFrame()
 		lastTimestamp = tEnd;
 	}
 	// TODO: Cap UI overlay update rates
-	updateOverlay();
+	{
+		vks::Profiler::CpuScope scope(profiler, "overlay");
+		updateOverlay();
+	}
+	profiler.endFrame();
 }
 
 void VulkanExampleBase::updateOverlay()
@@ -203,6 +213,54 @@ void VulkanExampleBase::updateOverlay()
 #endif
 	ImGui::PushItemWidth(110.0f * uiOverlay.scale);
 	OnUpdateUIOverlay(&uiOverlay);
+	profiler.drawUI(&uiOverlay);
+	instrumentation.drawUI(&uiOverlay);
+	if (instrumentation.enabled && uiOverlay.header("Descriptors"))
+	{
+		const vks::DescriptorAllocator::FrameStatistics frameDescriptors = descriptorAllocator.getFrameStatistics();
+		const vks::DescriptorAllocator::Statistics descriptors = descriptorAllocator.getStatistics();
+		uiOverlay.text("%u sets, %u writes in %u updates / frame", frameDescriptors.allocations, frameDescriptors.writes, frameDescriptors.updateCalls);
+		uiOverlay.text("%u pools (%u transient), %u layouts", descriptors.pools, descriptors.transientPools, descriptors.layouts);
+	}
+	if (asyncCompute.isPrepared() && uiOverlay.header("Async compute"))
+	{
+		const vks::AsyncCompute::Statistics& async = asyncCompute.getStatistics();
+		uiOverlay.text(asyncCompute.isAsync() ? "Compute queue family %u" : "Graphics queue (family %u)", asyncCompute.getQueueFamilyIndex());
+		uiOverlay.text("%.2f ms step, %.2f ms frame", async.computeTime, async.graphicsTime);
+		uiOverlay.text("%.2f ms overlap (%.0f%% of the step)", async.overlap, (async.computeTime > 0.0f) ? async.overlap * 100.0f / async.computeTime : 0.0f);
+	}
+	if ((instrumentation.enabled || (framePacer.mode != vks::FramePacer::MODE_OFF)) && uiOverlay.header("Presentation"))
+	{
+		const vks::FramePacer::Statistics& pacing = framePacer.getStatistics();
+		uiOverlay.text("%s, %u images", VulkanSwapChain::presentModeName(swapChain.presentMode), swapChain.imageCount);
+		uiOverlay.text("%.2f ms latency (max %.2f)", pacing.latency, pacing.latencyMax);
+		if (swapChain.presentWait)
+		{
+			uiOverlay.text("%.2f ms present interval, %.2f ms sleep", pacing.presentInterval, pacing.sleepTime);
+		}
+		else
+		{
+			uiOverlay.text("Latency to the end of the GPU work");
+		}
+		if (framePacer.framesAhead > 0)
+		{
+			// submitFrame waits for the GPU work of every frame, so only finished frames can be queued
+			uiOverlay.text(swapChain.presentWait ? "%u frames ahead (queued presents only)" : "%u frames ahead: no effect without present wait", framePacer.framesAhead);
+		}
+	}
+	if (instrumentation.enabled && uiOverlay.header("Overlay"))
+	{
+		const vks::UIOverlay::Statistics& overlay = uiOverlay.statistics;
+		uiOverlay.text("%.1f allocations/s, %.1f rebuilds/s", overlay.allocationsPerSecond, overlay.rebuildsPerSecond);
+		uiOverlay.text("%.1f uploads/s, %.3f ms CPU", overlay.uploadsPerSecond, overlay.cpuTime);
+	}
+	if (instrumentation.enabled && uploadArena.isPrepared() && uiOverlay.header("Uploads"))
+	{
+		const vks::UploadArena::FrameStatistics frameUploads = uploadArena.getFrameStatistics();
+		const vks::UploadArena::Statistics uploads = uploadArena.getStatistics();
+		uiOverlay.text("%u allocations, %.1f KB / frame", frameUploads.allocations, frameUploads.bytes / 1024.0f);
+		uiOverlay.text("peak %.1f of %.1f KB, %u overflows", uploads.peakUsage / 1024.0f, uploads.capacity / 1024.0f, static_cast<uint32_t>(uploads.overflows));
+	}
 	ImGui::PopItemWidth();
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	ImGui::PopStyleVar();
@@ -252,6 +310,11 @@ void VulkanExampleBase::createSynchronizationPrimitives()
 
 void VulkanExampleBase::initSwapChainSurface()
 {
+	if (settings.headless)
+	{
+		swapChain.initHeadless(queue, vulkanDevice->queueFamilyIndices.graphicIndex);
+		return;
+	}
 #ifdef _WIN32
 	swapChain.initSurface(windowInstance, window);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -339,6 +402,34 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	{
 		settings.vsync = true;
 	}
+	if (commandLineParser.isSet("presentmode"))
+	{
+		const std::string value = commandLineParser.getValueAsString("presentmode", "fifo");
+		const std::vector<VkPresentModeKHR> presentModes = { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+		const std::vector<std::string> presentModeNames = { "fifo", "relaxed", "mailbox", "immediate" };
+		auto presentModeName = std::find(presentModeNames.begin(), presentModeNames.end(), value);
+		if (presentModeName != presentModeNames.end())
+		{
+			swapChain.presentConfig.presentMode = presentModes[std::distance(presentModeNames.begin(), presentModeName)];
+		}
+		else
+		{
+			std::cerr << "Unknown present mode " << value << ", use fifo, relaxed, mailbox or immediate\n";
+		}
+	}
+	if (commandLineParser.isSet("swapchainimages"))
+	{
+		swapChain.presentConfig.minImageCount = std::max(commandLineParser.getValueAsInt("swapchainimages", 0), 0);
+	}
+	if (commandLineParser.isSet("latencymode"))
+	{
+		framePacer.mode = static_cast<vks::FramePacer::Mode>(std::min(std::max(commandLineParser.getValueAsInt("latencymode", 0), 0), static_cast<int32_t>(vks::FramePacer::MODE_JUST_IN_TIME)));
+	}
+	if (commandLineParser.isSet("framesahead"))
+	{
+		framePacer.framesAhead = std::max(commandLineParser.getValueAsInt("framesahead", 0), 0);
+	}
+	asyncCompute.singleQueue = commandLineParser.isSet("noasynccompute");
 
 	if (commandLineParser.isSet("height"))
 	{
@@ -371,6 +462,10 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	{
 		benchmark.active = true;
 		vks::tools::errorModeSilent = true;
+		for (size_t i = 0; i < args.size(); i++)
+		{
+			benchmark.commandLine += (i > 0 ? " " : "") + std::string(args[i]);
+		}
 	}
 
 	if (commandLineParser.isSet("benchmarkwarmup"))
@@ -379,7 +474,7 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	}
 	if (commandLineParser.isSet("benchmarkruntime"))
 	{
-		benchmark.duration = commandLineParser.getValueAsInt("commandLineParser", benchmark.duration);
+		benchmark.duration = commandLineParser.getValueAsInt("benchmarkruntime", benchmark.duration);
 	}
 	if (commandLineParser.isSet("benchmarkresultfile"))
 	{
@@ -387,7 +482,54 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	}
 	if (commandLineParser.isSet("benchmarkresultframes"))
 	{
-		benchmark.outputFrames = true;
+		benchmark.outputFrameTimes = true;
+	}
+	if (commandLineParser.isSet("headless"))
+	{
+		settings.headless = true;
+		vks::tools::errorModeSilent = true;
+	}
+	if (commandLineParser.isSet("headlessframes"))
+	{
+		headless.frameCount = commandLineParser.getValueAsInt("headlessframes", headless.frameCount);
+	}
+	if (commandLineParser.isSet("dumpframe"))
+	{
+		// getValueAsInt treats 0 as unset, but the first frame can be dumped as well
+		headless.dumpFrame = std::max(atoi(commandLineParser.getValueAsString("dumpframe", "0").c_str()), 0);
+	}
+	if (commandLineParser.isSet("dumpfile"))
+	{
+		headless.dumpFile = commandLineParser.getValueAsString("dumpfile", headless.dumpFile);
+	}
+	if (commandLineParser.isSet("profile"))
+	{
+		profiler.enabled = true;
+	}
+	if (commandLineParser.isSet("profiletrace"))
+	{
+		profiler.enabled = true;
+		profiler.traceFilename = commandLineParser.getValueAsString("profiletrace", profiler.traceFilename);
+	}
+	if (commandLineParser.isSet("profiletraceframes"))
+	{
+		profiler.traceFrames = commandLineParser.getValueAsInt("profiletraceframes", profiler.traceFrames);
+	}
+	if (commandLineParser.isSet("instrumentation"))
+	{
+		instrumentation.enabled = true;
+	}
+	if (commandLineParser.isSet("startupreport"))
+	{
+		startup.report = true;
+	}
+	if (commandLineParser.isSet("pipelinethreads"))
+	{
+		startup.pipelineThreads = commandLineParser.getValueAsInt("pipelinethreads", startup.pipelineThreads);
+	}
+	if (commandLineParser.isSet("serialpipelines"))
+	{
+		pipelineRegistry.synchronous = true;
 	}
 	if (commandLineParser.isSet("benchmarkframes")) {
 		benchmark.outputFrames = commandLineParser.getValueAsInt("benchmarkframes", benchmark.outputFrames);
@@ -401,9 +543,15 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 #elif defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	initWaylandConnection();
+	if (!settings.headless)
+	{
+		initWaylandConnection();
+	}
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	initxcbConnection();
+	if (!settings.headless)
+	{
+		initxcbConnection();
+	}
 #endif
 
 #ifdef _WIN32
@@ -435,13 +583,15 @@ VulkanExampleBase::~VulkanExampleBase()
 		vkDestroyFramebuffer(device, frameBuffers[i], nullptr);
 	}
 
-	for (auto& shaderModule : shaderModules)
-	{
-		vkDestroyShaderModule(device, shaderModule, nullptr);
-	}
+	pipelineRegistry.destroy();
+	pipelineLibrary.destroy();
+	descriptorAllocator.destroy();
+	uploadArena.destroy();
+	asyncCompute.destroy();
+	shaderModuleCache.destroy();
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
-	vkFreeMemory(device, depthStencil.mem, nullptr);
+	vulkanDevice->FreeMemory(depthStencil.mem);
 
 	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
@@ -457,6 +607,9 @@ VulkanExampleBase::~VulkanExampleBase()
 		uiOverlay.freeResources();
 	}
 
+	profiler.destroyGpu();
+	instrumentation.destroy();
+
 	delete vulkanDevice;
 
 	if (settings.validation)
@@ -480,29 +633,43 @@ VulkanExampleBase::~VulkanExampleBase()
 	if (dfb)
 		dfb->Release(dfb);
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	xdg_toplevel_destroy(xdg_toplevel);
-	xdg_surface_destroy(xdg_surface);
-	wl_surface_destroy(surface);
-	if (keyboard)
-		wl_keyboard_destroy(keyboard);
-	if (pointer)
-		wl_pointer_destroy(pointer);
-	if (seat)
-		wl_seat_destroy(seat);
-	xdg_wm_base_destroy(shell);
-	wl_compositor_destroy(compositor);
-	wl_registry_destroy(registry);
-	wl_display_disconnect(display);
+	if (!settings.headless)
+	{
+		xdg_toplevel_destroy(xdg_toplevel);
+		xdg_surface_destroy(xdg_surface);
+		wl_surface_destroy(surface);
+		if (keyboard)
+			wl_keyboard_destroy(keyboard);
+		if (pointer)
+			wl_pointer_destroy(pointer);
+		if (seat)
+			wl_seat_destroy(seat);
+		xdg_wm_base_destroy(shell);
+		wl_compositor_destroy(compositor);
+		wl_registry_destroy(registry);
+		wl_display_disconnect(display);
+	}
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// todo : android cleanup (if required)
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	xcb_destroy_window(connection, window);
-	xcb_disconnect(connection);
+	if (!settings.headless)
+	{
+		xcb_destroy_window(connection, window);
+		xcb_disconnect(connection);
+	}
 #endif
 }
 
 bool VulkanExampleBase::initVulkanSetting()
 {
+	// The self tests don't need a device, they run once the example has added its options
+	if (commandLineParser.isSet("selftest"))
+	{
+		const uint32_t failed = runSelfTests(std::cout);
+		std::cout << failed << " checks failed\n";
+		exit((failed == 0) ? 0 : 1);
+	}
+
 	VkResult err;
 
 	//Vulkan instance
@@ -597,6 +764,126 @@ bool VulkanExampleBase::initVulkanSetting()
 	// Vulkan device creation
 	// This is handled by a separate class that gets a logical device representation and encapsulates functions related to a device
 	vulkanDevice = new vks::VulkanDevice(physicalDevice);
+
+	// Instrumentation needs pipeline statistics queries and, for the heap budgets, VK_EXT_memory_budget
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 = nullptr;
+	if (instrumentation.enabled)
+	{
+		if (deviceFeatures.pipelineStatisticsQuery)
+		{
+			curEnabledDeviceFeatures.pipelineStatisticsQuery = VK_TRUE;
+		}
+		const bool properties2 = (apiVersion >= VK_API_VERSION_1_1) ||
+			(std::find(supportedInstanceExtensions.begin(), supportedInstanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != supportedInstanceExtensions.end());
+		if (properties2 && vulkanDevice->IsExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+		{
+			getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(instance,
+				(apiVersion >= VK_API_VERSION_1_1) ? "vkGetPhysicalDeviceMemoryProperties2" : "vkGetPhysicalDeviceMemoryProperties2KHR"));
+		}
+		if (getMemoryProperties2 != nullptr)
+		{
+			enabledDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+		else
+		{
+			std::cerr << "VK_EXT_memory_budget is not supported, only tracked allocations are reported\n";
+		}
+	}
+
+	// Pipeline variants are linked from graphics pipeline libraries if the example requested it and the device supports them
+	if (pipelineLibrary.requested && !commandLineParser.isSet("nopipelinelibrary"))
+	{
+		const bool properties2 = (apiVersion >= VK_API_VERSION_1_1) ||
+			(std::find(supportedInstanceExtensions.begin(), supportedInstanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != supportedInstanceExtensions.end());
+		if (properties2 && vulkanDevice->IsExtensionSupported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) && vulkanDevice->IsExtensionSupported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+		{
+			PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance,
+				(apiVersion >= VK_API_VERSION_1_1) ? "vkGetPhysicalDeviceFeatures2" : "vkGetPhysicalDeviceFeatures2KHR"));
+			PFN_vkGetPhysicalDeviceProperties2KHR getProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(vkGetInstanceProcAddr(instance,
+				(apiVersion >= VK_API_VERSION_1_1) ? "vkGetPhysicalDeviceProperties2" : "vkGetPhysicalDeviceProperties2KHR"));
+			VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+			VkPhysicalDeviceFeatures2 features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+			features2.pNext = &libraryFeatures;
+			getFeatures2(physicalDevice, &features2);
+			VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT libraryProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT };
+			VkPhysicalDeviceProperties2 properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+			properties.pNext = &libraryProperties;
+			getProperties2(physicalDevice, &properties);
+			pipelineLibrary.enabled = (libraryFeatures.graphicsPipelineLibrary == VK_TRUE);
+			pipelineLibrary.fastLinking = (libraryProperties.graphicsPipelineLibraryFastLinking == VK_TRUE);
+		}
+		if (pipelineLibrary.enabled)
+		{
+			enabledDeviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+			enabledDeviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+			pipelineLibrary.features.graphicsPipelineLibrary = VK_TRUE;
+			pipelineLibrary.features.pNext = deviceCreateNextChain;
+			deviceCreateNextChain = &pipelineLibrary.features;
+		}
+		else
+		{
+			std::cerr << "VK_EXT_graphics_pipeline_library is not supported, pipeline variants are compiled as full pipelines\n";
+		}
+	}
+
+	// Frame pacing waits for presents with VK_KHR_present_wait (which needs the ids of VK_KHR_present_id)
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR };
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+	if ((framePacer.mode != vks::FramePacer::MODE_OFF) && !settings.headless)
+	{
+		const bool properties2 = (apiVersion >= VK_API_VERSION_1_1) ||
+			(std::find(supportedInstanceExtensions.begin(), supportedInstanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != supportedInstanceExtensions.end());
+		if (properties2 && vulkanDevice->IsExtensionSupported(VK_KHR_PRESENT_ID_EXTENSION_NAME) && vulkanDevice->IsExtensionSupported(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+		{
+			PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance,
+				(apiVersion >= VK_API_VERSION_1_1) ? "vkGetPhysicalDeviceFeatures2" : "vkGetPhysicalDeviceFeatures2KHR"));
+			presentIdFeatures.pNext = &presentWaitFeatures;
+			VkPhysicalDeviceFeatures2 features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+			features2.pNext = &presentIdFeatures;
+			getFeatures2(physicalDevice, &features2);
+			swapChain.presentWait = (presentIdFeatures.presentId == VK_TRUE) && (presentWaitFeatures.presentWait == VK_TRUE);
+		}
+		if (swapChain.presentWait)
+		{
+			enabledDeviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			enabledDeviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			presentIdFeatures.presentId = VK_TRUE;
+			presentWaitFeatures.presentWait = VK_TRUE;
+			presentWaitFeatures.pNext = deviceCreateNextChain;
+			deviceCreateNextChain = &presentIdFeatures;
+		}
+		else
+		{
+			std::cerr << "VK_KHR_present_wait is not supported, frames are not paced and the latency is measured to the end of the GPU work\n";
+			if (framePacer.framesAhead > 0)
+			{
+				std::cerr << "--framesahead has no effect without VK_KHR_present_wait\n";
+			}
+		}
+	}
+
+	// Simulation steps hand their states over to the graphics queue with timeline semaphores if the example schedules them asynchronously
+	if (asyncCompute.requested && !asyncCompute.singleQueue)
+	{
+		const bool properties2 = (apiVersion >= VK_API_VERSION_1_1) ||
+			(std::find(supportedInstanceExtensions.begin(), supportedInstanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != supportedInstanceExtensions.end());
+		if (properties2 && vulkanDevice->IsExtensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+		{
+			PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance,
+				(apiVersion >= VK_API_VERSION_1_1) ? "vkGetPhysicalDeviceFeatures2" : "vkGetPhysicalDeviceFeatures2KHR"));
+			VkPhysicalDeviceFeatures2 features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+			features2.pNext = &asyncCompute.features;
+			getFeatures2(physicalDevice, &features2);
+			asyncCompute.timelineSemaphores = (asyncCompute.features.timelineSemaphore == VK_TRUE);
+		}
+		if (asyncCompute.timelineSemaphores)
+		{
+			enabledDeviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+			asyncCompute.features.pNext = deviceCreateNextChain;
+			deviceCreateNextChain = &asyncCompute.features;
+		}
+	}
+
 	VkResult res = vulkanDevice->CreateLogicalDevice(curEnabledDeviceFeatures, enabledDeviceExtensions, deviceCreateNextChain);
 	if (res != VK_SUCCESS)
 	{
@@ -604,6 +891,15 @@ bool VulkanExampleBase::initVulkanSetting()
 		return false;
 	}
 	device = vulkanDevice->logicalDevice;
+	shaderModuleCache.setDevice(device);
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	shaderModuleCache.assetManager = androidApp->activity->assetManager;
+#endif
+
+	if (instrumentation.enabled)
+	{
+		instrumentation.prepare(vulkanDevice, getMemoryProperties2);
+	}
 
 	// Get a graphics queue from the device
 	vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.graphicIndex, 0, &queue);
@@ -635,6 +931,8 @@ bool VulkanExampleBase::initVulkanSetting()
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = &semaphores.renderComplete;
 
+	benchmark.endPhase("init");
+
 	return true;
 }
 
@@ -673,6 +971,10 @@ void VulkanExampleBase::setupDPIAwareness()
 HWND VulkanExampleBase::setupWindow(HINSTANCE hinstance, WNDPROC wndproc)
 {
 	this->windowInstance = hinstance;
+	if (settings.headless)
+	{
+		return nullptr;
+	}
 
 	WNDCLASSEX wndClass;
 
@@ -1855,6 +2157,10 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 
 struct xdg_surface *VulkanExampleBase::setupWindow()
 {
+	if (settings.headless)
+	{
+		return nullptr;
+	}
 	surface = wl_compositor_create_surface(compositor);
 	xdg_surface = xdg_wm_base_get_xdg_surface(shell, surface);
 
@@ -1881,6 +2187,11 @@ xcb_window_t VulkanExampleBase::setupWindow()
 {
 	uint32_t value_mask, value_list[32];
 
+	if (settings.headless)
+	{
+		return 0;
+	}
+
 	window = xcb_generate_id(connection);
 
 	value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
@@ -2151,6 +2462,15 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 		}//if
 	}//if extCount
 
+	// Memory budgets of the instrumentation are queried with vkGetPhysicalDeviceMemoryProperties2KHR on Vulkan 1.0,
+	// pipeline library support with vkGetPhysicalDeviceFeatures2KHR
+	if ((instrumentation.enabled || pipelineLibrary.requested) && (apiVersion < VK_API_VERSION_1_1) &&
+		(std::find(supportedInstanceExtensions.begin(), supportedInstanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != supportedInstanceExtensions.end()) &&
+		(std::find_if(enabledInstanceExtensions.begin(), enabledInstanceExtensions.end(), [](const char* extension) { return strcmp(extension, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0; }) == enabledInstanceExtensions.end()))
+	{
+		instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	}
+
 	//Enable requested instance extensions
 	if (enabledInstanceExtensions.size()>0)
 	{
@@ -2256,7 +2576,7 @@ void VulkanExampleBase::setupDepthStencil()
 	memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 	memAlloc.allocationSize = memReqs.size;
 	memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &depthStencil.mem));
+	VK_CHECK_RESULT(vulkanDevice->AllocateMemory(&memAlloc, &depthStencil.mem, vks::MEMORY_CATEGORY_ATTACHMENT));
 	VK_CHECK_RESULT(vkBindImageMemory(device, depthStencil.image, depthStencil.mem, 0));
 
 	VkImageViewCreateInfo imageViewCI{};
@@ -2382,6 +2702,28 @@ void VulkanExampleBase::getEnabledFeatures()
 {
 }
 
+uint32_t VulkanExampleBase::runSelfTests(std::ostream& out)
+{
+	uint32_t failed = 0;
+	out << "Profiler\n";
+	failed += vks::Profiler::selfTest(out);
+	out << "Allocation tracker\n";
+	failed += vks::AllocationTracker::selfTest(out);
+	out << "Light clusters\n";
+	failed += vks::LightClusterGrid::selfTest(out);
+	out << "Pipeline registry\n";
+	failed += vks::PipelineRegistry::selfTest(out);
+	out << "Descriptor allocator\n";
+	failed += vks::DescriptorAllocator::selfTest(out);
+	out << "Upload arena\n";
+	failed += vks::UploadArena::selfTest(out);
+	out << "Frame pacer\n";
+	failed += vks::FramePacer::selfTest(out);
+	out << "Async compute\n";
+	failed += vks::AsyncCompute::selfTest(out);
+	return failed;
+}
+
 void VulkanExampleBase::prepareForRendering()
 {
 	if (vulkanDevice->enableDebugMarkers)
@@ -2397,13 +2739,33 @@ void VulkanExampleBase::prepareForRendering()
 	setupDepthStencil();
 	setupRenderPass();
 	createPipelineCache();
+	descriptorAllocator.prepare(device, swapChain.imageCount);
+	pipelineRegistry.prepare(device, pipelineCache, &shaderModuleCache, startup.pipelineThreads);
+	if (pipelineLibrary.enabled)
+	{
+		pipelineLibrary.prepare(device, pipelineCache, &shaderModuleCache);
+		pipelineRegistry.setLinkFunctions([this](const vks::PipelineStateDesc& desc) { return pipelineLibrary.link(desc, false); },
+			[this](const vks::PipelineStateDesc& desc) { return pipelineLibrary.link(desc, true); });
+	}
 	setupFrameBuffer();
 
-	settings.overlay = settings.overlay && (!benchmark.active);
+	// GPU timings and pipeline statistics default to one slot per swapchain image
+	if (profiler.enabled)
+	{
+		profiler.prepareGpu(vulkanDevice, vulkanDevice->queueFamilyIndices.graphicIndex, swapChain.imageCount);
+	}
+	if (instrumentation.enabled)
+	{
+		instrumentation.prepareStatistics(swapChain.imageCount);
+	}
+
+	// Frame times and other changing text would make headless frame dumps differ between runs
+	settings.overlay = settings.overlay && (!benchmark.active) && (!settings.headless);
 	if (settings.overlay)
 	{
 		uiOverlay.device = vulkanDevice;
 		uiOverlay.queue = queue;
+		uiOverlay.frameCount = swapChain.imageCount;
 		uiOverlay.shaders =
 		{
 			loadShader(getShadersPath() + "base/uioverlay.vert.spv",VK_SHADER_STAGE_VERTEX_BIT),
@@ -2420,35 +2782,164 @@ VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileNa
 	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	shaderStage.stage = stage;
 
-#ifdef VK_USE_PLATFORM_ANDROID_KHR
-	shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device);
-#else
-	shaderStage.module = vks::tools::loadShader(fileName.c_str(), device);
-#endif
-
+	shaderStage.module = shaderModuleCache.load(fileName);
 	shaderStage.pName = "main";
 	assert(shaderStage.module != VK_NULL_HANDLE);
-	shaderModules.push_back(shaderStage.module);
 
 	return shaderStage;
 }
 
+void VulkanExampleBase::createPipelines(vks::PipelineBatch& batch)
+{
+	const uint32_t count = static_cast<uint32_t>(batch.size());
+	batch.create(device, pipelineCache, startup.pipelineThreads);
+	startup.pipelineCount += count;
+	startup.pipelineTime += batch.createTime;
+}
+
+void VulkanExampleBase::reportStartup()
+{
+	const vks::ShaderModuleCache::Statistics shaders = shaderModuleCache.getStatistics();
+	benchmark.setCounter("startup.shaderModules", shaders.modules);
+	benchmark.setCounter("startup.shaderCacheHits", shaders.fileHits + shaders.contentHits);
+	benchmark.setCounter("startup.shaderLoadMs", shaders.loadTime);
+	benchmark.setCounter("startup.pipelines", startup.pipelineCount);
+	benchmark.setCounter("startup.pipelineMs", startup.pipelineTime);
+	const vks::PipelineRegistry::Statistics variants = pipelineRegistry.getStatistics();
+	benchmark.setCounter("startup.pipelineVariants", variants.compiled + variants.pending);
+	benchmark.setCounter("startup.pipelineVariantsPending", variants.pending);
+	const vks::GraphicsPipelineLibrary::Statistics libraries = pipelineLibrary.getStatistics();
+	if (pipelineLibrary.enabled)
+	{
+		benchmark.setCounter("startup.pipelineLibraries", libraries.parts);
+		benchmark.setCounter("startup.fastLinks", variants.fastLinked);
+		benchmark.setCounter("startup.fastLinkMs", variants.fastLinkTime);
+	}
+
+	if (!startup.report)
+	{
+		return;
+	}
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "Startup of " << windowTitle << ":\n";
+	double total = 0.0;
+	for (auto& phase : benchmark.phases)
+	{
+		std::cout << "  " << phase.first << ": " << phase.second << " ms\n";
+		total += phase.second;
+	}
+	std::cout << "  total: " << total << " ms\n";
+	std::cout << "  shaders: " << shaders.modules << " modules (" << shaders.bytes / 1024 << " KB) in " << shaders.loadTime << " ms, "
+		<< shaders.fileHits << " file and " << shaders.contentHits << " content cache hits\n";
+	std::cout << "  pipelines: " << startup.pipelineCount << " batched in " << startup.pipelineTime << " ms\n";
+	if (variants.requests > 0)
+	{
+		std::cout << "  pipeline variants: " << variants.compiled + variants.pending << " (" << variants.dedupHits << " deduplicated requests), "
+			<< variants.compiled << " compiled in " << variants.compileTime << " ms, " << variants.pending << " pending"
+			<< (pipelineRegistry.synchronous ? " (serial)" : "") << "\n";
+	}
+	if (pipelineLibrary.enabled)
+	{
+		std::cout << "  pipeline libraries: " << libraries.parts << " parts (" << libraries.partHits << " reused) in " << libraries.partTime << " ms, "
+			<< variants.fastLinked << " variants fast linked in " << variants.fastLinkTime << " ms"
+			<< (pipelineLibrary.fastLinking ? "" : " (fast linking not guaranteed)") << "\n";
+	}
+}
+
+bool VulkanExampleBase::updatePipelineVariants()
+{
+	if (!pipelineRegistry.update())
+	{
+		return false;
+	}
+	const vks::PipelineRegistry::Statistics variants = pipelineRegistry.getStatistics();
+	if (variants.pending == 0)
+	{
+		benchmark.setCounter("startup.pipelineVariantsReadyMs", variants.readyTime);
+		if (startup.report)
+		{
+			std::cout << "Pipeline variants of " << windowTitle << " ready " << variants.readyTime << " ms after the first request ("
+				<< variants.compiled << " compiled in " << variants.compileTime << " ms)\n";
+		}
+	}
+	return true;
+}
+
 void VulkanExampleBase::renderLoop()
 {
+	benchmark.endPhase("prepare");
+	reportStartup();
+
 	if (benchmark.active)
 	{
 		benchmark.run(
-			[=] {render(); },
+			[=] {
+				beginPacedFrame();
+				{
+					vks::Profiler::CpuScope scope(profiler, "render");
+					render();
+				}
+				profiler.endFrame();
+			},
 			vulkanDevice->properties
 		);
 
 		vkDeviceWaitIdle(device);
 		if (benchmark.filename!="")
 		{
+			instrumentation.addCounters(benchmark);
+			if (instrumentation.enabled)
+			{
+				const vks::DescriptorAllocator::Statistics descriptors = descriptorAllocator.getStatistics();
+				const double frames = static_cast<double>(std::max(descriptors.frames, 1u));
+				benchmark.setCounter("descriptors.allocationsPerFrame", descriptors.frameTotals.allocations / frames);
+				benchmark.setCounter("descriptors.writesPerFrame", descriptors.frameTotals.writes / frames);
+				benchmark.setCounter("descriptors.pools", descriptors.pools + descriptors.transientPools);
+			}
+			const vks::FramePacer::Statistics& pacing = framePacer.getStatistics();
+			benchmark.setCounter("present.latencyMs", pacing.latencyTotal / std::max(pacing.latencySamples, 1u));
+			benchmark.setCounter("present.latencyMaxMs", pacing.latencyMax);
+			benchmark.setCounter("present.presentWait", swapChain.presentWait ? 1.0 : 0.0);
+			benchmark.setCounter("present.imageCount", swapChain.imageCount);
+			// Frames ahead that took effect: only presents are queued, the GPU work of each frame is waited for in submitFrame
+			benchmark.setCounter("present.framesAhead", swapChain.presentWait ? framePacer.framesAhead : 0);
+			if (asyncCompute.isPrepared())
+			{
+				const vks::AsyncCompute::Statistics& async = asyncCompute.getStatistics();
+				const double samples = std::max(async.samples, 1u);
+				benchmark.setCounter("asyncCompute.dedicatedQueue", asyncCompute.isAsync() ? 1.0 : 0.0);
+				benchmark.setCounter("asyncCompute.computeMs", async.computeTimeTotal / samples);
+				benchmark.setCounter("asyncCompute.graphicsMs", async.graphicsTimeTotal / samples);
+				benchmark.setCounter("asyncCompute.overlapMs", async.overlapTotal / samples);
+			}
+			if (uploadArena.isPrepared())
+			{
+				const vks::UploadArena::Statistics uploads = uploadArena.getStatistics();
+				const double frames = static_cast<double>(std::max(uploads.frames, 1u));
+				benchmark.setCounter("uploads.bytesPerFrame", uploads.frameTotals.bytes / frames);
+				benchmark.setCounter("uploads.peakUsage", static_cast<double>(uploads.peakUsage));
+				benchmark.setCounter("uploads.overflows", static_cast<double>(uploads.overflows));
+			}
 			benchmark.saveResults();
 		}
 	}
 
+	if (settings.headless)
+	{
+		// There are no window events, render a fixed number of frames (at least up to the dumped one)
+		if (!benchmark.active)
+		{
+			const uint32_t frameCount = std::max<uint32_t>(headless.frameCount, static_cast<uint32_t>(headless.dumpFrame + 1));
+			lastTimestamp = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < frameCount; i++)
+			{
+				nextFrame();
+			}
+		}
+		vkDeviceWaitIdle(device);
+		return;
+	}
+
 	destWidth = width;
 	destHeight = height;
 	lastTimestamp = std::chrono::high_resolution_clock::now();
@@ -2821,11 +3312,40 @@ bool VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
 		const VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		return uiOverlay.draw(commandBuffer);
+		// The overlay geometry has a slot per swap chain image, other (secondary) command buffers are expected to be recorded for the current image
+		uint32_t frameIndex = currentCmdBufferIndex;
+		auto drawCmdBuffer = std::find(drawCmdBuffers.begin(), drawCmdBuffers.end(), commandBuffer);
+		if (drawCmdBuffer != drawCmdBuffers.end())
+		{
+			frameIndex = static_cast<uint32_t>(std::distance(drawCmdBuffers.begin(), drawCmdBuffer));
+		}
+		return uiOverlay.draw(commandBuffer, frameIndex);
 	}
 	return false;
 }
 
+void VulkanExampleBase::beginPacedFrame()
+{
+	if (swapChain.presentWait)
+	{
+		const uint64_t target = framePacer.waitTarget();
+		if (target > 0)
+		{
+			if (swapChain.waitForPresent(target, PRESENT_WAIT_TIMEOUT) == VK_SUCCESS)
+			{
+				framePacer.presentCompleted(target, framePacer.now());
+			}
+			else
+			{
+				// Timed out (e.g. the window is hidden) or the swap chain is out of date
+				framePacer.reset();
+			}
+		}
+		framePacer.sleepBeforeFrame();
+	}
+	currentPresentId = framePacer.beginFrame();
+}
+
 void VulkanExampleBase::prepareFrame()
 {
 	//Acquire the next image from the swap chain λһ֡ƽpresentлź
@@ -2839,16 +3359,25 @@ void VulkanExampleBase::prepareFrame()
 	else
 	{
 		VK_CHECK_RESULT(result);
+		// The previous frame that used this image has completed, so its transient descriptor pools and upload space can be reused
+		descriptorAllocator.beginFrame(currentCmdBufferIndex);
+		uploadArena.beginFrame(currentCmdBufferIndex);
+		if (settings.overlay)
+		{
+			uiOverlay.beginFrame(currentCmdBufferIndex);
+		}
 	}
 }
 
 void VulkanExampleBase::submitFrame()
 {
-	VkResult result = swapChain.queuePresent(queue, currentCmdBufferIndex, semaphores.renderComplete);
+	VkResult result = swapChain.queuePresent(queue, currentCmdBufferIndex, semaphores.renderComplete, currentPresentId);
 	if (!(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR))
 	{
 		if (result == VK_ERROR_OUT_OF_DATE_KHR)
 		{
+			// The presents of the old swap chain won't complete
+			framePacer.reset();
 			resizeWindow();
 			return;
 		}
@@ -2859,6 +3388,67 @@ void VulkanExampleBase::submitFrame()
 	}
 
 	VK_CHECK_RESULT(vkQueueWaitIdle(queue));//ύæȶȾ
+	framePacer.endFrame();
+	if (!swapChain.presentWait)
+	{
+		// Without present wait the end of the frame's GPU work is the closest known point to its present
+		framePacer.presentCompleted(currentPresentId, framePacer.now());
+	}
+
+	if (settings.headless)
+	{
+		if (headless.renderedFrames == static_cast<uint32_t>(headless.dumpFrame))
+		{
+			if (saveSwapChainImage(currentCmdBufferIndex, headless.dumpFile))
+			{
+				std::cout << "Saved frame " << headless.dumpFrame << " to " << headless.dumpFile << "\n";
+			}
+			else
+			{
+				std::cerr << "Could not save frame " << headless.dumpFrame << " to " << headless.dumpFile << "\n";
+			}
+		}
+		headless.renderedFrames++;
+	}
+}
+
+bool VulkanExampleBase::saveSwapChainImage(uint32_t imageIndex, const std::string& filename)
+{
+	VkImage image = swapChain.images[imageIndex];
+	const VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingMemory;
+	VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size, &stagingBuffer, &stagingMemory, nullptr, vks::MEMORY_CATEGORY_STAGING));
+
+	VkCommandBuffer copyCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
+	VkBufferImageCopy copyRegion = {};
+	copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	copyRegion.imageExtent = { width, height, 1 };
+	vkCmdCopyImageToBuffer(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer, 1, &copyRegion);
+	vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, subresourceRange);
+	vulkanDevice->FlushCommandBuffer(copyCmd, queue);
+
+	uint8_t* data;
+	VK_CHECK_RESULT(vkMapMemory(device, stagingMemory, 0, size, 0, (void**)&data));
+	std::vector<uint8_t> pixels(data, data + size);
+	vkUnmapMemory(device, stagingMemory);
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	vulkanDevice->FreeMemory(stagingMemory);
+
+	// PNG stores RGBA, the alpha of the swapchain image isn't meaningful
+	const bool bgra = (swapChain.colorFormat == VK_FORMAT_B8G8R8A8_UNORM) || (swapChain.colorFormat == VK_FORMAT_B8G8R8A8_SRGB);
+	for (size_t i = 0; i < pixels.size(); i += 4)
+	{
+		if (bgra)
+		{
+			std::swap(pixels[i], pixels[i + 2]);
+		}
+		pixels[i + 3] = 255;
+	}
+	return vks::tools::savePng(filename, width, height, pixels.data());
 }
 
 void VulkanExampleBase::renderFrame()
@@ -2892,9 +3482,27 @@ CommandLineParser::CommandLineParser()
 	add("benchmark", { "-b", "--benchmark" }, 0, "Run example in benchmark mode");
 	add("benchmarkwarmup", { "-bw", "--benchwarmup" }, 1, "Set warmup time for benchmark mode in seconds");
 	add("benchmarkruntime", { "-br", "--benchruntime" }, 1, "Set duration time for benchmark mode in seconds");
-	add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
+	add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results, a .json extension writes a structured report");
 	add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	add("headless", { "-hl", "--headless" }, 0, "Render into offscreen images without a window");
+	add("headlessframes", { "-hlf", "--headlessframes" }, 1, "Number of frames rendered in headless mode (default 100)");
+	add("dumpframe", { "-df", "--dumpframe" }, 1, "Save the given frame as PNG (headless mode)");
+	add("dumpfile", { "-dfn", "--dumpfile" }, 1, "File name of the saved frame (default frame.png)");
+	add("profile", { "-pf", "--profile" }, 0, "Show CPU and GPU region timings in the UI overlay");
+	add("profiletrace", { "-pt", "--profiletrace" }, 1, "Enable profiling and save the first frames as Chrome trace to the given file");
+	add("profiletraceframes", { "-ptf", "--profiletraceframes" }, 1, "Number of frames saved to the profiler trace (default 120)");
+	add("instrumentation", { "-is", "--instrumentation" }, 0, "Collect pipeline statistics and device memory usage (UI overlay and benchmark report)");
+	add("startupreport", { "-sr", "--startupreport" }, 0, "Print the time spent in the startup phases, shader loading and pipeline creation");
+	add("pipelinethreads", { "-plt", "--pipelinethreads" }, 1, "Number of threads batched pipelines are created on (default: one per hardware thread)");
+	add("serialpipelines", { "-spl", "--serialpipelines" }, 0, "Compile pipeline variants on the render thread when they are requested instead of in the background");
+	add("nopipelinelibrary", { "-npl", "--nopipelinelibrary" }, 0, "Compile pipeline variants as full pipelines instead of linking them from graphics pipeline libraries");
+	add("presentmode", { "-pm", "--presentmode" }, 1, "Select the present mode (fifo, relaxed, mailbox or immediate), overrides --vsync");
+	add("swapchainimages", { "-sci", "--swapchainimages" }, 1, "Minimum number of swapchain images (default: one more than the surface minimum)");
+	add("latencymode", { "-lm", "--latencymode" }, 1, "Frame pacing: 0 = off, 1 = wait for presents (VK_KHR_present_wait), 2 = also delay frame starts just in time");
+	add("framesahead", { "-fa", "--framesahead" }, 1, "Finished frames that may be queued for presentation when a paced frame starts (default 0), GPU work is never queued as every frame is waited for");
+	add("noasynccompute", { "-nac", "--noasynccompute" }, 0, "Run compute simulation steps on the graphics queue instead of a dedicated compute queue");
+	add("selftest", { "--selftest" }, 0, "Run the device independent checks of the helper classes (profiler, allocation tracker, light clusters, pipeline registry, descriptor allocator, upload arena, frame pacer, async compute and the example's own) and exit");
 }
 
 void CommandLineParser::add(std::string name, std::vector<std::string> commands, bool hasValue, std::string help)
@@ -72,6 +72,19 @@
 #include "VulkanInitializers.hpp"
 #include "camera.hpp"
 #include "benchmark.hpp"
+#include "Profiler.hpp"
+#include "Instrumentation.hpp"
+#include "ShaderModuleCache.hpp"
+#include "PipelineBatch.hpp"
+#include "PipelineRegistry.hpp"
+#include "PipelineLibrary.hpp"
+#include "DescriptorAllocator.hpp"
+#include "UploadArena.hpp"
+#include "FramePacer.hpp"
+#include "AsyncCompute.hpp"
+
+// Presents that aren't shown within this time (nanoseconds, e.g. minimized window) are not waited for
+#define PRESENT_WAIT_TIMEOUT 1000000000ull
 
 class CommandLineParser
 {
@@ -167,8 +180,22 @@ protected:
 	uint32_t currentCmdBufferIndex = 0;
 	//Descriptor set pool
 	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
-	// List of shader modules created (stored for cleanup)
-	std::vector<VkShaderModule> shaderModules;
+	// Shader modules created by loadShader, cached by file name and content (and destroyed by the base)
+	vks::ShaderModuleCache shaderModuleCache;
+	// Pipeline variants requested by description and compiled in the background (pipelines are destroyed by the base)
+	vks::PipelineRegistry pipelineRegistry;
+	// Libraries the registry links its variants from if requested by the example and supported (VK_EXT_graphics_pipeline_library)
+	vks::GraphicsPipelineLibrary pipelineLibrary;
+	// Growing descriptor pools, per-frame transient pools, cached set layouts and batched writes (owned by the base)
+	vks::DescriptorAllocator descriptorAllocator;
+	// Ring buffer for per-frame uniform data bound with dynamic offsets, created by examples that use it (uploadArena.prepare)
+	vks::UploadArena uploadArena;
+	// Waits for presents and delays frame starts for lower latency (--latencymode), measures the input-to-present latency
+	vks::FramePacer framePacer;
+	// Present id of the current frame, passed to queuePresent
+	uint64_t currentPresentId = 0;
+	// Runs simulation steps on a dedicated compute queue alongside rendering, requested and prepared by examples (asyncCompute.prepare)
+	vks::AsyncCompute asyncCompute;
 	//Pipeline cache object
 	VkPipelineCache pipelineCache;
 	VulkanSwapChain swapChain;
@@ -195,6 +222,10 @@ public:
 	float frameTimer = 1.0f;
 
 	vks::Benchmark benchmark;
+	// CPU and GPU region timings, enabled with --profile
+	vks::Profiler profiler;
+	// Pipeline statistics and device memory usage, enabled with --instrumentation
+	vks::Instrumentation instrumentation;
 	// Encapsulated physical and logical vulkan device
 	vks::VulkanDevice * vulkanDevice;
 
@@ -208,8 +239,30 @@ public:
 		bool vsync = false;
 		// Enable UI overlay
 		bool overlay = true;
+		// Render into offscreen images without a window, surface or presentation
+		bool headless = false;
 	} settings;
 
+	struct
+	{
+		// Frames the render loop runs in headless mode (if not benchmarking)
+		uint32_t frameCount = 100;
+		// Frame saved as PNG, -1 = none
+		int32_t dumpFrame = -1;
+		std::string dumpFile = "frame.png";
+		uint32_t renderedFrames = 0;
+	} headless;
+
+	struct
+	{
+		// Print the time of the startup phases, shader loading and pipeline creation once the example is prepared
+		bool report = false;
+		// Threads used by createPipelines, 0 = one per hardware thread
+		uint32_t pipelineThreads = 0;
+		uint32_t pipelineCount = 0;
+		double pipelineTime = 0.0;
+	} startup;
+
 	VkClearColorValue defaultClearColor = { {0.025f,0.025f,0.025f,1.0f} };
 
 	static std::vector<const char*>args;
@@ -399,16 +452,33 @@ public:
 
 	virtual void prepareForRendering();
 
+	// Runs the selfTest of the helper classes for --selftest and returns the number of failed checks, examples add the checks of their own helpers
+	virtual uint32_t runSelfTests(std::ostream& out);
+
 	VkPipelineShaderStageCreateInfo loadShader(std::string fileName, VkShaderStageFlagBits stage);
 
+	// Creates the pipelines queued in the batch on several threads with the base's pipeline cache
+	void createPipelines(vks::PipelineBatch& batch);
+
+	void reportStartup();
+
+	// Returns true when pipeline variants got ready since the last call, command buffers binding them need to be rebuilt
+	bool updatePipelineVariants();
+
 	void renderLoop();
 
 	bool drawUI(const VkCommandBuffer commandBuffer);
 
+	// Waits as requested by the frame pacer and starts the next frame, called before render
+	void beginPacedFrame();
+
 	void prepareFrame();
 
 	void submitFrame();
 
+	// Copies a swapchain image (in present layout) to the host and writes it as PNG
+	bool saveSwapChainImage(uint32_t imageIndex, const std::string& filename);
+
 	virtual void renderFrame();
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay * overlay);
@@ -95,7 +95,7 @@ namespace vks
 			{
 				vkDestroyImage(vulkanDevice->logicalDevice, attachment.image, nullptr);
 				vkDestroyImageView(vulkanDevice->logicalDevice, attachment.imageView, nullptr);
-				vkFreeMemory(vulkanDevice->logicalDevice, attachment.memory, nullptr);
+				vulkanDevice->FreeMemory(attachment.memory);
 			}
 
 			vkDestroySampler(vulkanDevice->logicalDevice, sampler, nullptr);
@@ -153,7 +153,7 @@ namespace vks
 			vkGetImageMemoryRequirements(vulkanDevice->logicalDevice, attachment.image, &memReqs);
 			memAlloc.allocationSize = memReqs.size;
 			memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(vulkanDevice->logicalDevice, &memAlloc, nullptr, &attachment.memory));
+			VK_CHECK_RESULT(vulkanDevice->AllocateMemory(&memAlloc, &attachment.memory, MEMORY_CATEGORY_ATTACHMENT));
 			VK_CHECK_RESULT(vkBindImageMemory(vulkanDevice->logicalDevice, attachment.image, attachment.memory, 0));
 
 			attachment.subresourceRange = {};
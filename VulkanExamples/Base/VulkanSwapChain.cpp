@@ -223,6 +223,81 @@ void VulkanSwapChain::connect(VkInstance instance, VkPhysicalDevice physicalDevi
 	fpGetSwapchainImagesKHR = reinterpret_cast<PFN_vkGetSwapchainImagesKHR>(vkGetDeviceProcAddr(device, "vkGetSwapchainImagesKHR"));
 	fpAcquireNextImageKHR = reinterpret_cast<PFN_vkAcquireNextImageKHR>(vkGetDeviceProcAddr(device, "vkAcquireNextImageKHR"));
 	fpQueuePresentKHR = reinterpret_cast<PFN_vkQueuePresentKHR>(vkGetDeviceProcAddr(device, "vkQueuePresentKHR"));
+	// Only available if VK_KHR_present_wait has been enabled on the device
+	fpWaitForPresentKHR = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"));
+	presentWait = presentWait && (fpWaitForPresentKHR != nullptr);
+}
+
+/**
+* Select the present mode for a swap chain
+*
+* @param requested Requested present mode, VK_PRESENT_MODE_MAX_ENUM_KHR to select from the vsync setting
+* @param vsync Without a request: FIFO if set, otherwise the lowest latency mode available (mailbox, then immediate)
+* @param available Present modes supported by the surface
+*
+* @return The requested mode if supported, otherwise the closest one (FIFO is always supported)
+*/
+VkPresentModeKHR VulkanSwapChain::selectPresentMode(VkPresentModeKHR requested, bool vsync, const std::vector<VkPresentModeKHR>& available)
+{
+	auto supported = [&](VkPresentModeKHR mode) { return std::find(available.begin(), available.end(), mode) != available.end(); };
+	if (requested == VK_PRESENT_MODE_MAX_ENUM_KHR)
+	{
+		requested = vsync ? VK_PRESENT_MODE_FIFO_KHR : VK_PRESENT_MODE_MAILBOX_KHR;
+	}
+
+	// Fallbacks keep the tearing / non-tearing choice where possible
+	std::vector<VkPresentModeKHR> candidates;
+	switch (requested)
+	{
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		candidates = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+		break;
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		candidates = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		candidates = { VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	default:
+		break;
+	}
+	for (VkPresentModeKHR candidate : candidates)
+	{
+		if (supported(candidate))
+		{
+			return candidate;
+		}
+	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+/**
+* Select the minimum image count of a swap chain
+*
+* @param requested Requested image count, 0 for one more than the surface minimum
+* @param surfaceCaps Capabilities of the surface the count is clamped to
+*/
+uint32_t VulkanSwapChain::selectImageCount(uint32_t requested, const VkSurfaceCapabilitiesKHR& surfaceCaps)
+{
+	uint32_t imageCount = (requested == 0) ? surfaceCaps.minImageCount + 1 : std::max(requested, surfaceCaps.minImageCount);
+	if ((surfaceCaps.maxImageCount > 0) && (imageCount > surfaceCaps.maxImageCount))
+	{
+		std::cerr << imageCount << " swapchain images are not supported, using " << surfaceCaps.maxImageCount << "\n";
+		imageCount = surfaceCaps.maxImageCount;
+	}
+	return imageCount;
+}
+
+const char* VulkanSwapChain::presentModeName(VkPresentModeKHR presentMode)
+{
+	switch (presentMode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+	case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+	default: return "unknown";
+	}
 }
 
 /** 
@@ -231,9 +306,17 @@ void VulkanSwapChain::connect(VkInstance instance, VkPhysicalDevice physicalDevi
 * @param width Pointer to the width of the swapchain (may be adjusted to fit the requirements of the swapchain)
 * @param height Pointer to the height of the swapchain (may be adjusted to fit the requirements of the swapchain)
 * @param vsync (Optional) Can be used to force vsync-ed rendering (by using VK_PRESENT_MODE_FIFO_KHR as presentation mode)
+*
+* @note presentConfig selects the present mode and image count explicitly, vsync is only used if it doesn't request a mode
 */
 void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync)
 {
+	if (headless)
+	{
+		createHeadless(*width, *height);
+		return;
+	}
+
 	//Store the current swap chain handle so we can use it later on to ease up recreation
 	VkSwapchainKHR oldSwapchain = this->swapChain;
 
@@ -246,8 +329,8 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync)
 	VK_CHECK_RESULT(fpGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, this->surface, &presentModeCount, NULL));
 	assert(presentModeCount > 0);
 
-	std::vector<VkPresentModeKHR> presentModes(presentModeCount);
-	VK_CHECK_RESULT(fpGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, this->surface, &presentModeCount, presentModes.data()));
+	supportedPresentModes.resize(presentModeCount);
+	VK_CHECK_RESULT(fpGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, this->surface, &presentModeCount, supportedPresentModes.data()));
 
 	VkExtent2D swapchainExtent = {};
 	// If width (and height) equals the special value 0xFFFFFFFF,the size of the surface will set by swapchain
@@ -265,37 +348,17 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync)
 	}
 
 	// Select a present mode for the swapchain
-
-	// The VK_PRESENT_MODE_FIFO_KHR mode must always be present as per spec
-	// This mode waits for the vertical blank("v-sync")
-	VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
-
-	//If v-sync is not requested,try to find a mailbox mode
-	// It's the lowest latency non-tearing present mode available
-	if (!vsync)
+	// The VK_PRESENT_MODE_FIFO_KHR mode must always be present as per spec, it waits for the vertical blank ("v-sync")
+	// Without v-sync mailbox is preferred, it's the lowest latency non-tearing present mode available
+	VkPresentModeKHR swapchainPresentMode = selectPresentMode(presentConfig.presentMode, vsync, supportedPresentModes);
+	if ((presentConfig.presentMode != VK_PRESENT_MODE_MAX_ENUM_KHR) && (swapchainPresentMode != presentConfig.presentMode))
 	{
-		for (size_t i=0;i<presentModeCount;++i)
-		{
-			if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
-			{
-				swapchainPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-				break;
-			}
-
-			if (presentModes[i]==VK_PRESENT_MODE_IMMEDIATE_KHR)
-			{
-				swapchainPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-			}
-
-		}//for
+		std::cerr << "Present mode " << presentModeName(presentConfig.presentMode) << " is not supported, using " << presentModeName(swapchainPresentMode) << "\n";
 	}
+	presentMode = swapchainPresentMode;
 
-	//û
-	uint32_t desiredNumberOfSwapchainImages = surfaceCaps.minImageCount + 1;
-	if( (surfaceCaps.maxImageCount>0) && (desiredNumberOfSwapchainImages>surfaceCaps.maxImageCount))
-	{
-		desiredNumberOfSwapchainImages = surfaceCaps.maxImageCount;
-	}
+	// Fewer images lower the latency of queued frames, more images keep FIFO and mailbox from blocking
+	uint32_t desiredNumberOfSwapchainImages = selectImageCount(presentConfig.minImageCount, surfaceCaps);
 
 	//Find the transformation of the surface
 	VkSurfaceTransformFlagBitsKHR preTransform;
@@ -421,6 +484,22 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync)
 */
 VkResult VulkanSwapChain::acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t *imageIndex)
 {
+	if (headless)
+	{
+		// Images are used in turn, the semaphore is signaled by an empty submission so the frame's submit can wait on it as usual
+		headlessImageIndex = (headlessImageIndex + 1) % imageCount;
+		*imageIndex = headlessImageIndex;
+		if (presentCompleteSemaphore != VK_NULL_HANDLE)
+		{
+			VkSubmitInfo submitInfo = {};
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &presentCompleteSemaphore;
+			return vkQueueSubmit(headlessQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		}
+		return VK_SUCCESS;
+	}
+
 	// By setting timeout to UINT64_MAX we will always wait until the next image has been acquired or an actual error is thrown
 	// With that we don't have to handle VK_NOT_READY
 	return fpAcquireNextImageKHR(device, swapChain, UINT64_MAX, presentCompleteSemaphore, (VkFence)nullptr, imageIndex);
@@ -432,11 +511,28 @@ VkResult VulkanSwapChain::acquireNextImage(VkSemaphore presentCompleteSemaphore,
 * @param queue Presentation queue for presenting the image
 * @param imageIndex Index of the swapchain image to queue for presentation
 * @param waitSemaphore (Optional) Semaphore that is waited on before the image is presented (only used if != VK_NULL_HANDLE)
+* @param presentId (Optional) Increasing id of the present that can be waited for with waitForPresent (only used if present wait is enabled and != 0)
 *
 * @return VkResult of the queue presentation
 */
-VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore)
+VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore, uint64_t presentId)
 {
+	if (headless)
+	{
+		// Nothing is presented, only the wait on the render complete semaphore is kept so it is unsignaled for the next frame
+		if (waitSemaphore != VK_NULL_HANDLE)
+		{
+			VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			VkSubmitInfo submitInfo = {};
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &waitSemaphore;
+			submitInfo.pWaitDstStageMask = &waitStageMask;
+			return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+		}
+		return VK_SUCCESS;
+	}
+
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.pNext = NULL;
@@ -451,15 +547,47 @@ VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSem
 		presentInfo.waitSemaphoreCount = 1;
 	}
 
+	VkPresentIdKHR presentIdInfo = {};
+	if (presentWait && (presentId != 0))
+	{
+		presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentIdInfo.swapchainCount = 1;
+		presentIdInfo.pPresentIds = &presentId;
+		presentInfo.pNext = &presentIdInfo;
+	}
+
 	return fpQueuePresentKHR(queue, &presentInfo);
 }
 
+/**
+* Wait until a present passed to queuePresent has been shown (VK_KHR_present_wait)
+*
+* @param presentId Id of the present
+* @param timeout Timeout in nanoseconds
+*
+* @return VK_SUCCESS once shown, VK_TIMEOUT, or VK_ERROR_FEATURE_NOT_PRESENT if present wait is not enabled
+*/
+VkResult VulkanSwapChain::waitForPresent(uint64_t presentId, uint64_t timeout)
+{
+	if (!presentWait || headless || (swapChain == VK_NULL_HANDLE))
+	{
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	return fpWaitForPresentKHR(device, swapChain, presentId, timeout);
+}
+
 
 /**
 * Destroy and free Vulkan resources used for the swapchain
 */
 void VulkanSwapChain::cleanup()
 {
+	if (headless)
+	{
+		destroyHeadlessImages();
+		return;
+	}
+
 	if (swapChain!=VK_NULL_HANDLE)
 	{
 		for (uint32_t i = 0;i<imageCount;++i)
@@ -479,6 +607,105 @@ void VulkanSwapChain::cleanup()
 
 }
 
+/**
+* Use offscreen images instead of a surface and swapchain, e.g. for automated runs without a window system
+*
+* @param queue Queue used to signal and wait on the semaphores passed to acquireNextImage and queuePresent
+* @param queueFamilyIndex Queue family used for rendering
+*/
+void VulkanSwapChain::initHeadless(VkQueue queue, uint32_t queueFamilyIndex)
+{
+	headless = true;
+	headlessQueue = queue;
+	queueNodeIndex = queueFamilyIndex;
+	surface = VK_NULL_HANDLE;
+
+	// Same preference as for surfaces, with a fallback if the format can't be rendered to
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_B8G8R8A8_UNORM, &formatProperties);
+	colorFormat = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) ? VK_FORMAT_B8G8R8A8_UNORM : VK_FORMAT_R8G8B8A8_UNORM;
+	colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+}
+
+/**
+* Create the ring of offscreen images that replaces the swapchain images in headless mode
+*/
+void VulkanSwapChain::createHeadless(uint32_t width, uint32_t height)
+{
+	destroyHeadlessImages();
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	imageCount = HEADLESS_IMAGE_COUNT;
+	images.resize(imageCount);
+	buffers.resize(imageCount);
+	headlessMemory.resize(imageCount);
+	headlessImageIndex = imageCount - 1;
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		VkImageCreateInfo imageCI = {};
+		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = colorFormat;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		// Same usage a surface usually supports, transfer source is needed for frame dumps
+		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &images[i]));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, images[i], &memReqs);
+		VkMemoryAllocateInfo memAlloc = {};
+		memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = UINT32_MAX;
+		for (uint32_t j = 0; j < memoryProperties.memoryTypeCount; j++)
+		{
+			if ((memReqs.memoryTypeBits & (1 << j)) && (memoryProperties.memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+			{
+				memAlloc.memoryTypeIndex = j;
+				break;
+			}
+		}//for_j
+		if (memAlloc.memoryTypeIndex == UINT32_MAX)
+		{
+			vks::tools::exitFatal("Could not find a memory type for the headless swapchain images", -1);
+		}
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &headlessMemory[i]));
+		VK_CHECK_RESULT(vkBindImageMemory(device, images[i], headlessMemory[i], 0));
+
+		VkImageViewCreateInfo colorAttachmentView = {};
+		colorAttachmentView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		colorAttachmentView.format = colorFormat;
+		colorAttachmentView.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+		colorAttachmentView.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		colorAttachmentView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		colorAttachmentView.image = images[i];
+
+		buffers[i].image = images[i];
+		VK_CHECK_RESULT(vkCreateImageView(device, &colorAttachmentView, nullptr, &buffers[i].view));
+	}//for_i
+}
+
+void VulkanSwapChain::destroyHeadlessImages()
+{
+	for (size_t i = 0; i < headlessMemory.size(); i++)
+	{
+		vkDestroyImageView(device, buffers[i].view, nullptr);
+		vkDestroyImage(device, images[i], nullptr);
+		vkFreeMemory(device, headlessMemory[i], nullptr);
+	}
+	headlessMemory.clear();
+	images.clear();
+	buffers.clear();
+}
+
 #if defined(_DIRECT2DISPLAY)
 /**
 * Create direct to display surface
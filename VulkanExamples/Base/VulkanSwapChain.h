@@ -9,6 +9,9 @@
 #include <vulkan/vulkan.h>
 #include "VulkanTools.h"
 
+// Number of offscreen images used in place of the swapchain images in headless mode
+#define HEADLESS_IMAGE_COUNT 3
+
 #ifdef _ANDROID_
 #include "VulkanAndroid.h"
 #endif
@@ -37,6 +40,15 @@ private:
 	PFN_vkGetSwapchainImagesKHR fpGetSwapchainImagesKHR;
 	PFN_vkAcquireNextImageKHR fpAcquireNextImageKHR;
 	PFN_vkQueuePresentKHR fpQueuePresentKHR;
+	PFN_vkWaitForPresentKHR fpWaitForPresentKHR = nullptr;
+
+	// Headless mode
+	VkQueue headlessQueue = VK_NULL_HANDLE;
+	std::vector<VkDeviceMemory> headlessMemory;
+	uint32_t headlessImageIndex = 0;
+
+	void createHeadless(uint32_t width, uint32_t height);
+	void destroyHeadlessImages();
 
 public:
 	VkFormat colorFormat;
@@ -46,6 +58,22 @@ public:
 	std::vector<VkImage> images;
 	std::vector<SwapChainBuffer> buffers;
 	uint32_t queueNodeIndex = UINT32_MAX;
+	// Renders into offscreen images without a surface, acquire and present only signal and wait on the frame's semaphores
+	bool headless = false;
+
+	// Requested presentation, applied by create (unsupported requests fall back, see selectPresentMode and selectImageCount)
+	struct PresentConfig
+	{
+		// VK_PRESENT_MODE_MAX_ENUM_KHR = chosen from the vsync setting
+		VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+		// 0 = one more than the surface minimum
+		uint32_t minImageCount = 0;
+	} presentConfig;
+	// Present mode of the current swap chain and the modes the surface supports
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	std::vector<VkPresentModeKHR> supportedPresentModes;
+	// Set if VK_KHR_present_id and VK_KHR_present_wait are enabled on the device, queuePresent then tags the presents with ids
+	bool presentWait = false;
 
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
 	void initSurface(void* platformHandle, void* platformWindow);
@@ -68,11 +96,19 @@ public:
 
 	void connect(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device);
 
+	void initHeadless(VkQueue queue, uint32_t queueFamilyIndex);
+
 	void create(uint32_t* width, uint32_t* height, bool vsync = false);
 
 	VkResult acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex);
 
-	VkResult queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore = VK_NULL_HANDLE);
+	VkResult queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore = VK_NULL_HANDLE, uint64_t presentId = 0);
+
+	VkResult waitForPresent(uint64_t presentId, uint64_t timeout);
+
+	static VkPresentModeKHR selectPresentMode(VkPresentModeKHR requested, bool vsync, const std::vector<VkPresentModeKHR>& available);
+	static uint32_t selectImageCount(uint32_t requested, const VkSurfaceCapabilitiesKHR& surfaceCaps);
+	static const char* presentModeName(VkPresentModeKHR presentMode);
 
 	void cleanup();
 
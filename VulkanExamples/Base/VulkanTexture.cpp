@@ -26,7 +26,7 @@ namespace vks
 		{
 			vkDestroySampler(device->logicalDevice, sampler, nullptr);
 		}
-		vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+		device->FreeMemory(deviceMemory);
 	}
 
 	ktxResult Texture::loadKTXFile(std::string fileName, ktxTexture ** target)
@@ -119,7 +119,7 @@ namespace vks
 			memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits,
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+			VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &stagingMemory, MEMORY_CATEGORY_STAGING));
 			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 			//Copy texture data into staging buffer
@@ -173,7 +173,7 @@ namespace vks
 			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
 			memAllocInfo.allocationSize = memReqs.size;
 			memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+			VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &deviceMemory, MEMORY_CATEGORY_TEXTURE));
 			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 			VkImageSubresourceRange subresourceRange = {};
@@ -198,7 +198,7 @@ namespace vks
 
 			//Ѿɣ
 			//Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+			device->FreeMemory(stagingMemory);
 			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 		}
 		else
@@ -237,7 +237,7 @@ namespace vks
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
 			//Allocate host memory for image
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &mappableMemory));
+			VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &mappableMemory, MEMORY_CATEGORY_TEXTURE));
 			//Bind allocated image for use
 			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, mappableImage, mappableMemory, 0));
 
@@ -361,7 +361,7 @@ namespace vks
 		//Get memory type index for a host visible buffer
 		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+		VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &stagingMemory, MEMORY_CATEGORY_STAGING));
 		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 		// Copy texture data into staging buffer
@@ -404,7 +404,7 @@ namespace vks
 		memAllocInfo.allocationSize = memReqs.size;
 
 		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+		VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &deviceMemory, MEMORY_CATEGORY_TEXTURE));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 		VkImageSubresourceRange subresourceRange = {};
@@ -427,7 +427,7 @@ namespace vks
 		device->FlushCommandBuffer(copyCmd, copyQueue);
 
 		// Clean up staging resources
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+		device->FreeMemory(stagingMemory);
 		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 		// Create sampler
@@ -510,7 +510,7 @@ namespace vks
 		// Get memory type index for a host visible buffer
 		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+		VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &stagingMemory, MEMORY_CATEGORY_STAGING));
 		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 
@@ -570,7 +570,7 @@ namespace vks
 		memAllocInfo.allocationSize = memReqs.size;
 		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+		VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &deviceMemory, MEMORY_CATEGORY_TEXTURE));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 		// Use a separate command buffer for texture loading
@@ -625,7 +625,7 @@ namespace vks
 
 		// Clean up staging resources
 		ktxTexture_Destroy(pKtxTexture);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+		device->FreeMemory(stagingMemory);
 		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
@@ -677,7 +677,7 @@ namespace vks
 		// Get memory type index for a host visible buffer
 		memAllocateInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocateInfo, nullptr, &stagingMemory));
+		VK_CHECK_RESULT(device->AllocateMemory(&memAllocateInfo, &stagingMemory, MEMORY_CATEGORY_STAGING));
 		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 		// Copy texture data into staging buffer
@@ -740,7 +740,7 @@ namespace vks
 		memAllocateInfo.allocationSize = memReqs.size;
 		memAllocateInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocateInfo, nullptr, &deviceMemory));
+		VK_CHECK_RESULT(device->AllocateMemory(&memAllocateInfo, &deviceMemory, MEMORY_CATEGORY_TEXTURE));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 		// Use a separate command buffer for texture loading
@@ -795,7 +795,7 @@ namespace vks
 
 		// Clean up staging resources
 		ktxTexture_Destroy(pKtxTexture);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+		device->FreeMemory(stagingMemory);
 		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
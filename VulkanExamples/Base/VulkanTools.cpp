@@ -8,6 +8,13 @@
 
 #include "VulkanTools.h"
 
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 const std::string getAssetPath()
 {
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -323,58 +330,43 @@ namespace vks
 
 #if defined(__ANDROID__)
 		// Android shaders are stored as assets in the apk
-		// So they need to be loaded via the asset manager
+		// The SPIR-V is passed straight from the asset buffer, uncompressed assets are mapped from the apk
 		VkShaderModule loadShader(AAssetManager* assetManager, const char *fileName, VkDevice device)
 		{
-			// Load shader from compressed asset
-			AAsset* asset = AAssetManager_open(assetManager, fileName, AASSET_MODE_STREAMING);
-			assert(asset);
-			size_t size = AAsset_getLength(asset);
-			assert(size > 0);
-
-			char *shaderCode = new char[size];
-			AAsset_read(asset, shaderCode, size);
-			AAsset_close(asset);
-
-			VkShaderModule shaderModule;
-			VkShaderModuleCreateInfo moduleCreateInfo;
-			moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-			moduleCreateInfo.pNext = NULL;
-			moduleCreateInfo.codeSize = size;
-			moduleCreateInfo.pCode = (uint32_t*)shaderCode;
-			moduleCreateInfo.flags = 0;
-
-			VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, NULL, &shaderModule));
+			MappedFile file;
+			if (file.open(assetManager, fileName))
+			{
+				VkShaderModule shaderModule;
+				VkShaderModuleCreateInfo moduleCreateInfo{};
+				moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+				moduleCreateInfo.codeSize = file.size;
+				moduleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(file.data);
 
-			delete[] shaderCode;
+				VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, NULL, &shaderModule));
 
-			return shaderModule;
+				return shaderModule;
+			}
+			else
+			{
+				LOGE("Could not open shader file \"%s\"", fileName);
+				return VK_NULL_HANDLE;
+			}
 		}
 #else
 		VkShaderModule loadShader(const char *fileName, VkDevice device)
 		{
-			std::ifstream is(fileName, std::ios::binary | std::ios::in | std::ios::ate);
-
-			if (is.is_open())
+			// The SPIR-V is passed straight from the mapping, mappings are page aligned
+			MappedFile file;
+			if (file.open(fileName))
 			{
-				size_t size = is.tellg();
-				is.seekg(0, std::ios::beg);
-				char* shaderCode = new char[size];
-				is.read(shaderCode, size);
-				is.close();
-
-				assert(size > 0);
-
 				VkShaderModule shaderModule;
 				VkShaderModuleCreateInfo moduleCreateInfo{};
 				moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-				moduleCreateInfo.codeSize = size;
-				moduleCreateInfo.pCode = (uint32_t*)shaderCode;
+				moduleCreateInfo.codeSize = file.size;
+				moduleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(file.data);
 
 				VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, NULL, &shaderModule));
 
-				delete[] shaderCode;
-
 				return shaderModule;
 			}
 			else
@@ -385,6 +377,129 @@ namespace vks
 		}
 #endif
 
+		MappedFile::~MappedFile()
+		{
+			close();
+		}
+
+#if defined(__ANDROID__)
+		bool MappedFile::open(AAssetManager* assetManager, const char* fileName)
+		{
+			close();
+			asset = AAssetManager_open(assetManager, fileName, AASSET_MODE_BUFFER);
+			if (!asset)
+			{
+				return false;
+			}
+			// Uncompressed assets are mapped, compressed ones are decompressed into memory owned by the asset
+			data = static_cast<const char*>(AAsset_getBuffer(asset));
+			size = AAsset_getLength(asset);
+			if (!data || (size == 0))
+			{
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void MappedFile::close()
+		{
+			if (asset)
+			{
+				AAsset_close(asset);
+				asset = nullptr;
+			}
+			data = nullptr;
+			size = 0;
+		}
+#elif defined(_WIN32)
+		bool MappedFile::open(const char* fileName)
+		{
+			close();
+			file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0))
+			{
+				close();
+				return false;
+			}
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping == NULL)
+			{
+				close();
+				return false;
+			}
+			data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (!data)
+			{
+				close();
+				return false;
+			}
+			size = static_cast<size_t>(fileSize.QuadPart);
+			return true;
+		}
+
+		void MappedFile::close()
+		{
+			if (data)
+			{
+				UnmapViewOfFile(data);
+			}
+			if (mapping != NULL)
+			{
+				CloseHandle(mapping);
+				mapping = NULL;
+			}
+			if (file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+			data = nullptr;
+			size = 0;
+		}
+#else
+		bool MappedFile::open(const char* fileName)
+		{
+			close();
+			int fd = ::open(fileName, O_RDONLY);
+			if (fd < 0)
+			{
+				return false;
+			}
+			struct stat fileStat;
+			if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0))
+			{
+				::close(fd);
+				return false;
+			}
+			// The mapping stays valid after the descriptor has been closed
+			void* mapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (mapped == MAP_FAILED)
+			{
+				return false;
+			}
+			data = static_cast<const char*>(mapped);
+			size = static_cast<size_t>(fileStat.st_size);
+			return true;
+		}
+
+		void MappedFile::close()
+		{
+			if (data)
+			{
+				munmap(const_cast<char*>(data), size);
+			}
+			data = nullptr;
+			size = 0;
+		}
+#endif
+
 		bool fileExists(const std::string &filename)
 		{
 			std::ifstream f(filename.c_str());
@@ -396,5 +511,103 @@ namespace vks
 	        return (value + alignment - 1) & ~(alignment - 1);
         }
 
+		uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			uint64_t hash = seed;
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		// PNG chunks and zlib streams are big endian
+		static void appendBigEndian(std::vector<uint8_t>& data, uint32_t value)
+		{
+			data.push_back((uint8_t)(value >> 24));
+			data.push_back((uint8_t)(value >> 16));
+			data.push_back((uint8_t)(value >> 8));
+			data.push_back((uint8_t)value);
+		}
+
+		static uint32_t crc32(const uint8_t* data, size_t size)
+		{
+			uint32_t crc = 0xFFFFFFFF;
+			for (size_t i = 0; i < size; i++)
+			{
+				crc ^= data[i];
+				for (uint32_t k = 0; k < 8; k++)
+				{
+					crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+				}
+			}
+			return ~crc;
+		}
+
+		static void writePngChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& payload)
+		{
+			std::vector<uint8_t> chunk;
+			appendBigEndian(chunk, (uint32_t)payload.size());
+			chunk.insert(chunk.end(), type, type + 4);
+			chunk.insert(chunk.end(), payload.begin(), payload.end());
+			appendBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+			file.write((const char*)chunk.data(), chunk.size());
+		}
+
+		bool savePng(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba)
+		{
+			std::ofstream file(filename, std::ios::out | std::ios::binary);
+			if (!file.is_open() || (width == 0) || (height == 0))
+			{
+				return false;
+			}
+
+			// Scanlines with filter type 0 (none)
+			const size_t rowSize = (size_t)width * 4;
+			std::vector<uint8_t> raw;
+			raw.reserve((rowSize + 1) * height);
+			for (uint32_t y = 0; y < height; y++)
+			{
+				raw.push_back(0);
+				raw.insert(raw.end(), rgba + y * rowSize, rgba + (y + 1) * rowSize);
+			}
+
+			// zlib stream with stored (uncompressed) deflate blocks, no compression library is needed and the images are only used for comparisons
+			std::vector<uint8_t> zlib = { 0x78, 0x01 };
+			uint32_t adlerA = 1, adlerB = 0;
+			for (size_t offset = 0; offset < raw.size(); offset += 65535)
+			{
+				const uint16_t blockSize = (uint16_t)std::min<size_t>(65535, raw.size() - offset);
+				const bool last = (offset + blockSize >= raw.size());
+				zlib.push_back(last ? 1 : 0);
+				zlib.push_back((uint8_t)(blockSize & 0xFF));
+				zlib.push_back((uint8_t)(blockSize >> 8));
+				zlib.push_back((uint8_t)(~blockSize & 0xFF));
+				zlib.push_back((uint8_t)((~blockSize >> 8) & 0xFF));
+				zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+			}
+			for (uint8_t value : raw)
+			{
+				adlerA = (adlerA + value) % 65521;
+				adlerB = (adlerB + adlerA) % 65521;
+			}
+			appendBigEndian(zlib, (adlerB << 16) | adlerA);
+
+			const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+			file.write((const char*)signature, sizeof(signature));
+
+			std::vector<uint8_t> header;
+			appendBigEndian(header, width);
+			appendBigEndian(header, height);
+			// 8 bit depth, RGBA color, deflate, no filter method extensions, no interlacing
+			header.insert(header.end(), { 8, 6, 0, 0, 0 });
+			writePngChunk(file, "IHDR", header);
+			writePngChunk(file, "IDAT", zlib);
+			writePngChunk(file, "IEND", std::vector<uint8_t>());
+			return file.good();
+		}
+
 	}
 }
@@ -126,9 +126,45 @@ namespace vks
 		VkShaderModule loadShader(const char *fileName, VkDevice device);
 #endif
 
+		/** @brief Read-only memory mapping of a file (of an asset on Android), the data stays valid until the file is closed */
+		class MappedFile
+		{
+		public:
+			const char* data = nullptr;
+			size_t size = 0;
+
+			MappedFile() = default;
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+			~MappedFile();
+
+#if defined(__ANDROID__)
+			bool open(AAssetManager* assetManager, const char* fileName);
+#else
+			bool open(const char* fileName);
+#endif
+			void close();
+
+		private:
+#if defined(__ANDROID__)
+			AAsset* asset = nullptr;
+#elif defined(_WIN32)
+			HANDLE file = INVALID_HANDLE_VALUE;
+			HANDLE mapping = NULL;
+#endif
+		};
+
 		/** @brief Checks if a file exists */
 		bool fileExists(const std::string &filename);
 
 		uint32_t alignedSize(uint32_t value, uint32_t alignment);
+
+		/** @brief Seed of hashBytes, the FNV-1a offset basis */
+		const uint64_t hashSeed = 14695981039346656037ull;
+		/** @brief 64 bit FNV-1a hash of a byte range, pass the result of an earlier call as seed to hash several ranges */
+		uint64_t hashBytes(const void* data, size_t size, uint64_t seed = hashSeed);
+
+		/** @brief Writes 8 bit RGBA pixels as uncompressed PNG */
+		bool savePng(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba);
 	}
 }
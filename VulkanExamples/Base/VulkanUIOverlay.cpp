@@ -103,7 +103,7 @@ namespace vks
 		VkMemoryAllocateInfo memAllocInfo = vks::initializers::GenMemoryAllocateInfo();
 		memAllocInfo.allocationSize = memReqs.size;
 		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &fontMemory));
+		VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &fontMemory, MEMORY_CATEGORY_UI));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, fontImage, fontMemory, 0));
 
 		// Image view
@@ -123,7 +123,9 @@ namespace vks
 			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 			&stagingBuffer,
-			uploadSize));
+			uploadSize,
+			nullptr,
+			MEMORY_CATEGORY_STAGING));
 
 		stagingBuffer.map();
 		memcpy(stagingBuffer.mappedData, fontData, uploadSize);
@@ -293,7 +295,7 @@ namespace vks
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
 	}
 
-	/** Update vertex and index buffer containing the imGui elements when required */
+	/** Checks the draw data of the last ImGui::Render, returns true if the command buffers need to be recorded again */
 	bool UIOverlay::update()
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
@@ -301,57 +303,129 @@ namespace vks
 
 		if (!imDrawData) { return false; };
 
-		// Note: Alignment is done inside buffer creation
-		VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
-		VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
-
-		// Update buffers only if vertex or index count has been changed compared to current buffer size
-		if ((vertexBufferSize == 0) || (indexBufferSize == 0)) {
+		// Nothing to upload
+		if ((imDrawData->TotalVtxCount == 0) || (imDrawData->TotalIdxCount == 0)) {
 			return false;
 		}
 
-		// Vertex buffer
-		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount)) {
+		const auto tStart = std::chrono::high_resolution_clock::now();
+
+		// The slots grow geometrically, so buffers are only recreated (and memory allocated) when the UI outgrows them
+		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (imDrawData->TotalVtxCount > vertexCapacity) || (slotVersions.size() != frameCount)) {
+			vertexCapacity = std::max(std::max(vertexCapacity, UI_OVERLAY_MIN_VERTICES), 1);
+			while (vertexCapacity < imDrawData->TotalVtxCount) {
+				vertexCapacity *= 2;
+			}
 			vertexBuffer.unmap();
 			vertexBuffer.destroy();
-			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vertexBuffer, vertexBufferSize));
-			vertexCount = imDrawData->TotalVtxCount;
-			vertexBuffer.unmap();
-			vertexBuffer.map();
+			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vertexBuffer,
+				static_cast<VkDeviceSize>(vertexCapacity) * sizeof(ImDrawVert) * frameCount, nullptr, MEMORY_CATEGORY_UI));
+			VK_CHECK_RESULT(vertexBuffer.map());
+			statistics.bufferAllocations++;
 			updateCmdBuffers = true;
 		}
-
-		// Index buffer
-		VkDeviceSize indexSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
-		if ((indexBuffer.buffer == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount)) {
+		if ((indexBuffer.buffer == VK_NULL_HANDLE) || (imDrawData->TotalIdxCount > indexCapacity) || (slotVersions.size() != frameCount)) {
+			indexCapacity = std::max(std::max(indexCapacity, UI_OVERLAY_MIN_INDICES), 1);
+			while (indexCapacity < imDrawData->TotalIdxCount) {
+				indexCapacity *= 2;
+			}
 			indexBuffer.unmap();
 			indexBuffer.destroy();
-			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &indexBuffer, indexBufferSize));
-			indexCount = imDrawData->TotalIdxCount;
-			indexBuffer.map();
+			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indexBuffer,
+				static_cast<VkDeviceSize>(indexCapacity) * sizeof(ImDrawIdx) * frameCount, nullptr, MEMORY_CATEGORY_UI));
+			VK_CHECK_RESULT(indexBuffer.map());
+			statistics.bufferAllocations++;
 			updateCmdBuffers = true;
 		}
+		if (updateCmdBuffers) {
+			// New buffers hold no geometry yet
+			slotVersions.assign(frameCount, geometryVersion);
+			geometryVersion++;
+		}
+		vertexCount = imDrawData->TotalVtxCount;
+		indexCount = imDrawData->TotalIdxCount;
 
-		// Upload data
-		ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mappedData;
-		ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer.mappedData;
+		// The recorded draws depend on the counts, the clip rectangles and the display size, but not on the vertex data
+		uint64_t layout = vks::tools::hashBytes(&imDrawData->DisplaySize, sizeof(imDrawData->DisplaySize));
+		uint64_t geometry = vks::tools::hashSeed;
+		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++) {
+			const ImDrawList* cmd_list = imDrawData->CmdLists[i];
+			const int32_t counts[3] = { cmd_list->VtxBuffer.Size, cmd_list->IdxBuffer.Size, cmd_list->CmdBuffer.Size };
+			layout = vks::tools::hashBytes(counts, sizeof(counts), layout);
+			for (int32_t j = 0; j < cmd_list->CmdBuffer.Size; j++) {
+				const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[j];
+				layout = vks::tools::hashBytes(&pcmd->ElemCount, sizeof(pcmd->ElemCount), layout);
+				layout = vks::tools::hashBytes(&pcmd->ClipRect, sizeof(pcmd->ClipRect), layout);
+			}
+			geometry = vks::tools::hashBytes(cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), geometry);
+			geometry = vks::tools::hashBytes(cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), geometry);
+		}
+		if (layout != layoutHash) {
+			layoutHash = layout;
+			updateCmdBuffers = true;
+		}
+		// Unchanged geometry is not uploaded again, the slots are written when their frame begins
+		if ((geometry != geometryHash) || updateCmdBuffers) {
+			geometryHash = geometry;
+			geometryVersion++;
+		}
+		statistics.rebuilds += updateCmdBuffers ? 1 : 0;
+
+		// Rates over about a second of frames
+		rateWindow.time += ImGui::GetIO().DeltaTime;
+		if (rateWindow.time >= 1.0f) {
+			statistics.allocationsPerSecond = (statistics.bufferAllocations - rateWindow.bufferAllocations) / rateWindow.time;
+			statistics.rebuildsPerSecond = (statistics.rebuilds - rateWindow.rebuilds) / rateWindow.time;
+			statistics.uploadsPerSecond = static_cast<float>(statistics.uploads - rateWindow.uploads) / rateWindow.time;
+			rateWindow.time = 0.0f;
+			rateWindow.bufferAllocations = statistics.bufferAllocations;
+			rateWindow.rebuilds = statistics.rebuilds;
+			rateWindow.uploads = statistics.uploads;
+		}
+
+		pendingCpuTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		return updateCmdBuffers;
+	}
 
-		for (int n = 0; n < imDrawData->CmdListsCount; n++) {
-			const ImDrawList* cmd_list = imDrawData->CmdLists[n];
-			memcpy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-			memcpy(idxDst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-			vtxDst += cmd_list->VtxBuffer.Size;
-			idxDst += cmd_list->IdxBuffer.Size;
+	/** Writes the current geometry to the slot of the frame if it holds an older version, the previous frame using the slot must have completed */
+	void UIOverlay::beginFrame(uint32_t frameIndex)
+	{
+		ImDrawData* imDrawData = ImGui::GetDrawData();
+		if ((!imDrawData) || (vertexBuffer.mappedData == nullptr) || (frameIndex >= slotVersions.size())) {
+			return;
+		}
+		// The draw data has changed since the last update, it will be uploaded after the next one
+		if ((imDrawData->TotalVtxCount > vertexCapacity) || (imDrawData->TotalIdxCount > indexCapacity)) {
+			return;
 		}
 
-		// Flush to make writes visible to GPU
-		vertexBuffer.flush();
-		indexBuffer.flush();
+		const auto tStart = std::chrono::high_resolution_clock::now();
+		if (slotVersions[frameIndex] == geometryVersion) {
+			statistics.skippedUploads++;
+		}
+		else {
+			// Written directly to the mapped (coherent) memory of the slot
+			ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mappedData + static_cast<size_t>(frameIndex) * vertexCapacity;
+			ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer.mappedData + static_cast<size_t>(frameIndex) * indexCapacity;
+			for (int n = 0; n < imDrawData->CmdListsCount; n++) {
+				const ImDrawList* cmd_list = imDrawData->CmdLists[n];
+				memcpy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+				memcpy(idxDst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+				vtxDst += cmd_list->VtxBuffer.Size;
+				idxDst += cmd_list->IdxBuffer.Size;
+			}
+			slotVersions[frameIndex] = geometryVersion;
+			statistics.uploads++;
+			statistics.uploadBytes += imDrawData->TotalVtxCount * sizeof(ImDrawVert) + imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
+		}
 
-		return updateCmdBuffers;
+		statistics.cpuTime = pendingCpuTime + std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		statistics.cpuTimeTotal += statistics.cpuTime;
+		statistics.frames++;
+		pendingCpuTime = 0.0f;
 	}
 
-	bool UIOverlay::draw(const VkCommandBuffer commandBuffer)
+	bool UIOverlay::draw(const VkCommandBuffer commandBuffer, uint32_t frameIndex)
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		int32_t vertexOffset = 0;
@@ -360,6 +434,10 @@ namespace vks
 		if ((!imDrawData) || (imDrawData->CmdListsCount == 0)) {
 			return false;
 		}
+		// Buffers not (re)created for this draw data or frame count yet, update will request another recording
+		if ((frameIndex >= slotVersions.size()) || (imDrawData->TotalVtxCount > vertexCapacity) || (imDrawData->TotalIdxCount > indexCapacity)) {
+			return false;
+		}
 
 		ImGuiIO& io = ImGui::GetIO();
 
@@ -370,9 +448,10 @@ namespace vks
 		pushConstBlock.translate = glm::vec2(-1.0f);
 		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 
-		VkDeviceSize offsets[1] = { 0 };
+		// Geometry slot of the frame
+		VkDeviceSize offsets[1] = { static_cast<VkDeviceSize>(frameIndex) * vertexCapacity * sizeof(ImDrawVert) };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, static_cast<VkDeviceSize>(frameIndex) * indexCapacity * sizeof(ImDrawIdx), VK_INDEX_TYPE_UINT16);
 
 		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++)
 		{
@@ -407,7 +486,7 @@ namespace vks
 		indexBuffer.destroy();
 		vkDestroyImageView(device->logicalDevice, fontView, nullptr);
 		vkDestroyImage(device->logicalDevice, fontImage, nullptr);
-		vkFreeMemory(device->logicalDevice, fontMemory, nullptr);
+		device->FreeMemory(fontMemory);
 		vkDestroySampler(device->logicalDevice, sampler, nullptr);
 		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
 		vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
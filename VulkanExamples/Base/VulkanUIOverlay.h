@@ -15,6 +15,7 @@
 #include <vector>
 #include <sstream>
 #include <iomanip>
+#include <chrono>
 
 #include <vulkan/vulkan.h>
 #include "VulkanTools.h"
@@ -28,6 +29,10 @@
 #include "VulkanAndroid.h"
 #endif
 
+// Capacity of a geometry slot when the overlay buffers are first created, slots grow by doubling
+#define UI_OVERLAY_MIN_VERTICES 4096
+#define UI_OVERLAY_MIN_INDICES 8192
+
 namespace vks 
 {
 	class UIOverlay 
@@ -39,10 +44,36 @@ namespace vks
 		VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 		uint32_t subpass = 0;
 
+		// Host coherent and persistently mapped, one slot per frame so a slot is only written when its swap chain image is acquired
 		vks::Buffer vertexBuffer;
 		vks::Buffer indexBuffer;
 		int32_t vertexCount = 0;
 		int32_t indexCount = 0;
+		// Vertices and indices per slot
+		int32_t vertexCapacity = 0;
+		int32_t indexCapacity = 0;
+		// Number of slots, the swap chain image count (set by the base)
+		uint32_t frameCount = 1;
+
+		struct Statistics
+		{
+			// Buffer (re)creations, each one allocates device memory
+			uint32_t bufferAllocations = 0;
+			// update calls that required the command buffers to be recorded again
+			uint32_t rebuilds = 0;
+			uint64_t uploads = 0;
+			uint64_t uploadBytes = 0;
+			// Frames whose slot already held the current geometry
+			uint64_t skippedUploads = 0;
+			// Rates over the last second (of ImGui delta time)
+			float allocationsPerSecond = 0.0f;
+			float rebuildsPerSecond = 0.0f;
+			float uploadsPerSecond = 0.0f;
+			// CPU time of the last update and upload, and the sum over all frames
+			float cpuTime = 0.0f;
+			double cpuTimeTotal = 0.0;
+			uint32_t frames = 0;
+		} statistics;
 
 		std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
@@ -73,7 +104,8 @@ namespace vks
 		void prepareResources();
 
 		bool update();
-		bool draw(const VkCommandBuffer commandBuffer);
+		void beginFrame(uint32_t frameIndex);
+		bool draw(const VkCommandBuffer commandBuffer, uint32_t frameIndex = 0);
 		void resize(uint32_t width, uint32_t height);
 
 		void freeResources();
@@ -88,5 +120,22 @@ namespace vks
 		bool comboBox(const char* caption, int32_t* itemindex, std::vector<std::string> items);
 		bool button(const char* caption);
 		void text(const char* formatstr, ...);
+
+	private:
+		// Hash of everything the recorded draw commands depend on, and of the vertex and index data
+		uint64_t layoutHash = 0;
+		uint64_t geometryHash = 0;
+		// Incremented when the geometry changes, each slot remembers the version it holds
+		uint32_t geometryVersion = 0;
+		std::vector<uint32_t> slotVersions;
+		float pendingCpuTime = 0.0f;
+
+		struct
+		{
+			float time = 0.0f;
+			uint32_t bufferAllocations = 0;
+			uint32_t rebuilds = 0;
+			uint64_t uploads = 0;
+		} rateWindow;
 	};
 }
\ No newline at end of file
@@ -12,11 +12,15 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
 #include "VulkanglTFModel.h"
+#include "MeshSimplifier.hpp"
+#include "ThreadPool.hpp"
+#include "frustum.hpp"
 
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutImage = VK_NULL_HANDLE;
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutUbo = VK_NULL_HANDLE;
 VkMemoryPropertyFlags vkglTF::memoryPropertyFlags = 0;
 uint32_t vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageBaseColor;
+vkglTF::LodGenerationSettings vkglTF::lodGenerationSettings;
 
 
 /*
@@ -60,7 +64,7 @@ void vkglTF::Texture::destroy()
 	{
 		vkDestroyImageView(device->logicalDevice, view, nullptr);
 		vkDestroyImage(device->logicalDevice, image, nullptr);
-		vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+		device->FreeMemory(deviceMemory);
 		vkDestroySampler(device->logicalDevice, sampler, nullptr);
 	}
 }
@@ -146,7 +150,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
 		memAllocInfo.allocationSize = memReqs.size;
 		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+		VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &stagingMemory, vks::MEMORY_CATEGORY_STAGING));
 		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 		uint8_t* data;
@@ -172,7 +176,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
 		memAllocInfo.allocationSize = memReqs.size;
 		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+		VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &deviceMemory, vks::MEMORY_CATEGORY_MODEL));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 		VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -222,7 +226,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 
 		device->FlushCommandBuffer(copyCmd, copyQueue, true);
 
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+		device->FreeMemory(stagingMemory);
 		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 		// Generate the mip chain (gltf uses jpg and png,so we need to create this manually)
@@ -364,7 +368,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 	vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer,&memReqs);
 	memAllocInfo.allocationSize = memReqs.size;
 	memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+	VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &stagingMemory, vks::MEMORY_CATEGORY_STAGING));
 	VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 	uint8_t* data;
@@ -407,7 +411,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 	vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
 	memAllocInfo.allocationSize = memReqs.size;
 	memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+	VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &deviceMemory, vks::MEMORY_CATEGORY_MODEL));
 	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 	VkImageSubresourceRange subresourceRange = {};
@@ -423,7 +427,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 	device->FlushCommandBuffer(copyCmd, copyQueue);
 	this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-	vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+	device->FreeMemory(stagingMemory);
 	vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 	ktxTexture_Destroy(pKtxTexture);
@@ -466,47 +470,21 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 /*
 	glTF material
 */
-void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags)
+void vkglTF::Material::createDescriptorSet(vks::DescriptorAllocator& descriptorAllocator, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags)
 {
-	VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-	descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	descriptorSetAllocInfo.descriptorPool = descriptorPool;
-	descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-	descriptorSetAllocInfo.descriptorSetCount = 1;
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &descriptorSet));
-
-	std::vector<VkDescriptorImageInfo> imageDescriptors{};
-	std::vector<VkWriteDescriptorSet> writeDescriptorSets{};
+	descriptorSet = descriptorAllocator.allocate(descriptorSetLayout);
 
+	// The writes are only queued, the model flushes them together once all sets are allocated
+	uint32_t binding = 0;
 	if (descriptorBindingFlags&DescriptorBindingFlags::ImageBaseColor)
 	{
-		imageDescriptors.push_back(baseColorTexture->descriptorImageInfo);
-		VkWriteDescriptorSet writeDescriptorSet{};
-		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		writeDescriptorSet.descriptorCount = 1;
-		writeDescriptorSet.dstSet = descriptorSet;
-		writeDescriptorSet.dstBinding = static_cast<uint32_t>(writeDescriptorSets.size());//index
-		writeDescriptorSet.pImageInfo = &baseColorTexture->descriptorImageInfo;
-
-		writeDescriptorSets.push_back(writeDescriptorSet);
+		descriptorAllocator.write(descriptorSet, binding++, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, baseColorTexture->descriptorImageInfo);
 	}
 
 	if (normalTexture && (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap ))
 	{
-		imageDescriptors.push_back(normalTexture->descriptorImageInfo);
-		VkWriteDescriptorSet writeDescriptorSet{};
-		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		writeDescriptorSet.descriptorCount = 1;
-		writeDescriptorSet.dstSet = descriptorSet;
-		writeDescriptorSet.dstBinding = static_cast<uint32_t>(writeDescriptorSets.size());//index
-		writeDescriptorSet.pImageInfo = &normalTexture->descriptorImageInfo;
-
-		writeDescriptorSets.push_back(writeDescriptorSet);
+		descriptorAllocator.write(descriptorSet, binding++, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, normalTexture->descriptorImageInfo);
 	}
-
-	vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 }//createDescriptorSet
 
 /*
@@ -530,7 +508,7 @@ vkglTF::Mesh::Mesh(vks::VulkanDevice * device, glm::mat4 matrix)
 	this->uniformBlock.matrix = matrix;
 	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		sizeof(this->uniformBlock), &this->uniformBuffer.buffer, &this->uniformBuffer.memory, &this->uniformBlock));
+		sizeof(this->uniformBlock), &this->uniformBuffer.buffer, &this->uniformBuffer.memory, &this->uniformBlock, vks::MEMORY_CATEGORY_MODEL));
 
 	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
 	uniformBuffer.descriptorBufferInfo = { uniformBuffer.buffer,0,sizeof(uniformBlock) };
@@ -539,7 +517,7 @@ vkglTF::Mesh::Mesh(vks::VulkanDevice * device, glm::mat4 matrix)
 vkglTF::Mesh::~Mesh()
 {
 	vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
+	device->FreeMemory(uniformBuffer.memory);
 	for (auto primitive:primitives)
 	{
 		delete primitive;
@@ -716,7 +694,7 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
 	memAllocInfo.allocationSize = memReqs.size;
 	memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+	VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &stagingMemory, vks::MEMORY_CATEGORY_STAGING));
 	VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 	// Copy texture data into staging buffer
@@ -749,7 +727,7 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	vkGetImageMemoryRequirements(device->logicalDevice, emptyTexture.image, &memReqs);
 	memAllocInfo.allocationSize = memReqs.size;
 	memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &emptyTexture.deviceMemory));
+	VK_CHECK_RESULT(device->AllocateMemory(&memAllocInfo, &emptyTexture.deviceMemory, vks::MEMORY_CATEGORY_MODEL));
 	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, emptyTexture.image, emptyTexture.deviceMemory, 0));
 
 	VkImageSubresourceRange subresourceRange{};
@@ -767,7 +745,7 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	emptyTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 	//Clean up staging resources
-	vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+	device->FreeMemory(stagingMemory);
 	vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 	VkSamplerCreateInfo samplerCreateInfo = vks::initializers::GenSamplerCreateInfo();
@@ -801,16 +779,24 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 vkglTF::Model::~Model()
 {
 	vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
+	device->FreeMemory(vertices.memory);
 
 	vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
+	device->FreeMemory(indices.memory);
 
 	for (auto texture:textures)
 	{
 		texture.destroy();
 	}
 
+	if (materialTable.buffer != VK_NULL_HANDLE)
+	{
+		vkDestroyBuffer(device->logicalDevice, materialTable.buffer, nullptr);
+		device->FreeMemory(materialTable.memory);
+	}
+
+	drawList.indirectBuffer.destroy();
+
 	for (auto node:nodes)
 	{
 		delete node;
@@ -833,7 +819,8 @@ vkglTF::Model::~Model()
 		descriptorSetLayoutImage = VK_NULL_HANDLE;
 	}
 
-	vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+	// Destroys the pools of the node and material sets
+	descriptorAllocator.reset();
 	emptyTexture.destroy();
 }
 
@@ -1188,11 +1175,14 @@ void vkglTF::Model::loadMaterials(tinygltf::Model & gltfModel)
 			material.alphaCutoff = static_cast<float>(mat.additionalValues["alphaCutoff"].Factor());
 		}
 
+		material.index = static_cast<uint32_t>(materials.size());
 		materials.push_back(material);
 	}//for
 
 	// Push a default material at the end of the list for meshes with no material assigned
-	materials.push_back(Material(device));
+	Material defaultMaterial(device);
+	defaultMaterial.index = static_cast<uint32_t>(materials.size());
+	materials.push_back(defaultMaterial);
 }
 
 void vkglTF::Model::loadAnimations(tinygltf::Model & gltfModel)
@@ -1330,8 +1320,153 @@ void vkglTF::Model::loadAnimations(tinygltf::Model & gltfModel)
 	}//for gltfModel.animations
 }
 
+/*
+	Simplifies the primitives in parallel and appends their level of detail chains to the index buffer
+	The levels reuse the vertices of their primitive, so the vertex buffer doesn't change
+*/
+void vkglTF::Model::generateLods(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer)
+{
+	std::vector<Primitive*> primitives;
+	for (Node* node : linearNodes)
+	{
+		if (node->mesh)
+		{
+			for (Primitive* primitive : node->mesh->primitives)
+			{
+				if (primitive->indexCount >= 3)
+				{
+					primitives.push_back(primitive);
+				}
+			}
+		}
+	}//for linearNodes
+	if (primitives.empty())
+	{
+		return;
+	}
+
+	// Normals and texture coordinates are taken into account, so the collapses prefer regions where they don't change
+	vks::MeshSimplifier::Settings settings;
+	settings.maxError = lodGenerationSettings.maxError;
+	settings.lockBorders = lodGenerationSettings.lockBorders;
+	settings.attributeWeights = { lodGenerationSettings.normalWeight, lodGenerationSettings.normalWeight, lodGenerationSettings.normalWeight, lodGenerationSettings.uvWeight, lodGenerationSettings.uvWeight };
+	const uint32_t attributeCount = static_cast<uint32_t>(settings.attributeWeights.size());
+
+	uint32_t threadCount = (lodGenerationSettings.threadCount > 0) ? lodGenerationSettings.threadCount : std::thread::hardware_concurrency();
+	threadCount = std::max(std::min(threadCount, static_cast<uint32_t>(primitives.size())), 1u);
+	vks::ThreadPool threadPool;
+	threadPool.setThreadCount(threadCount);
+
+	std::vector<std::vector<vks::MeshSimplifier::Level>> levels(primitives.size());
+	for (size_t i = 0; i < primitives.size(); i++)
+	{
+		threadPool.threads[i % threadCount]->addJob([&, i] {
+			const Primitive* primitive = primitives[i];
+			std::vector<glm::vec3> positions(primitive->vertexCount);
+			std::vector<float> attributes(primitive->vertexCount * attributeCount);
+			for (uint32_t v = 0; v < primitive->vertexCount; v++)
+			{
+				const Vertex& vertex = vertexBuffer[primitive->firstVertex + v];
+				positions[v] = vertex.pos;
+				float* attribute = &attributes[v * attributeCount];
+				attribute[0] = vertex.normal.x;
+				attribute[1] = vertex.normal.y;
+				attribute[2] = vertex.normal.z;
+				attribute[3] = vertex.uv.x;
+				attribute[4] = vertex.uv.y;
+			}
+			// Indices relative to the first vertex of the primitive
+			std::vector<uint32_t> indices(indexBuffer.begin() + primitive->firstIndex, indexBuffer.begin() + primitive->firstIndex + primitive->indexCount);
+			for (uint32_t& index : indices)
+			{
+				index -= primitive->firstVertex;
+			}
+			levels[i] = vks::MeshSimplifier::buildLodChain(positions.data(), attributes.data(), attributeCount, positions.size(), indices.data(), indices.size(),
+				lodGenerationSettings.levelCount, lodGenerationSettings.reduction, settings);
+		});
+	}//for_i
+	threadPool.wait();
+
+	for (size_t i = 0; i < primitives.size(); i++)
+	{
+		Primitive* primitive = primitives[i];
+		primitive->lods.clear();
+		for (const vks::MeshSimplifier::Level& level : levels[i])
+		{
+			Primitive::Lod lod;
+			lod.firstIndex = static_cast<uint32_t>(indexBuffer.size());
+			lod.indexCount = static_cast<uint32_t>(level.indices.size());
+			lod.error = level.error;
+			for (uint32_t index : level.indices)
+			{
+				indexBuffer.push_back(index + primitive->firstVertex);
+			}
+			primitive->lods.push_back(lod);
+		}
+	}//for_i
+}
+
+/*
+	Splits the index range of each primitive into meshlets, the triangles are reordered in place so every meshlet is a contiguous range
+*/
+void vkglTF::Model::generateMeshlets(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer)
+{
+	std::vector<Primitive*> primitives;
+	for (Node* node : linearNodes)
+	{
+		if (node->mesh)
+		{
+			for (Primitive* primitive : node->mesh->primitives)
+			{
+				if (primitive->indexCount >= 3)
+				{
+					primitives.push_back(primitive);
+				}
+			}
+		}
+	}//for linearNodes
+	if (primitives.empty())
+	{
+		return;
+	}
+
+	// The index ranges of the primitives don't overlap, so each job can reorder its own range
+	const uint32_t threadCount = std::max(std::min(std::thread::hardware_concurrency(), static_cast<uint32_t>(primitives.size())), 1u);
+	vks::ThreadPool threadPool;
+	threadPool.setThreadCount(threadCount);
+	for (size_t i = 0; i < primitives.size(); i++)
+	{
+		threadPool.threads[i % threadCount]->addJob([&, i] {
+			Primitive* primitive = primitives[i];
+			std::vector<glm::vec3> positions(primitive->vertexCount);
+			std::vector<glm::vec3> normals(primitive->vertexCount);
+			for (uint32_t v = 0; v < primitive->vertexCount; v++)
+			{
+				positions[v] = vertexBuffer[primitive->firstVertex + v].pos;
+				normals[v] = vertexBuffer[primitive->firstVertex + v].normal;
+			}
+			std::vector<uint32_t> indices(indexBuffer.begin() + primitive->firstIndex, indexBuffer.begin() + primitive->firstIndex + primitive->indexCount / 3 * 3);
+			for (uint32_t& index : indices)
+			{
+				index -= primitive->firstVertex;
+			}
+			primitive->meshlets = vks::buildMeshlets(positions.data(), normals.data(), positions.size(), indices);
+			for (size_t j = 0; j < indices.size(); j++)
+			{
+				indexBuffer[primitive->firstIndex + j] = indices[j] + primitive->firstVertex;
+			}
+			for (vks::Meshlet& meshlet : primitive->meshlets)
+			{
+				meshlet.firstIndex += primitive->firstIndex;
+			}
+		});
+	}//for_i
+	threadPool.wait();
+}
+
 void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice * device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
 {
+	loadingFlags = fileLoadingFlags;
 	tinygltf::Model gltfModel;
 	tinygltf::TinyGLTF gltfContext;
 	if (fileLoadingFlags&FileLoadingFlags::DontLoadImages)
@@ -1460,6 +1595,15 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice * devic
 		}
 	}//for
 
+	if (fileLoadingFlags & FileLoadingFlags::GenerateLods)
+	{
+		generateLods(indexBuffer, vertexBuffer);
+	}
+	if (fileLoadingFlags & FileLoadingFlags::GenerateMeshlets)
+	{
+		generateMeshlets(indexBuffer, vertexBuffer);
+	}
+
 	size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
 	size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
 	indices.count = static_cast<uint32_t>(indexBuffer.size());
@@ -1477,21 +1621,21 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice * devic
 	// Vertex data
 	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		vertexBufferSize, &vertexStaging.buffer, &vertexStaging.memory, vertexBuffer.data()));
+		vertexBufferSize, &vertexStaging.buffer, &vertexStaging.memory, vertexBuffer.data(), vks::MEMORY_CATEGORY_STAGING));
 
 	//Index data
 	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		indexBufferSize, &indexStaging.buffer, &indexStaging.memory, indexBuffer.data()));
+		indexBufferSize, &indexStaging.buffer, &indexStaging.memory, indexBuffer.data(), vks::MEMORY_CATEGORY_STAGING));
 
 	// Create device local buffers
 	// Vertex buffer
 	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBufferSize, &vertices.buffer, &vertices.memory));
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBufferSize, &vertices.buffer, &vertices.memory, nullptr, vks::MEMORY_CATEGORY_MODEL));
 
 	//Index buffer
 	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBufferSize, &indices.buffer, &indices.memory));
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBufferSize, &indices.buffer, &indices.memory, nullptr, vks::MEMORY_CATEGORY_MODEL));
 
 	//Copy from staging buffers
 	VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -1507,53 +1651,15 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice * devic
 	device->FlushCommandBuffer(copyCmd, transferQueue, true);
 
 	vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
+	device->FreeMemory(vertexStaging.memory);
 	vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+	device->FreeMemory(indexStaging.memory);
 
 	getSceneDimensions();
 
-	// Setup descriptors
-	uint32_t uboCount{ 0 };
-	uint32_t imageCount{ 0 };
-	for (auto node : linearNodes)
-	{
-		if (node->mesh)
-		{
-			uboCount++;
-		}
-	}
-
-	for (auto material : materials)
-	{
-		if (material.baseColorTexture != nullptr)
-		{
-			imageCount++;
-		}
-	}
-
-	std::vector<VkDescriptorPoolSize> tempDescriptorPoolSize = {
-		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,uboCount},
-	};
-
-	if (imageCount > 0)
-	{
-		if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor)
-		{
-			tempDescriptorPoolSize.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,imageCount });
-		}
-		if (descriptorBindingFlags&DescriptorBindingFlags::ImageNormalMap)
-		{
-			tempDescriptorPoolSize.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,imageCount });
-		}
-	}
-
-	VkDescriptorPoolCreateInfo descriptorPoolCI{};
-	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(tempDescriptorPoolSize.size());
-	descriptorPoolCI.pPoolSizes = tempDescriptorPoolSize.data();
-	descriptorPoolCI.maxSets = uboCount + imageCount;
-	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+	// Setup descriptors, the allocator sizes its pools by the layouts, so nothing has to be counted up front
+	descriptorAllocator.reset(new vks::DescriptorAllocator());
+	descriptorAllocator->prepare(device->logicalDevice, 0);
 
 	// Descriptors for per-node uniform buffers
 	{
@@ -1603,10 +1709,15 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice * devic
 		{
 			if (material.baseColorTexture != nullptr)
 			{
-				material.createDescriptorSet(descriptorPool, vkglTF::descriptorSetLayoutImage, descriptorBindingFlags);
+				material.createDescriptorSet(*descriptorAllocator, vkglTF::descriptorSetLayoutImage, descriptorBindingFlags);
 			}
 		}//for
 	}
+
+	// One update for the writes of all node and material sets
+	descriptorAllocator->flush();
+
+	prepareDrawList();
 }
 
 void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
@@ -1617,6 +1728,95 @@ void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
 	buffersBound = true;
 }
 
+bool vkglTF::Model::prepareMaterialTable(VkQueue transferQueue, uint32_t textureCount)
+{
+	// Images weren't loaded (FileLoadingFlags::DontLoadImages)
+	if (emptyTexture.device == nullptr)
+	{
+		return false;
+	}
+
+	// The empty texture is appended, so the array is never empty
+	materialTable.textureCount = static_cast<uint32_t>(textures.size()) + 1;
+	if (textureCount > 0)
+	{
+		if (materialTable.textureCount > textureCount)
+		{
+			return false;
+		}
+		materialTable.textureCount = textureCount;
+	}
+	const VkPhysicalDeviceLimits& limits = device->properties.limits;
+	if ((materialTable.textureCount > limits.maxPerStageDescriptorSamplers) || (materialTable.textureCount > limits.maxPerStageDescriptorSampledImages))
+	{
+		return false;
+	}
+
+	auto textureIndex = [this](const vkglTF::Texture* texture)
+	{
+		if ((texture == nullptr) || (texture == &emptyTexture))
+		{
+			return static_cast<uint32_t>(VKGLTF_NO_TEXTURE);
+		}
+		return static_cast<uint32_t>(texture - textures.data());
+	};
+
+	std::vector<MaterialTableEntry> entries(materials.size());
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		const vkglTF::Material& material = materials[i];
+		entries[i].baseColorFactor = material.baseColorFactor;
+		entries[i].baseColorTexture = textureIndex(material.baseColorTexture);
+		entries[i].normalTexture = textureIndex(material.normalTexture);
+		entries[i].alphaCutoff = material.alphaCutoff;
+		entries[i].alphaMask = (material.alphaMode == Material::ALPHA_MODE_MASK) ? 1 : 0;
+	}//for_i
+
+	const VkDeviceSize bufferSize = entries.size() * sizeof(MaterialTableEntry);
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingMemory;
+	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		bufferSize, &stagingBuffer, &stagingMemory, entries.data(), vks::MEMORY_CATEGORY_STAGING));
+	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		bufferSize, &materialTable.buffer, &materialTable.memory, nullptr, vks::MEMORY_CATEGORY_MODEL));
+
+	VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	VkBufferCopy copyRegion = {};
+	copyRegion.size = bufferSize;
+	vkCmdCopyBuffer(copyCmd, stagingBuffer, materialTable.buffer, 1, &copyRegion);
+	device->FlushCommandBuffer(copyCmd, transferQueue, true);
+
+	vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+	device->FreeMemory(stagingMemory);
+
+	// Layout and set belong to the descriptor allocator of the model
+	materialTable.descriptorSetLayout = descriptorAllocator->getLayout(
+	{
+		vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+		vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1, materialTable.textureCount)
+	});
+	materialTable.descriptorSet = descriptorAllocator->allocate(materialTable.descriptorSetLayout);
+
+	VkDescriptorBufferInfo bufferInfo{ materialTable.buffer, 0, bufferSize };
+	descriptorAllocator->write(materialTable.descriptorSet, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfo);
+	for (uint32_t i = 0; i < static_cast<uint32_t>(textures.size()); i++)
+	{
+		descriptorAllocator->write(materialTable.descriptorSet, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textures[i].descriptorImageInfo, i);
+	}//for_i
+	for (uint32_t i = static_cast<uint32_t>(textures.size()); i < materialTable.textureCount; i++)
+	{
+		descriptorAllocator->write(materialTable.descriptorSet, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, emptyTexture.descriptorImageInfo, i);
+	}//for_i
+	descriptorAllocator->flush();
+	return true;
+}
+
+void vkglTF::Model::bindMaterialTable(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set)
+{
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, 1, &materialTable.descriptorSet, 0, nullptr);
+	drawStatistics.descriptorBinds++;
+}
+
 void vkglTF::Model::drawNode(Node * node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
 {
 	if (node->mesh)
@@ -1646,15 +1846,24 @@ void vkglTF::Model::drawNode(Node * node, VkCommandBuffer commandBuffer, uint32_
 				if (renderFlags & RenderFlags::BindImages)
 				{
 					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
+					drawStatistics.descriptorBinds++;
+				}
+				// The material table is bound once (bindMaterialTable), only the index into it changes between draws
+				if ((renderFlags & RenderFlags::PushMaterialIndex) && (material.index != pushedMaterialIndex))
+				{
+					vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &material.index);
+					pushedMaterialIndex = material.index;
+					drawStatistics.pushConstants++;
 				}
 				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+				drawStatistics.drawCalls++;
 			}
 		}//for
 	}//if mesh
 
 	for (auto& child:node->children)
 	{
-		drawNode(child, commandBuffer, renderFlags);
+		drawNode(child, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
 	}
 }
 
@@ -1667,12 +1876,205 @@ void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, Vk
 		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 	}
 
+	pushedMaterialIndex = 0xFFFFFFFF;
+	if (!(renderFlags & RenderFlags::WalkNodes) && !drawList.items.empty())
+	{
+		drawItems(commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+		return;
+	}
+
 	for (auto& node:nodes)
 	{
 		drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
 	}
 }
 
+void vkglTF::Model::prepareDrawList()
+{
+	const bool preTransform = loadingFlags & FileLoadingFlags::PreTransformVertices;
+	const bool flipY = loadingFlags & FileLoadingFlags::FlipY;
+
+	drawList.items.clear();
+	for (Node* node : linearNodes)
+	{
+		if (!node->mesh)
+		{
+			continue;
+		}
+		const glm::mat4 matrix = node->getMatrix();
+		for (Primitive* primitive : node->mesh->primitives)
+		{
+			DrawItem item;
+			item.primitive = primitive;
+			item.node = node;
+
+			// Bounding sphere of the corners, transformed the same way as the vertices (see loadFromFile)
+			glm::vec3 min = glm::vec3(FLT_MAX);
+			glm::vec3 max = glm::vec3(-FLT_MAX);
+			for (uint32_t corner = 0; corner < 8; corner++)
+			{
+				glm::vec3 position = glm::vec3((corner & 1) ? primitive->dimensions.max.x : primitive->dimensions.min.x,
+					(corner & 2) ? primitive->dimensions.max.y : primitive->dimensions.min.y,
+					(corner & 4) ? primitive->dimensions.max.z : primitive->dimensions.min.z);
+				if (preTransform)
+				{
+					position = glm::vec3(matrix * glm::vec4(position, 1.0f));
+				}
+				if (flipY)
+				{
+					position.y = -position.y;
+				}
+				if (!preTransform)
+				{
+					position = glm::vec3(matrix * glm::vec4(position, 1.0f));
+				}
+				min = glm::min(min, position);
+				max = glm::max(max, position);
+			}//for_corner
+			item.center = (min + max) * 0.5f;
+			item.radius = glm::distance(min, max) * 0.5f;
+			drawList.items.push_back(item);
+		}//for
+	}//for
+
+	// Sorted by alpha mode for the render flags and by material so binds can be shared
+	std::stable_sort(drawList.items.begin(), drawList.items.end(), [](const DrawItem& a, const DrawItem& b)
+	{
+		if (a.primitive->material.alphaMode != b.primitive->material.alphaMode)
+		{
+			return a.primitive->material.alphaMode < b.primitive->material.alphaMode;
+		}
+		return a.primitive->material.index < b.primitive->material.index;
+	});
+	const uint32_t itemCount = static_cast<uint32_t>(drawList.items.size());
+	for (uint32_t mode = 0; mode < 3; mode++)
+	{
+		uint32_t offset = 0;
+		while ((offset < itemCount) && (drawList.items[offset].primitive->material.alphaMode < static_cast<Material::AlphaMode>(mode)))
+		{
+			offset++;
+		}
+		drawList.alphaModeOffsets[mode] = offset;
+	}//for_mode
+	drawList.alphaModeOffsets[3] = itemCount;
+	drawList.visibleCount = itemCount;
+
+	// Buffers of a previous call
+	drawList.indirectBuffer.destroy();
+	drawList.indirectBuffer = vks::Buffer();
+	if (itemCount == 0)
+	{
+		return;
+	}
+
+	std::vector<VkDrawIndexedIndirectCommand> commands(itemCount);
+	for (uint32_t i = 0; i < itemCount; i++)
+	{
+		const DrawItem& item = drawList.items[i];
+		commands[i].indexCount = item.primitive->indexCount;
+		commands[i].instanceCount = 1;
+		commands[i].firstIndex = item.primitive->firstIndex;
+		commands[i].vertexOffset = 0;
+		commands[i].firstInstance = 0;
+	}//for_i
+
+	// Host visible and mapped, the culling pass writes the commands directly
+	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&drawList.indirectBuffer, itemCount * sizeof(VkDrawIndexedIndirectCommand), commands.data(), vks::MEMORY_CATEGORY_MODEL));
+	VK_CHECK_RESULT(drawList.indirectBuffer.map());
+}
+
+uint32_t vkglTF::Model::cullDrawList(const glm::mat4& viewProjection)
+{
+	vks::Frustum frustum;
+	frustum.update(viewProjection);
+
+	VkDrawIndexedIndirectCommand* commands = static_cast<VkDrawIndexedIndirectCommand*>(drawList.indirectBuffer.mappedData);
+	uint32_t visibleCount = 0;
+	for (size_t i = 0; i < drawList.items.size(); i++)
+	{
+		const bool visible = frustum.checkSphere(drawList.items[i].center, drawList.items[i].radius);
+		commands[i].instanceCount = visible ? 1 : 0;
+		visibleCount += visible ? 1 : 0;
+	}//for_i
+	drawList.visibleCount = visibleCount;
+	return visibleCount;
+}
+
+void vkglTF::Model::drawItems(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
+{
+	// Same precedence as the alpha mode filters of drawNode
+	uint32_t begin = 0;
+	uint32_t end = drawList.alphaModeOffsets[3];
+	if (renderFlags & RenderFlags::RenderAlphaBlendedNodes)
+	{
+		begin = drawList.alphaModeOffsets[Material::ALPHA_MODE_BLEND];
+		end = drawList.alphaModeOffsets[3];
+	}
+	else if (renderFlags & RenderFlags::RenderAlphaMaskedNodes)
+	{
+		begin = drawList.alphaModeOffsets[Material::ALPHA_MODE_MASK];
+		end = drawList.alphaModeOffsets[Material::ALPHA_MODE_BLEND];
+	}
+	else if (renderFlags & RenderFlags::RenderOpaqueNodes)
+	{
+		begin = drawList.alphaModeOffsets[Material::ALPHA_MODE_OPAQUE];
+		end = drawList.alphaModeOffsets[Material::ALPHA_MODE_MASK];
+	}
+
+	const bool bindMaterials = (renderFlags & (RenderFlags::BindImages | RenderFlags::PushMaterialIndex)) != 0;
+	// Without multi draw indirect every indirect draw is a call of its own
+	const uint32_t maxBatchSize = (device->m_enabledDeviceFeatures.multiDrawIndirect == VK_TRUE) ? device->properties.limits.maxDrawIndirectCount : 1;
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	uint32_t first = begin;
+	while (first < end)
+	{
+		// The items of a material are adjacent, materials are bound once per batch
+		const vkglTF::Material& material = drawList.items[first].primitive->material;
+		uint32_t batchEnd = end;
+		if (bindMaterials)
+		{
+			batchEnd = first + 1;
+			while ((batchEnd < end) && (drawList.items[batchEnd].primitive->material.index == material.index))
+			{
+				batchEnd++;
+			}
+			if (renderFlags & RenderFlags::BindImages)
+			{
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
+				drawStatistics.descriptorBinds++;
+			}
+			if ((renderFlags & RenderFlags::PushMaterialIndex) && (material.index != pushedMaterialIndex))
+			{
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &material.index);
+				pushedMaterialIndex = material.index;
+				drawStatistics.pushConstants++;
+			}
+		}
+
+		if (drawList.indirect)
+		{
+			for (uint32_t batchStart = first; batchStart < batchEnd; batchStart += maxBatchSize)
+			{
+				const uint32_t drawCount = std::min(maxBatchSize, batchEnd - batchStart);
+				vkCmdDrawIndexedIndirect(commandBuffer, drawList.indirectBuffer.buffer, batchStart * stride, drawCount, stride);
+				drawStatistics.drawCalls++;
+			}
+			drawStatistics.indirectDraws += batchEnd - first;
+		}
+		else
+		{
+			for (uint32_t i = first; i < batchEnd; i++)
+			{
+				vkCmdDrawIndexed(commandBuffer, drawList.items[i].primitive->indexCount, 1, drawList.items[i].primitive->firstIndex, 0, 0);
+				drawStatistics.drawCalls++;
+			}
+		}
+		first = batchEnd;
+	}//while
+}
+
 void vkglTF::Model::getNodeDimensions(Node * node, glm::vec3 & min, glm::vec3 & max)
 {
 	if (node->mesh)
@@ -1827,22 +2229,8 @@ void vkglTF::Model::prepareNodeDescriptor(vkglTF::Node * node, VkDescriptorSetLa
 {
 	if (node->mesh)
 	{
-		VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-		descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		descriptorSetAllocInfo.descriptorPool = descriptorPool;
-		descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-		descriptorSetAllocInfo.descriptorSetCount = 1;
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &node->mesh->uniformBuffer.descriptorSet));
-
-		VkWriteDescriptorSet writeDescriptorSet{};
-		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		writeDescriptorSet.descriptorCount = 1;
-		writeDescriptorSet.dstSet = node->mesh->uniformBuffer.descriptorSet;
-		writeDescriptorSet.dstBinding = 0;
-		writeDescriptorSet.pBufferInfo = &node->mesh->uniformBuffer.descriptorBufferInfo;
-
-		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+		node->mesh->uniformBuffer.descriptorSet = descriptorAllocator->allocate(descriptorSetLayout);
+		descriptorAllocator->write(node->mesh->uniformBuffer.descriptorSet, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, node->mesh->uniformBuffer.descriptorBufferInfo);
 	}
 
 	for (auto& child:node->children)
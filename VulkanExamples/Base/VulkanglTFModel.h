@@ -4,9 +4,12 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <memory>
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "MeshletBuilder.hpp"
+#include "DescriptorAllocator.hpp"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -41,6 +44,21 @@ namespace vkglTF
 	extern VkMemoryPropertyFlags memoryPropertyFlags;
 	extern uint32_t descriptorBindingFlags;
 
+	/*
+		Settings for FileLoadingFlags::GenerateLods
+	*/
+	struct LodGenerationSettings
+	{
+		uint32_t levelCount = 4; // Levels generated after the source primitive
+		float reduction = 0.5f; // Index count of each level relative to the previous one
+		float maxError = 0.05f; // Largest geometric error relative to the extent of the primitive
+		float normalWeight = 0.25f; // Attribute weights relative to the squared position error
+		float uvWeight = 1.0f;
+		bool lockBorders = true;
+		uint32_t threadCount = 0; // Primitives are simplified in parallel, 0 = hardware concurrency
+	};
+	extern LodGenerationSettings lodGenerationSettings;
+
 	struct Node;
 	
 	/*
@@ -94,12 +112,14 @@ namespace vkglTF
 		vkglTF::Texture* diffuseTexture;
 
 		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		// Position in Model::materials, pushed per draw with RenderFlags::PushMaterialIndex
+		uint32_t index = 0;
 
 		Material(vks::VulkanDevice* curDevice) :device(curDevice)
 		{
 		};
 
-		void createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
+		void createDescriptorSet(vks::DescriptorAllocator& descriptorAllocator, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
 	};
 
 	struct Primitive
@@ -110,6 +130,19 @@ namespace vkglTF
 		uint32_t vertexCount;
 		Material& material;
 
+		// Generated levels of detail, index ranges into the index buffer of the model that use the vertices of this primitive
+		struct Lod
+		{
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			float error; // Geometric error against the primitive in model space
+		};
+		std::vector<Lod> lods;
+
+		// Clusters of the primitive's own index range, see FileLoadingFlags::GenerateMeshlets
+		// firstIndex of each meshlet is an offset into the index buffer of the model
+		std::vector<vks::Meshlet> meshlets;
+
 		struct Dimensions
 		{
 			glm::vec3 min = glm::vec3(FLT_MAX);
@@ -274,7 +307,9 @@ namespace vkglTF
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		GenerateLods = 0x00000010,
+		GenerateMeshlets = 0x00000020
 	};
 
 	enum RenderFlags
@@ -282,7 +317,37 @@ namespace vkglTF
 		BindImages = 0x00000001,
 		RenderOpaqueNodes = 0x00000002,
 		RenderAlphaMaskedNodes = 0x00000004,
-		RenderAlphaBlendedNodes = 0x00000008
+		RenderAlphaBlendedNodes = 0x00000008,
+		PushMaterialIndex = 0x00000010,
+		// Walk the node hierarchy even if the model has a draw list (reference path)
+		WalkNodes = 0x00000020
+	};
+
+	// Texture index of material table entries without a texture
+#define VKGLTF_NO_TEXTURE 0xFFFFFFFF
+
+	/*
+	Entry of the material table (std430 layout), see Model::prepareMaterialTable
+	*/
+	struct MaterialTableEntry
+	{
+		glm::vec4 baseColorFactor;
+		uint32_t baseColorTexture;
+		uint32_t normalTexture;
+		float alphaCutoff;
+		uint32_t alphaMask;
+	};
+
+	/*
+	Primitive of the flattened draw list, see Model::prepareDrawList
+	*/
+	struct DrawItem
+	{
+		Primitive* primitive;
+		Node* node;
+		// Bounding sphere in the space of the drawn vertices
+		glm::vec3 center;
+		float radius;
 	};
 
 	/*
@@ -299,7 +364,9 @@ namespace vkglTF
 	public:
 
 		vks::VulkanDevice* device;
-		VkDescriptorPool descriptorPool;
+		// Pools grow with the node and material sets, the writes of a load are submitted together
+		// Owned by the model, which can't be copied as it destroys its Vulkan resources and nodes
+		std::unique_ptr<vks::DescriptorAllocator> descriptorAllocator;
 
 		struct Vertices
 		{
@@ -336,8 +403,48 @@ namespace vkglTF
 		bool metallicRoughnessWorkflow = true;
 		bool buffersBound = false;
 		std::string path;
+		uint32_t loadingFlags = 0;
+
+		// Bindless materials: the textures of the model in one array and the materials in a storage buffer,
+		// bound once and indexed with the material index pushed per draw (RenderFlags::PushMaterialIndex)
+		// Set layout: binding 0 = storage buffer of MaterialTableEntry, binding 1 = combined image samplers[textureCount]
+		struct MaterialTable
+		{
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			uint32_t textureCount = 0;
+		} materialTable;
+
+		// Commands recorded by draw, accumulated until reset by the caller
+		struct DrawStatistics
+		{
+			uint32_t drawCalls = 0;
+			uint32_t descriptorBinds = 0;
+			uint32_t pushConstants = 0;
+			// Draws read from the indirect buffer by the indirect draw calls
+			uint32_t indirectDraws = 0;
+		} drawStatistics;
+
+		// Primitives of all nodes sorted by alpha mode and material, built once by prepareDrawList
+		// draw walks the list instead of the node hierarchy, binds or pushes once per material and with indirect set
+		// records a vkCmdDrawIndexedIndirect batch per material (or per alpha mode if no material binding is requested)
+		// Indirect drawing is opt-in, without multiDrawIndirect every item becomes an indirect call of its own
+		struct DrawList
+		{
+			std::vector<DrawItem> items;
+			// First item of each alpha mode (opaque, mask, blend) and the end of the list
+			uint32_t alphaModeOffsets[4] = { 0, 0, 0, 0 };
+			bool indirect = false;
+			// One VkDrawIndexedIndirectCommand per item, host visible so cullDrawList writes the instance counts directly
+			vks::Buffer indirectBuffer;
+			uint32_t visibleCount = 0;
+		} drawList;
 
 		Model() {};
+		Model(const Model&) = delete;
+		Model& operator=(const Model&) = delete;
 		~Model();
 
 		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model,
@@ -351,10 +458,28 @@ namespace vkglTF
 
 		void loadAnimations(tinygltf::Model& gltfModel);
 
+		void generateLods(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer);
+
+		void generateMeshlets(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer);
+
 		void loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue,uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None,float scale = 1.0f);
 
 		void bindBuffers(VkCommandBuffer commandBuffer);
 
+		// Uploads the material table and writes its descriptor set, fails if the textures exceed the per stage sampler limit
+		// textureCount fixes the size of the texture array for shaders that can't size it with a specialization constant (unused slots hold the empty texture),
+		// fails if the textures don't fit; 0 sizes it to the textures of the model
+		bool prepareMaterialTable(VkQueue transferQueue, uint32_t textureCount = 0);
+
+		void bindMaterialTable(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set = 1);
+
+		// Called by loadFromFile, call again after changing node matrices
+		void prepareDrawList();
+
+		// Frustum culls the draw list by writing the instance counts of the indirect commands, returns the visible items
+		// Only the indirect path is affected, the buffer must not be in use by the device
+		uint32_t cullDrawList(const glm::mat4& viewProjection);
+
 		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 
 		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
@@ -373,6 +498,10 @@ namespace vkglTF
 
 	protected:
 	private:
+		// Material index of the last push in the current draw, consecutive primitives of a material share one push
+		uint32_t pushedMaterialIndex = 0xFFFFFFFF;
+
+		void drawItems(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet);
 	};
 
 
@@ -7,14 +7,119 @@
 #include <functional>
 #include <chrono>
 #include <iomanip>
+#include <cmath>
+#include <cstdint>
 #include <vulkan/vulkan_core.h>
+#ifdef _WIN32
 #include <consoleapi.h>
+#endif
 #include <iostream>
 #include <fstream>
 #include <numeric>
+#include <sstream>
 
 namespace vks
 {
+	// Log-linear histogram of frame times with a fixed memory footprint (HDR histogram layout)
+	// Values are recorded in microseconds, values below 2^subBucketBits are stored exactly, larger ones with a relative error below 1 / 2^(subBucketBits - 1)
+	class FrameTimeHistogram {
+	public:
+		static const uint32_t subBucketBits = 8;
+		static const uint32_t subBucketCount = 1u << subBucketBits;
+		static const uint32_t subBucketHalfCount = subBucketCount / 2;
+		// Covers up to 2^32 us, longer frames are clamped
+		static const uint32_t bucketCount = subBucketCount + (32 - subBucketBits) * subBucketHalfCount;
+
+	private:
+		std::vector<uint64_t> counts = std::vector<uint64_t>(bucketCount, 0);
+		uint64_t totalCount = 0;
+		double sum = 0.0;
+		double minValue = 0.0;
+		double maxValue = 0.0;
+
+		static uint32_t bucketIndex(uint64_t value)
+		{
+			if (value < subBucketCount)
+			{
+				return static_cast<uint32_t>(value);
+			}
+			uint32_t magnitude = 0;
+			while ((value >> (magnitude + 1)) != 0)
+			{
+				magnitude++;
+			}
+			// Keep subBucketBits significant bits, the top one is always set
+			const uint32_t shift = magnitude - (subBucketBits - 1);
+			const uint32_t subBucket = static_cast<uint32_t>(value >> shift) - subBucketHalfCount;
+			return subBucketCount + (shift - 1) * subBucketHalfCount + subBucket;
+		}
+
+		// Value range [lower, upper) of a bucket in microseconds
+		static void bucketRange(uint32_t index, double& lower, double& upper)
+		{
+			if (index < subBucketCount)
+			{
+				lower = static_cast<double>(index);
+				upper = lower + 1.0;
+				return;
+			}
+			const uint32_t shift = (index - subBucketCount) / subBucketHalfCount + 1;
+			const uint32_t subBucket = (index - subBucketCount) % subBucketHalfCount + subBucketHalfCount;
+			lower = std::ldexp(static_cast<double>(subBucket), shift);
+			upper = std::ldexp(static_cast<double>(subBucket + 1), shift);
+		}
+
+	public:
+		void reset()
+		{
+			std::fill(counts.begin(), counts.end(), 0);
+			totalCount = 0;
+			sum = 0.0;
+			minValue = 0.0;
+			maxValue = 0.0;
+		}
+
+		void record(double ms)
+		{
+			const double us = std::max(ms * 1000.0, 0.0);
+			const uint64_t value = static_cast<uint64_t>(std::min(us + 0.5, 4294967295.0));
+			counts[bucketIndex(value)]++;
+			minValue = (totalCount == 0) ? ms : std::min(minValue, ms);
+			maxValue = (totalCount == 0) ? ms : std::max(maxValue, ms);
+			sum += ms;
+			totalCount++;
+		}
+
+		uint64_t count() const { return totalCount; }
+		double min() const { return minValue; }
+		double max() const { return maxValue; }
+		double mean() const { return (totalCount > 0) ? sum / static_cast<double>(totalCount) : 0.0; }
+
+		// Frame time in ms below which the given percentage (0..100) of all frames lie
+		double percentile(double p) const
+		{
+			if (totalCount == 0)
+			{
+				return 0.0;
+			}
+			const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * static_cast<double>(totalCount))));
+			uint64_t accumulated = 0;
+			for (uint32_t i = 0; i < bucketCount; i++)
+			{
+				accumulated += counts[i];
+				if (accumulated >= rank)
+				{
+					double lower, upper;
+					bucketRange(i, lower, upper);
+					// Middle of the bucket, the exact extremes are known
+					const double value = (lower + upper) * 0.5 / 1000.0;
+					return std::min(std::max(value, minValue), maxValue);
+				}
+			}//for_i
+			return maxValue;
+		}
+	};//class FrameTimeHistogram
+
 	class Benchmark {
 	private:
 		FILE* stream;
@@ -22,16 +127,84 @@ namespace vks
 
 	public:
 		bool active = false;
-		bool outputFrameTimes = false;
+		bool outputFrameTimes = false; // Keeps every frame time for the result file, statistics only need the histogram
 		int outputFrames = -1; //-1 means no frames limit
 		uint32_t warmup = 1;
 		uint32_t duration = 10;
 		std::vector<double> frameTimes;
-		std::string filename = "";
+		std::string filename = ""; // Results are written as JSON if the name ends with .json, as CSV otherwise
+		std::string commandLine;
 
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
 
+		FrameTimeHistogram histogram;
+		// A frame stutters if it takes longer than stutterFactor times the moving average of the previous frames
+		double stutterFactor = 2.0;
+		uint32_t stutterCount = 0;
+		double movingAverage = 0.0;
+
+		// Wall clock time of the application phases in ms, in the order they finished
+		std::vector<std::pair<std::string, double>> phases;
+		std::chrono::high_resolution_clock::time_point phaseStart = std::chrono::high_resolution_clock::now();
+		// Prepended to the warmup and benchmark phases of run, so every run of a sweep keeps its own phase names
+		std::string phasePrefix;
+
+		// Additional named values of the run (e.g. memory usage or pipeline statistics), appended to the result file
+		std::vector<std::pair<std::string, double>> counters;
+
+		// Parameter sweeps run the benchmark once per configuration and collect one CSV row per run
+		std::string sweepHeader;
+		std::vector<std::string> sweepRows;
+
+		// Clears the results of the previous run
+		void reset()
+		{
+			frameTimes.clear();
+			histogram.reset();
+			runtime = 0.0;
+			frameCount = 0;
+			stutterCount = 0;
+			movingAverage = 0.0;
+		}
+
+		// Records the time since the end of the previous phase (or the creation of the benchmark) under the given name
+		void endPhase(const std::string& name)
+		{
+			auto tNow = std::chrono::high_resolution_clock::now();
+			phases.push_back(std::make_pair(name, std::chrono::duration<double, std::milli>(tNow - phaseStart).count()));
+			phaseStart = tNow;
+		}
+
+		void setCounter(const std::string& name, double value)
+		{
+			for (auto& counter : counters)
+			{
+				if (counter.first == name)
+				{
+					counter.second = value;
+					return;
+				}
+			}
+			counters.push_back(std::make_pair(name, value));
+		}
+
+		void recordFrame(double tDiff)
+		{
+			if (outputFrameTimes)
+			{
+				frameTimes.push_back(tDiff);
+			}
+			histogram.record(tDiff);
+			if ((frameCount > 0) && (tDiff > stutterFactor * movingAverage))
+			{
+				stutterCount++;
+			}
+			movingAverage = (frameCount == 0) ? tDiff : movingAverage * 0.9 + tDiff * 0.1;
+			runtime += tDiff;
+			frameCount++;
+		}
+
 		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps)
 		{
 			active = true;
@@ -54,6 +227,7 @@ namespace vks
 					tMeasured += tDiff;
 				};
 			}
+			endPhase(phasePrefix + "warmup");
 
 			//Benchmark phase
 			{
@@ -62,10 +236,7 @@ namespace vks
 					auto tStart = std::chrono::high_resolution_clock::now();
 					renderFunc();
 					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
-					runtime += tDiff;
-
-					frameTimes.push_back(tDiff);
-					frameCount++;
+					recordFrame(tDiff);
 					if (outputFrames != -1 && outputFrames == frameCount)
 					{
 						break;
@@ -77,11 +248,36 @@ namespace vks
 				std::cout << "runtime: " << (runtime / 1000.0) << "\n";//΢תΪ룿
 				std::cout << "frames : " << frameCount << "\n";
 				std::cout << "fps    : " << frameCount / (runtime / 1000.0) << "\n";
+				std::cout << "best   : " << histogram.min() << " ms" << "\n";
+				std::cout << "worst  : " << histogram.max() << " ms" << "\n";
+				std::cout << "avg    : " << histogram.mean() << " ms" << "\n";
+				std::cout << "p50    : " << histogram.percentile(50.0) << " ms" << "\n";
+				std::cout << "p90    : " << histogram.percentile(90.0) << " ms" << "\n";
+				std::cout << "p99    : " << histogram.percentile(99.0) << " ms" << "\n";
+				std::cout << "p99.9  : " << histogram.percentile(99.9) << " ms" << "\n";
+				std::cout << "stutter: " << stutterCount << " frames" << "\n";
 			}//Benchmark phase
+			endPhase(phasePrefix + "benchmark");
 
 		}//run
 
 		void saveResults()
+		{
+			const std::string extension = ".json";
+			if ((filename.size() >= extension.size()) && (filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0))
+			{
+				saveJsonReport();
+			}
+			else
+			{
+				saveCsvResults();
+			}
+#ifdef _WIN32
+			FreeConsole();
+#endif
+		}//Result
+
+		void saveCsvResults()
 		{
 			std::ofstream result(filename, std::ios::out);
 			if (result.is_open())
@@ -89,30 +285,157 @@ namespace vks
 				result<<std::fixed << std::setprecision(4);
 
 				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << "\n";
+				result << "\n" << "avg ms,min ms,max ms,p50 ms,p90 ms,p99 ms,p99.9 ms,stutters" << "\n";
+				result << histogram.mean() << "," << histogram.min() << "," << histogram.max() << "," << histogram.percentile(50.0) << "," << histogram.percentile(90.0) << ","
+					<< histogram.percentile(99.0) << "," << histogram.percentile(99.9) << "," << stutterCount << "\n";
 
-				if (outputFrames)
+				if (!counters.empty())
+				{
+					result << "\n" << "counter,value" << "\n";
+					for (auto& counter : counters)
+					{
+						result << counter.first << "," << counter.second << "\n";
+					}
+				}
+
+				if (outputFrameTimes)
 				{
 					result << "\n" << "frame,ms" << "\n";
 					for (size_t i = 0;i<frameTimes.size();i++)
 					{
 						result << i << "," << frameTimes[i] << "\n";
 					}
-
-					double tMin = *std::min_element(frameTimes.begin(), frameTimes.end());
-					double tMax = *std::max_element(frameTimes.begin(), frameTimes.end());
-					double tAvg = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / (double)frameTimes.size();
-					std::cout << "best   : " << (1000.0 / tMin) << " fps (" << tMin << " ms)" << "\n";
-					std::cout << "worst  : " << (1000.0 / tMax) << " fps (" << tMax << " ms)" << "\n";
-					std::cout << "avg    : " << (1000.0 / tAvg) << " fps (" << tAvg << " ms)" << "\n";
-					std::cout << "\n";
 				}
 
 				result.flush();
-#ifdef _WIN32
-				FreeConsole();
-#endif
 			}//if
-		}//Result
+		}
+
+		static std::string jsonString(const std::string& value)
+		{
+			std::string escaped = "\"";
+			for (char c : value)
+			{
+				switch (c)
+				{
+				case '"': escaped += "\\\""; break;
+				case '\\': escaped += "\\\\"; break;
+				case '\n': escaped += "\\n"; break;
+				case '\t': escaped += "\\t"; break;
+				case '\r': break;
+				default: escaped += c;
+				}
+			}
+			return escaped + "\"";
+		}
+
+		static std::string buildDescription()
+		{
+			std::stringstream build;
+#if defined(_MSC_VER)
+			build << "MSVC " << _MSC_VER;
+#elif defined(__clang__)
+			build << "clang " << __clang_version__;
+#elif defined(__GNUC__)
+			build << "gcc " << __VERSION__;
+#else
+			build << "unknown compiler";
+#endif
+#ifdef NDEBUG
+			build << ", release";
+#else
+			build << ", debug";
+#endif
+			build << ", " << __DATE__ << " " << __TIME__;
+			return build.str();
+		}
+
+		void saveJsonReport()
+		{
+			std::ofstream result(filename, std::ios::out);
+			if (!result.is_open())
+			{
+				return;
+			}
+			result << std::fixed << std::setprecision(4);
+			result << "{\n";
+			result << "\t\"device\": {\n";
+			result << "\t\t\"name\": " << jsonString(deviceProps.deviceName) << ",\n";
+			result << "\t\t\"vendorID\": " << deviceProps.vendorID << ",\n";
+			result << "\t\t\"deviceID\": " << deviceProps.deviceID << ",\n";
+			result << "\t\t\"driverVersion\": " << deviceProps.driverVersion << ",\n";
+			result << "\t\t\"apiVersion\": \"" << VK_VERSION_MAJOR(deviceProps.apiVersion) << "." << VK_VERSION_MINOR(deviceProps.apiVersion) << "." << VK_VERSION_PATCH(deviceProps.apiVersion) << "\"\n";
+			result << "\t},\n";
+			result << "\t\"build\": " << jsonString(buildDescription()) << ",\n";
+			result << "\t\"commandLine\": " << jsonString(commandLine) << ",\n";
+			result << "\t\"settings\": { \"warmup\": " << warmup << ", \"duration\": " << duration << ", \"frameLimit\": " << outputFrames << ", \"stutterFactor\": " << stutterFactor << " },\n";
+			result << "\t\"phases\": {";
+			for (size_t i = 0; i < phases.size(); i++)
+			{
+				result << ((i > 0) ? "," : "") << "\n\t\t" << jsonString(phases[i].first) << ": " << phases[i].second;
+			}
+			result << "\n\t},\n";
+			result << "\t\"results\": {\n";
+			result << "\t\t\"runtime\": " << runtime << ",\n";
+			result << "\t\t\"frames\": " << frameCount << ",\n";
+			result << "\t\t\"fps\": " << ((runtime > 0.0) ? frameCount / (runtime / 1000.0) : 0.0) << ",\n";
+			result << "\t\t\"avg\": " << histogram.mean() << ",\n";
+			result << "\t\t\"min\": " << histogram.min() << ",\n";
+			result << "\t\t\"max\": " << histogram.max() << ",\n";
+			result << "\t\t\"p50\": " << histogram.percentile(50.0) << ",\n";
+			result << "\t\t\"p90\": " << histogram.percentile(90.0) << ",\n";
+			result << "\t\t\"p99\": " << histogram.percentile(99.0) << ",\n";
+			result << "\t\t\"p99.9\": " << histogram.percentile(99.9) << ",\n";
+			result << "\t\t\"stutters\": " << stutterCount << "\n";
+			result << "\t}";
+			if (!counters.empty())
+			{
+				result << ",\n\t\"counters\": {";
+				for (size_t i = 0; i < counters.size(); i++)
+				{
+					result << ((i > 0) ? "," : "") << "\n\t\t" << jsonString(counters[i].first) << ": " << counters[i].second;
+				}
+				result << "\n\t}";
+			}
+			if (outputFrameTimes)
+			{
+				result << ",\n\t\"frameTimes\": [";
+				for (size_t i = 0; i < frameTimes.size(); i++)
+				{
+					result << ((i > 0) ? ", " : "") << frameTimes[i];
+				}
+				result << "]";
+			}
+			result << "\n}\n";
+			result.flush();
+			std::cout << "Saved benchmark report to " << filename << "\n";
+		}
+
+		// Records the results of the last run, parameters are the comma separated values for the columns in sweepHeader
+		void addSweepResult(const std::string& parameters)
+		{
+			std::stringstream row;
+			row << std::fixed << std::setprecision(4);
+			row << parameters << "," << runtime << "," << frameCount << "," << ((runtime > 0.0) ? frameCount / (runtime / 1000.0) : 0.0) << "," << histogram.mean() << "," << histogram.min() << "," << histogram.max()
+				<< "," << histogram.percentile(50.0) << "," << histogram.percentile(99.0) << "," << stutterCount;
+			sweepRows.push_back(row.str());
+		}
+
+		void saveSweepResults(const std::string& sweepFilename)
+		{
+			std::ofstream result(sweepFilename, std::ios::out);
+			if (result.is_open())
+			{
+				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "\n";
+				result << sweepHeader << ",runtime,frames,fps,avg ms,min ms,max ms,p50 ms,p99 ms,stutters" << "\n";
+				for (auto& row : sweepRows)
+				{
+					result << row << "\n";
+				}
+				result.flush();
+				std::cout << "Saved " << sweepRows.size() << " sweep results to " << sweepFilename << "\n";
+			}
+		}
 
 	};//class Benchmark
 
@@ -0,0 +1,450 @@
+/*
+* CPU cloth solver for the compute shader cloth example
+*
+* Uses the same particle layout as cloth.comp and can be used as a reference or as a fallback for large grids
+* Positions are advanced with Verlet integration (SSE where available) and corrected with XPBD distance constraints
+* Constraints are graph coloured so that all constraints of one colour can be projected in parallel (Gauss-Seidel per colour)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "ThreadPool.hpp"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define CLOTH_CPU_SSE
+#endif
+
+namespace cloth
+{
+	// SSBO cloth grid particle declaration, must match the layout used by the compute shader
+	struct Particle
+	{
+		glm::vec4 pos;
+		glm::vec4 vel;
+		glm::vec4 uv;
+		glm::vec4 normal;
+		float pinned;
+		glm::vec3 _pad0;
+	};
+
+	// Initial cloth grid, same layout as the original example (index = i + j * gridsize.y)
+	// The compute shader and the CPU solver address neighbours with index = y * gridsize.x + x, so grids are expected to be square
+	// Scene 0: Horizontal cloth falling onto a sphere, scene 1: Vertical cloth pinned at the top
+	inline std::vector<Particle> generateParticles(glm::uvec2 gridsize, glm::vec2 size, uint32_t sceneSetup)
+	{
+		std::vector<Particle> particles(gridsize.x * gridsize.y);
+
+		float dx = size.x / (gridsize.x - 1);
+		float dy = size.y / (gridsize.y - 1);
+		float du = 1.0f / (gridsize.x - 1);
+		float dv = 1.0f / (gridsize.y - 1);
+
+		glm::mat4 transM = glm::translate(glm::mat4(1.0f), glm::vec3(-size.x / 2.0f, -2.0f, -size.y / 2.0f));
+
+		for (uint32_t i = 0; i < gridsize.y; i++)
+		{
+			for (uint32_t j = 0; j < gridsize.x; j++)
+			{
+				Particle& particle = particles[i + j * gridsize.y];
+				particle.vel = glm::vec4(0.0f);
+				particle.pinned = 0.0f;
+				if (sceneSetup == 0)
+				{
+					particle.pos = transM * glm::vec4(dx * j, 0.0f, dy * i, 1.0f);
+					particle.uv = glm::vec4(1.0f - du * i, dv * j, 0.0f, 0.0f);
+				}
+				else
+				{
+					particle.pos = transM * glm::vec4(dx * j, dy * i, 0.0f, 1.0f);
+					particle.uv = glm::vec4(du * j, dv * i, 0.0f, 0.0f);
+					// Pin some particles
+					particle.pinned = ((i == 0) && ((j == 0) || (j == gridsize.x / 3) || (j == gridsize.x - gridsize.x / 3) || (j == gridsize.x - 1))) ? 1.0f : 0.0f;
+				}
+			}
+		}
+
+		return particles;
+	}
+
+	struct SimulationParameters
+	{
+		glm::vec3 gravity = glm::vec3(0.0f, 9.8f, 0.0f);
+		// Fraction of the velocity removed per second
+		float damping = 2.5f;
+		// XPBD compliance (inverse stiffness) for the structural, shear and bending constraints
+		float stretchCompliance = 0.0f;
+		float shearCompliance = 1e-6f;
+		float bendCompliance = 1e-4f;
+		uint32_t substeps = 16;
+		uint32_t iterations = 1;
+		glm::vec3 spherePos = glm::vec3(0.0f);
+		float sphereRadius = 1.0f;
+	};
+
+	class CpuSolver
+	{
+	public:
+		SimulationParameters params;
+
+		explicit CpuSolver(uint32_t threadCount)
+		{
+			this->threadCount = std::max(threadCount, 1u);
+			threadPool.setThreadCount(this->threadCount);
+		}
+
+		// Copies the particle state and builds the constraint batches for a grid of the given size
+		void setup(const std::vector<Particle>& particles, glm::uvec2 gridsize)
+		{
+			this->gridsize = gridsize;
+			particleCount = static_cast<uint32_t>(particles.size());
+			const size_t paddedCount = (particleCount + 3) & ~size_t(3);
+
+			for (std::vector<float>* v : { &posX, &posY, &posZ, &prevX, &prevY, &prevZ, &invMass })
+			{
+				v->assign(paddedCount, 0.0f);
+			}
+			for (uint32_t i = 0; i < particleCount; i++)
+			{
+				posX[i] = prevX[i] = particles[i].pos.x;
+				posY[i] = prevY[i] = particles[i].pos.y;
+				posZ[i] = prevZ[i] = particles[i].pos.z;
+				invMass[i] = (particles[i].pinned == 1.0f) ? 0.0f : 1.0f;
+			}
+
+			buildConstraints();
+		}
+
+		// Advances the simulation by deltaT using params.substeps substeps
+		void step(float deltaT)
+		{
+			const float h = deltaT / std::max(params.substeps, 1u);
+			lastSubstep = h;
+			for (uint32_t s = 0; s < params.substeps; s++)
+			{
+				integrate(h);
+				for (auto& batch : batches)
+				{
+					for (DistanceConstraint& constraint : batch)
+					{
+						constraint.lambda = 0.0f;
+					}
+				}
+				for (uint32_t i = 0; i < params.iterations; i++)
+				{
+					for (auto& batch : batches)
+					{
+						solveBatch(batch, h);
+					}
+				}
+				collideSphere();
+			}
+		}
+
+		// Writes positions, velocities and normals back, uv and pinned state are left untouched
+		void readParticles(std::vector<Particle>& particles) const
+		{
+			const float invH = (lastSubstep > 0.0f) ? 1.0f / lastSubstep : 0.0f;
+			for (uint32_t i = 0; i < particleCount; i++)
+			{
+				particles[i].pos = glm::vec4(posX[i], posY[i], posZ[i], 1.0f);
+				particles[i].vel = glm::vec4((posX[i] - prevX[i]) * invH, (posY[i] - prevY[i]) * invH, (posZ[i] - prevZ[i]) * invH, 0.0f);
+				particles[i].normal = glm::vec4(calculateNormal(i), 0.0f);
+			}
+		}
+
+		// Hash of the current positions, identical for identical builds regardless of the thread count
+		uint64_t checksum() const
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (const std::vector<float>* v : { &posX, &posY, &posZ })
+			{
+				for (uint32_t i = 0; i < particleCount; i++)
+				{
+					uint32_t bits;
+					memcpy(&bits, &(*v)[i], sizeof(bits));
+					hash = (hash ^ bits) * 1099511628211ull;
+				}
+			}
+			return hash;
+		}
+
+		uint32_t getColorCount() const
+		{
+			return static_cast<uint32_t>(batches.size());
+		}
+
+		size_t getConstraintCount() const
+		{
+			size_t count = 0;
+			for (auto& batch : batches)
+			{
+				count += batch.size();
+			}
+			return count;
+		}
+
+	private:
+		// Constraints of one colour share no particles, so projecting them in parallel is free of races
+		static const uint32_t minBatchSizePerThread = 256;
+
+		struct DistanceConstraint
+		{
+			uint32_t p0;
+			uint32_t p1;
+			float restLength;
+			float compliance;
+			float lambda;
+		};
+
+		vks::ThreadPool threadPool;
+		uint32_t threadCount;
+
+		glm::uvec2 gridsize;
+		uint32_t particleCount = 0;
+		float lastSubstep = 0.0f;
+
+		// Current and previous positions in SoA layout, padded to a multiple of four
+		std::vector<float> posX, posY, posZ;
+		std::vector<float> prevX, prevY, prevZ;
+		// Zero for pinned particles
+		std::vector<float> invMass;
+
+		std::vector<std::vector<DistanceConstraint>> batches;
+
+		uint32_t index(uint32_t x, uint32_t y) const
+		{
+			return y * gridsize.x + x;
+		}
+
+		void buildConstraints()
+		{
+			std::vector<DistanceConstraint> constraints;
+			auto addConstraint = [&](uint32_t p0, uint32_t p1, float compliance)
+			{
+				const float restLength = glm::distance(glm::vec3(posX[p0], posY[p0], posZ[p0]), glm::vec3(posX[p1], posY[p1], posZ[p1]));
+				constraints.push_back({ p0, p1, restLength, compliance, 0.0f });
+			};
+
+			for (uint32_t y = 0; y < gridsize.y; y++)
+			{
+				for (uint32_t x = 0; x < gridsize.x; x++)
+				{
+					// Structural
+					if (x + 1 < gridsize.x) addConstraint(index(x, y), index(x + 1, y), params.stretchCompliance);
+					if (y + 1 < gridsize.y) addConstraint(index(x, y), index(x, y + 1), params.stretchCompliance);
+					// Shear
+					if ((x + 1 < gridsize.x) && (y + 1 < gridsize.y))
+					{
+						addConstraint(index(x, y), index(x + 1, y + 1), params.shearCompliance);
+						addConstraint(index(x + 1, y), index(x, y + 1), params.shearCompliance);
+					}
+					// Bending, approximated by distance constraints skipping one particle
+					if (x + 2 < gridsize.x) addConstraint(index(x, y), index(x + 2, y), params.bendCompliance);
+					if (y + 2 < gridsize.y) addConstraint(index(x, y), index(x, y + 2), params.bendCompliance);
+				}
+			}
+
+			// Greedy graph colouring, each constraint gets the first colour not used by any other constraint of its particles
+			std::vector<uint64_t> usedColors(particleCount, 0);
+			batches.clear();
+			for (const DistanceConstraint& constraint : constraints)
+			{
+				const uint64_t used = usedColors[constraint.p0] | usedColors[constraint.p1];
+				uint32_t color = 0;
+				while ((color < 63) && (used & (1ull << color)))
+				{
+					color++;
+				}
+				usedColors[constraint.p0] |= (1ull << color);
+				usedColors[constraint.p1] |= (1ull << color);
+				if (color >= batches.size())
+				{
+					batches.resize(color + 1);
+				}
+				batches[color].push_back(constraint);
+			}
+		}
+
+		// Verlet prediction: x' = x + (x - x_prev) * damping + g * h^2
+		void integrate(float h)
+		{
+			const size_t paddedCount = posX.size();
+			const float damping = std::max(0.0f, 1.0f - params.damping * h);
+			const glm::vec3 gravityStep = params.gravity * h * h;
+			size_t i = 0;
+#if defined(CLOTH_CPU_SSE)
+			const __m128 dampingV = _mm_set1_ps(damping);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 gravityV[3] = { _mm_set1_ps(gravityStep.x), _mm_set1_ps(gravityStep.y), _mm_set1_ps(gravityStep.z) };
+			float* pos[3] = { posX.data(), posY.data(), posZ.data() };
+			float* prev[3] = { prevX.data(), prevY.data(), prevZ.data() };
+			for (; i < paddedCount; i += 4)
+			{
+				// Pinned particles (inverse mass of zero) keep their position
+				const __m128 movable = _mm_cmpgt_ps(_mm_loadu_ps(&invMass[i]), zero);
+				for (uint32_t c = 0; c < 3; c++)
+				{
+					const __m128 p = _mm_loadu_ps(pos[c] + i);
+					const __m128 velocity = _mm_mul_ps(_mm_sub_ps(p, _mm_loadu_ps(prev[c] + i)), dampingV);
+					const __m128 predicted = _mm_add_ps(p, _mm_and_ps(movable, _mm_add_ps(velocity, gravityV[c])));
+					_mm_storeu_ps(prev[c] + i, p);
+					_mm_storeu_ps(pos[c] + i, predicted);
+				}
+			}
+#endif
+			for (; i < paddedCount; i++)
+			{
+				const float px = posX[i], py = posY[i], pz = posZ[i];
+				if (invMass[i] > 0.0f)
+				{
+					posX[i] += (px - prevX[i]) * damping + gravityStep.x;
+					posY[i] += (py - prevY[i]) * damping + gravityStep.y;
+					posZ[i] += (pz - prevZ[i]) * damping + gravityStep.z;
+				}
+				prevX[i] = px;
+				prevY[i] = py;
+				prevZ[i] = pz;
+			}
+		}
+
+		void solveConstraint(DistanceConstraint& constraint, float h)
+		{
+			const uint32_t p0 = constraint.p0;
+			const uint32_t p1 = constraint.p1;
+			const float w = invMass[p0] + invMass[p1];
+			if (w == 0.0f)
+			{
+				return;
+			}
+			const float dx = posX[p0] - posX[p1];
+			const float dy = posY[p0] - posY[p1];
+			const float dz = posZ[p0] - posZ[p1];
+			const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+			if (length < 1e-9f)
+			{
+				return;
+			}
+			const float alpha = constraint.compliance / (h * h);
+			const float c = length - constraint.restLength;
+			const float deltaLambda = (-c - alpha * constraint.lambda) / (w + alpha);
+			constraint.lambda += deltaLambda;
+
+			const float s = deltaLambda / length;
+			posX[p0] += invMass[p0] * s * dx;
+			posY[p0] += invMass[p0] * s * dy;
+			posZ[p0] += invMass[p0] * s * dz;
+			posX[p1] -= invMass[p1] * s * dx;
+			posY[p1] -= invMass[p1] * s * dy;
+			posZ[p1] -= invMass[p1] * s * dz;
+		}
+
+		void solveBatch(std::vector<DistanceConstraint>& batch, float h)
+		{
+			const uint32_t batchSize = static_cast<uint32_t>(batch.size());
+			const uint32_t jobCount = std::min(threadCount, std::max(batchSize / minBatchSizePerThread, 1u));
+			if (jobCount == 1)
+			{
+				for (DistanceConstraint& constraint : batch)
+				{
+					solveConstraint(constraint, h);
+				}
+				return;
+			}
+
+			const uint32_t chunkSize = (batchSize + jobCount - 1) / jobCount;
+			for (uint32_t t = 0; t < jobCount; t++)
+			{
+				const uint32_t first = std::min(t * chunkSize, batchSize);
+				const uint32_t last = std::min(first + chunkSize, batchSize);
+				threadPool.threads[t]->addJob([=, &batch] {
+					for (uint32_t i = first; i < last; i++)
+					{
+						solveConstraint(batch[i], h);
+					}
+				});
+			}
+			threadPool.wait();
+		}
+
+		// Pushes particles inside the sphere to its surface and cancels their velocity, same as the compute shader
+		void collideSphere()
+		{
+			const float radius = params.sphereRadius + 0.01f;
+			for (uint32_t i = 0; i < particleCount; i++)
+			{
+				const glm::vec3 dist = glm::vec3(posX[i], posY[i], posZ[i]) - params.spherePos;
+				const float length = glm::length(dist);
+				if ((length < radius) && (length > 0.0f))
+				{
+					const glm::vec3 pos = params.spherePos + dist / length * radius;
+					posX[i] = prevX[i] = pos.x;
+					posY[i] = prevY[i] = pos.y;
+					posZ[i] = prevZ[i] = pos.z;
+				}
+			}
+		}
+
+		glm::vec3 position(uint32_t i) const
+		{
+			return glm::vec3(posX[i], posY[i], posZ[i]);
+		}
+
+		// Same neighbourhood and winding as the normal calculation in the compute shader
+		glm::vec3 calculateNormal(uint32_t i) const
+		{
+			const uint32_t x = i % gridsize.x;
+			const uint32_t y = i / gridsize.x;
+			const uint32_t w = gridsize.x;
+			const glm::vec3 pos = position(i);
+			glm::vec3 normal(0.0f);
+			glm::vec3 a, b, c;
+			if (y > 0)
+			{
+				if (x > 0)
+				{
+					a = position(i - 1) - pos;
+					b = position(i - w - 1) - pos;
+					c = position(i - w) - pos;
+					normal += glm::cross(a, b) + glm::cross(b, c);
+				}
+				if (x < gridsize.x - 1)
+				{
+					a = position(i - w) - pos;
+					b = position(i - w + 1) - pos;
+					c = position(i + 1) - pos;
+					normal += glm::cross(a, b) + glm::cross(b, c);
+				}
+			}
+			if (y < gridsize.y - 1)
+			{
+				if (x > 0)
+				{
+					a = position(i + w) - pos;
+					b = position(i + w - 1) - pos;
+					c = position(i - 1) - pos;
+					normal += glm::cross(a, b) + glm::cross(b, c);
+				}
+				if (x < gridsize.x - 1)
+				{
+					a = position(i + 1) - pos;
+					b = position(i + w + 1) - pos;
+					c = position(i + w) - pos;
+					normal += glm::cross(a, b) + glm::cross(b, c);
+				}
+			}
+			const float length = glm::length(normal);
+			return (length > 0.0f) ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+		}
+	};
+}
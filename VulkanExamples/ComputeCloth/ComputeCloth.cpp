@@ -6,19 +6,23 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <chrono>
+#include <fstream>
+#include <iomanip>
 #include "VulkanExampleBase.h"
 #include "VulkanglTFModel.h"
+#include "ClothCpu.hpp"
 
 #define ENABLE_VALIDATION false
+// Work group size of the cloth compute shader in x and y
+#define CLOTH_WORKGROUP_SIZE 10
 
 class VulkanExample :public VulkanExampleBase
 {
 public:
 	uint32_t sceneSetup = 0;
-	uint32_t readSet = 0;
 	uint32_t indexCount;
 	bool simulateWind = false;
-	bool specializedComputeQueue = false;
 
 	vks::Texture2D textureCloth;
 	vkglTF::Model modelSphere;
@@ -48,22 +52,21 @@ public:
 	{
 		struct StorageBuffers
 		{
-			vks::Buffer input;
-			vks::Buffer output;
+			// Double buffered cloth state, a step reads one and writes the other while the graphics queue renders the first
+			std::array<vks::Buffer, ASYNC_COMPUTE_STATE_COUNT> states;
+			// Intermediate results of the iterations within a step
+			vks::Buffer scratch;
 		} storageBuffers;
 
-		struct Semaphores
-		{
-			VkSemaphore ready{ 0L };
-			VkSemaphore complete{ 0L };
-		}semaphores;
-
 		vks::Buffer uniformBuffer;
 		VkQueue queue;
 		VkCommandPool commandPool;
-		std::array<VkCommandBuffer, 2>commandBuffers;
+		// One command buffer per state read by the step
+		std::array<VkCommandBuffer, ASYNC_COMPUTE_STATE_COUNT> commandBuffers;
 		VkDescriptorSetLayout descriptorSetLayout;
-		std::array<VkDescriptorSet, 2> descritptorSets;
+		// Sets reading state k and writing the scratch buffer, and reading the scratch buffer and writing state k
+		std::array<VkDescriptorSet, ASYNC_COMPUTE_STATE_COUNT> inputSets;
+		std::array<VkDescriptorSet, ASYNC_COMPUTE_STATE_COUNT> outputSets;
 		VkPipelineLayout pipelineLayout;
 		VkPipeline pipeline;
 
@@ -83,16 +86,8 @@ public:
 		} ubo;
 	} compute;
 
-	//SSBO cloth grid particle declaration
-	struct Particle
-	{
-		glm::vec4 pos;
-		glm::vec4 vel;
-		glm::vec4 uv;
-		glm::vec4 normal;
-		float pinned;
-		glm::vec3 _pad0;
-	};
+	//SSBO cloth grid particle declaration, shared with the CPU solver
+	using Particle = cloth::Particle;
 
 	struct Cloth
 	{
@@ -100,6 +95,26 @@ public:
 		glm::vec2 size = glm::vec2(5.0f);
 	} cloth;
 
+	// CPU solver settings, see runCpuBenchmark and runGoldenCheck
+	struct CpuSolverSettings
+	{
+		// Simulate on the CPU and render from a host visible vertex buffer instead of running the compute shader
+		bool enabled = false;
+		uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		uint32_t steps = 120;
+		std::vector<uint32_t> benchmarkGridSizes = { 64, 128, 256, 512, 1024 };
+		std::string goldenFile;
+		// Append the checksum to the golden file if it has no entry for the settings instead of failing
+		bool recordGolden = false;
+	} cpuSettings;
+
+	struct CpuPass
+	{
+		std::unique_ptr<cloth::CpuSolver> solver;
+		std::vector<Particle> particles;
+		vks::Buffer vertexBuffer;
+	} cpu;
+
 	VulkanExample():VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		windowTitle = "Compute Shader cloth simulation";
@@ -107,6 +122,58 @@ public:
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 512.0f);
 		camera.setRotation(glm::vec3(-30.0f, -45.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -5.0f));
+		asyncCompute.requested = true;
+
+		commandLineParser.add("gridsize", { "-gs", "--gridsize" }, 1, "Set number of cloth particles per side");
+		commandLineParser.add("scene", { "-sc", "--scene" }, 1, "Select scene setup (0 = cloth falling onto sphere, 1 = pinned cloth)");
+		commandLineParser.add("cpusolver", { "-cpu", "--cpusolver" }, 0, "Simulate the cloth with the CPU solver instead of the compute shader");
+		commandLineParser.add("threads", { "-t", "--threads" }, 1, "Set number of CPU solver threads");
+		commandLineParser.add("steps", { "-st", "--steps" }, 1, "Set number of simulation steps for the CPU benchmark and golden output runs");
+		commandLineParser.add("cpubenchmark", { "-cb", "--cpubenchmark" }, 0, "Benchmark CPU solver steps per second for a list of grid sizes and exit");
+		commandLineParser.add("benchmarkgrids", { "-cbg", "--benchmarkgrids" }, 1, "Comma separated list of grid sizes for the CPU benchmark");
+		commandLineParser.add("golden", { "-gold", "--golden" }, 0, "Compare CPU solver output against the reference checksums in data/golden/computecloth.txt and exit");
+		commandLineParser.add("goldenfile", { "-goldf", "--goldenfile" }, 1, "Use the given golden file instead of data/golden/computecloth.txt");
+		commandLineParser.add("goldenrecord", { "-goldrec", "--goldenrecord" }, 0, "Append the checksum to the golden file if it has no entry for the gridsize, scene and steps");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("gridsize"))
+		{
+			const uint32_t gridsize = std::max(commandLineParser.getValueAsInt("gridsize", cloth.gridsize.x), 3);
+			cloth.gridsize = glm::uvec2(gridsize);
+		}
+		if (commandLineParser.isSet("scene"))
+		{
+			sceneSetup = std::min(commandLineParser.getValueAsInt("scene", 0), 1);
+		}
+		cpuSettings.enabled = commandLineParser.isSet("cpusolver");
+		if (commandLineParser.isSet("threads"))
+		{
+			cpuSettings.threadCount = commandLineParser.getValueAsInt("threads", cpuSettings.threadCount);
+		}
+		if (commandLineParser.isSet("steps"))
+		{
+			cpuSettings.steps = commandLineParser.getValueAsInt("steps", cpuSettings.steps);
+		}
+		if (commandLineParser.isSet("benchmarkgrids"))
+		{
+			cpuSettings.benchmarkGridSizes.clear();
+			std::stringstream sizes(commandLineParser.getValueAsString("benchmarkgrids", ""));
+			std::string size;
+			while (std::getline(sizes, size, ','))
+			{
+				cpuSettings.benchmarkGridSizes.push_back(std::max((uint32_t)std::stoul(size), 3u));
+			}
+		}
+		if (commandLineParser.isSet("cpubenchmark"))
+		{
+			runCpuBenchmark();
+			exit(0);
+		}
+		if (commandLineParser.isSet("golden") || commandLineParser.isSet("goldenrecord"))
+		{
+			cpuSettings.goldenFile = commandLineParser.getValueAsString("goldenfile", getAssetPath() + "golden/computecloth.txt");
+			cpuSettings.recordGolden = commandLineParser.isSet("goldenrecord");
+			exit(runGoldenCheck() ? 0 : 1);
+		}
 	};
 
 	~VulkanExample()
@@ -120,16 +187,19 @@ public:
 		textureCloth.destroy();
 
 		// Compute
-		compute.storageBuffers.input.destroy();
-		compute.storageBuffers.output.destroy();
+		for (vks::Buffer& state : compute.storageBuffers.states)
+		{
+			state.destroy();
+		}
+		compute.storageBuffers.scratch.destroy();
 		compute.uniformBuffer.destroy();
 		vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 		vkDestroyPipeline(device, compute.pipeline, nullptr);
-
-		vkDestroySemaphore(device, compute.semaphores.ready, nullptr);
-		vkDestroySemaphore(device, compute.semaphores.complete, nullptr);
 		vkDestroyCommandPool(device, compute.commandPool, nullptr);
+
+		// CPU solver
+		cpu.vertexBuffer.destroy();
 	}
 
 	// Enable physical device features required for this example
@@ -141,67 +211,139 @@ public:
 		}
 	}
 
-	void loadAssets()
+	std::unique_ptr<cloth::CpuSolver> createCpuSolver(const std::vector<Particle>& particles, glm::uvec2 gridsize)
 	{
-		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
-		modelSphere.loadFromFile(getAssetPath() + "models/sphere.gltf", vulkanDevice, queue, glTFLoadingFlags);
-		textureCloth.loadFromFile(getAssetPath() + "textures/vulkan_cloth_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		std::unique_ptr<cloth::CpuSolver> solver(new cloth::CpuSolver(cpuSettings.threadCount));
+		solver->params.gravity = glm::vec3(compute.ubo.gravity);
+		solver->params.spherePos = glm::vec3(compute.ubo.spherePos);
+		if (sceneSetup == 1)
+		{
+			// Remove sphere
+			solver->params.spherePos.z = -10.0f;
+		}
+		solver->params.sphereRadius = compute.ubo.sphereRadius;
+		solver->setup(particles, gridsize);
+		return solver;
 	}
 
-	void prepareStorageBuffers()
+	// Measures CPU solver steps per second for each of the benchmark grid sizes
+	void runCpuBenchmark()
 	{
-		std::vector<Particle> particleBuffer(cloth.gridsize.x * cloth.gridsize.y);
+		const float deltaT = 1.0f / 60.0f;
 
-		float dx = cloth.size.x / (cloth.gridsize.x - 1);
-		float dy = cloth.size.y / (cloth.gridsize.y - 1);
-		float du = 1.0f / (cloth.gridsize.x - 1);
-		float dv = 1.0f / (cloth.gridsize.y - 1);
-
-		switch (sceneSetup)
+		std::cout << "CPU cloth solver benchmark (" << cpuSettings.threadCount << " threads, scene " << sceneSetup << ")\n";
+		std::cout << "gridsize,particles,constraints,colors,steps,steps/s,checksum\n";
+		for (uint32_t gridsize : cpuSettings.benchmarkGridSizes)
 		{
-		case	0:
-		{
-			// Horz. cloth falls onto sphere
-			glm::mat4 transM = glm::translate(glm::mat4(1.0f), glm::vec3(-cloth.size.x / 2.0f, -2.0f, -cloth.size.y / 2.0f));
-
-			for (uint32_t i = 0; i < cloth.gridsize.y; i++)
+			std::vector<Particle> particles = cloth::generateParticles(glm::uvec2(gridsize), cloth.size, sceneSetup);
+			std::unique_ptr<cloth::CpuSolver> solver = createCpuSolver(particles, glm::uvec2(gridsize));
+
+			// Run for at least the given number of steps or one second
+			uint32_t steps = 0;
+			double seconds = 0.0;
+			auto tStart = std::chrono::high_resolution_clock::now();
+			while ((steps < cpuSettings.steps) && (seconds < 1.0))
 			{
-				for (uint32_t j = 0; j < cloth.gridsize.x; j++)
-				{
-					particleBuffer[i + j * cloth.gridsize.y].pos = transM * glm::vec4(dx*j, 0.0f, dy*i, 1.0f);
-					particleBuffer[i + j * cloth.gridsize.y].vel = glm::vec4(0.0f);
-					particleBuffer[i + j * cloth.gridsize.y].uv = glm::vec4(1.0f - du * i, dv*j, 0.0f, 0.0f);
-				}
+				solver->step(deltaT);
+				steps++;
+				seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
 			}
-			break;
+
+			std::cout << gridsize << "," << particles.size() << "," << solver->getConstraintCount() << "," << solver->getColorCount() << ","
+				<< steps << "," << std::fixed << std::setprecision(2) << steps / std::max(seconds, 1e-9) << ","
+				<< std::hex << std::setw(16) << std::setfill('0') << solver->checksum() << std::dec << std::setfill(' ') << "\n";
 		}
+	}
+
+	// Runs the CPU solver for a fixed number of steps and compares the result against the checksum stored in the golden file
+	// The result does not depend on the thread count, a missing entry fails unless it is recorded with --goldenrecord
+	bool runGoldenCheck()
+	{
+		const float deltaT = 1.0f / 60.0f;
 
-		case 1:
+		std::vector<Particle> particles = cloth::generateParticles(cloth.gridsize, cloth.size, sceneSetup);
+		std::unique_ptr<cloth::CpuSolver> solver = createCpuSolver(particles, cloth.gridsize);
+		for (uint32_t i = 0; i < cpuSettings.steps; i++)
 		{
-			//Vert.Pinned cloth
-			glm::mat4 transM = glm::translate(glm::mat4(1.0f), glm::vec3(-cloth.size.x / 2.0f, -2.0f, -cloth.size.y / 2.0f));
+			solver->step(deltaT);
+		}
+
+		std::stringstream key;
+		key << cloth.gridsize.x << " " << sceneSetup << " " << cpuSettings.steps;
+		std::stringstream checksum;
+		checksum << std::hex << std::setw(16) << std::setfill('0') << solver->checksum();
 
-			for (uint32_t i = 0; i < cloth.gridsize.y; i++)
+		std::ifstream goldenFile(cpuSettings.goldenFile);
+		std::string line;
+		while (std::getline(goldenFile, line))
+		{
+			if (line.compare(0, key.str().size() + 1, key.str() + " ") == 0)
 			{
-				for (uint32_t j = 0; j < cloth.gridsize.x; j++)
-				{
-					particleBuffer[i + j * cloth.gridsize.y].pos = transM * glm::vec4(dx*j, dy*i, 0.0f, 1.0f);
-					particleBuffer[i + j * cloth.gridsize.y].vel = glm::vec4(0.0f);
-					particleBuffer[i + j * cloth.gridsize.y].uv = glm::vec4(du*j, dv*i, 0.0f, 0.0f);
-
-					// Pin some particles
-					particleBuffer[i + j * cloth.gridsize.y].pinned = (i == 0) &&
-						((j == 0) || (j == cloth.gridsize.x / 3) || (j == cloth.gridsize.x - cloth.gridsize.x / 3) || (j == cloth.gridsize.x - 1));
-					// Remove sphere
-					compute.ubo.spherePos.z = -10.0f;
-				}
+				const std::string expected = line.substr(key.str().size() + 1);
+				const bool passed = (expected == checksum.str());
+				std::cout << "Golden output " << (passed ? "matches" : "MISMATCH") << " for gridsize/scene/steps " << key.str()
+					<< ": " << checksum.str() << (passed ? "" : " (expected " + expected + ")") << "\n";
+				return passed;
 			}
+		}
+		goldenFile.close();
 
-			break;
+		if (!cpuSettings.recordGolden)
+		{
+			std::cout << "Golden output MISSING for gridsize/scene/steps " << key.str() << " in " << cpuSettings.goldenFile << ": " << checksum.str() << "\n";
+			return false;
 		}
+		std::ofstream result(cpuSettings.goldenFile, std::ios::app);
+		result << key.str() << " " << checksum.str() << "\n";
+		std::cout << "Golden output recorded for gridsize/scene/steps " << key.str() << ": " << checksum.str() << "\n";
+		return true;
+	}
+
+	// Host visible vertex buffer the CPU solver results are written to each frame
+	void prepareCpuSolver(std::vector<Particle>& particles)
+	{
+		cpu.particles = particles;
+		cpu.solver = createCpuSolver(particles, cloth.gridsize);
+		cpu.solver->readParticles(cpu.particles);
+
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&cpu.vertexBuffer, cpu.particles.size() * sizeof(Particle), cpu.particles.data());
+		VK_CHECK_RESULT(cpu.vertexBuffer.map());
+	}
 
-		default:
-			break;
+	void updateCpuSolver()
+	{
+		if (paused)
+		{
+			return;
+		}
+		cpu.solver->params.gravity = glm::vec3(compute.ubo.gravity);
+		// Larger steps would need more substeps to keep the cloth from stretching
+		cpu.solver->step(std::min(frameTimer, 1.0f / 30.0f));
+		cpu.solver->readParticles(cpu.particles);
+		// The previous frame has finished (see submitFrame) so the buffer is no longer in use
+		memcpy(cpu.vertexBuffer.mappedData, cpu.particles.data(), cpu.particles.size() * sizeof(Particle));
+	}
+
+	void loadAssets()
+	{
+		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
+		modelSphere.loadFromFile(getAssetPath() + "models/sphere.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		textureCloth.loadFromFile(getAssetPath() + "textures/vulkan_cloth_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+	}
+
+	void prepareStorageBuffers()
+	{
+		std::vector<Particle> particleBuffer = cloth::generateParticles(cloth.gridsize, cloth.size, sceneSetup);
+		if (sceneSetup == 1)
+		{
+			// Remove sphere
+			compute.ubo.spherePos.z = -10.0f;
+		}
+
+		if (cpuSettings.enabled)
+		{
+			prepareCpuSolver(particleBuffer);
 		}
 
 		VkDeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
@@ -214,22 +356,26 @@ public:
 		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
 			&stagingBuffer, storageBufferSize, particleBuffer.data());
 
-		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &compute.storageBuffers.input, storageBufferSize);
-
-		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &compute.storageBuffers.output, storageBufferSize);
+		// The buffers are shared by the graphics and compute queue families (if they differ), so no ownership transfers are needed
+		const std::vector<uint32_t> queueFamilyIndices = asyncCompute.getSharedQueueFamilyIndices();
+		for (vks::Buffer& state : compute.storageBuffers.states)
+		{
+			vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &state, storageBufferSize, queueFamilyIndices);
+		}
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &compute.storageBuffers.scratch, storageBufferSize, queueFamilyIndices);
 
 		// Copy from staging buffer
+		// All buffers start with the initial particles, the shader doesn't write the pinned flags and texture coordinates
 		VkCommandBuffer copyCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 		VkBufferCopy copyRegion = {};
 		copyRegion.size = storageBufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.storageBuffers.input.buffer, 1, &copyRegion);
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.storageBuffers.output.buffer, 1, &copyRegion);
-		// Add an initial release barrier to the graphics queue,
-		// so that when the compute command buffer executes for the first time
-		// it doesn't complain about a lack of a corresponding "release" to its "acquire"
-		addGraphicsToComputeBarriers(copyCmd);
+		for (vks::Buffer& state : compute.storageBuffers.states)
+		{
+			vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, state.buffer, 1, &copyRegion);
+		}
+		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.storageBuffers.scratch.buffer, 1, &copyRegion);
 		vulkanDevice->FlushCommandBuffer(copyCmd, queue, true);
 
 		stagingBuffer.destroy();
@@ -332,12 +478,12 @@ public:
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,3),
-			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,4),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,5),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,8),
 			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,2)
 		};
 
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 3);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 5);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -444,87 +590,41 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &graphics.pipelines.sphere));
 	}
 
-	void addGraphicsToComputeBarriers(VkCommandBuffer commandBuffer)
-	{
-		if (specializedComputeQueue)
-		{
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::GenBufferMemoryBarrier();
-			bufferBarrier.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
-			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphicIndex;
-			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
-			bufferBarrier.size = VK_WHOLE_SIZE;
-
-			std::vector<VkBufferMemoryBarrier> bufferBarriers;
-
-			bufferBarrier.buffer = compute.storageBuffers.input.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-
-			bufferBarrier.buffer = compute.storageBuffers.output.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				VK_FLAGS_NONE, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
-		}
-	}
-
 	void addComputeToComputeBarriers(VkCommandBuffer commandBuffer)
 	{
 		VkBufferMemoryBarrier bufferBarrier = vks::initializers::GenBufferMemoryBarrier();
 		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
 		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
-		bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
 		bufferBarrier.size = VK_WHOLE_SIZE;
 
 		std::vector<VkBufferMemoryBarrier> bufferBarriers;
 
-		bufferBarrier.buffer = compute.storageBuffers.input.buffer;
-		bufferBarriers.push_back(bufferBarrier);
+		for (const vks::Buffer& state : compute.storageBuffers.states)
+		{
+			bufferBarrier.buffer = state.buffer;
+			bufferBarriers.push_back(bufferBarrier);
+		}
 
-		bufferBarrier.buffer = compute.storageBuffers.output.buffer;
+		bufferBarrier.buffer = compute.storageBuffers.scratch.buffer;
 		bufferBarriers.push_back(bufferBarrier);
 
 		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_FLAGS_NONE, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
 	}
 
-	void addComputeToGraphicsBarriers(VkCommandBuffer commandBuffer)
-	{
-		if (specializedComputeQueue)
-		{
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::GenBufferMemoryBarrier();
-			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-			bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
-			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
-			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphicIndex;
-			bufferBarrier.size = VK_WHOLE_SIZE;
-
-			std::vector<VkBufferMemoryBarrier> bufferBarriers;
-
-			bufferBarrier.buffer = compute.storageBuffers.input.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-
-			bufferBarrier.buffer = compute.storageBuffers.output.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-				VK_FLAGS_NONE, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
-		}
-	}
-
-	// todo: check barriers (validation,separate complete queue)
-	void buildComputeCommandBuffer()
+	// One command buffer per read state: the iterations alternate between the scratch buffer and the other state,
+	// so the state being rendered is only read
+	void buildComputeCommandBuffers()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::GenCommandBufferBeginInfo();
-		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 
-		for (uint32_t i = 0; i < 2; i++)
+		for (uint32_t i = 0; i < ASYNC_COMPUTE_STATE_COUNT; i++)
 		{
+			const uint32_t writeState = (i + 1) % ASYNC_COMPUTE_STATE_COUNT;
+
 			VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffers[i], &cmdBufInfo));
 
-			// Acquire the storage buffers from the graphics queue
-			addGraphicsToComputeBarriers(compute.commandBuffers[i]);
+			asyncCompute.cmdBeginStep(compute.commandBuffers[i], i);
 
 			vkCmdBindPipeline(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
 
@@ -532,11 +632,20 @@ public:
 			vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
 
 			// Dispatch the complete job
+			// An even number of iterations ends with a write to the other state
 			const uint32_t iterations = 64;
-			for (int32_t j = 0; j < iterations; j++)
+			for (uint32_t j = 0; j < iterations; j++)
 			{
-				readSet = 1 - readSet;
-				vkCmdBindDescriptorSets(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descritptorSets[readSet], 0, 0);
+				VkDescriptorSet descriptorSet;
+				if (j == 0)
+				{
+					descriptorSet = compute.inputSets[i];
+				}
+				else
+				{
+					descriptorSet = (j % 2 == 1) ? compute.outputSets[writeState] : compute.inputSets[writeState];
+				}
+				vkCmdBindDescriptorSets(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &descriptorSet, 0, 0);
 
 				if (j == iterations - 1)
 				{
@@ -544,26 +653,25 @@ public:
 					vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
 				}
 
-				vkCmdDispatch(compute.commandBuffers[i], cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
+				vkCmdDispatch(compute.commandBuffers[i], (cloth.gridsize.x + CLOTH_WORKGROUP_SIZE - 1) / CLOTH_WORKGROUP_SIZE, (cloth.gridsize.y + CLOTH_WORKGROUP_SIZE - 1) / CLOTH_WORKGROUP_SIZE, 1);
 
-				// Don't add a barrier on the last iteration of the loop,since we'll have an explicit release to the graphics queue
+				// The last iteration is made visible to the graphics queue by the scheduler
 				if (j != iterations - 1)
 				{
 					addComputeToComputeBarriers(compute.commandBuffers[i]);
 				}
 			}//for_j
 
-			//release the storage buffers back to the graphics queue
-			addComputeToGraphicsBarriers(compute.commandBuffers[i]);
+			asyncCompute.cmdEndStep(compute.commandBuffers[i], i);
 
-			vkEndCommandBuffer(compute.commandBuffers[i]);
+			VK_CHECK_RESULT(vkEndCommandBuffer(compute.commandBuffers[i]));
 		}//for_i
 	}
 
 	void prepareCompute()
 	{
-		//Create a complete capable device queue
-		vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.computeIndex, 0, &compute.queue);
+		// Dedicated compute queue if the scheduler runs asynchronously, the graphics queue otherwise
+		compute.queue = asyncCompute.getQueue();
 
 		// Create complete pipeline
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
@@ -584,20 +692,21 @@ public:
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &compute.pipelineLayout));
 
 		VkDescriptorSetAllocateInfo allocateInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
-		// Create two desriptor sets with input and output buffers switched
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocateInfo, &compute.descritptorSets[0]));
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocateInfo, &compute.descritptorSets[1]));
-
-		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+		// Create desriptor sets between each state and the scratch buffer, in both directions
+		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets;
+		for (uint32_t i = 0; i < ASYNC_COMPUTE_STATE_COUNT; i++)
 		{
-			vks::initializers::GenWriteDescriptorSet(compute.descritptorSets[0],VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,0,&compute.storageBuffers.input.descriptorBufferInfo),
-			vks::initializers::GenWriteDescriptorSet(compute.descritptorSets[0],VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1,&compute.storageBuffers.output.descriptorBufferInfo),
-			vks::initializers::GenWriteDescriptorSet(compute.descritptorSets[0],VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,2,&compute.uniformBuffer.descriptorBufferInfo),
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocateInfo, &compute.inputSets[i]));
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocateInfo, &compute.outputSets[i]));
 
-			vks::initializers::GenWriteDescriptorSet(compute.descritptorSets[1],VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,0,&compute.storageBuffers.output.descriptorBufferInfo),
-			vks::initializers::GenWriteDescriptorSet(compute.descritptorSets[1],VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1,&compute.storageBuffers.input.descriptorBufferInfo),
-			vks::initializers::GenWriteDescriptorSet(compute.descritptorSets[1],VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,2,&compute.uniformBuffer.descriptorBufferInfo),
-		};
+			computeWriteDescriptorSets.push_back(vks::initializers::GenWriteDescriptorSet(compute.inputSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &compute.storageBuffers.states[i].descriptorBufferInfo));
+			computeWriteDescriptorSets.push_back(vks::initializers::GenWriteDescriptorSet(compute.inputSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &compute.storageBuffers.scratch.descriptorBufferInfo));
+			computeWriteDescriptorSets.push_back(vks::initializers::GenWriteDescriptorSet(compute.inputSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptorBufferInfo));
+
+			computeWriteDescriptorSets.push_back(vks::initializers::GenWriteDescriptorSet(compute.outputSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &compute.storageBuffers.scratch.descriptorBufferInfo));
+			computeWriteDescriptorSets.push_back(vks::initializers::GenWriteDescriptorSet(compute.outputSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &compute.storageBuffers.states[i].descriptorBufferInfo));
+			computeWriteDescriptorSets.push_back(vks::initializers::GenWriteDescriptorSet(compute.outputSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptorBufferInfo));
+		}//for_i
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
 
@@ -609,24 +718,27 @@ public:
 		// Separate command pool as queue family for complete may be different than graphics
 		VkCommandPoolCreateInfo cmdPoolInfo = {};
 		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		cmdPoolInfo.queueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
+		cmdPoolInfo.queueFamilyIndex = asyncCompute.getQueueFamilyIndex();
 		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
 
-		// Create a command buffer for complete operations
-		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::GenCommandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 2);
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffers[0]));
-
-		// Semaphores for graphics / complete synchronization
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::GenSemaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores.ready));
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores.complete));
+		// Create the command buffers for complete operations
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::GenCommandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, ASYNC_COMPUTE_STATE_COUNT);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, compute.commandBuffers.data()));
 
-		// Build a single command buffer
-		buildComputeCommandBuffer();
+		buildComputeCommandBuffers();
 	}
 
 	void buildCommandBuffersForPreRenderPrmitives()
+	{
+		for (int32_t i = 0; i < drawCmdBuffers.size(); i++)
+		{
+			buildCommandBuffer(i);
+		}//for_i
+	}
+
+	// With the compute solver the command buffer is re-recorded every frame, as the rendered state alternates
+	void buildCommandBuffer(uint32_t i)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::GenCommandBufferBeginInfo();
 
@@ -643,62 +755,62 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); i++)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		// Set target frame buffer
+		renderPassBeginInfo.framebuffer = frameBuffers[i];
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		const uint32_t state = asyncCompute.getReadState();
 
-			// Acquire storage buffers from complete queue
-			addComputeToGraphicsBarriers(drawCmdBuffers[i]);
+		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			// Draw the particle system using the update vertex buffer
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if (!cpuSettings.enabled)
+		{
+			asyncCompute.cmdBeginFrame(drawCmdBuffers[i], state);
+		}
 
-			VkViewport viewport = vks::initializers::GenViewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		// Draw the particle system using the update vertex buffer
+		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkViewport viewport = vks::initializers::GenViewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 
-			VkDeviceSize offsets[1] = { 0 };
+		VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
+		vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			//Render Sphere
-			if (sceneSetup ==0)
-			{
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.sphere);
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.desccriptorSet, 0, nullptr);
-				modelSphere.draw(drawCmdBuffers[i]);
-			}
+		VkDeviceSize offsets[1] = { 0 };
 
-			// Render Cloth
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.cloth);
+		//Render Sphere
+		if (sceneSetup ==0)
+		{
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.sphere);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.desccriptorSet, 0, nullptr);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], graphics.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &compute.storageBuffers.output.buffer, offsets);
-			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
+			modelSphere.draw(drawCmdBuffers[i]);
+		}
 
-			drawUI(drawCmdBuffers[i]);
+		// Render Cloth
+		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.cloth);
+		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.desccriptorSet, 0, nullptr);
+		vkCmdBindIndexBuffer(drawCmdBuffers[i], graphics.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, cpuSettings.enabled ? &cpu.vertexBuffer.buffer : &compute.storageBuffers.states[state].buffer, offsets);
+		vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		drawUI(drawCmdBuffers[i]);
 
-			// release the storage buffers to the complete queue
-			addGraphicsToComputeBarriers(drawCmdBuffers[i]);
+		vkCmdEndRenderPass(drawCmdBuffers[i]);
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-		}//for_i
+		if (!cpuSettings.enabled)
+		{
+			asyncCompute.cmdEndFrame(drawCmdBuffers[i], state);
+		}
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 	}
 
 	void prepareForRendering()
 	{
 		VulkanExampleBase::prepareForRendering();
-		// Make sure the code works properly both with differrent queues families for graphics and complete and the same queue family
-#ifdef DEBUG_FORCE_SHARED_GRAPHICS_COMPUTE_QUEUE
-		vulkanDevice->queueFamilyIndices.compute = vulkanDevice->queueFamilyIndices.graphics;
-#endif // DEBUG_FORCE_SHARED_GRAPHICS_COMPUTE_QUEUE
-		// Check whether the complete queue family is distinct from the graphics queue family
-		specializedComputeQueue = vulkanDevice->queueFamilyIndices.graphicIndex != vulkanDevice->queueFamilyIndices.computeIndex;
+		// Simulation steps run on a dedicated compute queue if the device has one (and supports timeline semaphores), otherwise on the graphics queue
+		// Start with -nac to compare against the single queue path
+		asyncCompute.prepare(vulkanDevice, queue);
 		loadAssets();
 		prepareStorageBuffers();
 		prepareUniformBuffers();
@@ -710,46 +822,43 @@ public:
 		prepared = true;
 	}
 
+	void drawCpuSolver()
+	{
+		updateComputeUBO();
+		updateCpuSolver();
+
+		VulkanExampleBase::prepareFrame();
+
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &drawCmdBuffers[currentCmdBufferIndex];
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+		VulkanExampleBase::submitFrame();
+	}
+
+	// Step N runs on the compute queue while frame N renders the result of step N - 1
 	void draw()
 	{
-		static bool firstDraw = true;
-		VkSubmitInfo computeSubmitInfo = vks::initializers::GenSubmitInfo();
-		// FIXME find a better way to do this (without using fences,which is much slower)
-		VkPipelineStageFlags computeWaitDstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-		if (!firstDraw)
-		{
-			computeSubmitInfo.waitSemaphoreCount = 1;
-			computeSubmitInfo.pWaitSemaphores = &compute.semaphores.ready;
-			computeSubmitInfo.pWaitDstStageMask = &computeWaitDstStageMask;
-		}
-		else
+		if (cpuSettings.enabled)
 		{
-			firstDraw = false;
+			drawCpuSolver();
+			return;
 		}
 
-		computeSubmitInfo.signalSemaphoreCount = 1;
-		computeSubmitInfo.pSignalSemaphores = &compute.semaphores.complete;
-		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffers[readSet];
-
-		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+		// The previous step is done, so its uniform buffer can be updated for this one
+		asyncCompute.beginStep();
+		updateComputeUBO();
+		asyncCompute.submitStep(compute.commandBuffers[asyncCompute.getReadState()]);
 
 		// Submit graphics commands
 		VulkanExampleBase::prepareFrame();
 
-		VkPipelineStageFlags waitDstStageMask[2] = { submitPipelineStages,VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
-		VkSemaphore waitSemaphores[2] = { semaphores.presentComplete,compute.semaphores.complete };
+		buildCommandBuffer(currentCmdBufferIndex);
 
-		VkSemaphore signalSemaphores[2] = { semaphores.renderComplete,compute.semaphores.ready };
-
-		submitInfo.waitSemaphoreCount = 2;
-		submitInfo.pWaitDstStageMask = waitDstStageMask;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.signalSemaphoreCount = 2;
-		submitInfo.pSignalSemaphores = signalSemaphores;
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentCmdBufferIndex];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		asyncCompute.submitFrame(submitInfo);
+		asyncCompute.endFrame();
 
 		VulkanExampleBase::submitFrame();
 	}
@@ -761,8 +870,6 @@ public:
 			return;
 		}
 		draw();
-
-		updateComputeUBO();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay * overlay)
@@ -10,6 +10,10 @@
 #include "VulkanExampleBase.h"
 #include "VulkanglTFModel.h"
 #include "frustum.hpp"
+#include "HiZCpu.hpp"
+#include "LodSelection.hpp"
+#include "MeshSimplifier.hpp"
+#include "MeshletBuilder.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define INSTANCE_BUFFER_BIND_ID 1
@@ -24,6 +28,17 @@
 
 #define MAX_LOD_LEVEL 5
 
+// Number of frames between the compute shader writing the indirect draw stats and the host reading them
+#define STATS_READBACK_LATENCY 3
+
+// Upper bound for the number of depth pyramid levels (first level up to 32768 x 32768)
+#define DEPTH_PYRAMID_MAX_LEVELS 16
+
+// Culling phases of cull.comp
+#define CULL_PHASE_ALL 0 // Frustum culling only
+#define CULL_PHASE_EARLY 1 // Objects visible in the last frame
+#define CULL_PHASE_LATE 2 // Occlusion test against the depth pyramid of the early pass
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -42,22 +57,92 @@ public:
 
 	// Contains the instance data
 	vks::Buffer instanceBuffer;
-	// Contains the indirect drawing commands
+	// Contains the instance data of all visible objects compacted by the compute shader, one region of objectCount instances per LOD
+	vks::Buffer visibleInstanceBuffer;
+	// Contains the indirect drawing commands, one instanced draw per LOD level with visible objects
 	vks::Buffer indirectCommandsBuffer;
+	// Indirect draw stats (device local), the draw count is also consumed by vkCmdDrawIndexedIndirectCount
 	vks::Buffer indirectDrawCountConstBuffer;
-
+	// Host visible copies of the indirect draw stats, one slot per frame in flight
+	vks::Buffer indirectStatsReadbackBuffer;
 
 	// Indirect draw statistics (update via compute)
-	struct
+	struct IndirectStats
 	{
 		uint32_t drawCount; // Total number of indirect draw counts to be issued
+		uint32_t occludedCount; // Objects inside the frustum rejected by the occlusion test
 		uint32_t lodCount[MAX_LOD_LEVEL + 1]; // Statistics for number of draws per LOD level (written by compute shader)
+		uint32_t lodFirst[MAX_LOD_LEVEL + 1]; // Instances per LOD level already covered by the draw commands of an earlier culling phase
 	} indirectStats;
 
-	// Store the indirect draw commands containing index offets and instance count per object
-	std::vector<VkDrawIndexedIndirectCommand> drawIndirectCommands;
+	// Number of levels of detail (meshes) in the model
+	uint32_t lodLevelCount = 0;
 
+	// Draw path selected from the device features and extensions
+	struct
+	{
+		// Draws may start at an instance offset other than zero (drawIndirectFirstInstance)
+		bool firstInstance = false;
+		// VK_KHR_draw_indirect_count is available, only the draws written by the compute shader are issued
+		bool indirectCount = false;
+		// Disables the indirect count path (command line)
+		bool disableIndirectCount = false;
+	} drawPath;
+
+	PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR = nullptr;
 
+	// Check whether the compute queue family is distinct from the graphics queue family
+	bool specializedComputeQueue = false;
+
+	// Two phase occlusion culling, the objects visible in the last frame are drawn first and their depth is reduced to a hierarchical depth pyramid
+	// All objects are then tested against the pyramid and the newly visible ones are drawn in a second pass
+	struct
+	{
+		bool requested = false; // Command line
+		bool enabled = false; // Requested and supported by the device
+		uint32_t validateFrames = 0; // Compare the GPU results against the CPU reference after this number of frames (0 = off)
+		uint32_t renderedFrames = 0;
+		VkRenderPass renderPassEarly = VK_NULL_HANDLE; // Clears the attachments and keeps the depth for sampling
+		VkRenderPass renderPassLate = VK_NULL_HANDLE; // Loads the attachments of the early pass
+		VkImageView depthView = VK_NULL_HANDLE; // Depth aspect of the depth stencil attachment
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t levelCount = 0;
+		VkImage pyramid = VK_NULL_HANDLE; // Max depth per texel, kept in the general layout
+		VkDeviceMemory pyramidMemory = VK_NULL_HANDLE;
+		VkImageView pyramidView = VK_NULL_HANDLE; // All levels, sampled by the cull shader
+		std::vector<VkImageView> levelViews; // Single levels, written by the reduction
+		VkSampler sampler = VK_NULL_HANDLE;
+		vks::Buffer visibilityBuffer; // Per object visibility of the last late phase
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE; // Depth reduction
+		std::array<VkDescriptorSet, DEPTH_PYRAMID_MAX_LEVELS> descriptorSets; // One per pyramid level
+	} occlusion;
+
+	// Screen space error LOD selection, a level is used while its geometric error projects to less than threshold pixels
+	struct
+	{
+		float hysteresis = 0.1f; // Relative distance band around the switch distances, see cull.comp
+		lod::TriangleBudget budget; // Raises the threshold while more triangles than the budget are drawn
+		std::vector<float> errors; // Geometric error per level in object space, against the first level
+		std::vector<uint32_t> triangles; // Triangle count per level
+		uint64_t drawnTriangles = 0; // Triangles of the last frame whose stats have been read back
+		uint32_t simulationFrames = 0; // Replay a camera path on the CPU and exit (0 = off)
+		bool generate = false; // Generate the levels from the most detailed one with the mesh simplifier instead of using the authored ones
+		bool simplifyReport = false; // Print simplification throughput and error per level and exit
+		std::string clusterReportModel; // Print the triangles rejected by meshlet culling for this model and exit
+		std::vector<lod::MeshLevel> levels; // Index ranges of the levels in the index buffer of the model
+		float modelRadius = 0.0f; // Bounding sphere around the model origin that contains all levels
+		vks::Buffer stateBuffer; // Level each object was drawn with the last time it was visible
+	} lodSelection;
+
+	// Push constants shared by the cull and draw command passes
+	struct CullPushConstants
+	{
+		uint32_t objectCount;
+		uint32_t phase;
+	};
 
 	// Resources for the compute part of the example
 	struct
@@ -65,13 +150,19 @@ public:
 		vks::Buffer lodLevelBuffers; // Contains index start and counts for the different lod levels
 		VkQueue queue; // Separate queue for compute commands (queue family may differ from the one used for graphics)
 		VkCommandPool commandPool; // Use a separate command pool(queue family may differ from the one used for graphics)
-		VkCommandBuffer commandBuffer; // Command buffer storing the dispatch commands and barriers
-		VkFence fence; // Synchronization fence to avoid rewriting compute CB if still in use
-		VkSemaphore semaphore; // ڷcompute shaderִָ Used as a wait semephore for graphics submission
+		std::array<VkCommandBuffer, STATS_READBACK_LATENCY> commandBuffers; // Command buffers storing the dispatch commands and barriers, one per stats readback slot
+		std::array<VkFence, STATS_READBACK_LATENCY> fences; // Signaled once the stats of a readback slot have been written
+		uint32_t statsSlot = 0; // Readback slot used by the current frame
+		struct
+		{
+			VkSemaphore ready; // Signaled by the graphics submission once the indirect buffers may be rewritten
+			VkSemaphore complete; // ڷcompute shaderִָ Used as a wait semephore for graphics submission
+		} semaphores;
 		VkDescriptorSetLayout descriptorSetLayout;// Compute shader binding layout
 		VkDescriptorSet descriptorSet; // Compute shader bindings
 		VkPipelineLayout pipelineLayout; // Layout of the compute pipeline
-		VkPipeline pipeline; // Compute pipeline for updating particle positions
+		VkPipeline pipeline; // Compute pipeline for culling and compacting the visible instances
+		VkPipeline pipelineDrawCommands; // Compute pipeline for building the indirect draw commands from the per LOD counts
 	} compute;
 
 	struct
@@ -85,6 +176,8 @@ public:
 		glm::mat4 modelView;
 		glm::vec4 cameraPos;
 		glm::vec4 frustumPlanes[6];
+		glm::vec4 cullParams; // x, y: depth pyramid size, z: depth pyramid level count, w: object bounding radius
+		glm::vec4 lodParams; // x: projection scale divided by the error threshold in pixels, y: hysteresis
 	} uboSceneTransformDatas;
 
 	// View frustum for culling invisible objects
@@ -100,6 +193,8 @@ public:
 	VkDescriptorSetLayout descriptorSetLayout_IndirectDraw;
 
 	uint32_t objectCount = 0;
+	// Host copy of the instance data, used to validate the occlusion culling
+	std::vector<InstanceData> instanceDatas;
 
 	VulkanExample():VulkanExampleBase(ENABLE_VALIDATION)
 	{
@@ -110,6 +205,48 @@ public:
 		camera.setTranslation(glm::vec3(0.5f, 0.0f, 0.0f));
 		camera.movementSpeed = 5.0f;
 		memset(&indirectStats, 0, sizeof(indirectStats));
+
+		commandLineParser.add("noindirectcount", { "-nic", "--noindirectcount" }, 0, "Issue a fixed number of indirect draws instead of using VK_KHR_draw_indirect_count");
+		commandLineParser.add("occlusion", { "-oc", "--occlusion" }, 0, "Two phase occlusion culling against a hierarchical depth buffer");
+		commandLineParser.add("hizvalidate", { "--hizvalidate" }, 1, "Enable occlusion culling, compare the depth pyramid and visibility against the CPU reference after the given number of frames and exit");
+		commandLineParser.add("loderror", { "-le", "--loderror" }, 1, "Screen space error threshold for the LOD selection in pixels");
+		commandLineParser.add("tribudget", { "-tb", "--tribudget" }, 1, "Raise the LOD error threshold while more than the given number of triangles are drawn");
+		commandLineParser.add("hysteresis", { "-hy", "--hysteresis" }, 1, "Hysteresis of the LOD selection in percent of the switch distance");
+		commandLineParser.add("lodsim", { "--lodsim" }, 1, "Replay a camera path with the CPU LOD selection for the given number of frames, print triangles and LOD switches and exit");
+		commandLineParser.add("generatelods", { "-glod", "--generatelods" }, 0, "Generate the LOD chain from the most detailed level with the mesh simplifier");
+		commandLineParser.add("simplifyreport", { "--simplifyreport" }, 0, "Print mesh simplifier throughput and error per LOD level and exit");
+		commandLineParser.add("clusterreport", { "--clusterreport" }, 1, "Print the triangles rejected by meshlet frustum and normal cone culling from several viewpoints of the given model (relative to data/models) and exit");
+		commandLineParser.parse(args);
+		drawPath.disableIndirectCount = commandLineParser.isSet("noindirectcount");
+		occlusion.requested = commandLineParser.isSet("occlusion");
+		if (commandLineParser.isSet("hizvalidate"))
+		{
+			occlusion.requested = true;
+			occlusion.validateFrames = commandLineParser.getValueAsInt("hizvalidate", 10);
+		}
+		if (commandLineParser.isSet("loderror"))
+		{
+			lodSelection.budget.targetThreshold = std::max(std::stof(commandLineParser.getValueAsString("loderror", "1.0")), 0.01f);
+			lodSelection.budget.threshold = lodSelection.budget.targetThreshold;
+		}
+		if (commandLineParser.isSet("tribudget"))
+		{
+			lodSelection.budget.budget = static_cast<uint64_t>(std::max(commandLineParser.getValueAsInt("tribudget", 0), 0));
+		}
+		if (commandLineParser.isSet("hysteresis"))
+		{
+			lodSelection.hysteresis = std::max(std::stof(commandLineParser.getValueAsString("hysteresis", "10")), 0.0f) / 100.0f;
+		}
+		if (commandLineParser.isSet("lodsim"))
+		{
+			lodSelection.simulationFrames = std::max(commandLineParser.getValueAsInt("lodsim", 1000), 1);
+		}
+		lodSelection.generate = commandLineParser.isSet("generatelods");
+		lodSelection.simplifyReport = commandLineParser.isSet("simplifyreport");
+		if (commandLineParser.isSet("clusterreport"))
+		{
+			lodSelection.clusterReportModel = commandLineParser.getValueAsString("clusterreport", "sponza/sponza.gltf");
+		}
 	}
 	
 	~VulkanExample()
@@ -119,24 +256,328 @@ public:
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout_IndirectDraw, nullptr);
 
 		instanceBuffer.destroy();
+		visibleInstanceBuffer.destroy();
 		indirectCommandsBuffer.destroy();
+		indirectDrawCountConstBuffer.destroy();
+		indirectStatsReadbackBuffer.destroy();
 		uniformData.scene.destroy();
 		compute.lodLevelBuffers.destroy();
 
 		vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 		vkDestroyPipeline(device, compute.pipeline, nullptr);
-		vkDestroyFence(device, compute.fence, nullptr);
+		vkDestroyPipeline(device, compute.pipelineDrawCommands, nullptr);
+		for (VkFence fence : compute.fences)
+		{
+			vkDestroyFence(device, fence, nullptr);
+		}
 		vkDestroyCommandPool(device, compute.commandPool, nullptr);
-		vkDestroySemaphore(device, compute.semaphore, nullptr);
-
-
+		vkDestroySemaphore(device, compute.semaphores.ready, nullptr);
+		vkDestroySemaphore(device, compute.semaphores.complete, nullptr);
+
+		destroyDepthPyramid();
+		vkDestroyImageView(device, occlusion.depthView, nullptr);
+		vkDestroyRenderPass(device, occlusion.renderPassEarly, nullptr);
+		vkDestroyRenderPass(device, occlusion.renderPassLate, nullptr);
+		vkDestroySampler(device, occlusion.sampler, nullptr);
+		vkDestroyPipeline(device, occlusion.pipeline, nullptr);
+		vkDestroyPipelineLayout(device, occlusion.pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, occlusion.descriptorSetLayout, nullptr);
+		occlusion.visibilityBuffer.destroy();
+		lodSelection.stateBuffer.destroy();
 	}
 
 	void loadAssets()
 	{
-		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
+		uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
+		if (lodSelection.generate)
+		{
+			glTFLoadingFlags |= vkglTF::FileLoadingFlags::GenerateLods;
+			vkglTF::lodGenerationSettings.levelCount = MAX_LOD_LEVEL;
+		}
+		// The geometry is read back once to compute the geometric error of the LODs
+		const VkMemoryPropertyFlags memoryPropertyFlags = vkglTF::memoryPropertyFlags;
+		vkglTF::memoryPropertyFlags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 		lodModel.loadFromFile(getAssetPath() + "models/suzanne_lods.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		vkglTF::memoryPropertyFlags = memoryPropertyFlags;
+
+		// Either the first node of each authored level or the generated chain of the most detailed level
+		lodSelection.levels.clear();
+		lodSelection.modelRadius = 0.0f;
+		const uint32_t nodeCount = lodSelection.generate ? 1 : static_cast<uint32_t>(lodModel.nodes.size());
+		for (uint32_t i = 0; i < nodeCount; i++)
+		{
+			const vkglTF::Primitive* primitive = lodModel.nodes[i]->mesh->primitives[0];
+			lodSelection.modelRadius = std::max(lodSelection.modelRadius, glm::length(glm::max(glm::abs(primitive->dimensions.min), glm::abs(primitive->dimensions.max))));
+			lodSelection.levels.push_back({ primitive->firstIndex, primitive->indexCount });
+			if (lodSelection.generate)
+			{
+				for (const vkglTF::Primitive::Lod& level : primitive->lods)
+				{
+					lodSelection.levels.push_back({ level.firstIndex, level.indexCount });
+				}
+			}
+		}//for_i
+		lodSelection.levels.resize(std::min(lodSelection.levels.size(), static_cast<size_t>(MAX_LOD_LEVEL + 1)));
+		lodLevelCount = static_cast<uint32_t>(lodSelection.levels.size());
+	}
+
+	// The model doesn't keep a host copy of its geometry, so it's read back from the vertex and index buffers
+	void readbackGeometry(const vkglTF::Model& model, std::vector<vkglTF::Vertex>& vertexData, std::vector<uint32_t>& indexData)
+	{
+		const VkDeviceSize vertexSize = model.vertices.count * sizeof(vkglTF::Vertex);
+		const VkDeviceSize indexSize = model.indices.count * sizeof(uint32_t);
+
+		vks::Buffer readbackBuffer;
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, vertexSize + indexSize));
+		VK_CHECK_RESULT(readbackBuffer.map());
+
+		VkCommandBuffer copyCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = vertexSize;
+		vkCmdCopyBuffer(copyCmd, model.vertices.buffer, readbackBuffer.buffer, 1, &copyRegion);
+		copyRegion.dstOffset = vertexSize;
+		copyRegion.size = indexSize;
+		vkCmdCopyBuffer(copyCmd, model.indices.buffer, readbackBuffer.buffer, 1, &copyRegion);
+		addStatsBufferBarrier(copyCmd, readbackBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+		vulkanDevice->FlushCommandBuffer(copyCmd, queue, true);
+
+		const uint8_t* data = static_cast<const uint8_t*>(readbackBuffer.mappedData);
+		const vkglTF::Vertex* vertices = reinterpret_cast<const vkglTF::Vertex*>(data);
+		vertexData.assign(vertices, vertices + model.vertices.count);
+		const uint32_t* indices = reinterpret_cast<const uint32_t*>(data + vertexSize);
+		indexData.assign(indices, indices + model.indices.count);
+		readbackBuffer.destroy();
+	}
+
+	static std::vector<glm::vec3> getPositions(const std::vector<vkglTF::Vertex>& vertexData)
+	{
+		std::vector<glm::vec3> positions(vertexData.size());
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			positions[i] = vertexData[i].pos;
+		}//for_i
+		return positions;
+	}
+
+	// Splits the model into meshlets and culls them on the CPU from viewpoints inside and around the scene
+	// Fails if a meshlet rejected by its normal cone has a triangle facing the camera
+	bool runClusterReport(const std::string& filename)
+	{
+		const VkMemoryPropertyFlags memoryPropertyFlags = vkglTF::memoryPropertyFlags;
+		vkglTF::memoryPropertyFlags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		vkglTF::Model model;
+		auto timeStart = std::chrono::high_resolution_clock::now();
+		model.loadFromFile(filename, vulkanDevice, queue, vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::FlipY | vkglTF::FileLoadingFlags::DontLoadImages | vkglTF::FileLoadingFlags::GenerateMeshlets);
+		const double loadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - timeStart).count();
+		vkglTF::memoryPropertyFlags = memoryPropertyFlags;
+
+		std::vector<vkglTF::Vertex> vertexData;
+		std::vector<uint32_t> indexData;
+		readbackGeometry(model, vertexData, indexData);
+		const std::vector<glm::vec3> positions = getPositions(vertexData);
+		std::vector<glm::vec3> normals(vertexData.size());
+		for (size_t i = 0; i < vertexData.size(); i++)
+		{
+			normals[i] = vertexData[i].normal;
+		}//for_i
+
+		std::vector<vks::Meshlet> meshlets;
+		uint64_t meshletVertices = 0;
+		uint64_t meshletTriangles = 0;
+		for (vkglTF::Node* node : model.linearNodes)
+		{
+			if (node->mesh)
+			{
+				for (vkglTF::Primitive* primitive : node->mesh->primitives)
+				{
+					for (const vks::Meshlet& meshlet : primitive->meshlets)
+					{
+						meshlets.push_back(meshlet);
+						meshletVertices += meshlet.vertexCount;
+						meshletTriangles += meshlet.triangleCount;
+					}
+				}
+			}
+		}//for linearNodes
+		if (meshlets.empty())
+		{
+			std::cout << "No meshlets for " << filename << "\n";
+			return false;
+		}
+		std::cout << filename << ": " << meshlets.size() << " meshlets, " << static_cast<float>(meshletTriangles) / meshlets.size() << " triangles and "
+			<< static_cast<float>(meshletVertices) / meshlets.size() << " vertices per meshlet, loaded and built in " << loadTime << " ms\n";
+
+		// Looking around from the center of the scene and at the scene from outside
+		const glm::vec3 center = model.dimensions.center;
+		const glm::vec3 size = model.dimensions.size;
+		struct Viewpoint
+		{
+			const char* name;
+			glm::vec3 eye;
+			glm::vec3 target;
+		};
+		const std::vector<Viewpoint> viewpoints =
+		{
+			{ "center +x", center, center + glm::vec3(1.0f, 0.0f, 0.0f) },
+			{ "center -x", center, center - glm::vec3(1.0f, 0.0f, 0.0f) },
+			{ "center +z", center, center + glm::vec3(0.0f, 0.0f, 1.0f) },
+			{ "center -z", center, center - glm::vec3(0.0f, 0.0f, 1.0f) },
+			{ "corner", center + size * glm::vec3(0.4f, 0.3f, 0.4f), center },
+			{ "outside", center + size * glm::vec3(1.5f, 0.5f, 0.0f), center },
+		};
+
+		std::cout << "view,triangles,outside frustum,backfacing,rejected %,front facing in rejected\n";
+		const glm::mat4 projection = glm::perspective(glm::radians(60.0f), static_cast<float>(width) / static_cast<float>(height), 0.1f, glm::length(size) * 4.0f);
+		bool conservative = true;
+		for (const Viewpoint& viewpoint : viewpoints)
+		{
+			vks::Frustum viewFrustum;
+			viewFrustum.update(projection * glm::lookAt(viewpoint.eye, viewpoint.target, glm::vec3(0.0f, 1.0f, 0.0f)));
+			uint64_t outsideFrustum = 0;
+			uint64_t backfacing = 0;
+			uint64_t frontFacingRejected = 0;
+			for (const vks::Meshlet& meshlet : meshlets)
+			{
+				switch (vks::cullMeshlet(meshlet, viewFrustum.planes.data(), viewpoint.eye))
+				{
+				case vks::MESHLET_OUTSIDE_FRUSTUM:
+					outsideFrustum += meshlet.triangleCount;
+					break;
+				case vks::MESHLET_BACKFACING:
+					backfacing += meshlet.triangleCount;
+					frontFacingRejected += vks::countFrontFacingTriangles(meshlet, positions.data(), normals.data(), indexData.data(), viewpoint.eye);
+					break;
+				default:
+					break;
+				}
+			}//for meshlet
+			conservative = conservative && (frontFacingRejected == 0);
+			std::cout << viewpoint.name << "," << meshletTriangles << "," << outsideFrustum << "," << backfacing << ","
+				<< 100.0 * static_cast<double>(outsideFrustum + backfacing) / static_cast<double>(meshletTriangles) << "," << frontFacingRejected << "\n";
+		}//for viewpoint
+		return conservative;
+	}
+
+	// Measures the geometric error of each LOD against the most detailed one
+	void computeLodErrors()
+	{
+		std::vector<vkglTF::Vertex> vertexData;
+		std::vector<uint32_t> indexData;
+		readbackGeometry(lodModel, vertexData, indexData);
+
+		lodSelection.triangles.resize(lodLevelCount);
+		for (uint32_t i = 0; i < lodLevelCount; i++)
+		{
+			lodSelection.triangles[i] = lodSelection.levels[i].indexCount / 3;
+		}//for_i
+		lodSelection.errors = lod::computeGeometricErrors(getPositions(vertexData), indexData, lodSelection.levels);
+	}
+
+	// Simplifies the most detailed level like FileLoadingFlags::GenerateLods does and prints the time and error of each level
+	// The Hausdorff error is the symmetric surface distance to the most detailed level, the estimated error is the one of the simplifier
+	void runSimplifyReport()
+	{
+		std::vector<vkglTF::Vertex> vertexData;
+		std::vector<uint32_t> indexData;
+		readbackGeometry(lodModel, vertexData, indexData);
+		const std::vector<glm::vec3> positions = getPositions(vertexData);
+
+		const vkglTF::LodGenerationSettings& generation = vkglTF::lodGenerationSettings;
+		vks::MeshSimplifier::Settings settings;
+		settings.maxError = generation.maxError;
+		settings.lockBorders = generation.lockBorders;
+		settings.attributeWeights = { generation.normalWeight, generation.normalWeight, generation.normalWeight, generation.uvWeight, generation.uvWeight };
+		std::vector<float> attributes(vertexData.size() * 5);
+		for (size_t i = 0; i < vertexData.size(); i++)
+		{
+			attributes[i * 5 + 0] = vertexData[i].normal.x;
+			attributes[i * 5 + 1] = vertexData[i].normal.y;
+			attributes[i * 5 + 2] = vertexData[i].normal.z;
+			attributes[i * 5 + 3] = vertexData[i].uv.x;
+			attributes[i * 5 + 4] = vertexData[i].uv.y;
+		}//for_i
+
+		const lod::MeshLevel source = lodSelection.levels[0];
+		std::cout << "level,triangles,time (ms),triangles removed per second,estimated error,hausdorff error\n";
+		std::cout << "0," << source.indexCount / 3 << ",0,0,0,0\n";
+
+		auto timeStart = std::chrono::high_resolution_clock::now();
+		vks::MeshSimplifier simplifier(positions.data(), attributes.data(), 5, positions.size(), indexData.data() + source.firstIndex, source.indexCount, settings);
+		size_t targetIndexCount = source.indexCount;
+		for (uint32_t i = 1; i <= MAX_LOD_LEVEL; i++)
+		{
+			const size_t previousTriangles = simplifier.getIndices().size() / 3;
+			targetIndexCount = static_cast<size_t>(static_cast<float>(targetIndexCount) * generation.reduction) / 3 * 3;
+			simplifier.simplify(targetIndexCount);
+			const double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - timeStart).count();
+			const size_t triangles = simplifier.getIndices().size() / 3;
+
+			// The level is appended behind the source indices, so both can be passed as ranges of one index buffer
+			std::vector<uint32_t> indices(indexData.begin() + source.firstIndex, indexData.begin() + source.firstIndex + source.indexCount);
+			indices.insert(indices.end(), simplifier.getIndices().begin(), simplifier.getIndices().end());
+			const lod::MeshLevel level = { source.indexCount, static_cast<uint32_t>(simplifier.getIndices().size()) };
+			const lod::MeshLevel first = { 0, source.indexCount };
+			const float hausdorff = std::max(lod::oneSidedDistance(positions, indices, level, first, 1024), lod::oneSidedDistance(positions, indices, first, level, 1024));
+
+			std::cout << i << "," << triangles << "," << time << "," << static_cast<double>(previousTriangles - triangles) / std::max(time * 0.001, 1e-9) << ","
+				<< simplifier.getError() << "," << hausdorff << "\n";
+			timeStart = std::chrono::high_resolution_clock::now();
+		}//for_i
+	}
+
+	// Same as the base class, but with occlusion culling the depth attachment is also sampled by the depth pyramid reduction
+	virtual void setupDepthStencil() override
+	{
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat, &formatProperties);
+		// The late pass only draws the newly visible instances, which start behind the ones of the early pass in each LOD region
+		occlusion.enabled = occlusion.requested && drawPath.firstInstance && (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+
+		VkImageCreateInfo imageCI = vks::initializers::GenImageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = depthFormat;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (occlusion.enabled ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &depthStencil.image));
+
+		VkMemoryRequirements memReqs{};
+		vkGetImageMemoryRequirements(device, depthStencil.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vulkanDevice->AllocateMemory(&memAlloc, &depthStencil.mem, vks::MEMORY_CATEGORY_ATTACHMENT));
+		VK_CHECK_RESULT(vkBindImageMemory(device, depthStencil.image, depthStencil.mem, 0));
+
+		VkImageViewCreateInfo imageViewCI = vks::initializers::GenImageViewCreateInfo();
+		imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageViewCI.image = depthStencil.image;
+		imageViewCI.format = depthFormat;
+		imageViewCI.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		if (occlusion.enabled)
+		{
+			// Only the depth aspect can be sampled
+			vkDestroyImageView(device, occlusion.depthView, nullptr);
+			VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &occlusion.depthView));
+		}
+		//stencil aspect should only be set on depth+stencil formats (VK_FORMAT_D16_UNORM_S8_UINT..VK_FORMAT_D32_SFLOAT_S8_UINT)
+		if (depthFormat >= VK_FORMAT_D16_UNORM_S8_UINT)
+		{
+			imageViewCI.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+		VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &depthStencil.view));
+
+		// Window resize, the depth pyramid follows the size of the depth buffer
+		if (occlusion.enabled && (occlusion.pyramid != VK_NULL_HANDLE))
+		{
+			destroyDepthPyramid();
+			createDepthPyramid();
+			updateDepthPyramidDescriptorSets();
+		}
 	}
 
 	void updateUniformBuffer(bool viewChanged)
@@ -152,6 +593,8 @@ public:
 				memcpy(uboSceneTransformDatas.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
 			}//if
 		}//if
+		// The threshold may change every frame with the triangle budget
+		uboSceneTransformDatas.lodParams = glm::vec4(lod::projectionScale(camera.matrices.perspective, static_cast<float>(height)) / lodSelection.budget.threshold, lodSelection.hysteresis, 0.0f, 0.0f);
 
 		memcpy(uniformData.scene.mappedData, &uboSceneTransformDatas, sizeof(uboSceneTransformDatas));
 	}
@@ -162,41 +605,31 @@ public:
 
 		vks::Buffer tempStagingBuffer;
 
-		std::vector<InstanceData> instanceDatas(objectCount);
-		drawIndirectCommands.resize(objectCount);
+		instanceDatas.resize(objectCount);
+		computeLodErrors();
 
-		// Indirect draw commands
-		for (uint32_t x = 0; x < OBJECT_COUNT; x++)
-		{
-			for (uint32_t y = 0; y < OBJECT_COUNT; y++)
-			{
-				for (uint32_t z = 0; z < OBJECT_COUNT; z++)
-				{
-					uint32_t index = x + y * OBJECT_COUNT + z * OBJECT_COUNT*OBJECT_COUNT;
-					drawIndirectCommands[index].instanceCount = 1;
-					drawIndirectCommands[index].firstInstance = index;
-					// firstIndex and indexCount are written by the compute shader
-				}
-			}
-		}
-
-		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&tempStagingBuffer, drawIndirectCommands.size() * sizeof(VkDrawIndexedIndirectCommand), drawIndirectCommands.data()));
-
-		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indirectCommandsBuffer, tempStagingBuffer.size));
+		// Indirect draw commands, firstIndex, indexCount and instanceCount are written by the compute shader every frame
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indirectCommandsBuffer, lodLevelCount * sizeof(VkDrawIndexedIndirectCommand)));
 
-		vulkanDevice->CopyBuffer(&tempStagingBuffer, &indirectCommandsBuffer, queue);
-		tempStagingBuffer.destroy();
+		// Visible instances are appended to the region of their LOD, so each region has to be able to hold all objects
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &visibleInstanceBuffer, lodLevelCount * objectCount * sizeof(InstanceData)));
 
-		indirectStats.drawCount = static_cast<uint32_t>(drawIndirectCommands.size());
 		// indirectDrawCountConstBuffer ֯constBuffer
-		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indirectDrawCountConstBuffer, sizeof(indirectStats)));
+		// Cleared and written on the device, the draw count at offset 0 is the count buffer for vkCmdDrawIndexedIndirectCount
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indirectDrawCountConstBuffer, sizeof(indirectStats)));
+
+		// Stats are copied to one slot per frame and read on the host once the fence of that slot has been signaled
+		std::vector<IndirectStats> emptyStats(STATS_READBACK_LATENCY, indirectStats);
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&indirectStatsReadbackBuffer, emptyStats.size() * sizeof(IndirectStats), emptyStats.data()));
 		// Map for host access
-		VK_CHECK_RESULT(indirectDrawCountConstBuffer.map());
+		VK_CHECK_RESULT(indirectStatsReadbackBuffer.map());
 
 		// Instance data
+		const float objectScale = 2.0f;
 		for (uint32_t x = 0; x < OBJECT_COUNT; x++)
 		{
 			for (uint32_t y = 0; y < OBJECT_COUNT; y++)
@@ -205,7 +638,7 @@ public:
 				{
 					uint32_t index = x + y * OBJECT_COUNT + z * OBJECT_COUNT*OBJECT_COUNT;
 					instanceDatas[index].pos = glm::vec3((float)x, (float)y, (float)z) - glm::vec3((float)OBJECT_COUNT / 2.0f);
-					instanceDatas[index].scale = 2.0f;
+					instanceDatas[index].scale = objectScale;
 				}//for
 			}//for
 		}//for
@@ -218,27 +651,43 @@ public:
 		vulkanDevice->CopyBuffer(&tempStagingBuffer, &instanceBuffer, queue);
 		tempStagingBuffer.destroy();
 
+		// No object has been visible before the first frame, so the first early pass draws nothing and the late pass draws everything that passes the tests
+		std::vector<uint32_t> visibility(objectCount, 0);
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &tempStagingBuffer, visibility.size() * sizeof(uint32_t), visibility.data()));
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &occlusion.visibilityBuffer, tempStagingBuffer.size));
+		vulkanDevice->CopyBuffer(&tempStagingBuffer, &occlusion.visibilityBuffer, queue);
+		tempStagingBuffer.destroy();
+
+		// Level each object was last drawn with, starts at the most detailed one
+		std::vector<uint32_t> lodStates(objectCount, 0);
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &tempStagingBuffer, lodStates.size() * sizeof(uint32_t), lodStates.data()));
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &lodSelection.stateBuffer, tempStagingBuffer.size));
+		vulkanDevice->CopyBuffer(&tempStagingBuffer, &lodSelection.stateBuffer, queue);
+		tempStagingBuffer.destroy();
 
 		// Shader storage buffer containing index offsets and counts for the LODs
 		struct LOD
 		{
 			uint32_t firstIndex;
 			uint32_t indexCount;
-			float distance;
+			float error;
 			float _pad0;
 		};
 
 		std::vector<LOD> LODLevels;
-		uint32_t n = 0;
-		for (auto node : lodModel.nodes)
+		for (uint32_t i = 0; i < lodLevelCount; i++)
 		{
 			LOD lod;
-			lod.firstIndex = node->mesh->primitives[0]->firstIndex;// First index for this LOD
-			lod.indexCount = node->mesh->primitives[0]->indexCount;// Index count for this LOD
-			lod.distance = 5.0f + n * 5.0f; //Staging distance (to viewer) for this LOD
-			n++;
+			lod.firstIndex = lodSelection.levels[i].firstIndex;// First index for this LOD
+			lod.indexCount = lodSelection.levels[i].indexCount;// Index count for this LOD
+			lod.error = lodSelection.errors[i]; // Projected to the screen by the cull shader
 			LODLevels.push_back(lod);
 		}//for
+		uboSceneTransformDatas.cullParams.w = lodSelection.modelRadius * objectScale;
 
 		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &tempStagingBuffer, LODLevels.size() * sizeof(LOD), LODLevels.data()));
@@ -341,9 +790,12 @@ public:
 		std::vector<VkDescriptorPoolSize> poolSizesForIndirectDrawAndCompute =
 		{
 			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,2),
-			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,4),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,7),
+			// Depth pyramid for the cull shader and the inputs of the depth reduction
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,1 + DEPTH_PYRAMID_MAX_LEVELS),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,DEPTH_PYRAMID_MAX_LEVELS),
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizesForIndirectDrawAndCompute, 2);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizesForIndirectDrawAndCompute, 2 + DEPTH_PYRAMID_MAX_LEVELS);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
 
@@ -360,53 +812,404 @@ public:
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
-	void buildComputeCommandBuffer()
+	// Barriers for the buffers written by the compute shaders and consumed by the indirect draws
+	// If graphics and compute use different queue families, this is the release (recorded on the source queue) or acquire (recorded on the destination queue) half of an ownership transfer
+	void addIndirectBufferBarriers(VkCommandBuffer commandBuffer, bool toGraphics, bool recordedOnGraphicsQueue)
 	{
-		VkCommandBufferBeginInfo cmdBufBeginInfo = vks::initializers::GenCommandBufferBeginInfo();
-		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufBeginInfo));
+		const uint32_t graphicsFamily = vulkanDevice->queueFamilyIndices.graphicIndex;
+		const uint32_t computeFamily = vulkanDevice->queueFamilyIndices.computeIndex;
+		const VkPipelineStageFlags graphicsStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		const VkPipelineStageFlags computeStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+		const VkAccessFlags graphicsAccess = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		const VkAccessFlags computeAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::GenBufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = toGraphics ? computeAccess : graphicsAccess;
+		bufferBarrier.dstAccessMask = toGraphics ? graphicsAccess : computeAccess;
+		// With occlusion culling everything is recorded on the graphics queue, even if there is a separate compute queue family
+		bufferBarrier.srcQueueFamilyIndex = specializedComputeQueue ? (toGraphics ? computeFamily : graphicsFamily) : VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = specializedComputeQueue ? (toGraphics ? graphicsFamily : computeFamily) : VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		VkPipelineStageFlags srcStageMask = toGraphics ? computeStages : graphicsStages;
+		VkPipelineStageFlags dstStageMask = toGraphics ? graphicsStages : computeStages;
+
+		if (specializedComputeQueue)
+		{
+			// Stages and accesses of the other queue are not valid here
+			const bool release = (toGraphics != recordedOnGraphicsQueue);
+			if (release)
+			{
+				bufferBarrier.dstAccessMask = 0;
+				dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			}
+			else
+			{
+				bufferBarrier.srcAccessMask = 0;
+				srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			}
+		}
 
-		// Add memory barrier to ensure that the indirect commands have been consumed before the compute shader updates them
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		for (vks::Buffer* buffer : { &indirectCommandsBuffer, &visibleInstanceBuffer, &indirectDrawCountConstBuffer })
+		{
+			bufferBarrier.buffer = buffer->buffer;
+			bufferBarriers.push_back(bufferBarrier);
+		}
+
+		vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, VK_FLAGS_NONE, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
+	}
+
+	void addStatsBufferBarrier(VkCommandBuffer commandBuffer, vks::Buffer& buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
+	{
 		VkBufferMemoryBarrier bufferBarrier = vks::initializers::GenBufferMemoryBarrier();
-		bufferBarrier.buffer = indirectCommandsBuffer.buffer;
-		bufferBarrier.size = indirectCommandsBuffer.descriptorBufferInfo.range;
-		bufferBarrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
-		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-		bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphicIndex;
-		bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
+		bufferBarrier.srcAccessMask = srcAccessMask;
+		bufferBarrier.dstAccessMask = dstAccessMask;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = buffer.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, VK_FLAGS_NONE, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+	}
 
-		vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE,
-			0, nullptr, 1, &bufferBarrier, 0, nullptr);
+	// Reset the per LOD counters used for appending the visible instances
+	void addCounterReset(VkCommandBuffer commandBuffer)
+	{
+		vkCmdFillBuffer(commandBuffer, indirectDrawCountConstBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		addStatsBufferBarrier(commandBuffer, indirectDrawCountConstBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+
+	// Culls the instances of one phase and builds the indirect draws for the instances appended by it
+	void addCullDispatches(VkCommandBuffer commandBuffer, uint32_t phase)
+	{
+		CullPushConstants pushConstants = { objectCount, phase };
 
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
-		vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, nullptr);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
 
 		// Dispatch the compute job
-		// The compute shader will do the frustum culling and adjust the indirect draw calls depending on object visibility.
-		// It also determines the lod to use depending on distance to the viewer
-		vkCmdDispatch(compute.commandBuffer, objectCount / 16, 1, 1);
+		// The compute shader will do the frustum culling and append the visible instances to the region of the LOD selected by distance to the viewer
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
+		vkCmdDispatch(commandBuffer, (objectCount + 15) / 16, 1, 1);
 
+		// The draw commands are built from the final per LOD counts
+		addStatsBufferBarrier(commandBuffer, indirectDrawCountConstBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineDrawCommands);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+	}
+
+	// Copy the stats to a readback slot, the host reads them after waiting on the slot's fence
+	void addStatsCopy(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		addStatsBufferBarrier(commandBuffer, indirectDrawCountConstBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		VkBufferCopy copyRegion = {};
+		copyRegion.dstOffset = slot * sizeof(IndirectStats);
+		copyRegion.size = sizeof(IndirectStats);
+		vkCmdCopyBuffer(commandBuffer, indirectDrawCountConstBuffer.buffer, indirectStatsReadbackBuffer.buffer, 1, &copyRegion);
+		addStatsBufferBarrier(commandBuffer, indirectStatsReadbackBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+	}
+
+	// Builds all levels of the depth pyramid from the depth of the early pass
+	void addDepthPyramidReduction(VkCommandBuffer commandBuffer)
+	{
+		struct
+		{
+			glm::ivec2 inputSize;
+			glm::ivec2 outputSize;
+		} pushConstants;
+
+		VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion.pipeline);
+		pushConstants.inputSize = glm::ivec2(width, height);
+		for (uint32_t i = 0; i < occlusion.levelCount; i++)
 		{
+			pushConstants.outputSize = glm::ivec2(std::max(occlusion.width >> i, 1u), std::max(occlusion.height >> i, 1u));
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion.pipelineLayout, 0, 1, &occlusion.descriptorSets[i], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, occlusion.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, (pushConstants.outputSize.x + 15) / 16, (pushConstants.outputSize.y + 15) / 16, 1);
+
+			// The next level and the late cull phase read this level
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			pushConstants.inputSize = pushConstants.outputSize;
+		}//for_i
+	}
+
+	void buildComputeCommandBuffers()
+	{
+		VkCommandBufferBeginInfo cmdBufBeginInfo = vks::initializers::GenCommandBufferBeginInfo();
+
+		for (uint32_t i = 0; i < STATS_READBACK_LATENCY; i++)
+		{
+			VkCommandBuffer commandBuffer = compute.commandBuffers[i];
+			VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufBeginInfo));
+
+			if (occlusion.enabled)
+			{
+				// Culling is part of the frame's graphics command buffer, this one is submitted after it and only copies the stats
+				addStatsCopy(commandBuffer, i);
+				VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+				continue;
+			}
+
+			// Add memory barrier to ensure that the indirect commands have been consumed before the compute shader updates them
+			addIndirectBufferBarriers(commandBuffer, false, false);
+
+			// The compute queue's timings use the profiler slots behind the swapchain images
+			const uint32_t profilerSlot = swapChain.imageCount + i;
+			profiler.beginGpuSlot(commandBuffer, profilerSlot);
+			uint32_t region = profiler.beginGpuRegion(commandBuffer, profilerSlot, "cull");
+			addCounterReset(commandBuffer);
+			addCullDispatches(commandBuffer, CULL_PHASE_ALL);
+			profiler.endGpuRegion(commandBuffer, profilerSlot, region);
+			addStatsCopy(commandBuffer, i);
+
 			// Add memory barrier to ensure that the compute shader has finished writing the indirect command buffer before it's consumed
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::GenBufferMemoryBarrier();
-			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-			bufferBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
-			bufferBarrier.buffer = indirectCommandsBuffer.buffer;
-			bufferBarrier.size = indirectCommandsBuffer.descriptorBufferInfo.range;
-			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
-			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphicIndex;
+			addIndirectBufferBarriers(commandBuffer, true, false);
+
+			VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+		}//for_i
+	}
 
-			vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
-				VK_FLAGS_NONE, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+	// Render pass for one of the two occlusion culling passes, compatible with the frame buffers and pipelines created for the default render pass
+	void createOcclusionRenderPass(bool early, VkRenderPass* renderPass)
+	{
+		std::array<VkAttachmentDescription, 2> attachments = {};
+		// Color attachment
+		attachments[0].format = swapChain.colorFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = early ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = early ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachments[0].finalLayout = early ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		// Depth attachment, read only in between the passes so it can be sampled by the depth reduction
+		attachments[1].format = depthFormat;
+		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[1].loadOp = early ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[1].stencilLoadOp = early ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[1].initialLayout = early ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		attachments[1].finalLayout = early ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpassDescription = {};
+		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpassDescription.colorAttachmentCount = 1;
+		subpassDescription.pColorAttachments = &colorReference;
+		subpassDescription.pDepthStencilAttachment = &depthReference;
+
+		const VkPipelineStageFlags attachmentStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		const VkAccessFlags attachmentAccess = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		// Subpass dependencies for layout transitions
+		std::array<VkSubpassDependency, 2> dependencies;
+
+		// The late pass waits for the depth reduction to finish reading the depth
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = attachmentStages | (early ? 0 : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		dependencies[0].dstStageMask = attachmentStages;
+		dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = attachmentAccess;
+		dependencies[0].dependencyFlags = 0;
+
+		// The depth of the early pass is read by the depth reduction
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = attachmentStages;
+		dependencies[1].dstStageMask = early ? (attachmentStages | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = early ? (attachmentAccess | VK_ACCESS_SHADER_READ_BIT) : VK_ACCESS_MEMORY_READ_BIT;
+		dependencies[1].dependencyFlags = 0;
+
+		VkRenderPassCreateInfo renderPassInfo = vks::initializers::GenRenderPassCreateInfo();
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpassDescription;
+		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
+		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, renderPass));
+	}
+
+	// The first level is the previous power of two of the depth buffer size, so each following level halves exactly
+	// Without occlusion culling a single texel is created, the cull shader still has a valid binding
+	void createDepthPyramid()
+	{
+		occlusion.width = occlusion.enabled ? hiz::previousPow2(width) : 1;
+		occlusion.height = occlusion.enabled ? hiz::previousPow2(height) : 1;
+		occlusion.levelCount = std::min(hiz::getLevelCount(occlusion.width, occlusion.height), (uint32_t)DEPTH_PYRAMID_MAX_LEVELS);
+
+		VkImageCreateInfo imageCI = vks::initializers::GenImageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = VK_FORMAT_R32_SFLOAT;
+		imageCI.extent = { occlusion.width, occlusion.height, 1 };
+		imageCI.mipLevels = occlusion.levelCount;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		// Transfer source for the validation readback
+		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &occlusion.pyramid));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, occlusion.pyramid, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vulkanDevice->AllocateMemory(&memAlloc, &occlusion.pyramidMemory, vks::MEMORY_CATEGORY_ATTACHMENT));
+		VK_CHECK_RESULT(vkBindImageMemory(device, occlusion.pyramid, occlusion.pyramidMemory, 0));
+
+		VkImageViewCreateInfo imageViewCI = vks::initializers::GenImageViewCreateInfo();
+		imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageViewCI.image = occlusion.pyramid;
+		imageViewCI.format = VK_FORMAT_R32_SFLOAT;
+		imageViewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, occlusion.levelCount, 0, 1 };
+		VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &occlusion.pyramidView));
+		occlusion.levelViews.resize(occlusion.levelCount);
+		for (uint32_t i = 0; i < occlusion.levelCount; i++)
+		{
+			imageViewCI.subresourceRange.baseMipLevel = i;
+			imageViewCI.subresourceRange.levelCount = 1;
+			VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &occlusion.levelViews[i]));
+		}//for_i
+
+		// Written as storage image and sampled by the following passes, so the pyramid stays in the general layout
+		VkCommandBuffer layoutCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vks::tools::setImageLayout(layoutCmd, occlusion.pyramid, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, occlusion.levelCount, 0, 1 });
+		vulkanDevice->FlushCommandBuffer(layoutCmd, queue, true);
+
+		uboSceneTransformDatas.cullParams.x = static_cast<float>(occlusion.width);
+		uboSceneTransformDatas.cullParams.y = static_cast<float>(occlusion.height);
+		uboSceneTransformDatas.cullParams.z = static_cast<float>(occlusion.levelCount);
+		updateUniformBuffer(false);
+	}
+
+	void destroyDepthPyramid()
+	{
+		for (VkImageView view : occlusion.levelViews)
+		{
+			vkDestroyImageView(device, view, nullptr);
 		}
+		occlusion.levelViews.clear();
+		vkDestroyImageView(device, occlusion.pyramidView, nullptr);
+		vkDestroyImage(device, occlusion.pyramid, nullptr);
+		vulkanDevice->FreeMemory(occlusion.pyramidMemory);
+		occlusion.pyramidView = VK_NULL_HANDLE;
+		occlusion.pyramid = VK_NULL_HANDLE;
+		occlusion.pyramidMemory = VK_NULL_HANDLE;
+	}
+
+	// Points the cull shader and the depth reduction at the current depth buffer and pyramid
+	void updateDepthPyramidDescriptorSets()
+	{
+		std::vector<VkDescriptorImageInfo> imageInfos;
+		imageInfos.reserve(1 + occlusion.levelCount * 2);
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+
+		// Binding 6: Depth pyramid sampled by the cull shader
+		imageInfos.push_back(vks::initializers::GenDescriptorImageInfo(occlusion.sampler, occlusion.pyramidView, VK_IMAGE_LAYOUT_GENERAL));
+		writeDescriptorSets.push_back(vks::initializers::GenWriteDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, &imageInfos.back()));
 
-		// todo: barrier for indirect stats buffer?
-		vkEndCommandBuffer(compute.commandBuffer);
+		if (occlusion.enabled)
+		{
+			for (uint32_t i = 0; i < occlusion.levelCount; i++)
+			{
+				// Binding 0: The depth buffer for the first level, the previous level for all others
+				if (i == 0)
+				{
+					imageInfos.push_back(vks::initializers::GenDescriptorImageInfo(occlusion.sampler, occlusion.depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+				}
+				else
+				{
+					imageInfos.push_back(vks::initializers::GenDescriptorImageInfo(occlusion.sampler, occlusion.levelViews[i - 1], VK_IMAGE_LAYOUT_GENERAL));
+				}
+				writeDescriptorSets.push_back(vks::initializers::GenWriteDescriptorSet(occlusion.descriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageInfos.back()));
+				// Binding 1: The level written by this pass
+				imageInfos.push_back(vks::initializers::GenDescriptorImageInfo(VK_NULL_HANDLE, occlusion.levelViews[i], VK_IMAGE_LAYOUT_GENERAL));
+				writeDescriptorSets.push_back(vks::initializers::GenWriteDescriptorSet(occlusion.descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &imageInfos.back()));
+			}//for_i
+		}
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void prepareOcclusionCulling()
+	{
+		// Pyramid texels are only fetched, never filtered
+		VkSamplerCreateInfo samplerCI = vks::initializers::GenSamplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_NEAREST;
+		samplerCI.minFilter = VK_FILTER_NEAREST;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.maxLod = static_cast<float>(DEPTH_PYRAMID_MAX_LEVELS);
+		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device, &samplerCI, nullptr, &occlusion.sampler));
+
+		createDepthPyramid();
+
+		if (!occlusion.enabled)
+		{
+			return;
+		}
+
+		createOcclusionRenderPass(true, &occlusion.renderPassEarly);
+		createOcclusionRenderPass(false, &occlusion.renderPassLate);
+
+		// Depth reduction
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+		{
+			// Binding 0: Input depth
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,VK_SHADER_STAGE_COMPUTE_BIT,0,1),
+			// Binding 1: Output pyramid level
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,VK_SHADER_STAGE_COMPUTE_BIT,1,1),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorLayoutCreateInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCreateInfo, nullptr, &occlusion.descriptorSetLayout));
+
+		// Push constants with the input and output size of a level
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(&occlusion.descriptorSetLayout, 1);
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(glm::ivec4), 0);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &occlusion.pipelineLayout));
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::GenComputePipelineCreateInfo(occlusion.pipelineLayout, 0);
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computecullandlod/depthreduce.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &occlusion.pipeline));
+
+		// One descriptor set per level, allocated for the largest possible pyramid so they can be reused on resize
+		std::array<VkDescriptorSetLayout, DEPTH_PYRAMID_MAX_LEVELS> setLayouts;
+		setLayouts.fill(occlusion.descriptorSetLayout);
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, setLayouts.data(), DEPTH_PYRAMID_MAX_LEVELS);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, occlusion.descriptorSets.data()));
 	}
 
 	void prepareCompute()
 	{
 		// Get a compute capable device queue
-		vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.computeIndex, 0, &compute.queue);
+		// Occlusion culling runs in between the two render passes of a frame, so it uses the graphics queue
+		if (occlusion.enabled)
+		{
+			compute.queue = queue;
+		}
+		else
+		{
+			vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.computeIndex, 0, &compute.queue);
+		}
 
 		// Create compute pipeline
 		// Compute pipeline are created separate from graphics pipelines even if they use the same queue(family index)
@@ -415,7 +1218,7 @@ public:
 		{
 			// Binding 0: Instance input data buffer
 			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,0,1),
-			// Binding 1: Indirect draw command output buffer(input)
+			// Binding 1: Compacted visible instance output buffer
 			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,1,1),
 			// Binding 2: Uniform buffer with global matrices(input)
 			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,2,1),
@@ -423,12 +1226,24 @@ public:
 			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,3,1),
 			// Binding 4: LOD info(input)
 			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,4,1),
+			// Binding 5: Indirect draw command output buffer
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,5,1),
+			// Binding 6: Depth pyramid
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,VK_SHADER_STAGE_COMPUTE_BIT,6,1),
+			// Binding 7: Per object visibility
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,7,1),
+			// Binding 8: Per object LOD state
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,8,1),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayoutCreateInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCreateInfo, nullptr, &compute.descriptorSetLayout));
 
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(&compute.descriptorSetLayout, 1);
+		// Push constants used to pass the object count (size of the LOD regions) and the culling phase
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(CullPushConstants), 0);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
 
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
@@ -437,14 +1252,20 @@ public:
 		{
 			// Binding 0: Instance input data buffer
 			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,0,&instanceBuffer.descriptorBufferInfo),
-			// Binding 1: Indirect draw command output buffer
-			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1,&indirectCommandsBuffer.descriptorBufferInfo),
+			// Binding 1: Compacted visible instance output buffer
+			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1,&visibleInstanceBuffer.descriptorBufferInfo),
 			// Binding 2: Uniform buffer with global matrices
 			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,2,&uniformData.scene.descriptorBufferInfo),
 			// Binding 3: Atomic counter (written in shader)
 			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,3,&indirectDrawCountConstBuffer.descriptorBufferInfo),
 			// Binding 4: LOD info
 			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,4,&compute.lodLevelBuffers.descriptorBufferInfo),
+			// Binding 5: Indirect draw command output buffer
+			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,5,&indirectCommandsBuffer.descriptorBufferInfo),
+			// Binding 7: Per object visibility
+			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,7,&occlusion.visibilityBuffer.descriptorBufferInfo),
+			// Binding 8: Per object LOD state
+			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,8,&lodSelection.stateBuffer.descriptorBufferInfo),
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
@@ -453,42 +1274,63 @@ public:
 		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::GenComputePipelineCreateInfo(compute.pipelineLayout, 0);
 		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computecullandlod/cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 
-		// Use specialization constants to pass max. level of detail(determined by no. of meshes)
-		VkSpecializationMapEntry specializationEntry{};
-		specializationEntry.constantID = 0;
-		specializationEntry.offset = 0;
-		specializationEntry.size = sizeof(uint32_t);
+		// Use specialization constants to pass max. level of detail(determined by no. of meshes) and the draw command layout
+		struct SpecializationData
+		{
+			uint32_t maxLodLevel;
+			VkBool32 compactDraws;
+		} specializationData;
+		specializationData.maxLodLevel = lodLevelCount - 1;
+		specializationData.compactDraws = drawPath.firstInstance ? VK_TRUE : VK_FALSE;
 
-		uint32_t specializationData = static_cast<uint32_t>(lodModel.nodes.size()) - 1;
-		VkSpecializationInfo specializationInfo;
-		specializationInfo.mapEntryCount = 1;
-		specializationInfo.pMapEntries = &specializationEntry;
-		specializationInfo.dataSize = sizeof(specializationData);
-		specializationInfo.pData = &specializationData;
+		std::array<VkSpecializationMapEntry, 2> specializationEntries;
+		specializationEntries[0] = vks::initializers::GenSpecializationMapEntry(0, offsetof(SpecializationData, maxLodLevel), sizeof(uint32_t));
+		specializationEntries[1] = vks::initializers::GenSpecializationMapEntry(1, offsetof(SpecializationData, compactDraws), sizeof(VkBool32));
+		VkSpecializationInfo specializationInfo = vks::initializers::GenSpecializationInfo(static_cast<uint32_t>(specializationEntries.size()), specializationEntries.data(), sizeof(specializationData), &specializationData);
 
 		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
 		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipeline));
 
+		// Draw command pipeline
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computecullandlod/drawcommands.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineDrawCommands));
+
 		// Separate command pool as queue family for compute may be different than graphics
 		VkCommandPoolCreateInfo cmdPoolInfo = {};
 		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		cmdPoolInfo.queueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
+		cmdPoolInfo.queueFamilyIndex = occlusion.enabled ? vulkanDevice->queueFamilyIndices.graphicIndex : vulkanDevice->queueFamilyIndices.computeIndex;
 		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
 
-		// Create a command buffer for compute operation
-		VkCommandBufferAllocateInfo cmdBufferAllocateInfo = vks::initializers::GenCommandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufferAllocateInfo, &compute.commandBuffer));
+		// Create one command buffer for compute operation per stats readback slot
+		VkCommandBufferAllocateInfo cmdBufferAllocateInfo = vks::initializers::GenCommandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, STATS_READBACK_LATENCY);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufferAllocateInfo, compute.commandBuffers.data()));
 
-		// Fence for compute CB sync
+		// Fences for compute CB sync and stats readback
 		VkFenceCreateInfo fenceCreateInfo = vks::initializers::GenFenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &compute.fence));
+		for (VkFence& fence : compute.fences)
+		{
+			VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &fence));
+		}
 
 		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::GenSemaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphore));
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores.ready));
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores.complete));
+
+		if (specializedComputeQueue)
+		{
+			// Initial release from the graphics queue, so the first acquire in the compute command buffer has a matching release
+			VkCommandBuffer releaseCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			addIndirectBufferBarriers(releaseCmd, false, true);
+			vulkanDevice->FlushCommandBuffer(releaseCmd, queue, true);
+		}
 
-		// Build a single command buffer containing the compute dispatch commands
-		buildComputeCommandBuffer();
+		// Binding 6 (depth pyramid) is written along with the depth reduction descriptors
+		updateDepthPyramidDescriptorSets();
+
+		// Build the command buffers containing the compute dispatch commands
+		buildComputeCommandBuffers();
 	}
 
 	virtual void getEnabledFeatures() override
@@ -498,6 +1340,74 @@ public:
 		{
 			curEnabledDeviceFeatures.multiDrawIndirect = VK_TRUE;
 		}
+		// Instanced draws start at the region of their LOD in the compacted instance buffer
+		if (deviceFeatures.drawIndirectFirstInstance)
+		{
+			curEnabledDeviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+			drawPath.firstInstance = true;
+		}
+		// Only issue the draws written by the compute shader if the device supports an indirect draw count
+		if (drawPath.firstInstance && !drawPath.disableIndirectCount)
+		{
+			uint32_t extensionCount = 0;
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+			std::vector<VkExtensionProperties> extensions(extensionCount);
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+			for (const VkExtensionProperties& extension : extensions)
+			{
+				if (strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+				{
+					enabledDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+					drawPath.indirectCount = true;
+					break;
+				}
+			}//for
+		}
+	}
+
+	// Draws the instances of all LODs using the indirect commands written by the compute shaders
+	void drawInstances(VkCommandBuffer commandBuffer)
+	{
+		VkViewport viewport = vks::initializers::GenViewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		
+		VkRect2D scissor = vks::initializers::GenRect2D((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_IndirectDraw, 0, 1, &descriptorSet_IndirectDraw, 0, NULL);
+
+		VkDeviceSize offsets[1] = { 0 };
+		// Mesh containing the LODs
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.plants);
+		vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1, &lodModel.vertices.buffer, offsets);
+		vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BUFFER_BIND_ID, 1, &visibleInstanceBuffer.buffer, offsets);
+
+		vkCmdBindIndexBuffer(commandBuffer, lodModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		// One instanced draw per LOD level, culled objects are not part of the compacted instance data
+		if (drawPath.indirectCount)
+		{
+			// The number of draws is taken from the draw count written by the compute shader
+			vkCmdDrawIndexedIndirectCountKHR(commandBuffer, indirectCommandsBuffer.buffer, 0, indirectDrawCountConstBuffer.buffer, 0, lodLevelCount, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else if (drawPath.firstInstance && vulkanDevice->features.multiDrawIndirect)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, indirectCommandsBuffer.buffer, 0, lodLevelCount, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else
+		{
+			// if multi draw is not avaiable,we must issue separate draw commands
+			for (uint32_t j = 0; j < lodLevelCount; j++)
+			{
+				if (!drawPath.firstInstance)
+				{
+					// Draw commands are stored per LOD and start at instance zero, so select the LOD region with the binding offset instead
+					VkDeviceSize instanceOffset = j * objectCount * sizeof(InstanceData);
+					vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BUFFER_BIND_ID, 1, &visibleInstanceBuffer.buffer, &instanceOffset);
+				}
+				vkCmdDrawIndexedIndirect(commandBuffer, indirectCommandsBuffer.buffer, j * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+			}
+		}//if_else
 	}
 
 	void buildCommandBuffersForPreRenderPrmitives()
@@ -522,54 +1432,222 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufBeginInfo));
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-			VkViewport viewport = vks::initializers::GenViewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-			
-			VkRect2D scissor = vks::initializers::GenRect2D((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_IndirectDraw, 0, 1, &descriptorSet_IndirectDraw, 0, NULL);
-
-			VkDeviceSize offsets[1] = { 0 };
-			// Mesh containing the LODs
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.plants);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &lodModel.vertices.buffer, offsets);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer.buffer, offsets);
+			// GPU timings and pipeline statistics use one slot per swapchain image
+			profiler.beginGpuSlot(drawCmdBuffers[i], i);
+			instrumentation.beginSlot(drawCmdBuffers[i], i);
+			uint32_t region;
+			uint32_t pass;
 
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], lodModel.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-
-			if (vulkanDevice->features.multiDrawIndirect)
+			if (occlusion.enabled)
 			{
-				vkCmdDrawIndexedIndirect(drawCmdBuffers[i], indirectCommandsBuffer.buffer, 0, drawIndirectCommands.size(), sizeof(VkDrawIndexedIndirectCommand));
+				// Early pass: draw the objects that were visible in the last frame
+				region = profiler.beginGpuRegion(drawCmdBuffers[i], i, "cull early");
+				pass = instrumentation.beginPass(drawCmdBuffers[i], i, "cull early");
+				addIndirectBufferBarriers(drawCmdBuffers[i], false, true);
+				addCounterReset(drawCmdBuffers[i]);
+				addCullDispatches(drawCmdBuffers[i], CULL_PHASE_EARLY);
+				addIndirectBufferBarriers(drawCmdBuffers[i], true, true);
+				instrumentation.endPass(drawCmdBuffers[i], i, pass);
+				profiler.endGpuRegion(drawCmdBuffers[i], i, region);
+
+				region = profiler.beginGpuRegion(drawCmdBuffers[i], i, "draw early");
+				pass = instrumentation.beginPass(drawCmdBuffers[i], i, "draw early");
+				renderPassBeginInfo.renderPass = occlusion.renderPassEarly;
+				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				drawInstances(drawCmdBuffers[i]);
+				vkCmdEndRenderPass(drawCmdBuffers[i]);
+				instrumentation.endPass(drawCmdBuffers[i], i, pass);
+				profiler.endGpuRegion(drawCmdBuffers[i], i, region);
+
+				// Late pass: test all objects against the depth of the early pass and draw the ones that became visible
+				region = profiler.beginGpuRegion(drawCmdBuffers[i], i, "depth pyramid");
+				pass = instrumentation.beginPass(drawCmdBuffers[i], i, "depth pyramid");
+				addDepthPyramidReduction(drawCmdBuffers[i]);
+				instrumentation.endPass(drawCmdBuffers[i], i, pass);
+				profiler.endGpuRegion(drawCmdBuffers[i], i, region);
+
+				region = profiler.beginGpuRegion(drawCmdBuffers[i], i, "cull late");
+				pass = instrumentation.beginPass(drawCmdBuffers[i], i, "cull late");
+				addIndirectBufferBarriers(drawCmdBuffers[i], false, true);
+				addCullDispatches(drawCmdBuffers[i], CULL_PHASE_LATE);
+				addIndirectBufferBarriers(drawCmdBuffers[i], true, true);
+				instrumentation.endPass(drawCmdBuffers[i], i, pass);
+				profiler.endGpuRegion(drawCmdBuffers[i], i, region);
+
+				region = profiler.beginGpuRegion(drawCmdBuffers[i], i, "draw late");
+				pass = instrumentation.beginPass(drawCmdBuffers[i], i, "draw late");
+				renderPassBeginInfo.renderPass = occlusion.renderPassLate;
+				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				drawInstances(drawCmdBuffers[i]);
+				drawUI(drawCmdBuffers[i]);
+				vkCmdEndRenderPass(drawCmdBuffers[i]);
+				instrumentation.endPass(drawCmdBuffers[i], i, pass);
+				profiler.endGpuRegion(drawCmdBuffers[i], i, region);
+
+				VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+				continue;
 			}
-			else
+
+			// Acquire the indirect buffers from the compute queue
+			if (specializedComputeQueue)
 			{
-				// if multi draw is not avaiable,we must issue separate draw commands
-				for (auto j = 0; j < drawIndirectCommands.size(); j++)
-				{
-					vkCmdDrawIndexedIndirect(drawCmdBuffers[i], indirectCommandsBuffer.buffer, j * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
-				}
-			}//if_else
+				addIndirectBufferBarriers(drawCmdBuffers[i], true, true);
+			}
+
+			region = profiler.beginGpuRegion(drawCmdBuffers[i], i, "draw");
+			pass = instrumentation.beginPass(drawCmdBuffers[i], i, "draw");
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			drawInstances(drawCmdBuffers[i]);
 
 			drawUI(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
+			instrumentation.endPass(drawCmdBuffers[i], i, pass);
+			profiler.endGpuRegion(drawCmdBuffers[i], i, region);
+
+			// Release the indirect buffers to the compute queue
+			if (specializedComputeQueue)
+			{
+				addIndirectBufferBarriers(drawCmdBuffers[i], false, true);
+			}
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}//for
 	}
 
+	// Reads back the depth pyramid and the visibility of the last late phase and compares them against the CPU reference
+	// The first level isn't checked, the late pass has already added its objects to the depth buffer it was built from
+	bool validateOcclusionCulling()
+	{
+		VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+
+		hiz::DepthPyramid pyramid;
+		pyramid.width = occlusion.width;
+		pyramid.height = occlusion.height;
+		pyramid.levels.resize(occlusion.levelCount);
+
+		std::vector<VkBufferImageCopy> copyRegions(occlusion.levelCount);
+		VkDeviceSize readbackSize = 0;
+		for (uint32_t i = 0; i < occlusion.levelCount; i++)
+		{
+			copyRegions[i] = {};
+			copyRegions[i].bufferOffset = readbackSize;
+			copyRegions[i].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+			copyRegions[i].imageExtent = { pyramid.levelWidth(i), pyramid.levelHeight(i), 1 };
+			readbackSize += pyramid.levelWidth(i) * pyramid.levelHeight(i) * sizeof(float);
+		}//for_i
+		const VkDeviceSize visibilityOffset = readbackSize;
+		readbackSize += objectCount * sizeof(uint32_t);
+
+		vks::Buffer readbackBuffer;
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, readbackSize));
+		VK_CHECK_RESULT(readbackBuffer.map());
+
+		VkCommandBuffer copyCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkCmdCopyImageToBuffer(copyCmd, occlusion.pyramid, VK_IMAGE_LAYOUT_GENERAL, readbackBuffer.buffer, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+		VkBufferCopy copyRegion = {};
+		copyRegion.dstOffset = visibilityOffset;
+		copyRegion.size = objectCount * sizeof(uint32_t);
+		vkCmdCopyBuffer(copyCmd, occlusion.visibilityBuffer.buffer, readbackBuffer.buffer, 1, &copyRegion);
+		addStatsBufferBarrier(copyCmd, readbackBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+		vulkanDevice->FlushCommandBuffer(copyCmd, queue, true);
+
+		const uint8_t* data = static_cast<const uint8_t*>(readbackBuffer.mappedData);
+		for (uint32_t i = 0; i < occlusion.levelCount; i++)
+		{
+			const float* level = reinterpret_cast<const float*>(data + copyRegions[i].bufferOffset);
+			pyramid.levels[i].assign(level, level + pyramid.levelWidth(i) * pyramid.levelHeight(i));
+		}//for_i
+		const uint32_t* visibility = reinterpret_cast<const uint32_t*>(data + visibilityOffset);
+
+		// All levels above the first are rebuilt from the level below as read back from the GPU, the max reduction has to match exactly
+		uint32_t levelMismatches = 0;
+		std::vector<float> expectedLevel;
+		for (uint32_t i = 1; i < occlusion.levelCount; i++)
+		{
+			hiz::reduce(pyramid.levels[i - 1], pyramid.levelWidth(i - 1), pyramid.levelHeight(i - 1), expectedLevel, pyramid.levelWidth(i), pyramid.levelHeight(i));
+			for (size_t j = 0; j < expectedLevel.size(); j++)
+			{
+				levelMismatches += (expectedLevel[j] != pyramid.levels[i][j]) ? 1 : 0;
+			}
+		}//for_i
+
+		// The occlusion test can differ for objects right at the edge of a texel or depth value due to floating point precision
+		const glm::mat4 viewProjection = uboSceneTransformDatas.projection * uboSceneTransformDatas.modelView;
+		const float radius = uboSceneTransformDatas.cullParams.w;
+		uint32_t visibilityMismatches = 0;
+		uint32_t visibleCount = 0;
+		uint32_t occludedCount = 0;
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			const bool inFrustum = hiz::frustumCheck(uboSceneTransformDatas.frustumPlanes, instanceDatas[i].pos, radius);
+			const bool occluded = inFrustum && hiz::isOccluded(pyramid, viewProjection, instanceDatas[i].pos, radius);
+			const bool visible = inFrustum && !occluded;
+			visibilityMismatches += (visible != (visibility[i] != 0)) ? 1 : 0;
+			visibleCount += visible ? 1 : 0;
+			occludedCount += occluded ? 1 : 0;
+		}//for_i
+
+		readbackBuffer.destroy();
+
+		const bool passed = (levelMismatches == 0) && (visibilityMismatches <= objectCount / 1000);
+		std::cout << "Depth pyramid " << occlusion.width << "x" << occlusion.height << ", " << occlusion.levelCount << " levels, " << levelMismatches << " mismatching texels\n";
+		std::cout << "Visibility: " << visibleCount << " visible, " << occludedCount << " occluded, " << visibilityMismatches << " of " << objectCount << " objects mismatching\n";
+		std::cout << "Occlusion culling validation " << (passed ? "passed" : "FAILED") << "\n";
+		return passed;
+	}
+
+	uint32_t runSelfTests(std::ostream& out) override
+	{
+		uint32_t failed = VulkanExampleBase::runSelfTests(out);
+		out << "Depth pyramid\n";
+		failed += hiz::selfTest(out);
+		return failed;
+	}
+
 	void prepareForRendering()override
 	{
 		VulkanExampleBase::prepareForRendering();
+		if (occlusion.requested && !occlusion.enabled)
+		{
+			std::cout << "Occlusion culling needs drawIndirectFirstInstance and a depth format that can be sampled, using frustum culling only\n";
+			if (occlusion.validateFrames > 0)
+			{
+				exit(1);
+			}
+		}
+		specializedComputeQueue = !occlusion.enabled && (vulkanDevice->queueFamilyIndices.graphicIndex != vulkanDevice->queueFamilyIndices.computeIndex);
+		if (drawPath.indirectCount)
+		{
+			vkCmdDrawIndexedIndirectCountKHR = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+		}
+		if (!lodSelection.clusterReportModel.empty())
+		{
+			exit(runClusterReport(getAssetPath() + "models/" + lodSelection.clusterReportModel) ? 0 : 1);
+		}
 		loadAssets();
+		if (lodSelection.simplifyReport)
+		{
+			runSimplifyReport();
+			exit(0);
+		}
 		prepareBuffersForIndirectDrawAndComputeLOD();
+		if (lodSelection.simulationFrames > 0)
+		{
+			runLodSimulation();
+			exit(0);
+		}
 		setupDescriptorSetLayoutAndPipelineLayout_IndirectDraw();
 		preparePipelines_IndirectDraw();
 		setupDescriptorPool();
 		setupDescriptorSetAndUpdate_IndirectDraw();
+		prepareOcclusionCulling();
+		// Without occlusion culling the cull runs in its own command buffers, time them in extra slots if the compute queue supports timestamps
+		if (profiler.enabled && !occlusion.enabled && (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.computeIndex].timestampValidBits > 0))
+		{
+			profiler.prepareGpu(vulkanDevice, vulkanDevice->queueFamilyIndices.graphicIndex, swapChain.imageCount + STATS_READBACK_LATENCY);
+		}
 		prepareCompute();
 		buildCommandBuffersForPreRenderPrmitives();
 		prepared = true;
@@ -577,49 +1655,98 @@ public:
 
 	void draw()
 	{
+		static bool firstDraw = true;
+
 		VulkanExampleBase::prepareFrame();
 
 		// Submit compute shader for frustum culling
 
-		// Wait for fence to ensure that compute buffer writes have finished
-		vkWaitForFences(device, 1, &compute.fence, VK_TRUE, UINT64_MAX);
-		vkResetFences(device, 1, &compute.fence);
+		// Wait for the fence of this frame's readback slot, the stats copied there STATS_READBACK_LATENCY frames ago are then visible to the host
+		VkFence fence = compute.fences[compute.statsSlot];
+		vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+		vkResetFences(device, 1, &fence);
+
+		// Get draw count from compute
+		memcpy(&indirectStats, static_cast<uint8_t*>(indirectStatsReadbackBuffer.mappedData) + compute.statsSlot * sizeof(IndirectStats), sizeof(indirectStats));
+
+		// The timestamps and statistics of this swapchain image's last submission are ready, the queue is idle after each frame
+		profiler.collectGpuSlot(currentCmdBufferIndex);
+		profiler.collectGpuSlot(swapChain.imageCount + compute.statsSlot);
+		instrumentation.collectSlot(currentCmdBufferIndex);
+
+		if (occlusion.enabled)
+		{
+			// Culling and both passes are part of the frame's command buffer, the stats copy is submitted right behind it
+			std::array<VkCommandBuffer, 2> commandBuffers = { drawCmdBuffers[currentCmdBufferIndex], compute.commandBuffers[compute.statsSlot] };
+			compute.statsSlot = (compute.statsSlot + 1) % STATS_READBACK_LATENCY;
+
+			VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+			submitInfo.pCommandBuffers = commandBuffers.data();
+			submitInfo.pWaitSemaphores = &semaphores.presentComplete;
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitDstStageMask = &waitStageMask;
+			submitInfo.pSignalSemaphores = &semaphores.renderComplete;
+			submitInfo.signalSemaphoreCount = 1;
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+			profiler.submitGpuSlot(currentCmdBufferIndex);
+			instrumentation.submitSlot(currentCmdBufferIndex);
+
+			VulkanExampleBase::submitFrame();
+			return;
+		}
 
 		VkSubmitInfo computeSubmitInfo = vks::initializers::GenSubmitInfo();
+		// Don't overwrite the indirect buffers before the previous frame's draws have consumed them
+		VkPipelineStageFlags computeWaitDstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		if (!firstDraw)
+		{
+			computeSubmitInfo.waitSemaphoreCount = 1;
+			computeSubmitInfo.pWaitSemaphores = &compute.semaphores.ready;
+			computeSubmitInfo.pWaitDstStageMask = &computeWaitDstStageMask;
+		}
+		firstDraw = false;
 		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
+		computeSubmitInfo.pCommandBuffers = &compute.commandBuffers[compute.statsSlot];
 		computeSubmitInfo.signalSemaphoreCount = 1;
-		computeSubmitInfo.pSignalSemaphores = &compute.semaphore;
-		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+		computeSubmitInfo.pSignalSemaphores = &compute.semaphores.complete;
+		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, fence));
+		profiler.submitGpuSlot(swapChain.imageCount + compute.statsSlot);
 
+		compute.statsSlot = (compute.statsSlot + 1) % STATS_READBACK_LATENCY;
 
 		// Submit graphics command buffer
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentCmdBufferIndex];
-		//submitInfo.pCommandBuffers = VK_NULL_HANDLE;
 
 		// Wait on present and compute semaphores
 		std::array<VkPipelineStageFlags, 2> stageFlags =
 		{
 			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
 		};
 		std::array<VkSemaphore, 2> waitSemaphores =
 		{
 			semaphores.presentComplete,// Wait for presentation to finished
-			compute.semaphore, //Wait for compute to finish
+			compute.semaphores.complete, //Wait for compute to finish
+		};
+		std::array<VkSemaphore, 2> signalSemaphores =
+		{
+			semaphores.renderComplete,
+			compute.semaphores.ready,
 		};
 
 		submitInfo.pWaitSemaphores = waitSemaphores.data();
 		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
 		submitInfo.pWaitDstStageMask = stageFlags.data();
+		submitInfo.pSignalSemaphores = signalSemaphores.data();
+		submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
 		// Submit to queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, compute.fence));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		profiler.submitGpuSlot(currentCmdBufferIndex);
+		instrumentation.submitSlot(currentCmdBufferIndex);
 
 		VulkanExampleBase::submitFrame();
-
-		// Get draw count from compute
-		memcpy(&indirectStats, indirectDrawCountConstBuffer.mappedData, sizeof(indirectStats));
 	}
 
 	virtual void render()override
@@ -629,9 +1756,55 @@ public:
 			return;
 		}
 		draw();
-		if (camera.updated)
+		if ((occlusion.validateFrames > 0) && (++occlusion.renderedFrames == occlusion.validateFrames))
+		{
+			exit(validateOcclusionCulling() ? 0 : 1);
+		}
+		// The stats are STATS_READBACK_LATENCY frames old, the budget reacts with the same delay as in the simulation
+		lodSelection.drawnTriangles = 0;
+		for (uint32_t i = 0; i < lodLevelCount; i++)
+		{
+			lodSelection.drawnTriangles += static_cast<uint64_t>(indirectStats.lodCount[i]) * lodSelection.triangles[i];
+		}//for_i
+		lodSelection.budget.update(lodSelection.drawnTriangles);
+		updateUniformBuffer(camera.updated);
+	}
+
+	// Replays a fly through the object grid with the CPU LOD selection, without hysteresis, with hysteresis and with the triangle budget (if set)
+	// Only frustum culling is modelled
+	void runLodSimulation()
+	{
+		std::vector<glm::vec4> objects(instanceDatas.size());
+		for (size_t i = 0; i < instanceDatas.size(); i++)
+		{
+			objects[i] = glm::vec4(instanceDatas[i].pos, instanceDatas[i].scale);
+		}//for_i
+		const std::vector<glm::mat4> views = lod::flythroughPath(lodSelection.simulationFrames, static_cast<float>(OBJECT_COUNT) / 2.0f);
+
+		lod::SimulationSettings settings;
+		settings.errors = lodSelection.errors;
+		settings.triangles = lodSelection.triangles;
+		settings.objectRadius = uboSceneTransformDatas.cullParams.w;
+		settings.readbackLatency = STATS_READBACK_LATENCY;
+		settings.viewportWidth = static_cast<float>(width);
+		settings.viewportHeight = static_cast<float>(height);
+		settings.budget.targetThreshold = lodSelection.budget.targetThreshold;
+		settings.budget.threshold = lodSelection.budget.targetThreshold;
+
+		std::cout << "LOD errors:";
+		for (uint32_t i = 0; i < lodLevelCount; i++)
+		{
+			std::cout << " " << lodSelection.errors[i] << " (" << lodSelection.triangles[i] << " triangles)";
+		}//for_i
+		std::cout << "\nrun,frames,avg triangles,max triangles,over budget frames,lod switches,switches per frame,max switches per frame,max threshold\n";
+
+		lod::printReport(std::cout, "nohysteresis", lod::simulateCameraPath(objects, views, settings));
+		settings.hysteresis = lodSelection.hysteresis;
+		lod::printReport(std::cout, "hysteresis", lod::simulateCameraPath(objects, views, settings));
+		if (lodSelection.budget.budget > 0)
 		{
-			updateUniformBuffer(true);
+			settings.budget.budget = lodSelection.budget.budget;
+			lod::printReport(std::cout, "budget", lod::simulateCameraPath(objects, views, settings));
 		}
 	}
 
@@ -641,9 +1814,23 @@ public:
 			if (overlay->checkBox("Freeze frustum", &fixedFrustum)) {
 				updateUniformBuffer(true);
 			}
+			overlay->sliderFloat("LOD error (px)", &lodSelection.budget.targetThreshold, 0.25f, 16.0f);
+			overlay->sliderFloat("LOD hysteresis", &lodSelection.hysteresis, 0.0f, 0.5f);
 		}
 		if (overlay->header("Statistics")) {
-			overlay->text("Visible objects: %d", indirectStats.drawCount);
+			uint32_t visibleCount = 0;
+			for (uint32_t i = 0; i < MAX_LOD_LEVEL + 1; i++) {
+				visibleCount += indirectStats.lodCount[i];
+			}
+			overlay->text("Visible objects: %d", visibleCount);
+			if (occlusion.enabled) {
+				overlay->text("Occluded objects: %d", indirectStats.occludedCount);
+			}
+			overlay->text("Indirect draws: %d%s", indirectStats.drawCount, drawPath.indirectCount ? " (indirect count)" : "");
+			overlay->text("Triangles: %llu", static_cast<unsigned long long>(lodSelection.drawnTriangles));
+			if (lodSelection.budget.budget > 0) {
+				overlay->text("LOD error: %.2f px (budget %llu)", lodSelection.budget.threshold, static_cast<unsigned long long>(lodSelection.budget.budget));
+			}
 			for (uint32_t i = 0; i < MAX_LOD_LEVEL + 1; i++) {
 				overlay->text("LOD %d: %d", i, indirectStats.lodCount[i]);
 			}
@@ -0,0 +1,216 @@
+/*
+* CPU reference for the hierarchical depth (HiZ) occlusion culling of the compute cull and lod example
+*
+* Mirrors depthreduce.comp and the occlusion test in cull.comp, so the GPU results can be validated and the math can be checked without a GPU
+* The example uses a regular depth range (cleared to 1.0, less or equal test), so the pyramid keeps the farthest (max) depth of each region
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+
+#include <glm/glm.hpp>
+
+#include "SelfTest.hpp"
+
+namespace hiz
+{
+	// Largest power of two that is less or equal to value
+	inline uint32_t previousPow2(uint32_t value)
+	{
+		uint32_t result = 1;
+		while (result * 2 <= value)
+		{
+			result *= 2;
+		}
+		return result;
+	}
+
+	struct DepthPyramid
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<std::vector<float>> levels;
+
+		uint32_t levelWidth(uint32_t level) const
+		{
+			return std::max(width >> level, 1u);
+		}
+
+		uint32_t levelHeight(uint32_t level) const
+		{
+			return std::max(height >> level, 1u);
+		}
+
+		float texel(uint32_t level, uint32_t x, uint32_t y) const
+		{
+			return levels[level][y * levelWidth(level) + x];
+		}
+	};
+
+	// Number of levels for a pyramid whose first level is the previous power of two of the depth buffer size
+	inline uint32_t getLevelCount(uint32_t width, uint32_t height)
+	{
+		const uint32_t size = std::max(previousPow2(width), previousPow2(height));
+		return static_cast<uint32_t>(std::floor(std::log2(static_cast<float>(size)))) + 1;
+	}
+
+	// One reduction step, the footprint of each output texel is rounded outwards so the result stays conservative for non power of two input sizes
+	inline void reduce(const std::vector<float>& input, uint32_t inputWidth, uint32_t inputHeight, std::vector<float>& output, uint32_t outputWidth, uint32_t outputHeight)
+	{
+		output.resize(outputWidth * outputHeight);
+		for (uint32_t y = 0; y < outputHeight; y++)
+		{
+			const uint32_t firstY = y * inputHeight / outputHeight;
+			const uint32_t lastY = ((y + 1) * inputHeight + outputHeight - 1) / outputHeight;
+			for (uint32_t x = 0; x < outputWidth; x++)
+			{
+				const uint32_t firstX = x * inputWidth / outputWidth;
+				const uint32_t lastX = ((x + 1) * inputWidth + outputWidth - 1) / outputWidth;
+				float depth = 0.0f;
+				for (uint32_t iy = firstY; iy < lastY; iy++)
+				{
+					for (uint32_t ix = firstX; ix < lastX; ix++)
+					{
+						depth = std::max(depth, input[iy * inputWidth + ix]);
+					}
+				}
+				output[y * outputWidth + x] = depth;
+			}
+		}
+	}
+
+	// Builds all levels from a depth buffer of the given size (row major, values in [0, 1])
+	inline DepthPyramid buildDepthPyramid(const std::vector<float>& depth, uint32_t width, uint32_t height)
+	{
+		DepthPyramid pyramid;
+		pyramid.width = previousPow2(width);
+		pyramid.height = previousPow2(height);
+		pyramid.levels.resize(getLevelCount(width, height));
+
+		reduce(depth, width, height, pyramid.levels[0], pyramid.width, pyramid.height);
+		for (uint32_t i = 1; i < pyramid.levels.size(); i++)
+		{
+			reduce(pyramid.levels[i - 1], pyramid.levelWidth(i - 1), pyramid.levelHeight(i - 1), pyramid.levels[i], pyramid.levelWidth(i), pyramid.levelHeight(i));
+		}
+		return pyramid;
+	}
+
+	// Sphere against the view frustum planes, same as frustumCheck in cull.comp
+	inline bool frustumCheck(const glm::vec4* planes, glm::vec3 center, float radius)
+	{
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			if (glm::dot(glm::vec4(center, 1.0f), planes[i]) + radius < 0.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Returns true if the bounding box of the sphere is completely behind the depth stored in the pyramid
+	// The box is projected to screen space and tested against the pyramid level at which it covers at most 2x2 texels
+	inline bool isOccluded(const DepthPyramid& pyramid, const glm::mat4& viewProjection, glm::vec3 center, float radius)
+	{
+		glm::vec2 minUV(1.0f);
+		glm::vec2 maxUV(0.0f);
+		float minDepth = 1.0f;
+		for (int i = 0; i < 8; i++)
+		{
+			const glm::vec3 corner = center + radius * glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+			const glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+			// Corners behind the camera can't be projected
+			if (clip.w <= 0.0f)
+			{
+				return false;
+			}
+			const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			const glm::vec2 uv = glm::vec2(ndc) * 0.5f + 0.5f;
+			minUV = glm::min(minUV, uv);
+			maxUV = glm::max(maxUV, uv);
+			minDepth = std::min(minDepth, ndc.z);
+		}
+		minUV = glm::clamp(minUV, glm::vec2(0.0f), glm::vec2(1.0f));
+		maxUV = glm::clamp(maxUV, glm::vec2(0.0f), glm::vec2(1.0f));
+
+		const glm::vec2 size = (maxUV - minUV) * glm::vec2(static_cast<float>(pyramid.width), static_cast<float>(pyramid.height));
+		const float level = std::ceil(std::log2(std::max(std::max(size.x, size.y), 1.0f)));
+		const uint32_t levelIndex = std::min(static_cast<uint32_t>(level), static_cast<uint32_t>(pyramid.levels.size()) - 1);
+
+		const glm::ivec2 levelSize(pyramid.levelWidth(levelIndex), pyramid.levelHeight(levelIndex));
+		const glm::ivec2 first = glm::min(glm::ivec2(minUV * glm::vec2(levelSize)), levelSize - 1);
+		const glm::ivec2 last = glm::min(glm::ivec2(maxUV * glm::vec2(levelSize)), levelSize - 1);
+		float maxDepth = 0.0f;
+		for (int y = first.y; y <= last.y; y++)
+		{
+			for (int x = first.x; x <= last.x; x++)
+			{
+				maxDepth = std::max(maxDepth, pyramid.texel(levelIndex, x, y));
+			}
+		}
+		return minDepth > maxDepth;
+	}
+
+	// Checks the reduction and the occlusion test on a synthetic depth buffer, returns the number of failed checks
+	inline uint32_t selfTest(std::ostream& out)
+	{
+		vks::SelfTest test(out);
+
+		// Non power of two depth buffer with a near occluder covering the center and a far background
+		const uint32_t width = 1280;
+		const uint32_t height = 720;
+		std::vector<float> depth(width * height, 1.0f);
+		for (uint32_t y = height / 4; y < height * 3 / 4; y++)
+		{
+			for (uint32_t x = width / 4; x < width * 3 / 4; x++)
+			{
+				depth[y * width + x] = 0.5f + 0.1f * static_cast<float>((x * 7 + y * 13) % 17) / 17.0f;
+			}
+		}
+
+		const DepthPyramid pyramid = buildDepthPyramid(depth, width, height);
+		test.check((pyramid.width == 1024) && (pyramid.height == 512) && (pyramid.levels.size() == 11), "pyramid size and level count");
+
+		// Every pyramid texel must be at least as far as all depth samples in its footprint
+		bool conservative = true;
+		for (uint32_t level = 0; level < pyramid.levels.size(); level++)
+		{
+			const uint32_t levelWidth = pyramid.levelWidth(level);
+			const uint32_t levelHeight = pyramid.levelHeight(level);
+			for (uint32_t y = 0; (y < height) && conservative; y++)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					const uint32_t px = static_cast<uint32_t>(static_cast<uint64_t>(x) * levelWidth / width);
+					const uint32_t py = static_cast<uint32_t>(static_cast<uint64_t>(y) * levelHeight / height);
+					if (pyramid.texel(level, px, py) < depth[y * width + x])
+					{
+						conservative = false;
+						break;
+					}
+				}
+			}
+		}
+		test.check(conservative, "reduction is conservative on all levels");
+		test.check(pyramid.levels.back()[0] == 1.0f, "last level holds the farthest depth");
+
+		// Identity view projection, so screen space equals xy and depth equals z for points in front of the camera (w = 1)
+		const glm::mat4 viewProjection(1.0f);
+		test.check(isOccluded(pyramid, viewProjection, glm::vec3(0.0f, 0.0f, 0.9f), 0.05f), "object behind occluder is occluded");
+		test.check(!isOccluded(pyramid, viewProjection, glm::vec3(0.0f, 0.0f, 0.3f), 0.05f), "object in front of occluder is visible");
+		test.check(!isOccluded(pyramid, viewProjection, glm::vec3(0.45f, 0.0f, 0.9f), 0.1f), "object partially outside occluder is visible");
+		test.check(!isOccluded(pyramid, viewProjection, glm::vec3(-0.8f, -0.8f, 0.9f), 0.05f), "object over background is visible");
+
+		glm::mat4 behindCamera(1.0f);
+		behindCamera[3][3] = -1.0f;
+		test.check(!isOccluded(pyramid, behindCamera, glm::vec3(0.0f, 0.0f, 0.9f), 0.05f), "object behind the camera is not occluded");
+
+		return test.failed();
+	}
+}
@@ -0,0 +1,286 @@
+/*
+* Screen space error level of detail selection for the compute cull and lod example
+*
+* Mirrors the LOD selection of cull.comp, so the selection, hysteresis and triangle budget can be replayed on the CPU along a camera path
+* A level may be used as long as its geometric error, projected to the screen, stays below a threshold in pixels
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cfloat>
+#include <ostream>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.hpp"
+
+namespace lod
+{
+	// Index range of one level of detail in a shared index buffer
+	struct MeshLevel
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+
+	// Squared distance from a point to a triangle (closest point by Voronoi regions)
+	inline float pointTriangleDistance2(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		const glm::vec3 ab = b - a;
+		const glm::vec3 ac = c - a;
+		const glm::vec3 ap = p - a;
+		const float d1 = glm::dot(ab, ap);
+		const float d2 = glm::dot(ac, ap);
+		if ((d1 <= 0.0f) && (d2 <= 0.0f))
+		{
+			return glm::dot(ap, ap);
+		}
+
+		const glm::vec3 bp = p - b;
+		const float d3 = glm::dot(ab, bp);
+		const float d4 = glm::dot(ac, bp);
+		if ((d3 >= 0.0f) && (d4 <= d3))
+		{
+			return glm::dot(bp, bp);
+		}
+
+		const float vc = d1 * d4 - d3 * d2;
+		if ((vc <= 0.0f) && (d1 >= 0.0f) && (d3 <= 0.0f))
+		{
+			const glm::vec3 q = a + ab * (d1 / (d1 - d3));
+			return glm::dot(p - q, p - q);
+		}
+
+		const glm::vec3 cp = p - c;
+		const float d5 = glm::dot(ab, cp);
+		const float d6 = glm::dot(ac, cp);
+		if ((d6 >= 0.0f) && (d5 <= d6))
+		{
+			return glm::dot(cp, cp);
+		}
+
+		const float vb = d5 * d2 - d1 * d6;
+		if ((vb <= 0.0f) && (d2 >= 0.0f) && (d6 <= 0.0f))
+		{
+			const glm::vec3 q = a + ac * (d2 / (d2 - d6));
+			return glm::dot(p - q, p - q);
+		}
+
+		const float va = d3 * d6 - d5 * d4;
+		if ((va <= 0.0f) && ((d4 - d3) >= 0.0f) && ((d5 - d6) >= 0.0f))
+		{
+			const glm::vec3 q = b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+			return glm::dot(p - q, p - q);
+		}
+
+		const float denom = 1.0f / (va + vb + vc);
+		const glm::vec3 q = a + ab * (vb * denom) + ac * (vc * denom);
+		return glm::dot(p - q, p - q);
+	}
+
+	// Largest distance from the vertices of one level to the surface of another one
+	// At most maxSamples vertices are tested, which keeps the cost at load time bounded for dense levels
+	inline float oneSidedDistance(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const MeshLevel& from, const MeshLevel& to, uint32_t maxSamples)
+	{
+		std::vector<uint32_t> vertices(indices.begin() + from.firstIndex, indices.begin() + from.firstIndex + from.indexCount);
+		std::sort(vertices.begin(), vertices.end());
+		vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+		const size_t stride = std::max<size_t>(1, (vertices.size() + maxSamples - 1) / maxSamples);
+
+		float maxDistance2 = 0.0f;
+		for (size_t i = 0; i < vertices.size(); i += stride)
+		{
+			const glm::vec3& p = positions[vertices[i]];
+			float minDistance2 = FLT_MAX;
+			for (uint32_t j = to.firstIndex; j + 2 < to.firstIndex + to.indexCount; j += 3)
+			{
+				minDistance2 = std::min(minDistance2, pointTriangleDistance2(p, positions[indices[j]], positions[indices[j + 1]], positions[indices[j + 2]]));
+			}
+			maxDistance2 = std::max(maxDistance2, minDistance2);
+		}
+		return std::sqrt(maxDistance2);
+	}
+
+	// Geometric error of each level against the first (most detailed) one, as the symmetric surface distance
+	// Made monotonic, so a coarser level never has a smaller error than a finer one
+	inline std::vector<float> computeGeometricErrors(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const std::vector<MeshLevel>& levels, uint32_t maxSamples = 1024)
+	{
+		std::vector<float> errors(levels.size(), 0.0f);
+		for (size_t i = 1; i < levels.size(); i++)
+		{
+			const float error = std::max(oneSidedDistance(positions, indices, levels[i], levels[0], maxSamples), oneSidedDistance(positions, indices, levels[0], levels[i], maxSamples));
+			errors[i] = std::max(error, errors[i - 1]);
+		}
+		return errors;
+	}
+
+	// Pixels covered by one world unit at distance one
+	inline float projectionScale(const glm::mat4& projection, float viewportHeight)
+	{
+		return std::abs(projection[1][1]) * viewportHeight * 0.5f;
+	}
+
+	// Coarsest level whose projected error stays below the threshold at the given distance
+	// errorScale is the projection scale divided by the threshold in pixels, a level is allowed if error * objectScale * errorScale <= distance
+	inline uint32_t selectLevel(const std::vector<float>& errors, float objectScale, float errorScale, float distance)
+	{
+		uint32_t level = 0;
+		for (uint32_t i = 1; i < errors.size(); i++)
+		{
+			if (errors[i] * objectScale * errorScale <= distance)
+			{
+				level = i;
+			}
+		}
+		return level;
+	}
+
+	// The level only changes once the distance leaves a band of +-hysteresis around the switch distance, so objects close to it don't pop back and forth
+	inline uint32_t selectLevel(const std::vector<float>& errors, float objectScale, float errorScale, float hysteresis, float distance, uint32_t previousLevel)
+	{
+		const uint32_t minLevel = selectLevel(errors, objectScale, errorScale, distance / (1.0f + hysteresis));
+		const uint32_t maxLevel = selectLevel(errors, objectScale, errorScale, distance * (1.0f + hysteresis));
+		return std::min(std::max(previousLevel, minLevel), maxLevel);
+	}
+
+	// Raises the error threshold while more triangles than the budget are drawn and lowers it back to the target threshold otherwise
+	struct TriangleBudget
+	{
+		uint64_t budget = 0; // 0 = unlimited
+		float targetThreshold = 1.0f; // Error threshold in pixels if the budget isn't exceeded
+		float threshold = 1.0f; // Current error threshold in pixels
+		float maxThreshold = 256.0f;
+
+		void update(uint64_t drawnTriangles)
+		{
+			if ((budget == 0) || (threshold < targetThreshold))
+			{
+				threshold = targetThreshold;
+			}
+			if (budget == 0)
+			{
+				return;
+			}
+			// Grow fast and shrink slowly, with a dead band below the budget to avoid oscillating
+			if (drawnTriangles > budget)
+			{
+				threshold = std::min(threshold * 1.05f, maxThreshold);
+			}
+			else if (drawnTriangles < budget - budget / 10)
+			{
+				threshold = std::max(threshold / 1.02f, targetThreshold);
+			}
+		}
+	};
+
+	struct SimulationSettings
+	{
+		std::vector<float> errors; // Geometric error per level
+		std::vector<uint32_t> triangles; // Triangle count per level
+		float objectRadius = 1.0f; // Bounding radius for frustum culling
+		float hysteresis = 0.0f;
+		TriangleBudget budget;
+		uint32_t readbackLatency = 0; // Frames until the drawn triangles of a frame are known to the budget
+		float fovY = 60.0f;
+		float viewportWidth = 1280.0f;
+		float viewportHeight = 720.0f;
+		float zNear = 0.1f;
+		float zFar = 512.0f;
+	};
+
+	struct SimulationReport
+	{
+		uint32_t frames = 0;
+		uint64_t totalTriangles = 0;
+		uint64_t maxTriangles = 0;
+		uint32_t overBudgetFrames = 0;
+		uint64_t switches = 0; // Level changes of objects that were visible in consecutive frames
+		uint32_t maxSwitchesPerFrame = 0;
+		float maxThreshold = 0.0f;
+	};
+
+	// Deterministic fly through the object grid, moving along z with a lateral sway and slowly turning
+	inline std::vector<glm::mat4> flythroughPath(uint32_t frames, float extent)
+	{
+		std::vector<glm::mat4> views(frames);
+		for (uint32_t i = 0; i < frames; i++)
+		{
+			const float t = static_cast<float>(i) / static_cast<float>(std::max(frames - 1, 1u));
+			const glm::vec3 eye(0.35f * extent * std::sin(t * 6.2831853f), 0.1f * extent * std::sin(t * 12.566371f), -1.5f * extent + 3.0f * extent * t);
+			const float yaw = 0.6f * std::sin(t * 9.424778f);
+			const glm::vec3 direction(std::sin(yaw), 0.0f, std::cos(yaw));
+			views[i] = glm::lookAt(eye, eye + direction, glm::vec3(0.0f, 1.0f, 0.0f));
+		}
+		return views;
+	}
+
+	// Replays a camera path over the objects (xyz position, w scale) with frustum culling and the LOD selection of the cull shader
+	inline SimulationReport simulateCameraPath(const std::vector<glm::vec4>& objects, const std::vector<glm::mat4>& views, SimulationSettings settings)
+	{
+		const glm::mat4 projection = glm::perspective(glm::radians(settings.fovY), settings.viewportWidth / settings.viewportHeight, settings.zNear, settings.zFar);
+		const float scale = projectionScale(projection, settings.viewportHeight);
+		const uint32_t notVisible = UINT32_MAX;
+
+		SimulationReport report;
+		std::vector<uint32_t> levels(objects.size(), 0);
+		std::vector<uint32_t> previousVisible(objects.size(), notVisible);
+		std::vector<uint64_t> drawnTriangles;
+		vks::Frustum frustum;
+
+		for (const glm::mat4& view : views)
+		{
+			// The budget only knows the triangle count of a frame once it has been read back
+			if (drawnTriangles.size() > settings.readbackLatency)
+			{
+				settings.budget.update(drawnTriangles[drawnTriangles.size() - 1 - settings.readbackLatency]);
+			}
+			else
+			{
+				settings.budget.update(0);
+			}
+			const float errorScale = scale / settings.budget.threshold;
+
+			frustum.update(projection * view);
+			const glm::vec3 cameraPos = glm::vec3(glm::inverse(view)[3]);
+			uint64_t triangles = 0;
+			uint32_t switches = 0;
+			for (size_t i = 0; i < objects.size(); i++)
+			{
+				const glm::vec3 pos = glm::vec3(objects[i]);
+				if (!frustum.checkSphere(pos, settings.objectRadius))
+				{
+					previousVisible[i] = notVisible;
+					continue;
+				}
+				levels[i] = selectLevel(settings.errors, objects[i].w, errorScale, settings.hysteresis, glm::distance(pos, cameraPos), levels[i]);
+				switches += ((previousVisible[i] != notVisible) && (previousVisible[i] != levels[i])) ? 1 : 0;
+				previousVisible[i] = levels[i];
+				triangles += settings.triangles[levels[i]];
+			}//for_i
+
+			drawnTriangles.push_back(triangles);
+			report.frames++;
+			report.totalTriangles += triangles;
+			report.maxTriangles = std::max(report.maxTriangles, triangles);
+			report.overBudgetFrames += ((settings.budget.budget > 0) && (triangles > settings.budget.budget)) ? 1 : 0;
+			report.switches += switches;
+			report.maxSwitchesPerFrame = std::max(report.maxSwitchesPerFrame, switches);
+			report.maxThreshold = std::max(report.maxThreshold, settings.budget.threshold);
+		}//for
+		return report;
+	}
+
+	inline void printReport(std::ostream& out, const char* name, const SimulationReport& report)
+	{
+		const uint32_t frames = std::max(report.frames, 1u);
+		out << name << "," << report.frames << "," << report.totalTriangles / frames << "," << report.maxTriangles << "," << report.overBudgetFrames << ","
+			<< report.switches << "," << static_cast<float>(report.switches) / static_cast<float>(frames) << "," << report.maxSwitchesPerFrame << "," << report.maxThreshold << "\n";
+	}
+}
@@ -12,6 +12,7 @@
 */
 
 #include "VulkanExampleBase.h"
+#include "NBodyCpu.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION true
@@ -23,10 +24,49 @@
 #define PARTICLES_PER_ATTRACTOR 4*1024
 #endif
 
+#define ATTRACTOR_COUNT 6
+// Work group size of the compute shaders, each work group processes one tile (or cluster) of particles
+#define DEFAULT_TILE_SIZE 256
+
 class VulkanExample:public VulkanExampleBase
 {
 public:
-	uint32_t numParticles;
+	uint32_t numParticles = ATTRACTOR_COUNT * PARTICLES_PER_ATTRACTOR;
+	unsigned particleSeed = 0;
+
+	// Force model shared by the compute shaders and the CPU reference solver
+	nbody::SimulationParameters simulationParams;
+
+	// CPU reference solver settings, see runCpuSolver and validateAgainstCpu
+	struct
+	{
+		nbody::CpuSolver::Method method = nbody::CpuSolver::Method::BruteForce;
+		float theta = 0.5f;
+		uint32_t steps = 10;
+		bool validate = false;
+	} cpuReference;
+
+	// Force calculation kernels
+	// Tiled: all pairs, positions are streamed through shared memory one tile at a time
+	// Cluster: consecutive particles (sorted along a Morton curve) form clusters, distant clusters are approximated by their center of mass
+	enum class Kernel { Tiled, Cluster };
+
+	struct
+	{
+		Kernel kernel = Kernel::Tiled;
+		uint32_t tileSize = DEFAULT_TILE_SIZE;
+		// Largest power of two tile size supported by the device
+		uint32_t maxTileSize = DEFAULT_TILE_SIZE;
+		// Opening angle for the cluster kernel
+		float theta = 0.5f;
+	} kernelSettings;
+
+	// Benchmark sweep over particle counts, tile sizes and kernels
+	struct
+	{
+		bool enabled = false;
+		std::vector<uint32_t> particleCounts = { 4096, 10000, 24576, 65536, 100000 };
+	} sweep;
 
 	struct
 	{
@@ -49,7 +89,8 @@ public:
 		VkDescriptorSet descriptorSet; // Particle system rendering shader bindings
 		VkPipelineLayout pipelineLayout; //Layout of the graphics pipeline
 		VkPipeline pipeline; //Particle rendering pipeline
-		VkSemaphore semaphoreGraphicPassComplete; // Execution dependency between compute & graphic submission
+		// Rendered particle states, each simulation step copies its result into the one the next frame renders (see asyncCompute)
+		std::array<vks::Buffer, ASYNC_COMPUTE_STATE_COUNT> vertexBuffers;
 
 		struct
 		{
@@ -65,16 +106,17 @@ public:
 	{
 		uint32_t queueFamilyIndex; // Used to check if compute and graphics queue families differ and require addtional barriers
 		vks::Buffer storageBuffer;  // (Shader) storage buffer object containing the particles
+		vks::Buffer clusterBuffer;  // Center of mass and bounds per cluster, only used by the cluster kernel
 		vks::Buffer uniformBuffer; // Uniform buffer object containing
 		VkQueue queue; //Separate queue for compute commands (queue family may differ from the one used for graphics)
 		VkCommandPool commandPool; // Use a separate command pool (queue family may differ from the one used for graphics)
-		VkCommandBuffer commandBuffer; // Command buffer storing the dispatch commands and barriers
-		VkSemaphore semaphoreComputeComplete; // execution dependency between compute & graphics submission
+		std::array<VkCommandBuffer, ASYNC_COMPUTE_STATE_COUNT> commandBuffers; // Simulation step for each state the step reads, storing the dispatch commands and barriers
 		VkDescriptorSetLayout descriptorSetLayout;// Compute shader binding layout
 		VkDescriptorSet descriptorSet; // Compute shader bindings
 		VkPipelineLayout pipelineLayout; // Layout of the compute pipeline
-		VkPipeline pipelineCalculate; // Compute pipeline for N-body velocity calculation (1st pass)
-		VkPipeline pipelineIntegrate; // compute pipeline for eular integration (2nd pass)
+		VkPipeline pipelineCalculate = VK_NULL_HANDLE; // Compute pipeline for N-body velocity calculation (1st pass)
+		VkPipeline pipelineIntegrate = VK_NULL_HANDLE; // compute pipeline for eular integration (2nd pass)
+		VkPipeline pipelineCluster = VK_NULL_HANDLE; // Compute pipeline building the cluster bounds for the cluster kernel
 
 		//VkPipeline blur;
 		//VkPipelineLayout pipelineLayoutBlur;
@@ -88,12 +130,8 @@ public:
 		} ubo;
 	} compute;
 
-	// SSBO particle declaration
-	struct Particle
-	{
-		glm::vec4 pos; // xyz = position, w = mass
-		glm::vec4 vel; //xyz = velocity,w = gradient texture position
-	};
+	// SSBO particle declaration, shared with the CPU reference solver
+	using Particle = nbody::Particle;
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
@@ -103,6 +141,72 @@ public:
 		camera.setRotation(glm::vec3(-26.0f, 75.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -14.0f));
 		camera.movementSpeed = 2.5f;
+
+		commandLineParser.add("particles", { "-np", "--particles" }, 1, "Set number of simulated particles");
+		commandLineParser.add("cpusolver", { "-cs", "--cpusolver" }, 1, "Run the CPU reference solver (bruteforce, barneshut) and exit");
+		commandLineParser.add("theta", { "-th", "--theta" }, 1, "Set Barnes-Hut opening angle for the CPU solver and the cluster kernel");
+		commandLineParser.add("kernel", { "-k", "--kernel" }, 1, "Select force calculation kernel (tiled, cluster)");
+		commandLineParser.add("tilesize", { "-ts", "--tilesize" }, 1, "Set compute work group / tile size (power of two, clamped to device limits)");
+		commandLineParser.add("sweep", { "-sw", "--sweep" }, 0, "Benchmark all kernels and tile sizes for a list of particle counts, save as CSV and exit");
+		commandLineParser.add("sweepcounts", { "-swc", "--sweepcounts" }, 1, "Comma separated list of particle counts for the benchmark sweep");
+		commandLineParser.add("steps", { "-st", "--steps" }, 1, "Set number of simulation steps for CPU solver and validation runs");
+		commandLineParser.add("validate", { "-val", "--validate" }, 0, "Compare GPU simulation steps against the CPU reference solver and exit");
+		commandLineParser.parse(args);
+		// Simulation steps run on the compute queue while the previous step is rendered
+		asyncCompute.requested = true;
+		if (commandLineParser.isSet("particles"))
+		{
+			numParticles = std::max(commandLineParser.getValueAsInt("particles", numParticles), ATTRACTOR_COUNT);
+		}
+		if (commandLineParser.isSet("theta"))
+		{
+			cpuReference.theta = std::stof(commandLineParser.getValueAsString("theta", "0.5"));
+			kernelSettings.theta = cpuReference.theta;
+		}
+		if (commandLineParser.isSet("kernel"))
+		{
+			kernelSettings.kernel = (commandLineParser.getValueAsString("kernel", "tiled") == "cluster") ? Kernel::Cluster : Kernel::Tiled;
+		}
+		if (commandLineParser.isSet("tilesize"))
+		{
+			kernelSettings.tileSize = commandLineParser.getValueAsInt("tilesize", kernelSettings.tileSize);
+		}
+		if (commandLineParser.isSet("sweep"))
+		{
+			sweep.enabled = true;
+			// Keep the sweep short unless the benchmark timings were set explicitly
+			if (!commandLineParser.isSet("benchmarkruntime"))
+			{
+				benchmark.duration = 1;
+			}
+		}
+		if (commandLineParser.isSet("sweepcounts"))
+		{
+			sweep.particleCounts.clear();
+			std::stringstream counts(commandLineParser.getValueAsString("sweepcounts", ""));
+			std::string count;
+			while (std::getline(counts, count, ','))
+			{
+				sweep.particleCounts.push_back(std::max((uint32_t)std::stoul(count), (uint32_t)ATTRACTOR_COUNT));
+			}
+		}
+		if (commandLineParser.isSet("steps"))
+		{
+			cpuReference.steps = commandLineParser.getValueAsInt("steps", cpuReference.steps);
+		}
+		cpuReference.validate = commandLineParser.isSet("validate");
+
+		particleSeed = (benchmark.active || cpuReference.validate || sweep.enabled) ? 0 : (unsigned)time(nullptr);
+
+		if (commandLineParser.isSet("cpusolver"))
+		{
+			if (commandLineParser.getValueAsString("cpusolver", "bruteforce") == "barneshut")
+			{
+				cpuReference.method = nbody::CpuSolver::Method::BarnesHut;
+			}
+			runCpuSolver();
+			exit(0);
+		}
 	}
 
 	~VulkanExample()
@@ -112,22 +216,66 @@ public:
 		vkDestroyPipeline(device, graphics.pipeline, nullptr);
 		vkDestroyPipelineLayout(device, graphics.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, graphics.descriptorSetLayout, nullptr);
-		vkDestroySemaphore(device, graphics.semaphoreGraphicPassComplete, nullptr);
+		for (vks::Buffer& vertexBuffer : graphics.vertexBuffers)
+		{
+			vertexBuffer.destroy();
+		}
 
 		// Compute
 		compute.storageBuffer.destroy();
+		compute.clusterBuffer.destroy();
 		compute.uniformBuffer.destroy();
 		vkDestroyCommandPool(device, compute.commandPool, nullptr);
-		vkDestroySemaphore(device,compute.semaphoreComputeComplete,nullptr);
 		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 		vkDestroyPipelineLayout(device, compute.pipelineLayout,nullptr);
 		vkDestroyPipeline(device, compute.pipelineCalculate, nullptr);
 		vkDestroyPipeline(device, compute.pipelineIntegrate, nullptr);
+		vkDestroyPipeline(device, compute.pipelineCluster, nullptr);
 
 		textures.gradient.destroy();
 		textures.particle.destroy();
 	}
 
+	// Runs the CPU reference solver without touching the GPU and reports throughput and energy drift
+	void runCpuSolver()
+	{
+		const float deltaT = 0.001f;
+
+		nbody::CpuSolver solver(std::max(std::thread::hardware_concurrency(), 1u));
+		solver.params = simulationParams;
+		solver.method = cpuReference.method;
+		solver.theta = cpuReference.theta;
+
+		std::vector<Particle> particles = nbody::generateParticles(numParticles, particleSeed);
+
+		const double initialEnergy = solver.computeEnergy(particles);
+
+		uint64_t interactions = 0;
+		auto tStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < cpuReference.steps; i++)
+		{
+			solver.step(particles, deltaT);
+			interactions += solver.interactionCount;
+		}
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		const double seconds = std::chrono::duration<double>(tEnd - tStart).count();
+
+		const double finalEnergy = solver.computeEnergy(particles);
+
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "CPU solver finished" << "\n";
+		std::cout << "method          : " << ((solver.method == nbody::CpuSolver::Method::BarnesHut) ? "barneshut" : "bruteforce") << "\n";
+		if (solver.method == nbody::CpuSolver::Method::BarnesHut)
+		{
+			std::cout << "theta           : " << solver.theta << "\n";
+		}
+		std::cout << "particles       : " << numParticles << "\n";
+		std::cout << "steps           : " << cpuReference.steps << "\n";
+		std::cout << "ms/step         : " << seconds * 1000.0 / std::max(cpuReference.steps, 1u) << "\n";
+		std::cout << "interactions/s  : " << std::scientific << std::setprecision(3) << interactions / std::max(seconds, 1e-9) << "\n";
+		std::cout << "energy drift    : " << (finalEnergy - initialEnergy) / std::abs(initialEnergy) << "\n";
+	}
+
 	void loadAssets()
 	{
 		textures.particle.loadFromFile(getAssetPath() + "textures/particle01_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
@@ -139,7 +287,7 @@ public:
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
 			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,2),
-			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,2),
 			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,2)
 		};
 
@@ -148,67 +296,66 @@ public:
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
 
-	// Setup and fill the compute shader storage buffers containing the particles
-	void prepareStorageBuffers()
+	// Only the GLSL shaders support specialized work group sizes and the cluster kernel
+	bool usesGlslShaders() const
 	{
-#if 0
-		std::vector<glm::vec3> attractors = {
-			glm::vec3(2.5f, 1.5f, 0.0f),
-			glm::vec3(-2.5f, -1.5f, 0.0f),
-		};
-#else
-		std::vector<glm::vec3> attractors = {
-			glm::vec3(5.0f, 0.0f, 0.0f),
-			glm::vec3(-5.0f, 0.0f, 0.0f),
-			glm::vec3(0.0f, 0.0f, 5.0f),
-			glm::vec3(0.0f, 0.0f, -5.0f),
-			glm::vec3(0.0f, 4.0f, 0.0f),
-			glm::vec3(0.0f, -8.0f, 0.0f),
-		};
-#endif
+		return getShadersPath().find("/glsl/") != std::string::npos;
+	}
 
-#define ATTRACTORS_SIZE static_cast<uint32_t>(attractors.size())
+	// Clamps the requested tile size to a power of two supported by the device
+	// The shaders only use core compute features, so this also covers CPU implementations like lavapipe
+	void selectTileSize()
+	{
+		const VkPhysicalDeviceLimits& limits = vulkanDevice->properties.limits;
+		const uint32_t deviceMaxTileSize = std::min({ limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations, (uint32_t)(limits.maxComputeSharedMemorySize / sizeof(glm::vec4)) });
 
-		numParticles = static_cast<uint32_t>(attractors.size())*PARTICLES_PER_ATTRACTOR;
+		kernelSettings.maxTileSize = 32;
+		while (kernelSettings.maxTileSize * 2 <= deviceMaxTileSize)
+		{
+			kernelSettings.maxTileSize *= 2;
+		}
 
-		// Initial particle positions
-		std::vector<Particle> particleBuffer(numParticles);
+		// The HLSL shaders have a fixed thread group size and don't provide the cluster kernel
+		if (!usesGlslShaders())
+		{
+			kernelSettings.maxTileSize = DEFAULT_TILE_SIZE;
+			kernelSettings.tileSize = DEFAULT_TILE_SIZE;
+			kernelSettings.kernel = Kernel::Tiled;
+		}
 
-		std::default_random_engine randEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
-		std::normal_distribution<float> randomDist(0.0f, 1.0f);
+		uint32_t tileSize = 32;
+		while (tileSize * 2 <= std::min(kernelSettings.tileSize, kernelSettings.maxTileSize))
+		{
+			tileSize *= 2;
+		}
+		if (tileSize != kernelSettings.tileSize)
+		{
+			std::cout << "Tile size " << kernelSettings.tileSize << " not supported, using " << tileSize << "\n";
+		}
+		kernelSettings.tileSize = tileSize;
+	}
 
-		for (uint32_t i = 0; i < ATTRACTORS_SIZE; i++)
+	// Number of work groups (tiles or clusters) covering all particles, the last one may be partially filled
+	uint32_t getWorkGroupCount() const
+	{
+		return (numParticles + kernelSettings.tileSize - 1) / kernelSettings.tileSize;
+	}
+
+	// Initial particle positions, same distribution as used by the CPU reference solver
+	std::vector<Particle> generateInitialParticles() const
+	{
+		std::vector<Particle> particles = nbody::generateParticles(numParticles, particleSeed);
+		if (kernelSettings.kernel == Kernel::Cluster)
 		{
-			for (uint32_t j = 0; j < PARTICLES_PER_ATTRACTOR; j++)
-			{
-				Particle &particle = particleBuffer[i*PARTICLES_PER_ATTRACTOR + j];
+			nbody::sortParticlesSpatially(particles);
+		}
+		return particles;
+	}
 
-				// First particle in group as heavy center of gravity
-				if (j==0)
-				{
-					particle.pos = glm::vec4(attractors[i] * 1.5f, 90000.0f);
-					particle.vel = glm::vec4(glm::vec4(0.0f));
-				}
-				else
-				{
-					// Position
-					glm::vec3 position(attractors[i] + glm::vec3(randomDist(randEngine), randomDist(randEngine), randomDist(randEngine)) * 0.75f);
-					float len = glm::length(glm::normalize(position - attractors[i]));
-					position.y *= 2.0f - (len * len);
-
-					// Velocity
-					glm::vec3 angular = glm::vec3(0.5f, 1.5f, 0.5f) * (((i % 2) == 0) ? 1.0f : -1.0f);
-					glm::vec3 velocity = glm::cross((position - attractors[i]), angular) + glm::vec3(randomDist(randEngine), randomDist(randEngine), randomDist(randEngine) * 0.025f);
-
-					float mass = (randomDist(randEngine) * 0.5f + 0.5f) * 75.0f;
-					particle.pos = glm::vec4(position, mass);
-					particle.vel = glm::vec4(velocity, 0.0f);
-				}//if_else_j
-
-				// Color gradient offset
-				particle.vel.w = (float)i*1.0f / ATTRACTORS_SIZE;
-			}//for_j
-		}//for_i
+	// Setup and fill the compute shader storage buffers containing the particles
+	void prepareStorageBuffers()
+	{
+		std::vector<Particle> particleBuffer = generateInitialParticles();
 
 		compute.ubo.particleCount = numParticles;
 
@@ -222,8 +369,9 @@ public:
 		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 			&stagingBuffer, storageBufferSize, particleBuffer.data());
 
-		// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
-		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		// The SSBO will be used as a storage buffer for the compute pipeline, the graphics pipeline renders the copies in the vertex buffers
+		// Transfer source is required for these copies and for reading back results in validation mode
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &compute.storageBuffer, storageBufferSize);
 
 		// Copy from staging buffer to storage buffer
@@ -246,6 +394,9 @@ public:
 		vulkanDevice->FlushCommandBuffer(copyCmd, queue, true);
 		stagingBuffer.destroy();
 
+		// Two vec4 per cluster, only written and read by compute shaders
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &compute.clusterBuffer, getWorkGroupCount() * 2 * sizeof(glm::vec4));
+
 		// Binding description
 		vertices.bindingDescriptions.resize(1);
 		vertices.bindingDescriptions[0] = vks::initializers::GenVertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, sizeof(Particle), VK_VERTEX_INPUT_RATE_VERTEX);
@@ -266,6 +417,30 @@ public:
 		vertices.inputState.pVertexAttributeDescriptions = vertices.attributeDescriptions.data();
 	}
 
+	// Vertex buffers for the rendered particle states, both start with the initial particles
+	// They are shared by the graphics and compute queue families, so the steps and frames don't need ownership transfers
+	void prepareVertexBuffers()
+	{
+		std::vector<Particle> particleBuffer = generateInitialParticles();
+		const VkDeviceSize vertexBufferSize = particleBuffer.size() * sizeof(Particle);
+
+		vks::Buffer stagingBuffer;
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&stagingBuffer, vertexBufferSize, particleBuffer.data());
+
+		VkCommandBuffer copyCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = vertexBufferSize;
+		for (vks::Buffer& vertexBuffer : graphics.vertexBuffers)
+		{
+			vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&vertexBuffer, vertexBufferSize, asyncCompute.getSharedQueueFamilyIndices());
+			vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, vertexBuffer.buffer, 1, &copyRegion);
+		}
+		vulkanDevice->FlushCommandBuffer(copyCmd, queue, true);
+		stagingBuffer.destroy();
+	}
+
 	void updateComputeUniformBuffers()
 	{
 		compute.ubo.deltaT = paused ? 0.0f : frameTimer * 0.05f;
@@ -391,143 +566,283 @@ public:
 		setupDescriptorSetLayoutAndPipelineLayout();
 		preparePipelines();
 		setupDescriptorSetAndUpdate();
-
-		// Semaphores for compute & graphics sync
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::GenSemaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &graphics.semaphoreGraphicPassComplete));
 	}
 
-	void buildComputeCommandBuffer()
+	// Records a simulation step for each state it can read: the step advances the particles in the storage buffer and copies them
+	// into the vertex buffer of the state it writes, the storage buffer itself stays on the compute queue
+	void buildComputeCommandBuffers()
 	{
 		VkCommandBufferBeginInfo cmdBufferInfo = vks::initializers::GenCommandBufferBeginInfo();
 
-		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufferInfo));
+		for (uint32_t i = 0; i < ASYNC_COMPUTE_STATE_COUNT; i++)
+		{
+			VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffers[i], &cmdBufferInfo));
 
-		// Acquire barrier
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
+			asyncCompute.cmdBeginStep(compute.commandBuffers[i], i);
+
+			recordSimulationStep(compute.commandBuffers[i]);
+
+			VkBufferMemoryBarrier transferBarrier = vks::initializers::GenBufferMemoryBarrier();
+			transferBarrier.buffer = compute.storageBuffer.buffer;
+			transferBarrier.size = compute.storageBuffer.size;
+			transferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			transferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			transferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			transferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			vkCmdPipelineBarrier(compute.commandBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE,
+				0, nullptr, 1, &transferBarrier, 0, nullptr);
+
+			VkBufferCopy copyRegion = {};
+			copyRegion.size = compute.storageBuffer.size;
+			vkCmdCopyBuffer(compute.commandBuffers[i], compute.storageBuffer.buffer, graphics.vertexBuffers[(i + 1) % ASYNC_COMPUTE_STATE_COUNT].buffer, 1, &copyRegion);
+
+			asyncCompute.cmdEndStep(compute.commandBuffers[i], i);
+
+			VK_CHECK_RESULT(vkEndCommandBuffer(compute.commandBuffers[i]));
+		}//for_i
+	}
+
+	// Makes shader writes of the previous compute pass visible to the next one
+	void addComputeToComputeBarrier(VkCommandBuffer commandBuffer)
+	{
+		std::array<VkBufferMemoryBarrier, 2> bufferBarriers;
+		const std::array<vks::Buffer*, 2> buffers = { &compute.storageBuffer, &compute.clusterBuffer };
+		for (size_t i = 0; i < bufferBarriers.size(); i++)
 		{
-			VkBufferMemoryBarrier toCpmputeBufferBarrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,0,VK_ACCESS_SHADER_WRITE_BIT,
-				graphics.queueFamilyIndex,compute.queueFamilyIndex,compute.storageBuffer.buffer,0,compute.storageBuffer.size
-			};
+			bufferBarriers[i] = vks::initializers::GenBufferMemoryBarrier();
+			bufferBarriers[i].buffer = buffers[i]->buffer;
+			bufferBarriers[i].size = buffers[i]->descriptorBufferInfo.range;
+			bufferBarriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			bufferBarriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			// Transfer owernship if compute and graphics queue family indices differ
+			bufferBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		}
 
-			vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
-				0, nullptr, 1, &toCpmputeBufferBarrier, 0, nullptr);
+		// The cluster buffer is only written by the cluster kernel
+		const uint32_t barrierCount = (kernelSettings.kernel == Kernel::Cluster) ? 2 : 1;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_FLAGS_NONE, 0, nullptr, barrierCount, bufferBarriers.data(), 0, nullptr);
+	}
+
+	// Records both compute passes of a single simulation step
+	// Particle counts that are not a multiple of the tile size are covered by a partially filled last work group
+	void recordSimulationStep(VkCommandBuffer commandBuffer)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
+
+		// Cluster kernel: Build center of mass and bounds for each cluster
+		// ------------------------------------------------
+		if (kernelSettings.kernel == Kernel::Cluster)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCluster);
+			vkCmdDispatch(commandBuffer, getWorkGroupCount(), 1, 1);
+			addComputeToComputeBarrier(commandBuffer);
 		}
 
 		// First pass: Calculate particle movement
 		// ------------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
-		vkCmdBindDescriptorSets(compute.commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
+		vkCmdDispatch(commandBuffer, getWorkGroupCount(), 1, 1);
 
 		// Add memory barrier to ensure that the computer shader has finished writing to the buffer
-		VkBufferMemoryBarrier secondComputePassBufferBarrier = vks::initializers::GenBufferMemoryBarrier();
-		secondComputePassBufferBarrier.buffer = compute.storageBuffer.buffer;
-		secondComputePassBufferBarrier.size = compute.storageBuffer.descriptorBufferInfo.range;
-		secondComputePassBufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-		secondComputePassBufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		// Transfer owernship if compute and graphics queue family indices differ
-		secondComputePassBufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		secondComputePassBufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-		vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_FLAGS_NONE, 0, nullptr, 1, &secondComputePassBufferBarrier, 0, nullptr);
+		addComputeToComputeBarrier(commandBuffer);
 
 		// Second pass: Integrate particles
 		// ------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
+		vkCmdDispatch(commandBuffer, getWorkGroupCount(), 1, 1);
+	}
 
-		// Release barrier
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
+	// Runs a fixed number of simulation steps on the GPU and compares the result with the CPU brute force solver
+	// Both sides use single precision but different summation orders, so results are compared against a tolerance
+	// The cluster kernel approximates distant particles and is checked against a looser tolerance
+	bool validateAgainstCpu()
+	{
+		const float deltaT = 0.001f;
+		const uint32_t steps = std::max(cpuReference.steps, 1u);
+		const float tolerance = (kernelSettings.kernel == Kernel::Cluster) ? 1e-2f : 1e-3f;
+
+		compute.ubo.deltaT = deltaT;
+		memcpy(compute.uniformBuffer.mappedData, &compute.ubo, sizeof(compute.ubo));
+
+		vks::Buffer readbackBuffer;
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&readbackBuffer, compute.storageBuffer.size));
+
+		// The storage buffer has been acquired by the compute queue family in prepareCompute
+		VkCommandBuffer commandBuffer = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, compute.commandPool, true);
+
+		for (uint32_t i = 0; i < steps; i++)
 		{
-			VkBufferMemoryBarrier computeToGraphicBufferBarrier =
+			if (i > 0)
 			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,VK_ACCESS_SHADER_WRITE_BIT,0,
-				compute.queueFamilyIndex,graphics.queueFamilyIndex,compute.storageBuffer.buffer,0,compute.storageBuffer.size
-			};
-
-			vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				0, 0, nullptr, 1, &computeToGraphicBufferBarrier, 0, nullptr);
+				addComputeToComputeBarrier(commandBuffer);
+			}
+			recordSimulationStep(commandBuffer);
 		}
 
-		vkEndCommandBuffer(compute.commandBuffer);
-	}
+		VkBufferMemoryBarrier transferBarrier = vks::initializers::GenBufferMemoryBarrier();
+		transferBarrier.buffer = compute.storageBuffer.buffer;
+		transferBarrier.size = compute.storageBuffer.size;
+		transferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		transferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		transferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		transferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE,
+			0, nullptr, 1, &transferBarrier, 0, nullptr);
 
-	void prepareCompute()
-	{
-		// Create a compute capable device queue
-		// The VulkanDevice::createLogicalDevice functions finds a compute capable queue and prefers queue families that only support compute
-		// Depending on the implementation this may result in different queue family indices for graphics and computes,
-		// requiring proper synchronization (see the memory barriers in buildComputeCommandBuffer)
-		vkGetDeviceQueue(device, compute.queueFamilyIndex, 0, &compute.queue);
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = compute.storageBuffer.size;
+		vkCmdCopyBuffer(commandBuffer, compute.storageBuffer.buffer, readbackBuffer.buffer, 1, &copyRegion);
 
-		// Create compute pipeline
-		// Compute pipelines are created separate from graphics pipelines even if they use the same queue (family index)
-		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+		vulkanDevice->FlushCommandBuffer(commandBuffer, compute.queue, compute.commandPool);
+
+		std::vector<Particle> gpuParticles(numParticles);
+		VK_CHECK_RESULT(readbackBuffer.map());
+		memcpy(gpuParticles.data(), readbackBuffer.mappedData, numParticles * sizeof(Particle));
+		readbackBuffer.destroy();
+
+		// Reference solution
+		std::vector<Particle> cpuParticles = generateInitialParticles();
+		nbody::CpuSolver solver(std::max(std::thread::hardware_concurrency(), 1u));
+		solver.params = simulationParams;
+		for (uint32_t i = 0; i < steps; i++)
 		{
-			//Binding 0 : Particle position storage buffer
-			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,0),
-			// Bindging 1:Uniform buffer
-			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,1),
-		};
+			solver.step(cpuParticles, deltaT);
+		}
 
-		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
-		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &compute.descriptorSetLayout));
+		float maxPositionError = 0.0f;
+		float maxVelocityError = 0.0f;
+		uint32_t maxErrorIndex = 0;
+		for (uint32_t i = 0; i < numParticles; i++)
+		{
+			const float positionError = glm::length(glm::vec3(gpuParticles[i].pos - cpuParticles[i].pos)) / std::max(glm::length(glm::vec3(cpuParticles[i].pos)), 1.0f);
+			const float velocityError = glm::length(glm::vec3(gpuParticles[i].vel - cpuParticles[i].vel)) / std::max(glm::length(glm::vec3(cpuParticles[i].vel)), 1.0f);
+			if (positionError > maxPositionError)
+			{
+				maxPositionError = positionError;
+				maxErrorIndex = i;
+			}
+			maxVelocityError = std::max(maxVelocityError, velocityError);
+		}
 
-		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(&compute.descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
+		const bool passed = (maxPositionError <= tolerance) && (maxVelocityError <= tolerance);
+		std::cout << std::scientific << std::setprecision(3);
+		std::cout << "GPU validation " << (passed ? "passed" : "FAILED") << "\n";
+		std::cout << "kernel               : " << ((kernelSettings.kernel == Kernel::Cluster) ? "cluster" : "tiled") << "\n";
+		std::cout << "tile size            : " << kernelSettings.tileSize << "\n";
+		std::cout << "particles            : " << numParticles << "\n";
+		std::cout << "steps                : " << steps << "\n";
+		std::cout << "max position error   : " << maxPositionError << " (particle " << maxErrorIndex << ")" << "\n";
+		std::cout << "max velocity error   : " << maxVelocityError << "\n";
+		std::cout << "tolerance (relative) : " << tolerance << "\n";
+		return passed;
+	}
 
-		VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &compute.descriptorSet));
+	void updateComputeDescriptorSet()
+	{
 		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
 		{
 			// Binding 0: Particle position storage buffer
 			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,0,&compute.storageBuffer.descriptorBufferInfo),
 			// Binding 1: Uniform buffer
 			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1,&compute.uniformBuffer.descriptorBufferInfo),
+			// Binding 2: Cluster storage buffer
+			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,2,&compute.clusterBuffer.descriptorBufferInfo),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
+	}
 
-		// Create pipeline
-		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::GenComputePipelineCreateInfo(compute.pipelineLayout, 0);
+	// (Re)creates the compute pipelines for the selected kernel and tile size
+	void prepareComputePipelines()
+	{
+		vkDestroyPipeline(device, compute.pipelineCalculate, nullptr);
+		vkDestroyPipeline(device, compute.pipelineIntegrate, nullptr);
+		vkDestroyPipeline(device, compute.pipelineCluster, nullptr);
+		compute.pipelineCluster = VK_NULL_HANDLE;
 
-		// 1st pass
-		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_calculate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::GenComputePipelineCreateInfo(compute.pipelineLayout, 0);
 
 		// Set shader parameters via specialization constatnts
+		// Constant 0 is the work group size, which also sets the tile size of the shared memory kernel and the cluster size
 		struct SpecializationData
 		{
-			uint32_t sharedDataSize;
+			uint32_t tileSize;
 			float gravity;
 			float power;
 			float soften;
+			float theta;
 		} specializationData;
 
 		std::vector<VkSpecializationMapEntry> specializationMapEntries;
-		specializationMapEntries.push_back(vks::initializers::GenSpecializationMapEntry(0, offsetof(SpecializationData, sharedDataSize), sizeof(uint32_t)));
+		specializationMapEntries.push_back(vks::initializers::GenSpecializationMapEntry(0, offsetof(SpecializationData, tileSize), sizeof(uint32_t)));
 		specializationMapEntries.push_back(vks::initializers::GenSpecializationMapEntry(1, offsetof(SpecializationData, gravity), sizeof(float)));
 		specializationMapEntries.push_back(vks::initializers::GenSpecializationMapEntry(2, offsetof(SpecializationData, power), sizeof(float)));
 		specializationMapEntries.push_back(vks::initializers::GenSpecializationMapEntry(3, offsetof(SpecializationData, soften), sizeof(float)));
+		specializationMapEntries.push_back(vks::initializers::GenSpecializationMapEntry(4, offsetof(SpecializationData, theta), sizeof(float)));
 
-		specializationData.sharedDataSize = std::min((uint32_t)1024,
-			(uint32_t)(vulkanDevice->properties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)) );
-		specializationData.gravity = 0.002f;
-		specializationData.power = 0.75f;
-		specializationData.soften = 0.05f;
+		specializationData.tileSize = kernelSettings.tileSize;
+		specializationData.gravity = simulationParams.gravity;
+		specializationData.power = simulationParams.power;
+		specializationData.soften = simulationParams.soften;
+		specializationData.theta = kernelSettings.theta;
 
 		VkSpecializationInfo specialzationInfo = vks::initializers::GenSpecializationInfo(specializationMapEntries, sizeof(specializationData), &specializationData);
-		computePipelineCreateInfo.stage.pSpecializationInfo = &specialzationInfo;
 
-		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineCalculate));
+		// 1st pass
+		if (kernelSettings.kernel == Kernel::Cluster)
+		{
+			computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_cluster.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			computePipelineCreateInfo.stage.pSpecializationInfo = &specialzationInfo;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineCluster));
 
+			computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_calculate_cluster.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		}
+		else
+		{
+			computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_calculate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		}
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specialzationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineCalculate));
 
 		// 2nd pass
 		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_integrate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specialzationInfo;
 		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineIntegrate));
+	}
 
+	void prepareCompute()
+	{
+		// Compute queue selected by the async compute scheduler
+		// The VulkanDevice::createLogicalDevice functions finds a compute capable queue and prefers queue families that only support compute
+		// Depending on the implementation this may result in different queue family indices for graphics and computes,
+		// the storage buffer is then transferred to the compute queue family once (see below)
+		compute.queue = asyncCompute.getQueue();
+
+		// Create compute pipeline
+		// Compute pipelines are created separate from graphics pipelines even if they use the same queue (family index)
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+		{
+			//Binding 0 : Particle position storage buffer
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,0),
+			// Bindging 1:Uniform buffer
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,1),
+			// Binding 2: Cluster storage buffer
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,2),
+		};
+
+		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &compute.descriptorSetLayout));
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(&compute.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
+
+		VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &compute.descriptorSet));
+		updateComputeDescriptorSet();
+
+		prepareComputePipelines();
 
 		// Separate command pool as queue family for compute may be different than graphics
 		VkCommandPoolCreateInfo cmdPoolInfo = {};
@@ -536,26 +851,13 @@ public:
 		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
 
-		// Create a command buffer for compute operations
-		compute.commandBuffer = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, compute.commandPool);
-
-		// Semaphore for compute & graphics sync
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::GenSemaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphoreComputeComplete));
-
-		// Signal the semaphoreComputeComplete
-		VkSubmitInfo submitInfo = vks::initializers::GenSubmitInfo();
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &compute.semaphoreComputeComplete;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
-
-		// Build a single command buffer containing the compute dispatch commands
-		buildComputeCommandBuffer();
+		// Create a command buffer for each state a simulation step reads
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::GenCommandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, ASYNC_COMPUTE_STATE_COUNT);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, compute.commandBuffers.data()));
 
 		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
 		{
-			// Create a transient command buffer for setting up the initial buffer transfer state
+			// Create a transient command buffer for acquiring the uploaded storage buffer, it is only used by the compute queue from here on
 			VkCommandBuffer transferCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, compute.commandPool, true);
 
 			VkBufferMemoryBarrier acquireBufferBarrier =
@@ -566,19 +868,105 @@ public:
 			vkCmdPipelineBarrier(transferCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
 				0, nullptr, 1, &acquireBufferBarrier, 0, nullptr);
 
-			VkBufferMemoryBarrier releaseBufferBarrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,VK_ACCESS_SHADER_WRITE_BIT,0,
-				compute.queueFamilyIndex,graphics.queueFamilyIndex,compute.storageBuffer.buffer,0,compute.storageBuffer.size
-			};
-			vkCmdPipelineBarrier(transferCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
-				0, nullptr, 1, &releaseBufferBarrier, 0, nullptr);
-
 			vulkanDevice->FlushCommandBuffer(transferCmd, compute.queue, compute.commandPool);
 		}//if
 	}
 
+	// Measures compute only simulation steps for every combination of particle count, kernel and tile size
+	void runSweep()
+	{
+		std::vector<uint32_t> tileSizes;
+		for (uint32_t tileSize = 64; tileSize <= kernelSettings.maxTileSize; tileSize *= 2)
+		{
+			tileSizes.push_back(tileSize);
+		}
+		std::vector<Kernel> kernels = { Kernel::Tiled };
+		if (usesGlslShaders())
+		{
+			kernels.push_back(Kernel::Cluster);
+		}
+
+		VkCommandBuffer sweepCmdBuffer = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, compute.commandPool);
+		VkSubmitInfo sweepSubmitInfo = vks::initializers::GenSubmitInfo();
+		sweepSubmitInfo.commandBufferCount = 1;
+		sweepSubmitInfo.pCommandBuffers = &sweepCmdBuffer;
+
+		benchmark.sweepHeader = "kernel,tile size,particles";
+		for (uint32_t particleCount : sweep.particleCounts)
+		{
+			for (Kernel kernel : kernels)
+			{
+				for (uint32_t tileSize : tileSizes)
+				{
+					VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+
+					numParticles = particleCount;
+					kernelSettings.kernel = kernel;
+					kernelSettings.tileSize = tileSize;
+
+					compute.storageBuffer.destroy();
+					compute.clusterBuffer.destroy();
+					prepareStorageBuffers();
+					updateComputeDescriptorSet();
+					prepareComputePipelines();
+
+					compute.ubo.deltaT = 0.001f;
+					memcpy(compute.uniformBuffer.mappedData, &compute.ubo, sizeof(compute.ubo));
+
+					// The upload released the new storage buffer to the compute queue family
+					if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
+					{
+						VkCommandBuffer transferCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, compute.commandPool, true);
+						VkBufferMemoryBarrier acquireBufferBarrier =
+						{
+							VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,0,VK_ACCESS_SHADER_WRITE_BIT,
+							graphics.queueFamilyIndex,compute.queueFamilyIndex,compute.storageBuffer.buffer,0,compute.storageBuffer.size
+						};
+						vkCmdPipelineBarrier(transferCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+							0, nullptr, 1, &acquireBufferBarrier, 0, nullptr);
+						vulkanDevice->FlushCommandBuffer(transferCmd, compute.queue, compute.commandPool);
+					}
+
+					VkCommandBufferBeginInfo cmdBufferInfo = vks::initializers::GenCommandBufferBeginInfo();
+					VK_CHECK_RESULT(vkBeginCommandBuffer(sweepCmdBuffer, &cmdBufferInfo));
+					// Previous step has to be finished before the next one reads the positions
+					addComputeToComputeBarrier(sweepCmdBuffer);
+					recordSimulationStep(sweepCmdBuffer);
+					VK_CHECK_RESULT(vkEndCommandBuffer(sweepCmdBuffer));
+
+					const char* kernelName = (kernel == Kernel::Cluster) ? "cluster" : "tiled";
+					std::stringstream phasePrefix;
+					phasePrefix << kernelName << " tile size " << tileSize << " particles " << particleCount << " ";
+					benchmark.reset();
+					benchmark.phasePrefix = phasePrefix.str();
+					benchmark.run([=] {
+						VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &sweepSubmitInfo, VK_NULL_HANDLE));
+						VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+					}, vulkanDevice->properties);
+
+					std::stringstream parameters;
+					parameters << kernelName << "," << tileSize << "," << particleCount;
+					benchmark.addSweepResult(parameters.str());
+					std::cout << parameters.str() << " : " << benchmark.runtime / std::max(benchmark.frameCount, 1u) << " ms/step" << "\n";
+				}//for_tileSize
+			}//for_kernel
+		}//for_particleCount
+		benchmark.phasePrefix.clear();
+		vkFreeCommandBuffers(device, compute.commandPool, 1, &sweepCmdBuffer);
+
+		benchmark.saveSweepResults(benchmark.filename.empty() ? "computenbody_sweep.csv" : benchmark.filename);
+	}
+
 	void buildCommandBuffersForPreRenderPrmitives()
+	{
+		for (int32_t i = 0; i < drawCmdBuffers.size(); i++)
+		{
+			buildCommandBuffer(i);
+		}
+	}
+
+	// Draws the particle state of the current frame, re-recorded every frame as the rendered vertex buffer alternates
+	void buildCommandBuffer(uint32_t i)
 	{
 		VkCommandBufferBeginInfo cmdBufBeginInfo = vks::initializers::GenCommandBufferBeginInfo();
 
@@ -595,111 +983,90 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); i++)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		// Set target frame buffer
+		renderPassBeginInfo.framebuffer = frameBuffers[i];
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufBeginInfo));
+		const uint32_t state = asyncCompute.getReadState();
 
-			// Acquire barrier
-			if (graphics.queueFamilyIndex!=compute.queueFamilyIndex)
-			{
-				VkBufferMemoryBarrier bufferBarrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,0,VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-					compute.queueFamilyIndex,graphics.queueFamilyIndex,compute.storageBuffer.buffer,0,compute.storageBuffer.size
-				};
-				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
-					0, nullptr, 1, &bufferBarrier, 0, nullptr);
-			}//if
+		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufBeginInfo));
 
-			// Draw the particle system using the update vertex buffer
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		asyncCompute.cmdBeginFrame(drawCmdBuffers[i], state);
 
-			VkViewport viewport = vks::initializers::GenViewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		// Draw the particle system using the update vertex buffer
+		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkViewport viewport = vks::initializers::GenViewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, nullptr);
+		VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
+		vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &compute.storageBuffer.buffer, offsets);
-			vkCmdDraw(drawCmdBuffers[i], numParticles, 1, 0, 0);
+		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
+		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, nullptr);
 
-			drawUI(drawCmdBuffers[i]);
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &graphics.vertexBuffers[state].buffer, offsets);
+		vkCmdDraw(drawCmdBuffers[i], numParticles, 1, 0, 0);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		drawUI(drawCmdBuffers[i]);
 
-			// Release barrier
-			if (graphics.queueFamilyIndex!=compute.queueFamilyIndex)
-			{
-				VkBufferMemoryBarrier bufferBarrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,0,
-					graphics.queueFamilyIndex,compute.queueFamilyIndex,compute.storageBuffer.buffer,0,compute.storageBuffer.size
-				};
+		vkCmdEndRenderPass(drawCmdBuffers[i]);
 
-				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
-					0, nullptr, 1, &bufferBarrier, 0, nullptr);
-			}//if
+		asyncCompute.cmdEndFrame(drawCmdBuffers[i], state);
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-		}//for
+		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 	}
 
 	void prepareForRendering() override
 	{
 		VulkanExampleBase::prepareForRendering();
 
-		// We will be using the queue family indices to check if graphics and compute queue families differ
-		// If that's the case,we need additional barriers for aquiring and releasing resources
+		// Simulation steps run on a dedicated compute queue if the device has one (and supports timeline semaphores), otherwise on the graphics queue
+		asyncCompute.prepare(vulkanDevice, queue);
 		graphics.queueFamilyIndex = vulkanDevice->queueFamilyIndices.graphicIndex;
-		compute.queueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
+		compute.queueFamilyIndex = asyncCompute.getQueueFamilyIndex();
+		selectTileSize();
 		loadAssets();
 		setupDescriptorPool();
 		prepareGraphics();
 		prepareCompute();
+		if (cpuReference.validate)
+		{
+			const bool passed = validateAgainstCpu();
+			vkDeviceWaitIdle(device);
+			exit(passed ? 0 : 1);
+		}
+		if (sweep.enabled)
+		{
+			runSweep();
+			vkDeviceWaitIdle(device);
+			exit(0);
+		}
+		prepareVertexBuffers();
+		buildComputeCommandBuffers();
 		buildCommandBuffersForPreRenderPrmitives();
 		prepared = true;
 	}
 
+	// Step N runs on the compute queue while frame N renders the result of step N - 1
 	void draw()
 	{
+		// The previous step is done, so its uniform buffer can be updated for this one
+		asyncCompute.beginStep();
+		updateComputeUniformBuffers();
+		asyncCompute.submitStep(compute.commandBuffers[asyncCompute.getReadState()]);
+
 		VulkanExampleBase::prepareFrame();
 
-		VkPipelineStageFlags graphicsWaitStageMasks[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		VkSemaphore graphicsWaitSemaphores[] = { compute.semaphoreComputeComplete,semaphores.presentComplete };
-		VkSemaphore graphicsSignalSemaphores[] = { graphics.semaphoreGraphicPassComplete, semaphores.renderComplete };
+		buildCommandBuffer(currentCmdBufferIndex);
 
 		// Submit graphics commands
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentCmdBufferIndex];
-		submitInfo.waitSemaphoreCount = 2;
-		submitInfo.pWaitSemaphores = graphicsWaitSemaphores;
-		submitInfo.pWaitDstStageMask = graphicsWaitStageMasks;
-		submitInfo.signalSemaphoreCount = 2;
-		submitInfo.pSignalSemaphores = graphicsSignalSemaphores;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		asyncCompute.submitFrame(submitInfo);
+		asyncCompute.endFrame();
 
 		VulkanExampleBase::submitFrame();
-
-		//Wait for rendering finished
-		VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-
-		// Submit compute commands
-		VkSubmitInfo computeSubmitInfo = vks::initializers::GenSubmitInfo();
-		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
-		computeSubmitInfo.waitSemaphoreCount = 1;
-		computeSubmitInfo.pWaitSemaphores = &graphics.semaphoreGraphicPassComplete;
-		computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
-		computeSubmitInfo.signalSemaphoreCount = 1;
-		computeSubmitInfo.pSignalSemaphores = &compute.semaphoreComputeComplete;
-		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
 	}
 
 	virtual void render() override
@@ -710,8 +1077,6 @@ public:
 		}
 		draw();
 
-		//һ֡߼
-		updateComputeUniformBuffers();
 		if (camera.updated)
 		{
 			updateGraphicsUniformBuffers();
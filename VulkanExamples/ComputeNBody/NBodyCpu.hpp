@@ -0,0 +1,563 @@
+/*
+* CPU reference N-body solver for the compute shader N-body example
+*
+* Uses the same particle layout, initial distribution and force model as particle_calculate.comp and particle_integrate.comp
+* Forces can be evaluated either brute force (all pairs, SSE where available) or with a Barnes-Hut octree
+* Both methods are distributed across a thread pool
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define NBODY_CPU_SSE
+#endif
+
+namespace nbody
+{
+	// SSBO particle declaration, must match the layout used by the compute shaders
+	struct Particle
+	{
+		glm::vec4 pos; // xyz = position, w = mass
+		glm::vec4 vel; // xyz = velocity, w = gradient texture position
+	};
+
+	// Force model parameters, passed to the compute shaders as specialization constants
+	struct SimulationParameters
+	{
+		float gravity = 0.002f;
+		float power = 0.75f;
+		float soften = 0.05f;
+	};
+
+	// Generates the initial particle distribution, particles are split evenly across a fixed set of attractors
+	// The first particle of each attractor group is a heavy center of gravity
+	inline std::vector<Particle> generateParticles(uint32_t particleCount, unsigned seed)
+	{
+		const std::vector<glm::vec3> attractors = {
+			glm::vec3(5.0f, 0.0f, 0.0f),
+			glm::vec3(-5.0f, 0.0f, 0.0f),
+			glm::vec3(0.0f, 0.0f, 5.0f),
+			glm::vec3(0.0f, 0.0f, -5.0f),
+			glm::vec3(0.0f, 4.0f, 0.0f),
+			glm::vec3(0.0f, -8.0f, 0.0f),
+		};
+		const uint32_t attractorCount = static_cast<uint32_t>(attractors.size());
+		const uint32_t particlesPerAttractor = (particleCount + attractorCount - 1) / attractorCount;
+
+		std::vector<Particle> particles(particleCount);
+
+		std::default_random_engine randEngine(seed);
+		std::normal_distribution<float> randomDist(0.0f, 1.0f);
+
+		for (uint32_t index = 0; index < particleCount; index++)
+		{
+			const uint32_t i = index / particlesPerAttractor;
+			const uint32_t j = index % particlesPerAttractor;
+			Particle &particle = particles[index];
+
+			if (j == 0)
+			{
+				particle.pos = glm::vec4(attractors[i] * 1.5f, 90000.0f);
+				particle.vel = glm::vec4(0.0f);
+			}
+			else
+			{
+				// Position
+				glm::vec3 position(attractors[i] + glm::vec3(randomDist(randEngine), randomDist(randEngine), randomDist(randEngine)) * 0.75f);
+				float len = glm::length(glm::normalize(position - attractors[i]));
+				position.y *= 2.0f - (len * len);
+
+				// Velocity
+				glm::vec3 angular = glm::vec3(0.5f, 1.5f, 0.5f) * (((i % 2) == 0) ? 1.0f : -1.0f);
+				glm::vec3 velocity = glm::cross((position - attractors[i]), angular) + glm::vec3(randomDist(randEngine), randomDist(randEngine), randomDist(randEngine) * 0.025f);
+
+				float mass = (randomDist(randEngine) * 0.5f + 0.5f) * 75.0f;
+				particle.pos = glm::vec4(position, mass);
+				particle.vel = glm::vec4(velocity, 0.0f);
+			}
+
+			// Color gradient offset
+			particle.vel.w = (float)i * 1.0f / attractorCount;
+		}
+
+		return particles;
+	}
+
+	// Spreads the lower 10 bits of a value so that there are two zero bits between each bit
+	inline uint32_t expandMortonBits(uint32_t v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	// Reorders particles along a Morton curve so that neighbouring indices are also close in space
+	// Used by the cluster kernel, which groups consecutive particles into clusters
+	inline void sortParticlesSpatially(std::vector<Particle>& particles)
+	{
+		if (particles.empty())
+		{
+			return;
+		}
+
+		glm::vec3 minBounds(std::numeric_limits<float>::max());
+		glm::vec3 maxBounds(-std::numeric_limits<float>::max());
+		for (const Particle& particle : particles)
+		{
+			minBounds = glm::min(minBounds, glm::vec3(particle.pos));
+			maxBounds = glm::max(maxBounds, glm::vec3(particle.pos));
+		}
+		const glm::vec3 scale = 1023.0f / glm::max(maxBounds - minBounds, glm::vec3(1e-6f));
+
+		std::vector<std::pair<uint32_t, uint32_t>> keys(particles.size());
+		for (size_t i = 0; i < particles.size(); i++)
+		{
+			const glm::uvec3 cell = glm::uvec3((glm::vec3(particles[i].pos) - minBounds) * scale);
+			keys[i] = { expandMortonBits(cell.x) | (expandMortonBits(cell.y) << 1) | (expandMortonBits(cell.z) << 2), static_cast<uint32_t>(i) };
+		}
+		std::sort(keys.begin(), keys.end());
+
+		std::vector<Particle> sorted(particles.size());
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			sorted[i] = particles[keys[i].second];
+		}
+		particles.swap(sorted);
+	}
+
+	class CpuSolver
+	{
+	public:
+		enum class Method { BruteForce, BarnesHut };
+
+		SimulationParameters params;
+		Method method = Method::BruteForce;
+		// Barnes-Hut opening angle, a cell is approximated by its center of mass if size / distance < theta
+		float theta = 0.5f;
+
+		// Number of particle pair (or particle cell) interactions evaluated by the last step
+		uint64_t interactionCount = 0;
+
+		explicit CpuSolver(uint32_t threadCount)
+		{
+			this->threadCount = std::max(threadCount, 1u);
+			threadPool.setThreadCount(this->threadCount);
+		}
+
+		// Advances the simulation by one step, same as dispatching the calculate and integrate passes
+		void step(std::vector<Particle>& particles, float deltaT)
+		{
+			const uint32_t count = static_cast<uint32_t>(particles.size());
+			prepareSoA(particles);
+			accelerations.resize(count);
+			potentials.resize(count);
+			if (method == Method::BarnesHut)
+			{
+				buildOctree(count);
+			}
+
+			evaluate(count, false);
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				Particle& particle = particles[i];
+				particle.vel.x += deltaT * accelerations[i].x;
+				particle.vel.y += deltaT * accelerations[i].y;
+				particle.vel.z += deltaT * accelerations[i].z;
+
+				// Gradient texture position
+				particle.vel.w += 0.1f * deltaT;
+				if (particle.vel.w > 1.0f)
+				{
+					particle.vel.w -= 1.0f;
+				}
+
+				// The integrate shader advances the full vec4, so w (mass) is also offset by the gradient position
+				particle.pos += deltaT * particle.vel;
+			}
+		}
+
+		// Total energy of the system (kinetic + potential of the softened force model)
+		// Potential energy is exact for brute force and approximated by the octree for Barnes-Hut
+		double computeEnergy(const std::vector<Particle>& particles)
+		{
+			const uint32_t count = static_cast<uint32_t>(particles.size());
+			prepareSoA(particles);
+			accelerations.resize(count);
+			potentials.resize(count);
+			if (method == Method::BarnesHut)
+			{
+				buildOctree(count);
+			}
+
+			evaluate(count, true);
+
+			double kinetic = 0.0;
+			double potential = 0.0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const glm::vec3 vel = glm::vec3(particles[i].vel);
+				kinetic += 0.5 * particles[i].pos.w * glm::dot(vel, vel);
+				// Every pair is visited from both sides
+				potential += 0.5 * particles[i].pos.w * potentials[i];
+			}
+			return kinetic + potential;
+		}
+
+	private:
+		// Deepest octree level, cells below this size keep all of their particles in a single leaf
+		static const uint32_t maxOctreeDepth = 32;
+		// Max. number of particles stored in an octree leaf
+		static const uint32_t maxLeafSize = 8;
+
+		struct OctreeNode
+		{
+			glm::vec3 center;
+			float halfSize;
+			// Aggregated mass and center of mass of all particles in this cell
+			glm::vec3 massCenter;
+			float mass;
+			// Range in the sorted particle index list
+			uint32_t begin;
+			uint32_t end;
+			std::array<int32_t, 8> children;
+			bool leaf;
+		};
+
+		vks::ThreadPool threadPool;
+		uint32_t threadCount;
+
+		// Positions and masses in SoA layout, padded to a multiple of four with massless particles
+		std::vector<float> posX, posY, posZ, mass;
+		std::vector<glm::vec3> accelerations;
+		// Potential per unit mass, only calculated for energy evaluation
+		std::vector<double> potentials;
+		std::vector<uint64_t> threadInteractionCounts;
+
+		std::vector<OctreeNode> nodes;
+		std::vector<uint32_t> octreeIndices;
+
+		void prepareSoA(const std::vector<Particle>& particles)
+		{
+			const size_t count = particles.size();
+			const size_t paddedCount = (count + 3) & ~size_t(3);
+			posX.assign(paddedCount, 0.0f);
+			posY.assign(paddedCount, 0.0f);
+			posZ.assign(paddedCount, 0.0f);
+			mass.assign(paddedCount, 0.0f);
+			for (size_t i = 0; i < count; i++)
+			{
+				posX[i] = particles[i].pos.x;
+				posY[i] = particles[i].pos.y;
+				posZ[i] = particles[i].pos.z;
+				mass[i] = particles[i].pos.w;
+			}
+		}
+
+		// G / (r^2 + soften)^power, avoids pow for the default exponent
+		float forceFactor(float distanceSquared) const
+		{
+			const float d = distanceSquared + params.soften;
+			if (params.power == 0.75f)
+			{
+				const float sqrtD = std::sqrt(d);
+				return params.gravity / (sqrtD * std::sqrt(sqrtD));
+			}
+			return params.gravity / std::pow(d, params.power);
+		}
+
+		// Potential per unit mass of the force model G * m * r / (r^2 + soften)^power
+		double pairPotential(float otherMass, float distanceSquared) const
+		{
+			const double d = (double)distanceSquared + params.soften;
+			if (params.power == 1.0f)
+			{
+				return params.gravity * otherMass * 0.5 * std::log(d);
+			}
+			return params.gravity * otherMass * std::pow(d, 1.0 - params.power) / (2.0 * (1.0 - params.power));
+		}
+
+		// Evaluates accelerations (or potentials) for all particles, split across the thread pool
+		void evaluate(uint32_t count, bool energy)
+		{
+			threadInteractionCounts.assign(threadCount, 0);
+			const uint32_t chunkSize = (count + threadCount - 1) / threadCount;
+			for (uint32_t t = 0; t < threadCount; t++)
+			{
+				const uint32_t first = std::min(t * chunkSize, count);
+				const uint32_t last = std::min(first + chunkSize, count);
+				threadPool.threads[t]->addJob([=] {
+					uint64_t interactions = 0;
+					for (uint32_t i = first; i < last; i++)
+					{
+						if (method == Method::BarnesHut)
+						{
+							interactions += evaluateOctree(i, energy);
+						}
+						else
+						{
+							interactions += energy ? evaluatePotentialBruteForce(i, count) : evaluateBruteForce(i, count);
+						}
+					}
+					threadInteractionCounts[t] = interactions;
+				});
+			}
+			threadPool.wait();
+
+			interactionCount = 0;
+			for (uint64_t interactions : threadInteractionCounts)
+			{
+				interactionCount += interactions;
+			}
+		}
+
+		uint64_t evaluateBruteForce(uint32_t i, uint32_t count)
+		{
+			const size_t paddedCount = posX.size();
+			float ax = 0.0f, ay = 0.0f, az = 0.0f;
+			size_t j = 0;
+#if defined(NBODY_CPU_SSE)
+			// x^-0.75 = 1 / (sqrt(x) * sqrt(sqrt(x))), other exponents use the scalar path
+			if (params.power == 0.75f)
+			{
+				const __m128 px = _mm_set1_ps(posX[i]);
+				const __m128 py = _mm_set1_ps(posY[i]);
+				const __m128 pz = _mm_set1_ps(posZ[i]);
+				const __m128 soften = _mm_set1_ps(params.soften);
+				const __m128 gravity = _mm_set1_ps(params.gravity);
+				__m128 sumX = _mm_setzero_ps();
+				__m128 sumY = _mm_setzero_ps();
+				__m128 sumZ = _mm_setzero_ps();
+				for (; j < paddedCount; j += 4)
+				{
+					const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&posX[j]), px);
+					const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&posY[j]), py);
+					const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&posZ[j]), pz);
+					const __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)), soften);
+					const __m128 sqrtD = _mm_sqrt_ps(d);
+					const __m128 f = _mm_div_ps(_mm_mul_ps(gravity, _mm_loadu_ps(&mass[j])), _mm_mul_ps(sqrtD, _mm_sqrt_ps(sqrtD)));
+					sumX = _mm_add_ps(sumX, _mm_mul_ps(dx, f));
+					sumY = _mm_add_ps(sumY, _mm_mul_ps(dy, f));
+					sumZ = _mm_add_ps(sumZ, _mm_mul_ps(dz, f));
+				}
+				alignas(16) float lanes[4];
+				_mm_store_ps(lanes, sumX);
+				ax = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+				_mm_store_ps(lanes, sumY);
+				ay = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+				_mm_store_ps(lanes, sumZ);
+				az = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+			}
+#endif
+			for (; j < paddedCount; j++)
+			{
+				const float dx = posX[j] - posX[i];
+				const float dy = posY[j] - posY[i];
+				const float dz = posZ[j] - posZ[i];
+				const float f = mass[j] * forceFactor(dx * dx + dy * dy + dz * dz);
+				ax += dx * f;
+				ay += dy * f;
+				az += dz * f;
+			}
+			accelerations[i] = glm::vec3(ax, ay, az);
+			return count;
+		}
+
+		uint64_t evaluatePotentialBruteForce(uint32_t i, uint32_t count)
+		{
+			double potential = 0.0;
+			for (uint32_t j = 0; j < count; j++)
+			{
+				if (j == i)
+				{
+					continue;
+				}
+				const float dx = posX[j] - posX[i];
+				const float dy = posY[j] - posY[i];
+				const float dz = posZ[j] - posZ[i];
+				potential += pairPotential(mass[j], dx * dx + dy * dy + dz * dz);
+			}
+			potentials[i] = potential;
+			return count;
+		}
+
+		void buildOctree(uint32_t count)
+		{
+			glm::vec3 minBounds(std::numeric_limits<float>::max());
+			glm::vec3 maxBounds(-std::numeric_limits<float>::max());
+			for (uint32_t i = 0; i < count; i++)
+			{
+				minBounds = glm::min(minBounds, glm::vec3(posX[i], posY[i], posZ[i]));
+				maxBounds = glm::max(maxBounds, glm::vec3(posX[i], posY[i], posZ[i]));
+			}
+			const glm::vec3 extent = maxBounds - minBounds;
+
+			octreeIndices.resize(count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				octreeIndices[i] = i;
+			}
+
+			nodes.clear();
+			nodes.reserve(count / 2 + 1);
+			buildOctreeNode((minBounds + maxBounds) * 0.5f, std::max(std::max(extent.x, extent.y), extent.z) * 0.5f + 1e-4f, 0, count, 0);
+		}
+
+		// Builds the cell covering octreeIndices[begin, end) and returns its node index
+		int32_t buildOctreeNode(glm::vec3 center, float halfSize, uint32_t begin, uint32_t end, uint32_t depth)
+		{
+			const int32_t nodeIndex = static_cast<int32_t>(nodes.size());
+			nodes.push_back({});
+			OctreeNode node{};
+			node.center = center;
+			node.halfSize = halfSize;
+			node.begin = begin;
+			node.end = end;
+			node.children.fill(-1);
+			node.leaf = (end - begin <= maxLeafSize) || (depth >= maxOctreeDepth);
+
+			if (!node.leaf)
+			{
+				// Counting sort of the particles into the eight octants
+				std::array<uint32_t, 9> octantOffsets = {};
+				std::vector<uint8_t> octants(end - begin);
+				for (uint32_t k = begin; k < end; k++)
+				{
+					const uint32_t p = octreeIndices[k];
+					const uint8_t octant = (posX[p] >= center.x ? 1 : 0) | (posY[p] >= center.y ? 2 : 0) | (posZ[p] >= center.z ? 4 : 0);
+					octants[k - begin] = octant;
+					octantOffsets[octant + 1]++;
+				}
+				for (uint32_t o = 0; o < 8; o++)
+				{
+					octantOffsets[o + 1] += octantOffsets[o];
+				}
+				std::vector<uint32_t> sorted(end - begin);
+				std::array<uint32_t, 8> writePos;
+				std::copy(octantOffsets.begin(), octantOffsets.begin() + 8, writePos.begin());
+				for (uint32_t k = begin; k < end; k++)
+				{
+					sorted[writePos[octants[k - begin]]++] = octreeIndices[k];
+				}
+				std::copy(sorted.begin(), sorted.end(), octreeIndices.begin() + begin);
+
+				for (uint32_t o = 0; o < 8; o++)
+				{
+					if (octantOffsets[o + 1] == octantOffsets[o])
+					{
+						continue;
+					}
+					const float childHalfSize = halfSize * 0.5f;
+					const glm::vec3 childCenter = center + glm::vec3((o & 1) ? childHalfSize : -childHalfSize, (o & 2) ? childHalfSize : -childHalfSize, (o & 4) ? childHalfSize : -childHalfSize);
+					node.children[o] = buildOctreeNode(childCenter, childHalfSize, begin + octantOffsets[o], begin + octantOffsets[o + 1], depth + 1);
+				}
+			}
+
+			// Aggregate mass, the center of mass is weighted by absolute mass as the random distribution also yields negative masses
+			double totalMass = 0.0;
+			double weight = 0.0;
+			glm::dvec3 weightedCenter(0.0);
+			for (uint32_t k = begin; k < end; k++)
+			{
+				const uint32_t p = octreeIndices[k];
+				totalMass += mass[p];
+				weight += std::abs(mass[p]);
+				weightedCenter += glm::dvec3(posX[p], posY[p], posZ[p]) * (double)std::abs(mass[p]);
+			}
+			node.mass = (float)totalMass;
+			node.massCenter = (weight > 0.0) ? glm::vec3(weightedCenter / weight) : center;
+
+			nodes[nodeIndex] = node;
+			return nodeIndex;
+		}
+
+		uint64_t evaluateOctree(uint32_t i, bool energy)
+		{
+			const glm::vec3 position(posX[i], posY[i], posZ[i]);
+			glm::vec3 acceleration(0.0f);
+			double potential = 0.0;
+			uint64_t interactions = 0;
+			const float thetaSquared = theta * theta;
+
+			std::array<int32_t, maxOctreeDepth * 7 + 8> stack;
+			uint32_t stackSize = 0;
+			stack[stackSize++] = 0;
+
+			while (stackSize > 0)
+			{
+				const OctreeNode& node = nodes[stack[--stackSize]];
+				const glm::vec3 len = node.massCenter - position;
+				const float distanceSquared = glm::dot(len, len);
+				const float size = node.halfSize * 2.0f;
+
+				if (node.leaf)
+				{
+					for (uint32_t k = node.begin; k < node.end; k++)
+					{
+						const uint32_t p = octreeIndices[k];
+						const glm::vec3 d = glm::vec3(posX[p], posY[p], posZ[p]) - position;
+						const float d2 = glm::dot(d, d);
+						if (energy)
+						{
+							potential += (p != i) ? pairPotential(mass[p], d2) : 0.0;
+						}
+						else
+						{
+							acceleration += d * (mass[p] * forceFactor(d2));
+						}
+					}
+					interactions += node.end - node.begin;
+				}
+				else if (size * size < thetaSquared * distanceSquared)
+				{
+					// Far enough away to treat the whole cell as a single body
+					if (energy)
+					{
+						potential += pairPotential(node.mass, distanceSquared);
+					}
+					else
+					{
+						acceleration += len * (node.mass * forceFactor(distanceSquared));
+					}
+					interactions++;
+				}
+				else
+				{
+					for (int32_t child : node.children)
+					{
+						if (child >= 0)
+						{
+							stack[stackSize++] = child;
+						}
+					}
+				}
+			}
+
+			if (energy)
+			{
+				potentials[i] = potential;
+			}
+			else
+			{
+				accelerations[i] = acceleration;
+			}
+			return interactions;
+		}
+	};
+}
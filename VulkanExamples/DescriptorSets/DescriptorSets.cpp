@@ -56,7 +56,7 @@ public:
 	{
 		vkDestroyPipeline(device, pipeline, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+		// The set layout, the pools and the sets belong to the descriptor allocator of the base
 		for (auto cube:cubes)
 		{
 			cube.uniformBuffer.destroy();
@@ -149,7 +149,7 @@ public:
 			layout (set = 0,binding =1) uniform sampler2D ..;
 		*/
 
-		std::array<VkDescriptorSetLayoutBinding, 2> setLayoutBindings{};
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings(2);
 
 		/*
 		Binding 0: Uniform buffers(used to pass matrices)
@@ -171,89 +171,43 @@ public:
 		setLayoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 		setLayoutBindings[1].descriptorCount = 1;
 
-		// Create the descriptor set layout
-		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-		descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-		descriptorLayoutCI.pBindings = setLayoutBindings.data();
-
-		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &descriptorSetLayout));
+		// Get the descriptor set layout, the allocator creates it on first use and returns the cached one for the same bindings
+		descriptorSetLayout = descriptorAllocator.getLayout(setLayoutBindings);
 
 		/*
 			Descriptor Pool
 			Actual descriptors are allocated from a descriptor pool telling the driver what types and how many descriptors this application will use
 
-			An application can have multiple pools (e.g. for multiple threads) with any number of descriptor types as long as device limits are not supported
-
-			it's good pratices to allocate pools with actually required descriptor types and counts
+			The descriptor allocator of the base creates its pools on demand: the first pool holds DESCRIPTOR_POOL_INITIAL_SETS sets sized by the layout,
+			each further pool twice as many, so the number of objects doesn't have to be known up front
 
 		*/
-		std::array<VkDescriptorPoolSize, 2> descriptorPoolSize{};
-
-		// Uniform buffers: 1 for scene and 1 per object (scene and local matrices)
-		descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorPoolSize[0].descriptorCount = 1 + static_cast<uint32_t>(cubes.size());
-
-		// Combined image samples:1 per mesh texture
-		descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorPoolSize[1].descriptorCount = static_cast<uint32_t>(cubes.size());
-
-		// Create the global descriptor pool
-		VkDescriptorPoolCreateInfo descriptorPoolCI = {};
-		descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(descriptorPoolSize.size());
-		descriptorPoolCI.pPoolSizes = descriptorPoolSize.data();
-		// Max. number of descriptor sets that can be allocated from this pool (one per object)
-		descriptorPoolCI.maxSets = static_cast<uint32_t>(cubes.size());
-
-		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorPool));
 
 		/*
 		 Descriptor sets
-		 Using the shared descriptor set layout and descriptor pool we will now allocate the descriptor sets
+		 Using the shared descriptor set layout we will now allocate the descriptor sets
 		 Descriptor sets contain the actual descriptor for the objects(buffers,images) used at render time.
 		*/
 		for (auto &cube:cubes )
 		{
-			// Allocates an empty descriptor set without actual descriptors from the pool using the set layout
-			VkDescriptorSetAllocateInfo allocateInfo{};
-			allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-			allocateInfo.descriptorPool = descriptorPool;
-			allocateInfo.descriptorSetCount = 1;
-			allocateInfo.pSetLayouts = &descriptorSetLayout;
-			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocateInfo, &cube.descriptorSet));
-
-			// Allocate an empty descriptor set without actual descriptors matching shader binding set in the layout
-			std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+			// Allocates an empty descriptor set without actual descriptors using the set layout
+			cube.descriptorSet = descriptorAllocator.allocate(descriptorSetLayout);
 
 			/*
 			Binding 0: Object matrices Uniform buffer
 			*/
-			writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeDescriptorSets[0].dstSet = cube.descriptorSet;
-			writeDescriptorSets[0].dstBinding = 0;
-			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			writeDescriptorSets[0].pBufferInfo = &cube.uniformBuffer.descriptorBufferInfo;
-			writeDescriptorSets[0].descriptorCount = 1;
+			descriptorAllocator.write(cube.descriptorSet, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, cube.uniformBuffer.descriptorBufferInfo);
 
 			/*
 			Binding 1:Object texture
 			*/
-			writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeDescriptorSets[1].dstSet = cube.descriptorSet;
-			writeDescriptorSets[1].dstBinding = 1;
-			writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			// images use a different descriptor structure,wo we use pImageInfo instead of pBufferInfo
-			writeDescriptorSets[1].pImageInfo = &cube.texture.descriptorImageInfo;
-			writeDescriptorSets[1].descriptorCount = 1;
-
-			// Execute the writes to update descriptors for this set
-			// Note that it's also possible to gather all writes and only run updates once,even for multiple sets
-			// This is possible because each VkWriteDescriptorSet also contains the desctination set to be updated
-			// For simplicity we will update once per set instead
-
-			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			// images use a different descriptor structure, the allocator takes a VkDescriptorImageInfo instead of a VkDescriptorBufferInfo
+			descriptorAllocator.write(cube.descriptorSet, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, cube.texture.descriptorImageInfo);
 		}//for
+
+		// The writes are only queued above, they are executed for all sets with a single vkUpdateDescriptorSets
+		// This is possible because each VkWriteDescriptorSet also contains the desctination set to be updated
+		descriptorAllocator.flush();
 	}//setupDescriptSets
 
 	void preparePipelines()
@@ -14,6 +14,9 @@
 *
 * The used descriptor type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC then allows to set a dynamic
 * offset used to pass data from the single uniform buffer to the connected shader binding point.
+*
+* The uniform data is written to the upload arena of the base every frame, so the frames in flight
+* never share memory, and the command buffer of the frame is recorded with the new offsets.
 */
 
 #include "VulkanExampleBase.h"
@@ -29,32 +32,6 @@ struct Vertex
 	float color[3];
 };
 
-// Wrapper functions for aligned memory allocation
-// There is currently no standard for this in C++ that works across all platforms and vendors,so we abstract this
-void* alignedAlloc(size_t size, size_t alignment)
-{
-	void * data = nullptr;
-
-#if defined(_MSC_VER) || defined(__MINGW32__)
-	data = _aligned_malloc(size, alignment);
-#else
-	int res = posix_memalign(&data, alignment, size);
-	if (res != 0)
-		data = nullptr;
-#endif
-
-	return data;
-}
-
-void alignedFree(void* data)
-{
-#if	defined(_MSC_VER) || defined(__MINGW32__)
-	_aligned_free(data);
-#else
-	free(data);
-#endif
-}
-
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -70,12 +47,6 @@ public:
 	vks::Buffer indexBuffer;
 	uint32_t indexCount;
 
-	struct
-	{
-		vks::Buffer view;
-		vks::Buffer dynamic;
-	} uniformBuffers;
-
 	struct
 	{
 		glm::mat4 projection;
@@ -86,20 +57,27 @@ public:
 	glm::vec3 rotations[OBJECT_INSTANCES];
 	glm::vec3 rotationSpeeds[OBJECT_INSTANCES];
 
-	// One big uniform buffer that contains all matrices
-	// Note that we need to manually allocate the data to cope for GPU-specific uniform buffers offset alignments
+	// Per-object matrices, copied to the upload arena every frame (which takes care of the offset alignment of the GPU)
 	struct UboDataDynamic
 	{
-		glm::mat4 *model = nullptr;
+		glm::mat4 model[OBJECT_INSTANCES];
 	} uboDataDynamic;
 
+	// Dynamic offsets of the uniform data of the current frame in the upload arena
+	struct
+	{
+		uint32_t view = 0;
+		uint32_t model[OBJECT_INSTANCES];
+		// Objects whose data fit into the arena this frame
+		uint32_t objectCount = 0;
+	} dynamicOffsets;
+
 	VkPipeline pipeline;
 	VkPipelineLayout pipelineLayout;
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
 	float animationTimer = 0.0f;
-	size_t dynamicAlignment;;
 
 	VulkanExample():VulkanExampleBase(ENABLE_VALIDATION)
 	{
@@ -112,13 +90,8 @@ public:
 
 	~VulkanExample()
 	{
-		if (uboDataDynamic.model)
-		{
-			alignedFree(uboDataDynamic.model);
-		}
-
 		// Clean up used Vulkan resources
-		// Note : Inherited destructor cleans up resources stored in the base class
+		// Note : Inherited destructor cleans up resources stored in the base class (including the upload arena)
 		vkDestroyPipeline(device, pipeline,nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
@@ -126,12 +99,18 @@ public:
 
 		vertexBuffer.destroy();
 		indexBuffer.destroy();
-
-		uniformBuffers.view.destroy();
-		uniformBuffers.dynamic.destroy();
 	}
 
 	void buildCommandBuffersForPreRenderPrmitives()
+	{
+		for (uint32_t i = 0; i < drawCmdBuffers.size(); i++)
+		{
+			buildCommandBuffer(i);
+		}//for_i
+	}//buildCommandBuffersForPreRenderPrmitives
+
+	// Records the command buffer of a swap chain image with the dynamic offsets of the current frame
+	void buildCommandBuffer(uint32_t i)
 	{
 		VkCommandBufferBeginInfo cmdBufferBeginInfo = vks::initializers::GenCommandBufferBeginInfo();
 
@@ -148,7 +127,6 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValue;
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); i++)
 		{
 			renderPassBeginInfo.framebuffer = frameBuffers[i];
 
@@ -169,13 +147,13 @@ public:
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &vertexBuffer.buffer, offsets);
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 
-			// Render multiple objects using different model matrices by dynamically offsetting into one uniform buffer
-			for (uint32_t j = 0; j < OBJECT_INSTANCES; j++)
+			// Render multiple objects using different model matrices by dynamically offsetting into the upload arena
+			for (uint32_t j = 0; j < dynamicOffsets.objectCount; j++)
 			{
-				// One dynamic offset per dynamic descriptor to offset into the ubo containing all model matrices
-				uint32_t dynamicOffset = j * static_cast<uint32_t>(dynamicAlignment);
-				// Bind the descriptor set for rendering a mesh using the dynamic offset
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &dynamicOffset);
+				// One dynamic offset per dynamic descriptor (in binding order): the view matrices and the model matrix of the object
+				const uint32_t offsets[2] = { dynamicOffsets.view, dynamicOffsets.model[j] };
+				// Bind the descriptor set for rendering a mesh using the dynamic offsets
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 2, offsets);
 
 				vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
 			}//for_j
@@ -185,14 +163,40 @@ public:
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		}
+	}//buildCommandBuffer
 
-		}//for_i
-	}//buildCommandBuffersForPreRenderPrmitives
+	// Copies the uniform data of this frame to the upload arena, the space of the frame in flight isn't touched
+	void uploadUniformData()
+	{
+		dynamicOffsets.objectCount = 0;
+		const vks::UploadArena::Allocation view = uploadArena.upload(uboVS);
+		if (!view)
+		{
+			return;
+		}
+		dynamicOffsets.view = view.offset;
+		for (uint32_t j = 0; j < OBJECT_INSTANCES; j++)
+		{
+			const vks::UploadArena::Allocation model = uploadArena.upload(uboDataDynamic.model[j]);
+			if (!model)
+			{
+				// Arena full, the remaining objects are skipped this frame (counted as overflows by the arena)
+				break;
+			}
+			dynamicOffsets.model[j] = model.offset;
+			dynamicOffsets.objectCount++;
+		}//for_j
+	}
 
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
 
+		// The command buffer is recorded with the offsets of this frame's data
+		uploadUniformData();
+		buildCommandBuffer(currentCmdBufferIndex);
+
 		// Command buffer to be  submitted to the queue
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentCmdBufferIndex];
@@ -265,8 +269,7 @@ public:
 		// Example uses one ubo and one image sampler
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1),
-			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,1)
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,2)
 		};
 
 		VkDescriptorPoolCreateInfo descriprtorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(static_cast<uint32_t>(poolSizes.size()),poolSizes.data(),2);
@@ -278,7 +281,7 @@ public:
 	{
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
 		{
-			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,VK_SHADER_STAGE_VERTEX_BIT,0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,VK_SHADER_STAGE_VERTEX_BIT,0),
 			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,VK_SHADER_STAGE_VERTEX_BIT,1)
 		};
 
@@ -294,13 +297,16 @@ public:
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 
+		// Both bindings point at the upload arena, the ranges are the sizes of the blocks and the offsets are passed when binding
+		VkDescriptorBufferInfo viewBufferInfo = uploadArena.descriptor(sizeof(uboVS));
+		VkDescriptorBufferInfo modelBufferInfo = uploadArena.descriptor(sizeof(glm::mat4));
 		std::vector<VkWriteDescriptorSet> writeDescritptorSets = 
 		{
-			//Binding 0: Projection/View matrix uniform buffer
-			vks::initializers::GenWriteDescriptorSet(descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,0,&uniformBuffers.view.descriptorBufferInfo),
+			//Binding 0: Projection/View matrix as dynamic uniform buffer
+			vks::initializers::GenWriteDescriptorSet(descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,0,&viewBufferInfo),
 
 			//Binding 1: Instance matrix as dynamic uniform buffer
-			vks::initializers::GenWriteDescriptorSet(descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,1,&uniformBuffers.dynamic.descriptorBufferInfo)
+			vks::initializers::GenWriteDescriptorSet(descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,1,&modelBufferInfo)
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescritptorSets.size()), writeDescritptorSets.data(), 0, nullptr);
@@ -346,43 +352,12 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
 	}
 
-	// Prepare and initialize uniform buffer containing shader unfiorms
+	// Prepare the upload arena the shader uniforms are written to every frame
 	void prepareUniformBuffers()
 	{
-		// Allocate data for the dynamic uniform buffer object
-		// We allocate this manually as the alignment of the offset differs between GPUs
-
-		// Calculate required alignment based on minimum device offset alignment
-		size_t minUboAlignment = vulkanDevice->properties.limits.minUniformBufferOffsetAlignment;
-		dynamicAlignment = sizeof(glm::mat4);
-		if (minUboAlignment>0)
-		{
-			dynamicAlignment = (dynamicAlignment + minUboAlignment - 1)& ~(minUboAlignment - 1);
-		}
-
-		size_t bufferSize = OBJECT_INSTANCES * dynamicAlignment;
-
-		uboDataDynamic.model = (glm::mat4*)alignedAlloc(bufferSize, dynamicAlignment);
-		assert(uboDataDynamic.model);
-
-		std::cout << "minUniformBufferOffsetAlignment = " << minUboAlignment << std::endl;
-		std::cout << "dynamicAlignment = " << dynamicAlignment << std::endl;
-
-		//Vertex shader uniform buffer block
-
-		// Static shared uniform buffer object with projection and view matrix
-		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.view, sizeof(uboVS)));
-
-		//Uniform buffer object with per-object matrices
-		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,&uniformBuffers.dynamic,bufferSize));
-
-		// Override descriptor range to [basembase+dynamicAlignment]
-		uniformBuffers.dynamic.descriptorBufferInfo.range = dynamicAlignment;
-
-		// Map persistent
-		VK_CHECK_RESULT(uniformBuffers.view.map());
-		VK_CHECK_RESULT(uniformBuffers.dynamic.map());
+		// The arena aligns every block to minUniformBufferOffsetAlignment of the device
+		uploadArena.prepare(vulkanDevice);
+		std::cout << "minUniformBufferOffsetAlignment = " << vulkanDevice->properties.limits.minUniformBufferOffsetAlignment << std::endl;
 
 		// Prepare per-object matrices with offsets and random rotations
 		std::default_random_engine randomEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
@@ -394,16 +369,14 @@ public:
 		}
 
 		updateUniformBuffers();
-		updateDynamicUniformBuffer();
+		updateDynamicUniformBuffer(true);
 	}
 
 	void updateUniformBuffers()
 	{
-		//Fixed ubo with projection and view matrices
+		//Fixed ubo with projection and view matrices, uploaded with the next frame
 		uboVS.projection = camera.matrices.perspective;
 		uboVS.view = camera.matrices.view;
-
-		memcpy(uniformBuffers.view.mappedData, &uboVS, sizeof(uboVS));
 	}
 
 	void updateDynamicUniformBuffer(bool force = false)
@@ -427,8 +400,7 @@ public:
 				{
 					uint32_t index = x * dim*dim + y * dim + z;
 
-					// Aligned offset
-					glm::mat4* modelMat = (glm::mat4*)((uint64_t)uboDataDynamic.model + index * dynamicAlignment);
+					glm::mat4* modelMat = &uboDataDynamic.model[index];
 
 					// Update rotations
 					rotations[index] += animationTimer * rotationSpeeds[index];
@@ -444,13 +416,6 @@ public:
 		}//for_x
 
 		animationTimer = 0.0f;
-
-		memcpy(uniformBuffers.dynamic.mappedData, uboDataDynamic.model, uniformBuffers.dynamic.size);
-		//Flush to make changes visible to the host
-		VkMappedMemoryRange memoryRange = vks::initializers::GenMappedMemoryRange();
-		memoryRange.memory = uniformBuffers.dynamic.deviceMemory;
-		memoryRange.size = uniformBuffers.dynamic.size;
-		vkFlushMappedMemoryRanges(device, 1, &memoryRange);
 	}
 
 	void prepareForRendering()
@@ -0,0 +1,392 @@
+/*
+* Vulkan Example - Rendering the Sponza glTF scene with per-material descriptor sets or a bindless material table
+*
+* Per-material sets: one descriptor set bind per primitive and a separate pipeline for alpha masked materials
+* Bindless: all textures of the model in one array and the materials in a storage buffer, bound once per command buffer,
+* the material of a draw is selected with a push constant index
+* Both are recorded by walking the node hierarchy, the flattened draw list of the model or indirect draws from the draw list,
+* the indirect commands are frustum culled on the CPU every frame
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanExampleBase.h"
+#include "VulkanglTFModel.h"
+
+#define ENABLE_VALIDATION false
+
+// Recordings of the command buffers averaged per mode by --recordbench
+#define RECORD_BENCH_ROUNDS 100
+// Size of the texture array of the HLSL bindless shader, which can't be sized with a specialization constant
+#define HLSL_BINDLESS_TEXTURE_COUNT 64
+
+class VulkanExample :public VulkanExampleBase
+{
+public:
+	vkglTF::Model scene;
+
+	vks::Buffer uniformBuffer;
+
+	// Same uniform buffer layout as shader
+	struct UBOScene
+	{
+		glm::mat4 projection;
+		glm::mat4 view;
+		glm::vec4 lightPos = glm::vec4(0.0f, 2.5f, 0.0f, 1.0f);
+		glm::vec4 viewPos;
+	} uboScene;
+
+	// Set 0 of both pipeline layouts, layout and set belong to the descriptor allocator of the base
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorSet descriptorSet;
+
+	struct
+	{
+		// Set 1 = vkglTF::descriptorSetLayoutImage
+		VkPipelineLayout materialSets = VK_NULL_HANDLE;
+		// Set 1 = material table of the scene, material index pushed to the fragment shader
+		VkPipelineLayout bindless = VK_NULL_HANDLE;
+	}pipelineLayouts;
+
+	struct
+	{
+		vks::PipelineRegistry::Key opaque = vks::PipelineRegistry::INVALID_KEY;
+		vks::PipelineRegistry::Key masked = vks::PipelineRegistry::INVALID_KEY;
+		vks::PipelineRegistry::Key bindless = vks::PipelineRegistry::INVALID_KEY;
+	}pipelines;
+
+	bool bindless = true;
+	// 0 = node hierarchy, 1 = draw list, 2 = indirect draws from the draw list
+	int32_t drawPath = 2;
+	// Requires dynamic indexing of sampler arrays and the textures of the scene within the per stage sampler limits
+	bool bindlessSupported = false;
+
+	// Commands of the scene in one command buffer and the CPU time of recording them
+	struct
+	{
+		vkglTF::Model::DrawStatistics draws;
+		double time = 0.0;
+	}recordStatistics;
+
+	VulkanExample() :VulkanExampleBase(ENABLE_VALIDATION)
+	{
+		windowTitle = "glTF scene rendering";
+		camera.cameraType = Camera::CameraType::firstperson;
+		camera.flipY = true;
+		camera.setPosition(glm::vec3(0.0f, 1.0f, 0.0f));
+		camera.setRotation(glm::vec3(0.0f, -90.0f, 0.0f));
+		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
+		camera.movementSpeed = 2.5f;
+
+		commandLineParser.add("nobindless", { "-nbl", "--nobindless" }, 0, "Start with per-material descriptor sets instead of the bindless material table");
+		commandLineParser.add("drawpath", { "-dp", "--drawpath" }, 1, "Record the scene by walking the node hierarchy (0), from the draw list (1) or with indirect draws from the draw list (2, default)");
+		commandLineParser.add("recordbench", { "-rb", "--recordbench" }, 0, "Print the draw calls, descriptor binds and CPU record time of all material binding modes and draw paths at startup");
+		commandLineParser.parse(args);
+		bindless = !commandLineParser.isSet("nobindless");
+		drawPath = std::min(std::max(commandLineParser.getValueAsInt("drawpath", drawPath), 0), 2);
+	}
+
+	~VulkanExample()
+	{
+		// Pipelines are owned by the registry, the descriptor sets and the set 0 layout by the descriptor allocator of the base
+		vkDestroyPipelineLayout(device, pipelineLayouts.materialSets, nullptr);
+		if (pipelineLayouts.bindless != VK_NULL_HANDLE)
+		{
+			vkDestroyPipelineLayout(device, pipelineLayouts.bindless, nullptr);
+		}
+
+		uniformBuffer.destroy();
+	}
+
+	virtual void getEnabledFeatures() override
+	{
+		if (deviceFeatures.samplerAnisotropy)
+		{
+			curEnabledDeviceFeatures.samplerAnisotropy = VK_TRUE;
+		}
+		// The texture array of the material table is indexed with the (dynamically uniform) material of a draw
+		if (deviceFeatures.shaderSampledImageArrayDynamicIndexing)
+		{
+			curEnabledDeviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+		}
+		// Batches of the draw list are issued with one indirect call (otherwise the model issues one call per draw)
+		if (deviceFeatures.multiDrawIndirect)
+		{
+			curEnabledDeviceFeatures.multiDrawIndirect = VK_TRUE;
+		}
+	}
+
+	// Records the scene with the current material binding mode, the commands are counted by the model
+	void drawScene(VkCommandBuffer commandBuffer)
+	{
+		const uint32_t pathFlags = (drawPath == 0) ? vkglTF::RenderFlags::WalkNodes : 0;
+		scene.drawList.indirect = (drawPath == 2);
+
+		scene.bindBuffers(commandBuffer);
+		if (bindless)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.bindless, 0, 1, &descriptorSet, 0, nullptr);
+			scene.bindMaterialTable(commandBuffer, pipelineLayouts.bindless, 1);
+			// One pipeline for all materials, alpha masking is a property of the material table entry
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(pipelines.bindless));
+			scene.draw(commandBuffer, vkglTF::RenderFlags::PushMaterialIndex | pathFlags, pipelineLayouts.bindless);
+		}
+		else
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.materialSets, 0, 1, &descriptorSet, 0, nullptr);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(pipelines.opaque));
+			scene.draw(commandBuffer, vkglTF::RenderFlags::BindImages | vkglTF::RenderFlags::RenderOpaqueNodes | pathFlags, pipelineLayouts.materialSets, 1);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(pipelines.masked));
+			scene.draw(commandBuffer, vkglTF::RenderFlags::BindImages | vkglTF::RenderFlags::RenderAlphaMaskedNodes | pathFlags, pipelineLayouts.materialSets, 1);
+		}
+	}//drawScene
+
+	void buildCommandBuffersForPreRenderPrmitives()
+	{
+		VkCommandBufferBeginInfo cmdBufferBeginInfo = vks::initializers::GenCommandBufferBeginInfo();
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = defaultClearColor;
+		clearValues[1].depthStencil = { 1.0f,0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::GenRenderPassBeginInfo();
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.renderArea.offset.x = 0;
+		renderPassBeginInfo.renderArea.offset.y = 0;
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		double recordTime = 0.0;
+		for (int32_t i = 0; i < drawCmdBuffers.size(); i++)
+		{
+			renderPassBeginInfo.framebuffer = frameBuffers[i];
+
+			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufferBeginInfo));
+
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			VkViewport viewport = vks::initializers::GenViewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+
+			VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+
+			// Only the scene is counted and timed, the UI is the same for both modes
+			scene.drawStatistics = vkglTF::Model::DrawStatistics();
+			auto tStart = std::chrono::high_resolution_clock::now();
+			drawScene(drawCmdBuffers[i]);
+			recordTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+			drawUI(drawCmdBuffers[i]);
+
+			vkCmdEndRenderPass(drawCmdBuffers[i]);
+
+			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		}//for_i
+
+		recordStatistics.draws = scene.drawStatistics;
+		recordStatistics.time = recordTime / drawCmdBuffers.size();
+		benchmark.setCounter("scene.drawCalls", recordStatistics.draws.drawCalls);
+		benchmark.setCounter("scene.descriptorBinds", recordStatistics.draws.descriptorBinds);
+		benchmark.setCounter("scene.pushConstants", recordStatistics.draws.pushConstants);
+		benchmark.setCounter("scene.indirectDraws", recordStatistics.draws.indirectDraws);
+		benchmark.setCounter("scene.recordMs", recordStatistics.time);
+	}//buildCommandBuffersForPreRenderPrmitives
+
+	// Records the command buffers repeatedly for every material binding mode and draw path and prints the averages
+	void recordBenchmark()
+	{
+		const bool currentMode = bindless;
+		const int32_t currentPath = drawPath;
+		const char* pathNames[] = { "node hierarchy", "draw list", "indirect draw list" };
+		std::cout << "Recording " << scene.drawList.items.size() << " primitives of " << scene.linearNodes.size() << " nodes, " << RECORD_BENCH_ROUNDS << " rounds each\n";
+		for (uint32_t mode = 0; mode < 2; mode++)
+		{
+			bindless = (mode == 1);
+			if (bindless && !bindlessSupported)
+			{
+				std::cout << "bindless: not supported on this device\n";
+				continue;
+			}
+			for (drawPath = 0; drawPath < 3; drawPath++)
+			{
+				double time = 0.0;
+				for (uint32_t round = 0; round < RECORD_BENCH_ROUNDS; round++)
+				{
+					buildCommandBuffersForPreRenderPrmitives();
+					time += recordStatistics.time;
+				}//for_round
+				std::cout << (bindless ? "bindless" : "per-material sets") << ", " << pathNames[drawPath] << ": " << recordStatistics.draws.drawCalls << " draw calls, "
+					<< recordStatistics.draws.descriptorBinds << " descriptor binds, " << recordStatistics.draws.pushConstants << " push constants, "
+					<< time / RECORD_BENCH_ROUNDS << " ms per command buffer\n";
+			}//for_drawPath
+		}//for_mode
+		bindless = currentMode;
+		drawPath = currentPath;
+	}//recordBenchmark
+
+	void loadAssets()
+	{
+		// The per-material sets hold the color and the normal map (bindings 0 and 1 of vkglTF::descriptorSetLayoutImage)
+		vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageBaseColor | vkglTF::DescriptorBindingFlags::ImageNormalMap;
+		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
+		scene.loadFromFile(getAssetPath() + "models/sponza/sponza.gltf", vulkanDevice, queue, glTFLoadingFlags);
+
+		const uint32_t textureCount = (shaderDir == "hlsl") ? HLSL_BINDLESS_TEXTURE_COUNT : 0;
+		bindlessSupported = (deviceFeatures.shaderSampledImageArrayDynamicIndexing == VK_TRUE) && scene.prepareMaterialTable(queue, textureCount);
+		if (!bindlessSupported)
+		{
+			std::cout << "Bindless material table not supported, falling back to per-material descriptor sets\n";
+			bindless = false;
+		}
+	}//loadAssets
+
+	void setupDescriptors()
+	{
+		descriptorSetLayout = descriptorAllocator.getLayout(
+		{
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,VK_SHADER_STAGE_VERTEX_BIT,0)
+		});
+		descriptorSet = descriptorAllocator.allocate(descriptorSetLayout);
+		descriptorAllocator.write(descriptorSet, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffer.descriptorBufferInfo);
+		descriptorAllocator.flush();
+
+		std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, vkglTF::descriptorSetLayoutImage };
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::GenPipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayouts.materialSets));
+
+		if (bindlessSupported)
+		{
+			setLayouts[1] = scene.materialTable.descriptorSetLayout;
+			VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t) };
+			pipelineLayoutCI.pushConstantRangeCount = 1;
+			pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayouts.bindless));
+		}
+	}//setupDescriptors
+
+	void preparePipelines()
+	{
+		vks::PipelineStateDesc pipelineDesc;
+		pipelineDesc.renderPass = renderPass;
+		pipelineDesc.setVertexInput(vkglTF::Vertex::getPipelineVertexInputState(
+			{ vkglTF::VertexComponent::Position,vkglTF::VertexComponent::Normal,vkglTF::VertexComponent::UV,vkglTF::VertexComponent::Color,vkglTF::VertexComponent::Tangent }));
+		pipelineDesc.vertexShader = getShadersPath() + "gltfscenerendering/vkgltf.vert.spv";
+		pipelineDesc.specializationStages = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		// Per-material sets: alpha masking is a specialization constant, so masked materials need their own pipeline
+		pipelineDesc.layout = pipelineLayouts.materialSets;
+		pipelineDesc.fragmentShader = getShadersPath() + "gltfscenerendering/scene.frag.spv";
+		pipelines.opaque = pipelineRegistry.request(pipelineDesc, vks::PipelineRegistry::INVALID_KEY, false);
+		pipelineDesc.setSpecializationConstant(0, static_cast<uint32_t>(VK_TRUE));
+		// glTF default cutoff
+		pipelineDesc.setSpecializationConstant(1, 0.5f);
+		pipelines.masked = pipelineRegistry.request(pipelineDesc, vks::PipelineRegistry::INVALID_KEY, false);
+
+		// Bindless: the size of the texture array is a specialization constant
+		if (bindlessSupported)
+		{
+			pipelineDesc.layout = pipelineLayouts.bindless;
+			pipelineDesc.fragmentShader = getShadersPath() + "gltfscenerendering/bindless.frag.spv";
+			pipelineDesc.specializationConstants.clear();
+			pipelineDesc.setSpecializationConstant(0, scene.materialTable.textureCount);
+			pipelines.bindless = pipelineRegistry.request(pipelineDesc, vks::PipelineRegistry::INVALID_KEY, false);
+		}
+	}//preparePipelines
+
+	void prepareUniformBuffers()
+	{
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffer, sizeof(UBOScene)));
+		VK_CHECK_RESULT(uniformBuffer.map());
+		updateUniformBuffers();
+	}//prepareUniformBuffers
+
+	void updateUniformBuffers()
+	{
+		uboScene.projection = camera.matrices.perspective;
+		uboScene.view = camera.matrices.view;
+		uboScene.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
+		memcpy(uniformBuffer.mappedData, &uboScene, sizeof(UBOScene));
+	}//updateUniformBuffers
+
+	void draw()
+	{
+		VulkanExampleBase::prepareFrame();
+
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &drawCmdBuffers[currentCmdBufferIndex];
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+		VulkanExampleBase::submitFrame();
+	}//draw
+
+	void prepareForRendering() override
+	{
+		VulkanExampleBase::prepareForRendering();
+		loadAssets();
+		prepareUniformBuffers();
+		setupDescriptors();
+		preparePipelines();
+		if (commandLineParser.isSet("recordbench"))
+		{
+			recordBenchmark();
+		}
+		buildCommandBuffersForPreRenderPrmitives();
+		prepared = true;
+	}//prepareForRendering
+
+	virtual void render() override
+	{
+		if (!prepared)
+		{
+			return;
+		}
+		// The device is idle after the previous frame, so the indirect commands can be written in place
+		if (drawPath == 2)
+		{
+			scene.cullDrawList(camera.matrices.perspective * camera.matrices.view);
+		}
+		draw();
+		if (camera.updated)
+		{
+			updateUniformBuffers();
+		}
+	}//render
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay) override
+	{
+		if (overlay->header("Settings"))
+		{
+			if (bindlessSupported)
+			{
+				if (overlay->checkBox("Bindless materials", &bindless))
+				{
+					buildCommandBuffersForPreRenderPrmitives();
+				}
+			}
+			else
+			{
+				overlay->text("Bindless materials not supported");
+			}
+			if (overlay->comboBox("Draw path", &drawPath, { "Node hierarchy", "Draw list", "Indirect draw list" }))
+			{
+				buildCommandBuffersForPreRenderPrmitives();
+			}
+		}
+		if (overlay->header("Command buffer"))
+		{
+			overlay->text("%u draws, %u descriptor binds", recordStatistics.draws.drawCalls, recordStatistics.draws.descriptorBinds);
+			overlay->text("%u push constants", recordStatistics.draws.pushConstants);
+			if (drawPath == 2)
+			{
+				overlay->text("%u indirect draws, %u visible", recordStatistics.draws.indirectDraws, scene.drawList.visibleCount);
+			}
+			overlay->text("Scene recording: %.3f ms", recordStatistics.time);
+		}
+	}//OnUpdateUIOverlay
+};
+
+VULKAN_EXAMPLE_MAIN()
@@ -82,11 +82,11 @@ public:
 		VkImageView view;
 		VkFormat format;
 
-		void destroy(VkDevice device)
+		void destroy(vks::VulkanDevice* vulkanDevice)
 		{
-			vkDestroyImageView(device, view, nullptr);
-			vkDestroyImage(device, image, nullptr);
-			vkFreeMemory(device, mem, nullptr);
+			vkDestroyImageView(vulkanDevice->logicalDevice, view, nullptr);
+			vkDestroyImage(vulkanDevice->logicalDevice, image, nullptr);
+			vulkanDevice->FreeMemory(mem);
 		}
 	};
 
@@ -112,7 +112,7 @@ public:
 	struct Models
 	{
 		vkglTF::Model skybox;
-		std::vector<vkglTF::Model> objects;
+		std::array<vkglTF::Model, 4> objects;
 		int32_t objectIndex = 1;
 	} models;
 
@@ -152,11 +152,11 @@ public:
 		vkDestroySampler(device, offscreenFrameBuffer.sampler, nullptr);
 		vkDestroySampler(device, filterPass.sampler, nullptr);
 
-		offscreenFrameBuffer.depth.destroy(device);
-		offscreenFrameBuffer.colorAttachment[0].destroy(device);
-		offscreenFrameBuffer.colorAttachment[1].destroy(device);
+		offscreenFrameBuffer.depth.destroy(vulkanDevice);
+		offscreenFrameBuffer.colorAttachment[0].destroy(vulkanDevice);
+		offscreenFrameBuffer.colorAttachment[1].destroy(vulkanDevice);
 
-		filterPass.colorAttachment[0].destroy(device);
+		filterPass.colorAttachment[0].destroy(vulkanDevice);
 
 		uniformBuffers.matrices.destroy();
 		uniformBuffers.params.destroy();
@@ -170,7 +170,6 @@ public:
 		models.skybox.loadFromFile(getAssetPath() + "models/cube.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		std::vector<std::string> filenames = { "sphere.gltf","teapot.gltf","torusknot.gltf","venus.gltf" };
 		objectNames = { "Sphere", "Teapot", "Torusknot", "Venus" };
-		models.objects.resize(filenames.size());
 		for (size_t i = 0; i < filenames.size(); i++)
 		{
 			models.objects[i].loadFromFile(getAssetPath() + "models/"+filenames[i],vulkanDevice,queue,glTFLoadingFlags);
@@ -250,7 +249,7 @@ public:
 		vkGetImageMemoryRequirements(device, pAttachment->image, &memReqs);
 		memAlloc.allocationSize = memReqs.size;
 		memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &pAttachment->mem));
+		VK_CHECK_RESULT(vulkanDevice->AllocateMemory(&memAlloc, &pAttachment->mem, vks::MEMORY_CATEGORY_ATTACHMENT));
 		VK_CHECK_RESULT(vkBindImageMemory(device, pAttachment->image, pAttachment->mem, 0));
 
 		VkImageViewCreateInfo	imageViewCreateInfo = vks::initializers::GenImageViewCreateInfo();
@@ -517,6 +516,8 @@ public:
 		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 		VkPipelineDynamicStateCreateInfo dynamicStateCI = vks::initializers::GenPipelineDynamicStateCreateInfo(dynamicStateEnables);
 		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+		// The pipelines are queued with a copy of their state and created in parallel at the end
+		vks::PipelineBatch pipelineBatch;
 
 		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::GenPipelineCreateInfo(pipelineLayouts.models, renderPass, 0);
 		pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
@@ -551,7 +552,7 @@ public:
 		colorBlendStateCI.pAttachments = blendAttachmentStates.data();
 		shaderStages[0] = loadShader(getShadersPath() + "hdr/composition.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "hdr/composition.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.composition));
+		pipelineBatch.add(pipelineCI, &pipelines.composition);
 
 		
 		// Bloom pass
@@ -573,12 +574,12 @@ public:
 		uint32_t dir = 1;
 		specilizationInfo = vks::initializers::GenSpecializationInfo(1, specializationMapEntries.data(), sizeof(dir), &dir);
 		shaderStages[1].pSpecializationInfo = &specilizationInfo;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.bloom[0]));
+		pipelineBatch.add(pipelineCI, &pipelines.bloom[0]);
 
 		// Second blur pass
 		pipelineCI.renderPass = filterPass.renderPass;
 		dir = 0;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.bloom[1]));
+		pipelineBatch.add(pipelineCI, &pipelines.bloom[1]);
 
 
 		// Object rendering pipelines
@@ -601,7 +602,7 @@ public:
 		
 		// Skybox pipeline (background cube)
 		rasterizationStateCI.cullMode = VK_CULL_MODE_FRONT_BIT;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.skybox));
+		pipelineBatch.add(pipelineCI, &pipelines.skybox);
 
 		// Object rendering pipeline
 		shadertype = 1;
@@ -610,7 +611,9 @@ public:
 		depthStencilStateCI.depthTestEnable = VK_TRUE;
 		// Flip cull mode
 		rasterizationStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.reflect));
+		pipelineBatch.add(pipelineCI, &pipelines.reflect);
+
+		createPipelines(pipelineBatch);
 	}
 
 	void setupDescriptorPool()
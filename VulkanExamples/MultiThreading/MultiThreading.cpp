@@ -13,9 +13,22 @@
 
 #include "VulkanglTFModel.h"
 
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define OBJECT_UPDATE_SSE
+#endif
+
 #define ENABLE_VALIDATION false
 
-static int totalPrimitives = 0;
+// Default and upper limit for the number of animated objects (can be set with --objects)
+#define DEFAULT_OBJECT_COUNT 512
+#define MAX_OBJECT_COUNT (1024 * 1024)
+// Number of objects updated by a single job of the parallel update pass
+#define OBJECT_UPDATE_CHUNK_SIZE 4096
+
+// Number of frames that can be recorded ahead, each one owns its own set of per-thread command pools
+#define FRAME_RING_SIZE 3
+
 static int totalVisibleObjectCount = 0;
 
 //#define UI_COMMAND_ARRAY_CACHE
@@ -51,7 +64,15 @@ public:
 
 	VkPipelineLayout pipelineLayout;
 
-	VkCommandBuffer primaryCommandBuffer;
+	// Per-frame resources, a frame's slot in the ring is only reused after its fence has been signaled
+	struct FrameData
+	{
+		VkCommandBuffer primaryCommandBuffer;
+		// Fence to wait for all command buffers of this frame to finish before they are recorded again
+		VkFence renderFence;
+	};
+	std::array<FrameData, FRAME_RING_SIZE> frameDatas;
+	uint32_t currentFrameRingIndex = 0;
 
 	// Secondary scene command buffers used to store backdrop and user interface
 	struct SecondaryCommandBuffers
@@ -68,11 +89,14 @@ public:
 
 	// Number of animated objects to be renderer
 	// by using threads and secondary command buffers
+	uint32_t numObjects = DEFAULT_OBJECT_COUNT;
 	uint32_t numObjectsPerThread;
 
 	// Multi Threaded stuff
 	// Max. number of concurrent threads
 	uint32_t numThreads;
+	// Threads with at least one visible object, only their secondary command buffers are executed
+	uint32_t submittedThreadCount = 0;
 
 	// Use push constants to update shader
 	// parameters on a per-thread base
@@ -82,37 +106,62 @@ public:
 		glm::vec3 color;
 	};
 
-	struct ObjectData
-	{
-		glm::mat4 model;
-		glm::vec3 pos;
-		glm::vec3 rotation;
-		float rotationDir;
-		float rotationSpeed;
-		float scale;
-		float deltaT;
-		float stateT = 0;
-		bool visible = true;
-	};
+	// Per object simulation state, stored as a structure of arrays
+	// The update pass streams through each attribute separately and composes four model matrices at once
+	struct ObjectDatas
+	{
+		std::vector<float> posX;
+		std::vector<float> posY;
+		std::vector<float> posZ;
+		// Rotation around the y axis in degrees
+		std::vector<float> rotationY;
+		std::vector<float> rotationDir;
+		std::vector<float> rotationSpeed;
+		std::vector<float> scale;
+		std::vector<float> deltaT;
+		std::vector<glm::vec3> color;
+		// Outputs of the update pass, consumed while recording
+		std::vector<glm::mat4> model;
+		std::vector<uint8_t> visible;
+
+		void resize(size_t count)
+		{
+			posX.resize(count);
+			posY.resize(count);
+			posZ.resize(count);
+			rotationY.resize(count);
+			rotationDir.resize(count);
+			rotationSpeed.resize(count);
+			scale.resize(count);
+			deltaT.resize(count);
+			color.resize(count);
+			model.resize(count);
+			visible.resize(count);
+		}
+	} objects;
+
+	// Radius used for the frustum check, derived from the mesh once it has been loaded
+	float objectCullRadius = 1.0f;
+
+	// Average cost of the last parallel update pass
+	float updateTimePerObjectNs = 0.0f;
 
 	struct ThreadData
 	{
-		VkCommandPool commandPool;
-		// One command buffer per render object
-		std::vector<VkCommandBuffer> commandBuffers;
-		// One push constant block per render object
-		std::vector<ThreadPushConstantBlock> pushConstBlocks;
-		// Per object information(Position,rotation.etc)
-		std::vector<ObjectData> objectDatas;
+		// One command pool per frame in the ring, reset as a whole instead of per command buffer
+		std::array<VkCommandPool, FRAME_RING_SIZE> commandPools;
+		// One secondary command buffer per frame in the ring, containing all visible objects of this thread
+		std::array<VkCommandBuffer, FRAME_RING_SIZE> commandBuffers;
+		// Number of objects recorded into the current frame's command buffer
+		uint32_t visibleObjectCount = 0;
+		// Range of objects recorded by this thread
+		uint32_t firstObject = 0;
+		uint32_t lastObject = 0;
 	};
 	std::vector<ThreadData> threadDatas;
 
 	vks::ThreadPool threadPool;
 
-	// Fence to wait for all command buffers to finish before
-	// presenting to the swap chain
-	VkFence renderFence = {};
-
 	// View frustum for culling invisible objects
 	vks::Frustum frustum;
 
@@ -138,6 +187,20 @@ public:
 		numThreads = std::thread::hardware_concurrency();
 		assert(numThreads > 0);
 
+		// Allow overriding the number of worker threads from the command line
+		commandLineParser.add("threads", { "-t", "--threads" }, 1, "Set number of threads used for command buffer generation");
+		commandLineParser.add("objects", { "-oc", "--objects" }, 1, "Set number of animated objects (up to 1048576)");
+		commandLineParser.add("updatebenchmark", { "-ub", "--updatebenchmark" }, 0, "Run a CPU only benchmark of the object update pass and exit");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("threads"))
+		{
+			numThreads = std::max(std::min(commandLineParser.getValueAsInt("threads", numThreads), 512), 1);
+		}
+		if (commandLineParser.isSet("objects"))
+		{
+			numObjects = std::max(std::min(commandLineParser.getValueAsInt("objects", numObjects), MAX_OBJECT_COUNT), 1);
+		}
+
 #if defined(__ANDROID__)
 		LOGD("numThreads = %d", numThreads);
 #else
@@ -145,8 +208,16 @@ public:
 #endif // defined(__ANDROID__)
 
 		threadPool.setThreadCount(numThreads);
-		numObjectsPerThread = 512 / numThreads;
+		numObjectsPerThread = (numObjects + numThreads - 1) / numThreads;
 		rndEngine.seed(benchmark.active ? 0 : (unsigned)time(nullptr));
+
+		prepareObjects();
+
+		if (commandLineParser.isSet("updatebenchmark"))
+		{
+			runUpdateBenchmark();
+			exit(0);
+		}
 	}
 
 	~VulkanExample()
@@ -160,11 +231,18 @@ public:
 
 		for (auto& thread :threadDatas )
 		{
-			vkFreeCommandBuffers(device, thread.commandPool, thread.commandBuffers.size(), thread.commandBuffers.data());
-			vkDestroyCommandPool(device, thread.commandPool, nullptr);
+			// Destroying a pool frees all command buffers allocated from it
+			for (auto& commandPool : thread.commandPools)
+			{
+				vkDestroyCommandPool(device, commandPool, nullptr);
+			}
 		}
 
-		vkDestroyFence(device, renderFence, nullptr);
+		for (auto& frame : frameDatas)
+		{
+			vkFreeCommandBuffers(device, cmdPool, 1, &frame.primaryCommandBuffer);
+			vkDestroyFence(device, frame.renderFence, nullptr);
+		}
 	}
 
 	float rnd(float range)
@@ -174,14 +252,199 @@ public:
 		return rndDist(rndEngine);
 	}
 
+	// Initialize the simulation state of all objects
+	void prepareObjects()
+	{
+		objects.resize(numObjects);
+
+		for (uint32_t i = 0; i < numObjects; i++)
+		{
+			float theta = 2.0f*float(M_PI)*rnd(1.0f);
+			float phi = acos(1.0f - 2.0f*rnd(1.0f));
+			objects.posX[i] = sin(phi) * cos(theta) * 35.0f;
+			objects.posY[i] = 0.0f;
+			objects.posZ[i] = cos(phi) * 35.0f;
+
+			objects.rotationY[i] = rnd(360.0f);
+			objects.deltaT[i] = rnd(1.0f);
+			objects.rotationDir[i] = (rnd(100.0f) < 50.0f) ? 1.0f : -1.0f;
+			objects.rotationSpeed[i] = (2.0f + rnd(4.0f)) * objects.rotationDir[i];
+			objects.scale[i] = 0.75f + rnd(0.5f);
+
+			objects.color[i] = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
+			objects.visible[i] = 1;
+		}
+	}
+
+	// Computes the model matrix translate(pos) * rotateX(angleX) * rotateY(angleY) * scale(s) of a single object
+	// Equivalent to the glm::translate/rotate/scale chain, with both y rotations folded into one angle
+	void composeModelMatrix(uint32_t i)
+	{
+		const float cycle = objects.deltaT[i] * 2.0f * float(M_PI);
+		const float angleX = -sinf(cycle) * 0.25f * objects.rotationDir[i];
+		const float angleY = (glm::radians(objects.rotationY[i]) + cycle) * objects.rotationDir[i];
+		const float sx = sinf(angleX), cx = cosf(angleX);
+		const float sy = sinf(angleY), cy = cosf(angleY);
+		const float s = objects.scale[i];
+
+		glm::mat4& m = objects.model[i];
+		m[0] = glm::vec4(cy * s, sx * sy * s, -cx * sy * s, 0.0f);
+		m[1] = glm::vec4(0.0f, cx * s, sx * s, 0.0f);
+		m[2] = glm::vec4(sy * s, -sx * cy * s, cx * cy * s, 0.0f);
+		m[3] = glm::vec4(objects.posX[i], objects.posY[i], objects.posZ[i], 1.0f);
+	}
+
+#if defined(OBJECT_UPDATE_SSE)
+	// Transposes one matrix column of four objects from SoA registers and stores it
+	static void storeModelColumns(glm::mat4* models, uint32_t column, __m128 x, __m128 y, __m128 z, __m128 w)
+	{
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_ps(&models[0][column][0], x);
+		_mm_storeu_ps(&models[1][column][0], y);
+		_mm_storeu_ps(&models[2][column][0], z);
+		_mm_storeu_ps(&models[3][column][0], w);
+	}
+
+	// SSE version of composeModelMatrix, handles the four objects starting at i
+	void composeModelMatrices4(uint32_t i)
+	{
+		alignas(16) float sinX[4], cosX[4], sinY[4], cosY[4];
+		for (uint32_t k = 0; k < 4; k++)
+		{
+			const float cycle = objects.deltaT[i + k] * 2.0f * float(M_PI);
+			const float angleX = -sinf(cycle) * 0.25f * objects.rotationDir[i + k];
+			const float angleY = (glm::radians(objects.rotationY[i + k]) + cycle) * objects.rotationDir[i + k];
+			sinX[k] = sinf(angleX);
+			cosX[k] = cosf(angleX);
+			sinY[k] = sinf(angleY);
+			cosY[k] = cosf(angleY);
+		}
+
+		const __m128 sx = _mm_load_ps(sinX);
+		const __m128 cx = _mm_load_ps(cosX);
+		const __m128 sy = _mm_load_ps(sinY);
+		const __m128 cy = _mm_load_ps(cosY);
+		const __m128 s = _mm_loadu_ps(&objects.scale[i]);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		const __m128 sxs = _mm_mul_ps(sx, s);
+		const __m128 cxs = _mm_mul_ps(cx, s);
+
+		glm::mat4* models = &objects.model[i];
+		storeModelColumns(models, 0, _mm_mul_ps(cy, s), _mm_mul_ps(sxs, sy), _mm_sub_ps(zero, _mm_mul_ps(cxs, sy)), zero);
+		storeModelColumns(models, 1, zero, cxs, sxs, zero);
+		storeModelColumns(models, 2, _mm_mul_ps(sy, s), _mm_sub_ps(zero, _mm_mul_ps(sxs, cy)), _mm_mul_ps(cxs, cy), zero);
+		storeModelColumns(models, 3, _mm_loadu_ps(&objects.posX[i]), _mm_loadu_ps(&objects.posY[i]), _mm_loadu_ps(&objects.posZ[i]), one);
+	}
+#endif
+
+	// Update the objects in [first, last): animation state, model matrix and visibility
+	void updateObjects(uint32_t first, uint32_t last, float deltaTime)
+	{
+		vks::Profiler::CpuScope scope(profiler, "update objects");
+		if (!paused)
+		{
+			float* rotationY = objects.rotationY.data();
+			float* deltaT = objects.deltaT.data();
+			float* posY = objects.posY.data();
+			const float* rotationSpeed = objects.rotationSpeed.data();
+			for (uint32_t i = first; i < last; i++)
+			{
+				rotationY[i] += 2.5f * rotationSpeed[i] * deltaTime;
+				if (rotationY[i] > 360.0f)
+				{
+					rotationY[i] -= 360.0f;
+				}
+
+				deltaT[i] += 0.15f * deltaTime;
+				if (deltaT[i] > 1.0f)
+				{
+					deltaT[i] -= 1.0f;
+				}
+				posY[i] = sinf(deltaT[i] * 2.0f * float(M_PI)) * 2.5f;
+			}
+		}
+
+		uint32_t i = first;
+#if defined(OBJECT_UPDATE_SSE)
+		for (; i + 4 <= last; i += 4)
+		{
+			composeModelMatrices4(i);
+		}
+#endif
+		for (; i < last; i++)
+		{
+			composeModelMatrix(i);
+		}
+
+		// Check visibility against view frustum using a simple sphere check based on the radius of the mesh
+		for (i = first; i < last; i++)
+		{
+			objects.visible[i] = frustum.checkSphere(glm::vec3(objects.posX[i], objects.posY[i], objects.posZ[i]), objectCullRadius) ? 1 : 0;
+		}
+	}
+
+	// Runs the update pass for all objects in parallel chunks and waits for it to finish
+	void updateObjectsParallel(float deltaTime)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		const uint32_t chunkCount = (numObjects + OBJECT_UPDATE_CHUNK_SIZE - 1) / OBJECT_UPDATE_CHUNK_SIZE;
+		for (uint32_t c = 0; c < chunkCount; c++)
+		{
+			const uint32_t first = c * OBJECT_UPDATE_CHUNK_SIZE;
+			const uint32_t last = std::min(first + OBJECT_UPDATE_CHUNK_SIZE, numObjects);
+			threadPool.threads[c % numThreads]->addJob([=] { updateObjects(first, last, deltaTime); });
+		}
+		threadPool.wait();
+
+		auto tDiff = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - tStart).count();
+		updateTimePerObjectNs = (float)(tDiff / numObjects);
+	}
+
+	// CPU only benchmark of the update pass, doesn't touch the device
+	void runUpdateBenchmark()
+	{
+		const uint32_t warmupIterations = 10;
+		const uint32_t iterations = 100;
+
+		frustum.update(camera.matrices.perspective * camera.matrices.view);
+
+		for (uint32_t i = 0; i < warmupIterations; i++)
+		{
+			updateObjectsParallel(1.0f / 60.0f);
+		}
+
+		double totalNs = 0.0;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			updateObjectsParallel(1.0f / 60.0f);
+			totalNs += updateTimePerObjectNs;
+		}
+
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "Update benchmark finished" << "\n";
+		std::cout << "objects    : " << numObjects << "\n";
+		std::cout << "threads    : " << numThreads << "\n";
+		std::cout << "ns/object  : " << (totalNs / iterations) << "\n";
+		std::cout << "ms/update  : " << (totalNs / iterations) * numObjects / 1000000.0 << "\n";
+	}
+
 	// Create all threads and initialize shader push constants
 	void prepareMultiThreadedRenderer()
 	{
 		// Since this demo updates the command buffers on each frame
 		// We don't use the per-framebuffer command buffers from the
-		// base class,and create a single primary command buffer instead
+		// base class,and create one primary command buffer per frame in the ring instead
 		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::GenCommandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &primaryCommandBuffer));
+		// Fences are created signaled, so the first use of each ring slot doesn't block
+		VkFenceCreateInfo fenceCreateInfo = vks::initializers::GenFenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+		for (auto& frame : frameDatas)
+		{
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &frame.primaryCommandBuffer));
+			VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &frame.renderFence));
+		}
 
 		// Create additional secondary CBs for background and ui
 		cmdBufAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
@@ -203,44 +466,27 @@ public:
 
 		threadDatas.resize(numThreads);
 
-		float maxX = std::floor(std::sqrt(numThreads*numObjectsPerThread));
-		uint32_t posX = 0;
-		uint32_t posZ = 0;
-
 		for (uint32_t i = 0; i < numThreads; i++)
 		{
 			ThreadData * thread = &threadDatas[i];
 
-			//Create one command pool for each thread
+			// Create one command pool per frame for each thread
+			// Command buffers are never reset individually, the whole pool is reset once its frame has finished
 			VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::GenCommandPoolCreateInfo();
 			cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
-			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-			VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &thread->commandPool));
-
-			// One secondary command buffer per object that is updated by this thread
-			thread->commandBuffers.resize(numObjectsPerThread);
-			// Generate secondary command buffers for each thread
-			VkCommandBufferAllocateInfo secondaryCmdBufAllocateInfo = 
-				vks::initializers::GenCommandBufferAllocateInfo(thread->commandPool,VK_COMMAND_BUFFER_LEVEL_SECONDARY,thread->commandBuffers.size());
-			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &secondaryCmdBufAllocateInfo, thread->commandBuffers.data()));
+			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			for (uint32_t f = 0; f < FRAME_RING_SIZE; f++)
+			{
+				VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &thread->commandPools[f]));
 
-			thread->pushConstBlocks.resize(numObjectsPerThread);
-			thread->objectDatas.resize(numObjectsPerThread);
+				// A single secondary command buffer per frame holds all objects updated by this thread
+				VkCommandBufferAllocateInfo secondaryCmdBufAllocateInfo =
+					vks::initializers::GenCommandBufferAllocateInfo(thread->commandPools[f], VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+				VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &secondaryCmdBufAllocateInfo, &thread->commandBuffers[f]));
+			}
 
-			for (uint32_t j = 0; j < numObjectsPerThread; j++)
-			{
-				float theta = 2.0f*float(M_PI)*rnd(1.0f);
-				float phi = acos(1.0f - 2.0f*rnd(1.0f));
-				thread->objectDatas[j].pos = glm::vec3(sin(phi) * cos(theta), 0.0f, cos(phi)) * 35.0f;
-
-				thread->objectDatas[j].rotation = glm::vec3(0.0f, rnd(360.0f), 0.0f);
-				thread->objectDatas[j].deltaT = rnd(1.0f);
-				thread->objectDatas[j].rotationDir = (rnd(100.0f) < 50.0f) ? 1.0f : -1.0f;
-				thread->objectDatas[j].rotationSpeed = (2.0f + rnd(4.0f)) * thread->objectDatas[j].rotationDir;
-				thread->objectDatas[j].scale = 0.75f + rnd(0.5f);
-
-				thread->pushConstBlocks[j].color = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
-			}//for_j
+			thread->firstObject = std::min(i * numObjectsPerThread, numObjects);
+			thread->lastObject = std::min(thread->firstObject + numObjectsPerThread, numObjects);
 		}//for_i
 	}
 
@@ -249,6 +495,7 @@ public:
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
 		models.ufo.loadFromFile(getAssetPath() + "models/retroufo_red_lowpoly.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		models.starSphere.loadFromFile(getAssetPath() + "models/sphere.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		objectCullRadius = models.ufo.dimensions.radius * 0.5f;
 	}
 
 	void setupPipelineLayout()
@@ -314,9 +561,11 @@ public:
 	{
 		VulkanExampleBase::prepareForRendering();
 
-		// Create a fence for synchronization
-		VkFenceCreateInfo fenceCreateInfo = vks::initializers::GenFenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-		vkCreateFence(device, &fenceCreateInfo, nullptr, &renderFence);
+		// The GPU timings use one slot per frame of the ring instead of one per swapchain image
+		if (profiler.enabled)
+		{
+			profiler.prepareGpu(vulkanDevice, vulkanDevice->queueFamilyIndices.graphicIndex, FRAME_RING_SIZE);
+		}
 
 		loadAssets();
 		setupPipelineLayout();
@@ -524,52 +773,23 @@ public:
 	}
 
 	// Build the secondary command buffer for each thread
-	void threadRenderCode(uint32_t threadIndex,uint32_t cmdBufferIndex,VkCommandBufferInheritanceInfo inheritanceInfo)
+	void threadRenderCode(uint32_t threadIndex,VkCommandBufferInheritanceInfo inheritanceInfo)
 	{
+		vks::Profiler::CpuScope scope(profiler, "record secondary");
 		ThreadData * thread = &threadDatas[threadIndex];
-		ObjectData * objectData = &thread->objectDatas[cmdBufferIndex];
 
-		// Update
-		if (!paused)
-		{
-			objectData->rotation.y += 2.5f*objectData->rotationSpeed*frameTimer;
-			if (objectData->rotation.y > 360.0f)
-			{
-				objectData->rotation.y -= 360.0f;
-			}
-
-			objectData->deltaT += 0.15f*frameTimer;
-			if (objectData->deltaT > 1.0f)
-			{
-				objectData->deltaT -= 1.0f;
-			}
-			objectData->pos.y = sin(glm::radians(objectData->deltaT*360.0f))*2.5f;
-		}
-
-		objectData->model = glm::translate(glm::mat4(1.0f), objectData->pos);
-		objectData->model = glm::rotate(objectData->model, -sinf(glm::radians(objectData->deltaT * 360.0f)) * 0.25f, glm::vec3(objectData->rotationDir, 0.0f, 0.0f)); // X
-		objectData->model = glm::rotate(objectData->model, glm::radians(objectData->rotation.y), glm::vec3(0.0f, objectData->rotationDir, 0.0f)); // Y
-		objectData->model = glm::rotate(objectData->model, glm::radians(objectData->deltaT * 360.0f), glm::vec3(0.0f, objectData->rotationDir, 0.0f)); // Z
-		objectData->model = glm::scale(objectData->model, glm::vec3(objectData->scale));
-
-		thread->pushConstBlocks[cmdBufferIndex].MVP = matrices.projection * matrices.view * objectData->model;
-
-		// Check visibility against view frustum using a simple sphere check based on the radius of the mesh
-		objectData->visible = frustum.checkSphere(objectData->pos, models.ufo.dimensions.radius*0.5f);
-
-		if (!objectData->visible)
-		{
-			return;
-		}
+		// The frame that previously used this ring slot has finished (its fence was waited on in draw),
+		// so all command buffers of the pool can be recycled at once
+		VK_CHECK_RESULT(vkResetCommandPool(device, thread->commandPools[currentFrameRingIndex], 0));
 
 		/*
 			Record Command
 		*/
 		VkCommandBufferBeginInfo commandBufferBeginInfo = vks::initializers::GenCommandBufferBeginInfo();
-		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 		commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
 
-		VkCommandBuffer cmdBuffer = thread->commandBuffers[cmdBufferIndex];
+		VkCommandBuffer cmdBuffer = thread->commandBuffers[currentFrameRingIndex];
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &commandBufferBeginInfo));
 
@@ -578,16 +798,34 @@ public:
 		VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
 		vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
 
+		// State shared by all objects is only bound once per thread
 		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phong);
 
-		// Update shader push constant block
-		// Contains model view matrix
-		vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ThreadPushConstantBlock), &thread->pushConstBlocks[cmdBufferIndex]);
-
 		VkDeviceSize offsets[1] = { 0 };
 		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &models.ufo.vertices.buffer, offsets);
 		vkCmdBindIndexBuffer(cmdBuffer, models.ufo.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(cmdBuffer, models.ufo.indices.count, 1, 0, 0, 0);
+
+		// Objects have already been updated and culled, only the visible ones are recorded
+		const glm::mat4 viewProjection = matrices.projection * matrices.view;
+		ThreadPushConstantBlock pushConstBlock;
+
+		thread->visibleObjectCount = 0;
+		for (uint32_t i = thread->firstObject; i < thread->lastObject; i++)
+		{
+			if (!objects.visible[i])
+			{
+				continue;
+			}
+
+			// Update shader push constant block
+			// Contains model view matrix
+			pushConstBlock.MVP = viewProjection * objects.model[i];
+			pushConstBlock.color = objects.color[i];
+			vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ThreadPushConstantBlock), &pushConstBlock);
+			vkCmdDrawIndexed(cmdBuffer, models.ufo.indices.count, 1, 0, 0, 0);
+
+			thread->visibleObjectCount++;
+		}
 
 		VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
 	}
@@ -597,8 +835,7 @@ public:
 	// that's last submitted to the queue for rendering
 	void updatePrimaryCommandBuffers(VkFramebuffer frameBuffer)
 	{
-		//totalPrimitives = 0;
-		totalPrimitives++;
+		VkCommandBuffer primaryCommandBuffer = frameDatas[currentFrameRingIndex].primaryCommandBuffer;
 
 		// Inheritance info for the secondary command buffers
 		VkCommandBufferInheritanceInfo inheritanceInfo = vks::initializers::GenCommandBufferInheritanceInfo();
@@ -637,6 +874,10 @@ public:
 		// Set target frame buffer
 		VK_CHECK_RESULT(vkBeginCommandBuffer(primaryCommandBuffer, &cmdBufBeginInfo));
 
+		// GPU timings use one profiler slot per frame of the ring, its fence has been waited on so the last results are available
+		profiler.beginGpuSlot(primaryCommandBuffer, currentFrameRingIndex);
+		uint32_t region = profiler.beginGpuRegion(primaryCommandBuffer, currentFrameRingIndex, "render pass");
+
 		//The primary command buffer does not contain any rendering commands
 		// These are stored(and retrieved) from the secondary command buffers
 		vkCmdBeginRenderPass(primaryCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
@@ -646,28 +887,27 @@ public:
 			commandBuffers.push_back(secondaryCommandBuffers.backgrounds[currentCmdBufferIndex]);
 		}
 
-		// Add a job to the thread's queue for each object to be rendered
+		// Update all objects before recording, so recording only reads the results
+		updateObjectsParallel(frameTimer);
+
+		// Add a single job to each thread's queue that records all of its objects
 		for (uint32_t t = 0; t < numThreads; t++)
 		{
-			for (uint32_t i = 0; i < numObjectsPerThread; i++)
-			{
-				threadPool.threads[t]->addJob([=] {threadRenderCode(t, i, inheritanceInfo); });
-			}//for_i
+			threadPool.threads[t]->addJob([=] {threadRenderCode(t, inheritanceInfo); });
 		}//for_t
 		threadPool.wait();
 
 		totalVisibleObjectCount = 0;
-		// Only submit if object is within the current view frustum
+		submittedThreadCount = 0;
+		// Only submit if at least one object of the thread is within the current view frustum
 		for (uint32_t t = 0; t < numThreads; t++)
 		{
-			for (uint32_t i = 0; i < numObjectsPerThread; i++)
+			if (threadDatas[t].visibleObjectCount > 0)
 			{
-				if (threadDatas[t].objectDatas[i].visible)
-				{
-					totalVisibleObjectCount++;
-					commandBuffers.push_back(threadDatas[t].commandBuffers[i]);
-				}
-			}//for_i
+				totalVisibleObjectCount += threadDatas[t].visibleObjectCount;
+				submittedThreadCount++;
+				commandBuffers.push_back(threadDatas[t].commandBuffers[currentFrameRingIndex]);
+			}
 		}//for_t
 
 		// Render UI last
@@ -689,31 +929,38 @@ public:
 
 		vkCmdEndRenderPass(primaryCommandBuffer);
 
+		profiler.endGpuRegion(primaryCommandBuffer, currentFrameRingIndex, region);
+
 		VK_CHECK_RESULT(vkEndCommandBuffer(primaryCommandBuffer));
 	}
 
 	void draw()
 	{
-		//Wait for fence to signal that all command buffers are ready
+		FrameData& frame = frameDatas[currentFrameRingIndex];
+
+		//Wait for fence to signal that all command buffers of this ring slot are ready
 		VkResult fenceRes;
 		do
 		{
-			fenceRes = vkWaitForFences(device, 1, &renderFence, VK_TRUE, 100000000);
+			fenceRes = vkWaitForFences(device, 1, &frame.renderFence, VK_TRUE, 100000000);
 		} while (fenceRes == VK_TIMEOUT);//ʱȴֱΪ
 		VK_CHECK_RESULT(fenceRes);
 
-		vkResetFences(device, 1, &renderFence);//ɽȾ׶
+		vkResetFences(device, 1, &frame.renderFence);//ɽȾ׶
 
 		VulkanExampleBase::prepareFrame();
 
 		updatePrimaryCommandBuffers(frameBuffers[currentCmdBufferIndex]);
 
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &primaryCommandBuffer;
+		submitInfo.pCommandBuffers = &frame.primaryCommandBuffer;
 
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, renderFence));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frame.renderFence));
+		profiler.submitGpuSlot(currentFrameRingIndex);
 
 		VulkanExampleBase::submitFrame();
+
+		currentFrameRingIndex = (currentFrameRingIndex + 1) % FRAME_RING_SIZE;
 	}
 
 	virtual void render() override
@@ -732,8 +979,11 @@ public:
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)override
 	{
 		if (overlay->header("Statistics")) {
-			overlay->text("Active threads: %d", totalPrimitives);
+			overlay->text("Active threads: %d", numThreads);
+			overlay->text("Secondary command buffers: %d", submittedThreadCount);
+			overlay->text("Objects: %d", numObjects);
 			overlay->text("totalVisibleObjectCount: %d", totalVisibleObjectCount);
+			overlay->text("Update: %.2f ns/object", updateTimePerObjectNs);
 		}
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Stars", &displayStarSphere);
@@ -31,11 +31,13 @@ public:
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
+	// Variants of the pipeline registry, the toon and wireframe variants are compiled in the background and
+	// drawn with the phong pipeline until they are ready
 	struct
 	{
-		VkPipeline phong;
-		VkPipeline wireframe;
-		VkPipeline toon;
+		vks::PipelineRegistry::Key phong;
+		vks::PipelineRegistry::Key wireframe;
+		vks::PipelineRegistry::Key toon;
 	}pipelines;
 
 public:
@@ -52,14 +54,7 @@ public:
 	~VulkanExample()
 	{
 		// Clean up used Vulkan resources
-		// Note: Inherited destruct cleans up resources stored in base class
-		vkDestroyPipeline(device, pipelines.phong, nullptr);
-		if (deviceFeatures.fillModeNonSolid)
-		{
-			vkDestroyPipeline(device, pipelines.wireframe, nullptr);
-		}
-		vkDestroyPipeline(device, pipelines.toon, nullptr);
-
+		// Note: Inherited destruct cleans up resources stored in base class (including the pipelines of the registry)
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
@@ -120,13 +115,13 @@ public:
 			// Left : Solid colored
 			viewport.width = (float)width / 3.0f;
 			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phong);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(pipelines.phong));
 			scene.draw(drawCmdBuffers[i]);
 
 			// Center : Toon
 			viewport.x = (float)width / 3.0f;
 			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.toon);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(pipelines.toon));
 			// Line width > 1.0f only if wide lines feature is supported
 			if (deviceFeatures.wideLines)
 			{
@@ -139,7 +134,7 @@ public:
 				//Right : Wireframe
 				viewport.x = (float)width / 3.0f + (float)width / 3.0f;
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.wireframe);
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(pipelines.wireframe));
 				scene.draw(drawCmdBuffers[i]);
 			}
 
@@ -199,64 +194,35 @@ public:
 
 	void preparePipelines()
 	{
-		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::GenPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::GenPipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
-		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::GenPipelineColorBlendAttachmentState(0xf, VK_FALSE);
-		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::GenPipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
-		VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = vks::initializers::GenPipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
-		VkPipelineViewportStateCreateInfo viewportState = vks::initializers::GenPipelineViewportStateCreateInfo(1, 1, 0);
-		VkPipelineMultisampleStateCreateInfo multiSampleState = vks::initializers::GenPipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
-		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT,VK_DYNAMIC_STATE_SCISSOR,VK_DYNAMIC_STATE_LINE_WIDTH };
-		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::GenPipelineDynamicStateCreateInfo(dynamicStateEnables);
-		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
-
-		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::GenPipelineCreateInfo(pipelineLayout, renderPass);
-		pipelineCI.pInputAssemblyState = &inputAssemblyState;
-		pipelineCI.pRasterizationState = &rasterizationState;
-		pipelineCI.pColorBlendState = &colorBlendState;
-		pipelineCI.pMultisampleState = &multiSampleState;
-		pipelineCI.pViewportState = &viewportState;
-		pipelineCI.pDepthStencilState = &depthStencilStateCreateInfo;
-		pipelineCI.pDynamicState = &dynamicState;
-		pipelineCI.stageCount = shaderStages.size();
-		pipelineCI.pStages = shaderStages.data();
-		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState(
-			{vkglTF::VertexComponent::Position,vkglTF::VertexComponent::Normal,vkglTF::VertexComponent::Color});
+		vks::PipelineStateDesc pipelineDesc;
+		pipelineDesc.layout = pipelineLayout;
+		pipelineDesc.renderPass = renderPass;
+		pipelineDesc.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT,VK_DYNAMIC_STATE_SCISSOR,VK_DYNAMIC_STATE_LINE_WIDTH };
+		pipelineDesc.setVertexInput(vkglTF::Vertex::getPipelineVertexInputState(
+			{vkglTF::VertexComponent::Position,vkglTF::VertexComponent::Normal,vkglTF::VertexComponent::Color}));
 
 		// Create the graphics pipeline state objects
 
-		// We are using this pipeline as the base for the other pipelines(derivatives)
-		// Pipeline derivatives can be used for pipelines that share most of their state
-		// Depending on the implementation this may result in better performance for pipeline switching and faster creation time
-		pipelineCI.flags = VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT;
-
-		// Textured pipeline
 		// Phong shading pipeline
-		shaderStages[0] = loadShader(getShadersPath() + "pipelines/phong.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getShadersPath() + "pipelines/phong.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.phong));
-
-		// All pipelines created after the base pipeline will be derivatives
-		pipelineCI.flags = VK_PIPELINE_CREATE_DERIVATIVE_BIT;
-		// Base pipeline will be our first created pipeline
-		pipelineCI.basePipelineHandle = pipelines.phong;
-		// it's only allowed to either use a handle or index for the base pipeline
-		// As we use the handle,we must set the index to -1(see section 9.5 of the specification)
-		pipelineCI.basePipelineIndex = -1;
+		// Compiled right away on this thread, it's drawn in place of the other variants until they are ready
+		pipelineDesc.vertexShader = getShadersPath() + "pipelines/phong.vert.spv";
+		pipelineDesc.fragmentShader = getShadersPath() + "pipelines/phong.frag.spv";
+		pipelines.phong = pipelineRegistry.request(pipelineDesc, vks::PipelineRegistry::INVALID_KEY, false);
 
 		// Toon shading pipeline
-		shaderStages[0] = loadShader(getShadersPath() + "pipelines/toon.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getShadersPath() + "pipelines/toon.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.toon));
+		// Compiled on a worker thread of the registry into the shared pipeline cache
+		pipelineDesc.vertexShader = getShadersPath() + "pipelines/toon.vert.spv";
+		pipelineDesc.fragmentShader = getShadersPath() + "pipelines/toon.frag.spv";
+		pipelines.toon = pipelineRegistry.request(pipelineDesc, pipelines.phong);
 
 		// Pipeline for wire frame rendering
 		// Non solid rendering is not a mandatory
 		if (deviceFeatures.fillModeNonSolid)
 		{
-			rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
-			shaderStages[0] = loadShader(getShadersPath() + "pipelines/wireframe.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-			shaderStages[1] = loadShader(getShadersPath() + "pipelines/wireframe.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.wireframe));
+			pipelineDesc.polygonMode = VK_POLYGON_MODE_LINE;
+			pipelineDesc.vertexShader = getShadersPath() + "pipelines/wireframe.vert.spv";
+			pipelineDesc.fragmentShader = getShadersPath() + "pipelines/wireframe.frag.spv";
+			pipelines.wireframe = pipelineRegistry.request(pipelineDesc, pipelines.phong);
 		}
 	}//preparePipelines
 
@@ -313,6 +279,11 @@ public:
 		{
 			return;
 		}
+		// Swap in the variants that finished compiling
+		if (updatePipelineVariants())
+		{
+			buildCommandBuffersForPreRenderPrmitives();
+		}
 		draw();
 		
 		//Ϊһ֡drawCmdBuffer׼
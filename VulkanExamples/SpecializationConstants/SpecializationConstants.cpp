@@ -32,11 +32,15 @@ public:
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
+	// Variants of the pipeline registry, the toon and textured variants are compiled in the background and
+	// drawn with the phong pipeline until they are ready
+	// With graphics pipeline libraries they share the vertex input, pre-rasterization and fragment output libraries and are
+	// fast linked right away, the optimized links replace them once they are ready
 	struct
 	{
-		VkPipeline phong;
-		VkPipeline toon;
-		VkPipeline textured;
+		vks::PipelineRegistry::Key phong;
+		vks::PipelineRegistry::Key toon;
+		vks::PipelineRegistry::Key textured;
 	} pipelines;
 
 	VulkanExample()
@@ -46,14 +50,17 @@ public:
 		camera.setPerspective(60.0f, ((float)width / 3.0f) / (float)height, 0.1f, 512.0f);
 		camera.setRotation(glm::vec3(-40.0f, -90.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -2.0f));
+
+		// Link the variants from graphics pipeline libraries if the device supports them (-npl compiles full pipelines)
+		pipelineLibrary.requested = true;
+
+		commandLineParser.add("pipelinelibrarybench", { "-plb", "--pipelinelibrarybench" }, 0, "Compare full pipeline compiles with linking the variants from graphics pipeline libraries at startup");
+		commandLineParser.parse(args);
 	}
 
 	~VulkanExample()
 	{
-		vkDestroyPipeline(device, pipelines.phong, nullptr);
-		vkDestroyPipeline(device, pipelines.textured, nullptr);
-		vkDestroyPipeline(device, pipelines.toon, nullptr);
-
+		// Pipelines are owned by the registry of the base class
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
@@ -106,81 +113,49 @@ public:
 
 	void preparePipelines()
 	{
-		VkPipelineInputAssemblyStateCreateInfo inputAssembleStateCreateInfo = vks::initializers::GenPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,0,VK_FALSE);
-		VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = vks::initializers::GenPipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
-		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::GenPipelineColorBlendAttachmentState(0xf, VK_FALSE);
-		VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = vks::initializers::GenPipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
-		VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = vks::initializers::GenPipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
-		VkPipelineViewportStateCreateInfo viewportStateCreateInfo = vks::initializers::GenPipelineViewportStateCreateInfo(1, 1, 0);
-		VkPipelineMultisampleStateCreateInfo multiSampleStateCreateInfo = vks::initializers::GenPipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
-		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT,VK_DYNAMIC_STATE_SCISSOR,VK_DYNAMIC_STATE_LINE_WIDTH };
-		VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = vks::initializers::GenPipelineDynamicStateCreateInfo(dynamicStateEnables);
-
+		vks::PipelineStateDesc pipelineDesc;
+		pipelineDesc.layout = pipelineLayout;
+		pipelineDesc.renderPass = renderPass;
+		pipelineDesc.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT,VK_DYNAMIC_STATE_SCISSOR,VK_DYNAMIC_STATE_LINE_WIDTH };
+		pipelineDesc.setVertexInput(vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position,vkglTF::VertexComponent::Normal,vkglTF::VertexComponent::UV,vkglTF::VertexComponent::Color }));
 
-		// Prepare specialization data
+		// all pipelines will use the same "uber" shader and specialization constants to change branching and paramater of that shader
+		pipelineDesc.vertexShader = getShadersPath() + "specializationconstants/uber.vert.spv";
+		pipelineDesc.fragmentShader = getShadersPath() + "specializationconstants/uber.frag.spv";
+		// The vertex shader has no specialization constants, so all variants can share its pre-rasterization library
+		pipelineDesc.specializationStages = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		// Host data to take specialization constants from
-		struct SpecilizationData
-		{
-			// Sets the lighting model used in the fragment "uber" shader
-			uint32_t lightingModel;
-			// Parameter for the toon shading part of the fragment shader
-			float toonDesaturationFactor = 0.5f;
-		} specializationData;
-
-		// Each shader constant of a shader stage correspond to one map entry
-		std::array<VkSpecializationMapEntry, 2> specializationMapEntries;
 		// Shader bindings based on specialization constants are marked by the new "constant_id" layout qualifier:
 		// layout (constant_id = 0) const int LIGHTING_MODEL = 0;
 		// layout (constant_id = 1) const float PARAM_TOON_DESATURATION = 0.0f;
+		// The registry turns the constants of the description into the specialization info of the shader stages
 
-		// Map entry for the lighting model to be used by the fragment shader
-		specializationMapEntries[0].constantID = 0;
-		specializationMapEntries[0].size = sizeof(specializationData.lightingModel);
-		specializationMapEntries[0].offset = 0;
-
-		// Map entry for the toon shader paramater
-		specializationMapEntries[1].constantID = 1;
-		specializationMapEntries[1].size = sizeof(specializationData.toonDesaturationFactor);
-		specializationMapEntries[1].offset = offsetof(SpecilizationData, toonDesaturationFactor);
+		// Parameter for the toon shading part of the fragment shader
+		pipelineDesc.setSpecializationConstant(1, 0.5f);
 
-		// Prepare specialization info block for the shader stage
-		VkSpecializationInfo specializationInfo{};
-		specializationInfo.dataSize = sizeof(specializationData);
-		specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationMapEntries.size());
-		specializationInfo.pMapEntries = specializationMapEntries.data();
-		specializationInfo.pData = &specializationData;
-
-		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStageCreateInfos;
-		// all pipelines will use the same "uber" shader and specialization constants to change branching and paramater of that shader
-		shaderStageCreateInfos[0] = loadShader(getShadersPath() + "specializationconstants/uber.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStageCreateInfos[1] = loadShader(getShadersPath() + "specializationconstants/uber.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		// Specialization info is assigned is part of the shader stage (modul) and must be set after creating the module and before creating the pipeline
-		shaderStageCreateInfos[1].pSpecializationInfo = &specializationInfo;
-
-		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::GenPipelineCreateInfo(pipelineLayout, renderPass, 0);
-		pipelineCI.pInputAssemblyState = &inputAssembleStateCreateInfo;
-		pipelineCI.pRasterizationState = &rasterizationStateCreateInfo;
-		pipelineCI.pColorBlendState = &colorBlendStateCreateInfo;
-		pipelineCI.pMultisampleState = &multiSampleStateCreateInfo;
-		pipelineCI.pViewportState = &viewportStateCreateInfo;
-		pipelineCI.pDepthStencilState = &depthStencilStateCreateInfo;
-		pipelineCI.pDynamicState = &dynamicStateCreateInfo;
-		pipelineCI.stageCount = static_cast<uint32_t>(shaderStageCreateInfos.size());
-		pipelineCI.pStages = shaderStageCreateInfos.data();
-		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position,vkglTF::VertexComponent::Normal,vkglTF::VertexComponent::UV,vkglTF::VertexComponent::Color });
-
-		// Solid phong shading
-		specializationData.lightingModel = 0;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.phong));
+		// Solid phong shading, compiled right away and used until the other variants are ready
+		pipelineDesc.setSpecializationConstant(0, 0u);
+		pipelines.phong = pipelineRegistry.request(pipelineDesc, vks::PipelineRegistry::INVALID_KEY, false);
 
 		// Phong and textured
-		specializationData.lightingModel = 1;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.toon));
+		pipelineDesc.setSpecializationConstant(0, 1u);
+		pipelines.toon = pipelineRegistry.request(pipelineDesc, pipelines.phong);
 
 		// Textured discard
-		specializationData.lightingModel = 2;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.textured));
+		pipelineDesc.setSpecializationConstant(0, 2u);
+		pipelines.textured = pipelineRegistry.request(pipelineDesc, pipelines.phong);
+
+		if (commandLineParser.isSet("pipelinelibrarybench"))
+		{
+			if (pipelineLibrary.enabled)
+			{
+				pipelineLibrary.benchmark(std::cout, pipelineDesc, 0, 3);
+			}
+			else
+			{
+				std::cout << "Graphics pipeline library benchmark skipped, VK_EXT_graphics_pipeline_library is not enabled\n";
+			}
+		}
 	}
 
 	void setupDescriptorPool()
@@ -247,19 +222,19 @@ public:
 			// Left
 			VkViewport viewport = vks::initializers::GenViewport((float)width / 3.0f, (float)height, 0.0f, 1.0f);
 			vkCmdSetViewport(drawCmdBuffers[i],0, 1, &viewport);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phong);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(pipelines.phong));
 			scene.draw(drawCmdBuffers[i]);
 
 			// Middle
 			viewport.x = (float)width / 3.0f;
 			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.toon);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(pipelines.toon));
 			scene.draw(drawCmdBuffers[i]);
 
 			// Right
 			viewport.x = (float)width / 3.0f+ (float)width / 3.0f;
 			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.textured);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(pipelines.textured));
 			scene.draw(drawCmdBuffers[i]);
 
 			drawUI(drawCmdBuffers[i]);
@@ -300,6 +275,10 @@ public:
 		if (!prepared) {
 			return;
 		}
+		// Swap in the variants that finished compiling
+		if (updatePipelineVariants()) {
+			buildCommandBuffersForPreRenderPrmitives();
+		}
 		draw();
 		if (camera.updated) {
 			updateUniformBuffers();
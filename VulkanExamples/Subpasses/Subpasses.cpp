@@ -18,10 +18,13 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "LightClusters.hpp"
 
 #define ENABLE_VALIDATION true
 
+// Default number of lights, can be changed with --lights and in the UI
 #define NUM_LIGHTS 64
+#define MAX_LIGHTS 16384
 
 class VulkanExample :public VulkanExampleBase
 {
@@ -38,6 +41,21 @@ public:
 		camera.setRotation(glm::vec3(0.5f, 210.0f, 0.0f));
 		camera.setPerspective(60.f, (float)width / (float)height, 0.1f, 256.0f);
 		uiOverlay.subpass = 2;
+
+		commandLineParser.add("lights", { "-lc", "--lights" }, 1, "Number of lights (up to 16384)");
+		commandLineParser.add("nocluster", { "-nc", "--nocluster" }, 0, "Loop over all lights for every fragment instead of the lights of its cluster");
+		commandLineParser.add("clusterbench", { "--clusterbench" }, 0, "Print the light cluster assignment throughput in lights per millisecond and exit");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("clusterbench"))
+		{
+			vks::LightClusterGrid::benchmark(std::cout);
+			exit(0);
+		}
+		if (commandLineParser.isSet("lights"))
+		{
+			lightSettings.count = std::min(std::max(commandLineParser.getValueAsInt("lights", NUM_LIGHTS), 1), MAX_LIGHTS);
+		}
+		lightSettings.clustered = !commandLineParser.isSet("nocluster");
 	}
 
 	~VulkanExample()
@@ -63,6 +81,9 @@ public:
 		textures.glass.destroy();
 		uniformBuffers.mvpBuffer.destroy();
 		uniformBuffers.lights.destroy();
+		storageBuffers.lights.destroy();
+		storageBuffers.clusters.destroy();
+		storageBuffers.lightIndices.destroy();
 	}
 
 	// Enable physical device features required for this example
@@ -101,17 +122,38 @@ public:
 		vks::Texture2D glass;
 	} textures;
 
+	// Light range (distance at which the light fades out) is stored in position.w
 	struct Light
 	{
 		glm::vec4 position;
 		glm::vec3 color;
 		float radius;
 	};
+	std::vector<Light> lights;
 
 	struct
 	{
+		int32_t count = NUM_LIGHTS;
+		float range = 5.0f;
+		bool clustered = true;
+	} lightSettings;
+
+	// Lights are assigned to a froxel grid on the CPU, the composition pass only shades the lights of its cluster
+	vks::LightClusterGrid lightClusters;
+	glm::mat4 lightClustersProjection = glm::mat4(0.0f);
+	std::vector<glm::vec4> viewSpaceLights;
+	double clusterAssignTime = 0.0;
+
+	struct
+	{
+		// Transforms the G-Buffer positions (world space with flipped y) to view space
+		glm::mat4 view;
 		glm::vec4 viewPos;
-		Light lights[NUM_LIGHTS];
+		// x, y: tiles per pixel, z, w: depth slice scale and bias (slice = log(depth) * z + w)
+		glm::vec4 clusterScale;
+		// x, y, z: cluster grid size, w: number of lights
+		glm::uvec4 clusterGrid;
+		uint32_t clustered;
 	} uboLights;
 
 	struct
@@ -127,6 +169,14 @@ public:
 		vks::Buffer lights;
 	} uniformBuffers;
 
+	struct
+	{
+		vks::Buffer lights;
+		// Offset and count into lightIndices for every cluster
+		vks::Buffer clusters;
+		vks::Buffer lightIndices;
+	} storageBuffers;
+
 	struct 
 	{
 		VkDescriptorSetLayout scene;
@@ -159,7 +209,7 @@ public:
 	{
 		vkDestroyImageView(device,pAttachment->imageView,nullptr);
 		vkDestroyImage(device, pAttachment->image, nullptr);
-		vkFreeMemory(device, pAttachment->deviceMemory, nullptr);
+		vulkanDevice->FreeMemory(pAttachment->deviceMemory);
 	}
 
 	// Create a frame buffer attachment
@@ -210,7 +260,7 @@ public:
 		vkGetImageMemoryRequirements(device, pAttachment->image, &memReqs);
 		memAlloc.allocationSize = memReqs.size;
 		memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &pAttachment->deviceMemory));
+		VK_CHECK_RESULT(vulkanDevice->AllocateMemory(&memAlloc, &pAttachment->deviceMemory, vks::MEMORY_CATEGORY_ATTACHMENT));
 		VK_CHECK_RESULT(vkBindImageMemory(device, pAttachment->image, pAttachment->deviceMemory, 0));
 
 		VkImageViewCreateInfo  imageViewCI = vks::initializers::GenImageViewCreateInfo();
@@ -474,12 +524,18 @@ public:
 		std::uniform_real_distribution<float> rndDist(-1.0f, 1.0f);
 		std::uniform_int_distribution<uint32_t> rndCol(0, static_cast<uint32_t>(colors.size() - 1));
 
-		for (auto& light : uboLights.lights)
+		lights.resize(lightSettings.count);
+		for (auto& light : lights)
 		{
 			light.position = glm::vec4(rndDist(rndGen) * 6.0f, 0.25f + std::abs(rndDist(rndGen)) * 4.0f, rndDist(rndGen) * 6.0f, 1.0f);
 			light.color = colors[rndCol(rndGen)];
 			light.radius = 1.0f + std::abs(rndDist(rndGen));
+			light.position.w = lightSettings.range * (0.75f + 0.25f * std::abs(rndDist(rndGen)));
 		}//for
+
+		VK_CHECK_RESULT(storageBuffers.lights.map());
+		memcpy(storageBuffers.lights.mappedData, lights.data(), lights.size() * sizeof(Light));
+		storageBuffers.lights.unmap();
 	}//initLights
 
 	void updateUniformBufferDeferredMatrices()
@@ -498,10 +554,41 @@ public:
 	{
 		// Current view position
 		uboLights.viewPos = glm::vec4(camera.position, 0.0f)*glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
+		// G-Buffer positions and lights have their y flipped (see gbuffer.vert)
+		uboLights.view = camera.matrices.view * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
+
+		// The cluster bounds only depend on the projection
+		if (lightClustersProjection != camera.matrices.perspective)
+		{
+			lightClusters.build(camera.matrices.perspective, camera.getNearClip(), camera.getFarClip());
+			lightClustersProjection = camera.matrices.perspective;
+		}
+		uboLights.clusterScale = glm::vec4((float)lightClusters.tilesX / (float)width, (float)lightClusters.tilesY / (float)height, lightClusters.sliceScale, lightClusters.sliceBias);
+		uboLights.clusterGrid = glm::uvec4(lightClusters.tilesX, lightClusters.tilesY, lightClusters.slices, static_cast<uint32_t>(lights.size()));
+		uboLights.clustered = lightSettings.clustered ? 1 : 0;
 
 		VK_CHECK_RESULT(uniformBuffers.lights.map());
 		memcpy(uniformBuffers.lights.mappedData, &uboLights, sizeof(uboLights));
 		uniformBuffers.lights.unmap();
+
+		if (lightSettings.clustered)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			viewSpaceLights.resize(lights.size());
+			for (size_t i = 0; i < lights.size(); i++)
+			{
+				viewSpaceLights[i] = glm::vec4(glm::vec3(uboLights.view * glm::vec4(glm::vec3(lights[i].position), 1.0f)), lights[i].position.w);
+			}
+			lightClusters.assign(viewSpaceLights);
+			clusterAssignTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+			VK_CHECK_RESULT(storageBuffers.clusters.map());
+			memcpy(storageBuffers.clusters.mappedData, lightClusters.clusters.data(), lightClusters.clusters.size() * sizeof(uint32_t));
+			storageBuffers.clusters.unmap();
+			VK_CHECK_RESULT(storageBuffers.lightIndices.map());
+			memcpy(storageBuffers.lightIndices.mappedData, lightClusters.lightIndices.data(), lightClusters.lightIndices.size() * sizeof(uint32_t));
+			storageBuffers.lightIndices.unmap();
+		}
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -515,7 +602,16 @@ public:
 		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.lights, sizeof(uboLights));
 
+		// Lights and light clusters, sized for the largest light count and full cluster lists
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &storageBuffers.lights, MAX_LIGHTS * sizeof(Light));
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &storageBuffers.clusters, LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z * 2 * sizeof(uint32_t));
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &storageBuffers.lightIndices, LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z * LIGHT_CLUSTER_MAX_LIGHTS * sizeof(uint32_t));
+
 		// Update Uniform Buffer data
+		initLights();
 		updateUniformBufferDeferredMatrices();
 		updateUniformBufferDeferredLights();
 	}
@@ -586,6 +682,7 @@ public:
 			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,4),
 			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,4),
 			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,4),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,3),
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::GenDescriptorPoolCreateInfo(static_cast<uint32_t>(poolSizes.size()), poolSizes.data(), 4);
@@ -618,8 +715,14 @@ public:
 			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,VK_SHADER_STAGE_FRAGMENT_BIT,1),
 			// Binding 2: Albedo input attachment
 			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,VK_SHADER_STAGE_FRAGMENT_BIT,2),
-			// Binding 3: Light positions
+			// Binding 3: View and light cluster parameters
 			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,VK_SHADER_STAGE_FRAGMENT_BIT,3),
+			// Binding 4: Lights
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_FRAGMENT_BIT,4),
+			// Binding 5: Light clusters
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_FRAGMENT_BIT,5),
+			// Binding 6: Light index lists of the clusters
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_FRAGMENT_BIT,6),
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &descriptorSetLayouts.composition));
@@ -650,6 +753,9 @@ public:
 			vks::initializers::GenWriteDescriptorSet(descriptorSets.compositionDescriptorSet,VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,2,&texDescriptorAlbedo,1),
 			// Binding 3: Fragment shader lights
 			vks::initializers::GenWriteDescriptorSet(descriptorSets.compositionDescriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,3,&uniformBuffers.lights.descriptorBufferInfo	,1),
+			vks::initializers::GenWriteDescriptorSet(descriptorSets.compositionDescriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,4,&storageBuffers.lights.descriptorBufferInfo,1),
+			vks::initializers::GenWriteDescriptorSet(descriptorSets.compositionDescriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,5,&storageBuffers.clusters.descriptorBufferInfo,1),
+			vks::initializers::GenWriteDescriptorSet(descriptorSets.compositionDescriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,6,&storageBuffers.lightIndices.descriptorBufferInfo,1),
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
@@ -670,21 +776,6 @@ public:
 		shaderStages[0] = loadShader(getShadersPath() + "subpasses/composition.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "subpasses/composition.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 
-		// Use specialization constants to pass number of lights to the shader
-		VkSpecializationMapEntry specializationEntry{};
-		specializationEntry.constantID = 0;
-		specializationEntry.offset = 0;
-		specializationEntry.size = sizeof(uint32_t);
-
-		uint32_t specializationData = NUM_LIGHTS;
-		VkSpecializationInfo specializationInfo;
-		specializationInfo.mapEntryCount = 1;
-		specializationInfo.pMapEntries = &specializationEntry;
-		specializationInfo.dataSize = sizeof(specializationData);
-		specializationInfo.pData = &specializationData;
-
-		shaderStages[1].pSpecializationInfo = &specializationInfo;
-
 		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::GenPipelineCreateInfo(pipelineLayouts.composition, renderPass, 0);
 		pipelineCI.pVertexInputState = &emptyInputStateCI;
 		pipelineCI.pInputAssemblyState = &inputAssembleStateCI;
@@ -839,7 +930,6 @@ public:
 	{
 		VulkanExampleBase::prepareForRendering();
 		loadAssets();
-		initLights();
 		prepareUniformBuffers();
 		setupDescriptorSetLayoutAndPipelineLayout();
 		preparePipelines();
@@ -887,6 +977,23 @@ public:
 				initLights();
 				updateUniformBufferDeferredLights();
 			}
+			if (overlay->sliderInt("Lights", &lightSettings.count, 1, MAX_LIGHTS)) {
+				initLights();
+				updateUniformBufferDeferredLights();
+			}
+			if (overlay->sliderFloat("Light range", &lightSettings.range, 0.5f, 10.0f)) {
+				initLights();
+				updateUniformBufferDeferredLights();
+			}
+			if (overlay->checkBox("Clustered shading", &lightSettings.clustered)) {
+				updateUniformBufferDeferredLights();
+			}
+		}
+		if (lightSettings.clustered && overlay->header("Light clusters")) {
+			overlay->text("Grid: %dx%dx%d", lightClusters.tilesX, lightClusters.tilesY, lightClusters.slices);
+			overlay->text("Light indices: %d", static_cast<int32_t>(lightClusters.lightIndices.size()));
+			overlay->text("Full clusters: %d", lightClusters.overflowClusters);
+			overlay->text("Assignment: %.3f ms", clusterAssignTime);
 		}
 	}
 
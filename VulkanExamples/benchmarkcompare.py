@@ -0,0 +1,63 @@
+import argparse
+import json
+import sys
+
+# Compares two JSON benchmark reports (written with -b -bf result.json) and flags regressions
+parser = argparse.ArgumentParser(description='Compare two benchmark reports and flag regressions')
+parser.add_argument('baseline', type=str, help='report of the reference run')
+parser.add_argument('current', type=str, help='report of the run to check')
+parser.add_argument('--threshold', type=float, default=5.0, help='relative change in percent that counts as a regression')
+parser.add_argument('--stutters', type=int, default=0, help='additional stutter frames that count as a regression')
+args = parser.parse_args()
+
+# Frame time metrics in ms, lower is better
+metrics = ['avg', 'p50', 'p90', 'p99', 'p99.9', 'max']
+
+def loadReport(path):
+    with open(path, 'r') as file:
+        return json.load(file)
+
+baseline = loadReport(args.baseline)
+current = loadReport(args.current)
+
+if baseline['device']['name'] != current['device']['name'] or baseline['device']['driverVersion'] != current['device']['driverVersion']:
+    print("Warning: reports were taken on different devices or drivers (%s, %s)" % (baseline['device']['name'], current['device']['name']))
+if baseline['commandLine'] != current['commandLine']:
+    print("Warning: reports were taken with different command lines")
+
+regressions = []
+print("%-10s %12s %12s %9s" % ("metric", "baseline", "current", "change"))
+for metric in metrics:
+    old = baseline['results'].get(metric)
+    new = current['results'].get(metric)
+    if old is None or new is None:
+        continue
+    change = ((new - old) / old * 100.0) if old > 0.0 else 0.0
+    flag = ""
+    if change > args.threshold:
+        flag = "REGRESSION"
+        regressions.append(metric)
+    elif change < -args.threshold:
+        flag = "improved"
+    print("%-10s %9.4f ms %9.4f ms %+8.2f%% %s" % (metric, old, new, change, flag))
+
+oldStutters = baseline['results'].get('stutters', 0)
+newStutters = current['results'].get('stutters', 0)
+# Stutters are compared per frame, runs with a time limit don't render the same number of frames
+oldFrames = max(baseline['results'].get('frames', 1), 1)
+newFrames = max(current['results'].get('frames', 1), 1)
+scaledStutters = oldStutters * newFrames / oldFrames
+flag = ""
+if newStutters > scaledStutters * (1.0 + args.threshold / 100.0) + args.stutters:
+    flag = "REGRESSION"
+    regressions.append('stutters')
+print("%-10s %12d %12d %9s %s" % ("stutters", oldStutters, newStutters, "", flag))
+
+for name in sorted(set(baseline.get('phases', {})) & set(current.get('phases', {}))):
+    old = baseline['phases'][name]
+    new = current['phases'][name]
+    print("%-10s %9.1f ms %9.1f ms (phase)" % (name, old, new))
+
+if regressions:
+    sys.exit("Regressions in: " + ", ".join(regressions))
+print("No regressions")
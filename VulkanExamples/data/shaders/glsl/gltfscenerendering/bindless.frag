@@ -0,0 +1,65 @@
+#version 450
+
+#define NO_TEXTURE 0xFFFFFFFF
+
+// Same layout as vkglTF::MaterialTableEntry
+struct Material
+{
+	vec4 baseColorFactor;
+	uint baseColorTexture;
+	uint normalTexture;
+	float alphaCutoff;
+	uint alphaMask;
+};
+
+layout (constant_id = 0) const uint TEXTURE_COUNT = 1;
+
+layout (set = 1, binding = 0) readonly buffer Materials
+{
+	Material materials[];
+};
+layout (set = 1, binding = 1) uniform sampler2D textures[TEXTURE_COUNT];
+
+// The material index is the same for all invocations of a draw, so dynamic indexing of the texture array is sufficient
+layout (push_constant) uniform PushConsts {
+	uint materialIndex;
+} primitive;
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inColor;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 inViewVec;
+layout (location = 4) in vec3 inLightVec;
+layout (location = 5) in vec4 inTangent;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	Material material = materials[primitive.materialIndex];
+
+	vec4 color = material.baseColorFactor * vec4(inColor, 1.0);
+	if (material.baseColorTexture != NO_TEXTURE) {
+		color *= texture(textures[material.baseColorTexture], inUV);
+	}
+
+	if ((material.alphaMask != 0) && (color.a < material.alphaCutoff)) {
+		discard;
+	}
+
+	vec3 N = normalize(inNormal);
+	if (material.normalTexture != NO_TEXTURE) {
+		vec3 T = normalize(inTangent.xyz);
+		vec3 B = cross(inNormal, inTangent.xyz) * inTangent.w;
+		mat3 TBN = mat3(T, B, N);
+		N = TBN * normalize(texture(textures[material.normalTexture], inUV).xyz * 2.0 - vec3(1.0));
+	}
+
+	const float ambient = 0.1;
+	vec3 L = normalize(inLightVec);
+	vec3 V = normalize(inViewVec);
+	vec3 R = reflect(-L, N);
+	vec3 diffuse = max(dot(N, L), ambient).rrr;
+	float specular = pow(max(dot(R, V), 0.0), 32.0);
+	outFragColor = vec4(diffuse * color.rgb + specular, color.a);
+}
@@ -0,0 +1,35 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 inColor;
+layout (location = 4) in vec4 inTangent;
+
+layout (set = 0, binding = 0) uniform UBOScene 
+{
+	mat4 projection;
+	mat4 view;
+	vec4 lightPos;
+	vec4 viewPos;
+} uboScene;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec3 outViewVec;
+layout (location = 4) out vec3 outLightVec;
+layout (location = 5) out vec4 outTangent;
+
+// Vertices are pre-transformed by vkglTF, so there's no per-node model matrix
+void main() 
+{
+	outNormal = inNormal;
+	outColor = inColor;
+	outUV = inUV;
+	outTangent = inTangent;
+	gl_Position = uboScene.projection * uboScene.view * vec4(inPos.xyz, 1.0);
+	
+	outLightVec = uboScene.lightPos.xyz - inPos;
+	outViewVec = uboScene.viewPos.xyz - inPos;
+}
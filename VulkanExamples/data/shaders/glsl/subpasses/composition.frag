@@ -8,20 +8,68 @@ layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outColor;
 
-layout (constant_id = 0) const int NUM_LIGHTS = 64;
-
 struct Light {
-	vec4 position;
+	vec4 position; // xyz: position, w: range
 	vec3 color;
 	float radius;
 };
 
 layout (binding = 3) uniform UBO 
 {
+	mat4 view;
 	vec4 viewPos;
-	Light lights[NUM_LIGHTS];
+	// x, y: tiles per pixel, z, w: depth slice scale and bias
+	vec4 clusterScale;
+	// x, y, z: cluster grid size, w: number of lights
+	uvec4 clusterGrid;
+	uint clustered;
 } ubo;
 
+layout (std430, binding = 4) readonly buffer Lights
+{
+	Light lights[];
+};
+
+// Offset and count into lightIndices for every cluster
+layout (std430, binding = 5) readonly buffer Clusters
+{
+	uvec2 clusters[];
+};
+
+layout (std430, binding = 6) readonly buffer LightIndices
+{
+	uint lightIndices[];
+};
+
+#define ambient 0.15
+
+vec3 shadeLight(uint index, vec3 fragPos, vec3 N, vec3 V, vec4 albedo)
+{
+	Light light = lights[index];
+	// Vector to light
+	vec3 L = light.position.xyz - fragPos;
+	// Distance from light to fragment position
+	float dist = length(L);
+	
+	// Light to fragment
+	L = normalize(L);
+
+	// Attenuation, faded out towards the range of the light so it only touches the clusters it has been assigned to
+	float window = clamp(1.0 - pow(dist / light.position.w, 4.0), 0.0, 1.0);
+	float atten = light.radius / (pow(dist, 2.0) + 1.0) * window * window;
+
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	vec3 diff = light.color * albedo.rgb * NdotL * atten;
+
+	// Specular part
+	// Specular map values are stored in alpha of albedo mrt
+	vec3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	//vec3 spec = light.color * albedo.a * pow(NdotR, 32.0) * atten;
+
+	return diff;// + spec;
+}
 
 void main() 
 {
@@ -30,41 +78,33 @@ void main()
 	vec3 normal = subpassLoad(samplerNormal).rgb;
 	vec4 albedo = subpassLoad(samplerAlbedo);
 	
-	#define ambient 0.15
-	
 	// Ambient part
 	vec3 fragcolor  = albedo.rgb * ambient;
-	
-	for(int i = 0; i < NUM_LIGHTS; ++i)
+
+	vec3 N = normalize(normal);
+	// Viewer to fragment
+	vec3 V = normalize(ubo.viewPos.xyz - fragPos);
+
+	if (ubo.clustered != 0)
+	{
+		// Cluster of the fragment from its tile and view space depth (see vks::LightClusterGrid)
+		float depth = -(ubo.view * vec4(fragPos, 1.0)).z;
+		uvec3 cluster;
+		cluster.xy = min(uvec2(gl_FragCoord.xy * ubo.clusterScale.xy), ubo.clusterGrid.xy - 1);
+		cluster.z = uint(clamp(log(max(depth, 1e-6)) * ubo.clusterScale.z + ubo.clusterScale.w, 0.0, float(ubo.clusterGrid.z - 1)));
+		uvec2 range = clusters[(cluster.z * ubo.clusterGrid.y + cluster.y) * ubo.clusterGrid.x + cluster.x];
+		for (uint i = 0; i < range.y; ++i)
+		{
+			fragcolor += shadeLight(lightIndices[range.x + i], fragPos, N, V, albedo);
+		}
+	}
+	else
 	{
-		// Vector to light
-		vec3 L = ubo.lights[i].position.xyz - fragPos;
-		// Distance from light to fragment position
-		float dist = length(L);
-
-		// Viewer to fragment
-		vec3 V = ubo.viewPos.xyz - fragPos;
-		V = normalize(V);
-		
-		// Light to fragment
-		L = normalize(L);
-
-		// Attenuation
-		float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
-
-		// Diffuse part
-		vec3 N = normalize(normal);
-		float NdotL = max(0.0, dot(N, L));
-		vec3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
-
-		// Specular part
-		// Specular map values are stored in alpha of albedo mrt
-		vec3 R = reflect(-L, N);
-		float NdotR = max(0.0, dot(R, V));
-		//vec3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 32.0) * atten;
-
-		fragcolor += diff;// + spec;	
-	}    	
+		for (uint i = 0; i < ubo.clusterGrid.w; ++i)
+		{
+			fragcolor += shadeLight(i, fragPos, N, V, albedo);
+		}
+	}
    
 	outColor = vec4(fragcolor, 1.0);
-}
\ No newline at end of file
+}
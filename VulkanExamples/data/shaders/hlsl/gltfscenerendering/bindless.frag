@@ -0,0 +1,65 @@
+// Copyright 2020 Google LLC
+
+#define NO_TEXTURE 0xFFFFFFFF
+// HLSL can't size the texture array with a specialization constant, so the material table is padded to this size (see GltfSceneRendering.cpp)
+#define TEXTURE_COUNT 64
+
+// Same layout as vkglTF::MaterialTableEntry
+struct Material
+{
+	float4 baseColorFactor;
+	uint baseColorTexture;
+	uint normalTexture;
+	float alphaCutoff;
+	uint alphaMask;
+};
+
+StructuredBuffer<Material> materials : register(t0, space1);
+Texture2D textures[TEXTURE_COUNT] : register(t1, space1);
+SamplerState samplers[TEXTURE_COUNT] : register(s1, space1);
+
+// The material index is the same for all invocations of a draw, so dynamic indexing of the texture array is sufficient
+struct PushConsts {
+	uint materialIndex;
+};
+[[vk::push_constant]] PushConsts primitive;
+
+struct VSOutput
+{
+[[vk::location(0)]] float3 Normal : NORMAL0;
+[[vk::location(1)]] float3 Color : COLOR0;
+[[vk::location(2)]] float2 UV : TEXCOORD0;
+[[vk::location(3)]] float3 ViewVec : TEXCOORD1;
+[[vk::location(4)]] float3 LightVec : TEXCOORD2;
+[[vk::location(5)]] float4 Tangent : TEXCOORD3;
+};
+
+float4 main(VSOutput input) : SV_TARGET
+{
+	Material material = materials[primitive.materialIndex];
+
+	float4 color = material.baseColorFactor * float4(input.Color, 1.0);
+	if (material.baseColorTexture != NO_TEXTURE) {
+		color *= textures[material.baseColorTexture].Sample(samplers[material.baseColorTexture], input.UV);
+	}
+
+	if ((material.alphaMask != 0) && (color.a < material.alphaCutoff)) {
+		discard;
+	}
+
+	float3 N = normalize(input.Normal);
+	if (material.normalTexture != NO_TEXTURE) {
+		float3 T = normalize(input.Tangent.xyz);
+		float3 B = cross(input.Normal, input.Tangent.xyz) * input.Tangent.w;
+		float3x3 TBN = float3x3(T, B, N);
+		N = mul(normalize(textures[material.normalTexture].Sample(samplers[material.normalTexture], input.UV).xyz * 2.0 - float3(1.0, 1.0, 1.0)), TBN);
+	}
+
+	const float ambient = 0.1;
+	float3 L = normalize(input.LightVec);
+	float3 V = normalize(input.ViewVec);
+	float3 R = reflect(-L, N);
+	float3 diffuse = max(dot(N, L), ambient).rrr;
+	float specular = pow(max(dot(R, V), 0.0), 32.0);
+	return float4(diffuse * color.rgb + specular, color.a);
+}
@@ -4,66 +4,94 @@
 [[vk::input_attachment_index(1)]][[vk::binding(1)]] SubpassInput samplerNormal;
 [[vk::input_attachment_index(2)]][[vk::binding(2)]] SubpassInput samplerAlbedo;
 
-#define MAX_NUM_LIGHTS 64
-[[vk::constant_id(0)]] const int NUM_LIGHTS = 64;
-
 struct Light {
-	float4 position;
+	float4 position; // xyz: position, w: range
 	float3 color;
 	float radius;
 };
 
 struct UBO
 {
+	float4x4 view;
 	float4 viewPos;
-	Light lights[MAX_NUM_LIGHTS];
+	// x, y: tiles per pixel, z, w: depth slice scale and bias
+	float4 clusterScale;
+	// x, y, z: cluster grid size, w: number of lights
+	uint4 clusterGrid;
+	uint clustered;
 };
 
 cbuffer ubo : register(b3) { UBO ubo; }
 
+StructuredBuffer<Light> lights : register(t4);
+// Offset and count into lightIndices for every cluster
+StructuredBuffer<uint2> clusters : register(t5);
+StructuredBuffer<uint> lightIndices : register(t6);
+
+#define ambient 0.15
 
-float4 main([[vk::location(0)]] float2 inUV : TEXCOORD) : SV_TARGET
+float3 shadeLight(uint index, float3 fragPos, float3 N, float3 V, float4 albedo)
 {
-	// Read G-Buffer values from previous sub pass
-	float3 fragPos = samplerposition.SubpassLoad().rgb;
-	float3 normal = samplerNormal.SubpassLoad().rgb;
-	float4 albedo = samplerAlbedo.SubpassLoad();
+	Light light = lights[index];
+	// Vector to light
+	float3 L = light.position.xyz - fragPos;
+	// Distance from light to fragment position
+	float dist = length(L);
 
-	#define ambient 0.15
+	// Light to fragment
+	L = normalize(L);
 
-	// Ambient part
-	float3 fragcolor  = albedo.rgb * ambient;
+	// Attenuation, faded out towards the range of the light so it only touches the clusters it has been assigned to
+	float window = saturate(1.0 - pow(dist / light.position.w, 4.0));
+	float atten = light.radius / (pow(dist, 2.0) + 1.0) * window * window;
 
-	for(int i = 0; i < NUM_LIGHTS; ++i)
-	{
-		// Vector to light
-		float3 L = ubo.lights[i].position.xyz - fragPos;
-		// Distance from light to fragment position
-		float dist = length(L);
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	float3 diff = light.color * albedo.rgb * NdotL * atten;
 
-		// Viewer to fragment
-		float3 V = ubo.viewPos.xyz - fragPos;
-		V = normalize(V);
+	// Specular part
+	// Specular map values are stored in alpha of albedo mrt
+	float3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	//float3 spec = light.color * albedo.a * pow(NdotR, 32.0) * atten;
 
-		// Light to fragment
-		L = normalize(L);
+	return diff;// + spec;
+}
 
-		// Attenuation
-		float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
+float4 main([[vk::location(0)]] float2 inUV : TEXCOORD, float4 fragCoord : SV_POSITION) : SV_TARGET
+{
+	// Read G-Buffer values from previous sub pass
+	float3 fragPos = samplerposition.SubpassLoad().rgb;
+	float3 normal = samplerNormal.SubpassLoad().rgb;
+	float4 albedo = samplerAlbedo.SubpassLoad();
 
-		// Diffuse part
-		float3 N = normalize(normal);
-		float NdotL = max(0.0, dot(N, L));
-		float3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
+	// Ambient part
+	float3 fragcolor  = albedo.rgb * ambient;
 
-		// Specular part
-		// Specular map values are stored in alpha of albedo mrt
-		float3 R = reflect(-L, N);
-		float NdotR = max(0.0, dot(R, V));
-		//float3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 32.0) * atten;
+	float3 N = normalize(normal);
+	// Viewer to fragment
+	float3 V = normalize(ubo.viewPos.xyz - fragPos);
 
-		fragcolor += diff;// + spec;
+	if (ubo.clustered != 0)
+	{
+		// Cluster of the fragment from its tile and view space depth (see vks::LightClusterGrid)
+		float depth = -mul(ubo.view, float4(fragPos, 1.0)).z;
+		uint3 cluster;
+		cluster.xy = min(uint2(fragCoord.xy * ubo.clusterScale.xy), ubo.clusterGrid.xy - 1);
+		cluster.z = uint(clamp(log(max(depth, 1e-6)) * ubo.clusterScale.z + ubo.clusterScale.w, 0.0, float(ubo.clusterGrid.z - 1)));
+		uint2 range = clusters[(cluster.z * ubo.clusterGrid.y + cluster.y) * ubo.clusterGrid.x + cluster.x];
+		for (uint i = 0; i < range.y; ++i)
+		{
+			fragcolor += shadeLight(lightIndices[range.x + i], fragPos, N, V, albedo);
+		}
+	}
+	else
+	{
+		for (uint i = 0; i < ubo.clusterGrid.w; ++i)
+		{
+			fragcolor += shadeLight(i, fragPos, N, V, albedo);
+		}
 	}
 
 	return float4(fragcolor, 1.0);
-}
\ No newline at end of file
+}